@@ -5,10 +5,17 @@
  *
  * Copyright (c) 2016 Agilack
  */
+#include <QCoreApplication>
 #include <QDebug>
+#include <QStatusBar>
+#include <QTextStream>
+#include "data-model/instrument.h"
+#include "data-model/trace.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#define AUTOSAVE_FILE "atelier-autosave.log"
+
 /**
  * @brief Default constructor for the main window of the test-app
  *
@@ -18,10 +25,32 @@ MainWindow::MainWindow(QWidget *parent) :
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
+    mLoader   = 0;
+    mProgress = 0;
     setWindowTitle("VLE EA Unit-test for Atelier");
 
-    // Load some tests datas into Exploitation
-    loadTestData();
+    // Recover the autosave left by a crash, else load a scenario file
+    // (first argument) or some tests datas
+    QStringList args = QCoreApplication::arguments();
+    bool recovered = false;
+    if (ChangeLog::exists(AUTOSAVE_FILE))
+    {
+        recovered = mLog.recover(AUTOSAVE_FILE, &mExploitation);
+        if (recovered)
+            statusBar()->showMessage(tr("Recovered %1 change(s) from autosave")
+                                     .arg(mLog.countReplayed()), 5000);
+        else
+        {
+            // The autosave has been moved aside, forget the partial content
+            qWarning() << "Autosave recovery failed after" << mLog.countReplayed()
+                       << "change(s) :" << mLog.errorString();
+            statusBar()->showMessage(tr("Autosave recovery failed, kept into %1.bak")
+                                     .arg(AUTOSAVE_FILE), 5000);
+            mExploitation.clear();
+        }
+    }
+    if (( ! recovered) && (args.count() < 2))
+        loadTestData();
 
     // Catch signal emited when an entity is added to an Atelier
     QObject::connect(ui->AtelierWidget, SIGNAL(entityAdded(Atelier*,int)),
@@ -38,17 +67,41 @@ MainWindow::MainWindow(QWidget *parent) :
     // Catch signal when one value of an entity is modified
     QObject::connect(ui->AtelierWidget, SIGNAL(entityValueChanged(Atelier*,int,double)),
                      this,              SLOT  (entityValueChanged(Atelier*,int,double)));
+    // Catch signal when a block of values is modified (paste, fill)
+    QObject::connect(ui->AtelierWidget, SIGNAL(entityValuesChanged(Atelier*,int,int,int,int)),
+                     this,              SLOT  (entityValuesChanged(Atelier*,int,int,int,int)));
     // Catch signal emited when a new parameter is added to an Atelier
     QObject::connect(ui->AtelierWidget, SIGNAL(parameterAdded(Atelier*,int)),
                      this,              SLOT  (parameterAdded(Atelier*,int)));
     // Catch signal emited when a parameter is deleted
     QObject::connect(ui->AtelierWidget, SIGNAL(parameterDeleted(Atelier*,int)),
                      this,              SLOT  (parameterDeleted(Atelier*,int)));
+    // Catch signal emited when the type of a parameter is modified
+    QObject::connect(ui->AtelierWidget, SIGNAL(parameterKindChanged(Atelier*,int)),
+                     this,              SLOT  (parameterKindChanged(Atelier*,int)));
     // Catch signal emited when a parameter is renamed
     QObject::connect(ui->AtelierWidget, SIGNAL(parameterNameChanged(Atelier*,int)),
                      this,              SLOT  (parameterNameChanged(Atelier*,int)));
 
-    ui->AtelierWidget->setup(&mExploitation);
+    // The schedule follows the entities and their rotations
+    QObject::connect(ui->AtelierWidget,  SIGNAL(entityAdded(Atelier*,int)),
+                     ui->ScheduleWidget, SLOT  (slotEntityAdded(Atelier*,int)));
+    QObject::connect(ui->AtelierWidget,  SIGNAL(entityDeleted(Atelier*,int)),
+                     ui->ScheduleWidget, SLOT  (slotEntityDeleted(Atelier*,int)));
+    QObject::connect(ui->AtelierWidget,  SIGNAL(entityNameChanged(Atelier*)),
+                     ui->ScheduleWidget, SLOT  (slotEntityNameChanged(Atelier*)));
+    QObject::connect(ui->AtelierWidget,  SIGNAL(entityRotationChanged(Atelier*)),
+                     ui->ScheduleWidget, SLOT  (slotEntityRotationChanged(Atelier*)));
+
+    if (recovered || (args.count() < 2))
+    {
+        ui->AtelierWidget->setup(&mExploitation);
+        ui->ScheduleWidget->setup(&mExploitation);
+        if ( ! recovered)
+            startAutosave();
+    }
+    else
+        loadFile(args.at(1));
 }
 
 /**
@@ -57,6 +110,10 @@ MainWindow::MainWindow(QWidget *parent) :
  */
 MainWindow::~MainWindow()
 {
+    // The Exploitation may still be filled by the loader thread
+    if (mLoader)
+        mLoader->wait();
+
     qWarning() << "--=={ Dump Atelier(s) Datas }==--";
     for (uint i = 0; i < mExploitation.countAtelier(); ++i)
     {
@@ -82,6 +139,26 @@ MainWindow::~MainWindow()
         }
     }
 
+    // Clean exit, the autosave is not needed anymore
+    mLog.discard();
+
+    // Dump data-model counters (only when built with instrumentation)
+    if (Instrument::isEnabled())
+    {
+        QString report;
+        QTextStream out(&report);
+        Instrument::dump(out);
+        qWarning() << "--=={ Data-model counters }==--";
+        qWarning() << report.toStdString().c_str();
+    }
+
+    // Save widget trace spans (only when built with tracing)
+    if (Trace::isEnabled())
+    {
+        if (Trace::save("atelier-trace.json"))
+            qWarning() << "Trace saved into atelier-trace.json";
+    }
+
     delete ui;
 }
 
@@ -93,6 +170,8 @@ MainWindow::~MainWindow()
  */
 void MainWindow::entityAdded(Atelier *atelier, int index)
 {
+    mLog.recordEntityAdded(atelier, index);
+
     Atelier *entity = atelier->getEntity(index);
     qWarning() << "New entity added into Atelier " << atelier->getName() << " at index " << index << " named " << entity->getName();
 }
@@ -105,6 +184,7 @@ void MainWindow::entityAdded(Atelier *atelier, int index)
  */
 void MainWindow::entityDeleted(Atelier *atelier, int index)
 {
+    mLog.recordEntityDeleted(atelier, index);
     qWarning() << "An entity has been deleted from atelier " << atelier->getName() << " at index " << index;
 }
 
@@ -115,6 +195,7 @@ void MainWindow::entityDeleted(Atelier *atelier, int index)
  */
 void MainWindow::entityNameChanged (Atelier *entity)
 {
+    mLog.recordEntityName(entity);
     qWarning() << "Entity renamed " << entity->getName();
 }
 
@@ -125,6 +206,8 @@ void MainWindow::entityNameChanged (Atelier *entity)
  */
 void MainWindow::entityRotationChanged(Atelier *entity)
 {
+    mLog.recordEntityRotation(entity);
+
     if (entity->getRotation())
     {
         qWarning() << "Entity " << entity->getName()
@@ -146,12 +229,32 @@ void MainWindow::entityRotationChanged(Atelier *entity)
  */
 void MainWindow::entityValueChanged(Atelier *entity, int index, double value)
 {
+    mLog.recordEntityValue(entity, index, value);
+
     QString pName(entity->getParameterName(index));
     qWarning() << "Entity " << entity->getName()
                << " new value for parameter " << pName
                << ":" << value;
 }
 
+/**
+ * @brief Slot called when a block of entity values has been modified
+ *
+ * @param atelier Pointer to the modified Atelier
+ * @param row     First modified entity
+ * @param index   First modified parameter
+ * @param rows    Number of entities
+ * @param columns Number of parameters
+ */
+void MainWindow::entityValuesChanged(Atelier *atelier, int row, int index, int rows, int columns)
+{
+    mLog.recordEntityValues(atelier, row, index, rows, columns);
+
+    qWarning() << "Atelier " << atelier->getName()
+               << " new values for " << rows << " entities from " << row
+               << " and " << columns << " parameters from " << index;
+}
+
 /**
  * @brief Slot called when a new parameter is added to an Atelier
  *
@@ -160,6 +263,8 @@ void MainWindow::entityValueChanged(Atelier *entity, int index, double value)
  */
 void MainWindow::parameterAdded(Atelier *atelier, int index)
 {
+    mLog.recordParameterAdded(atelier, index);
+
     QString pName(atelier->getParameterName(index));
     qWarning() << "Atelier " << atelier->getName() << " new parameter added " << pName;
 }
@@ -172,9 +277,23 @@ void MainWindow::parameterAdded(Atelier *atelier, int index)
  */
 void MainWindow::parameterDeleted(Atelier *atelier, int index)
 {
+    mLog.recordParameterDeleted(atelier, index);
     qWarning() << "Atelier " << atelier->getName() << " one parameter has been deleted at index " << index;
 }
 
+/**
+ * @brief Slot called when the type of a parameter is modified
+ *
+ * @param atelier Pointer to the modified Atelier
+ * @param index   Index of the modified parameter
+ */
+void MainWindow::parameterKindChanged(Atelier *atelier, int index)
+{
+    mLog.recordParameterKind(atelier, index);
+    qWarning() << "Atelier " << atelier->getName() << " parameter " << index
+               << " is now of type " << AtelierColumn::kindName(atelier->getParameterKind(index));
+}
+
 /**
  * @brief Slot called when a parameter is renamed
  *
@@ -183,10 +302,120 @@ void MainWindow::parameterDeleted(Atelier *atelier, int index)
  */
 void MainWindow::parameterNameChanged(Atelier *atelier, int index)
 {
+    mLog.recordParameterName(atelier, index);
+
     QString pName(atelier->getParameterName(index));
     qWarning() << "Atelier " << atelier->getName() << " parameter renamed " << pName;
 }
 
+/**
+ * @brief Start to load a scenario file into local Exploitation
+ *
+ * The file is parsed by a worker thread, the widget is initialized when
+ * the Exploitation is complete (see slotLoaded).
+ *
+ * @param filename Name of the scenario file
+ */
+void MainWindow::loadFile(const QString &filename)
+{
+    mProgress = new QProgressBar(this);
+    mProgress->setRange(0, 100);
+    statusBar()->addPermanentWidget(mProgress);
+    statusBar()->showMessage(tr("Loading %1 ...").arg(filename));
+
+    mLoader = new ExploitationLoader(&mExploitation, this);
+    QObject::connect(mLoader,   SIGNAL(progress(int)),
+                     mProgress, SLOT  (setValue(int)));
+    QObject::connect(mLoader,   SIGNAL(loaded(bool)),
+                     this,      SLOT  (slotLoaded(bool)));
+    mLoader->load(filename);
+}
+
+/**
+ * @brief Slot called when the loader thread has finished to read the file
+ *
+ * @param success True if the file has been successfully loaded
+ */
+void MainWindow::slotLoaded(bool success)
+{
+    if ( ! success)
+    {
+        statusBar()->showMessage(tr("Load failed: %1").arg(mLoader->errorString()));
+        mProgress->hide();
+        return;
+    }
+
+    // Then, fill the widget by batches from the event loop
+    statusBar()->showMessage(tr("Filling rows ..."));
+    QObject::connect(ui->AtelierWidget, SIGNAL(setupProgress(int,int)),
+                     this,          SLOT  (slotSetupProgress(int,int)));
+    QObject::connect(ui->AtelierWidget, SIGNAL(setupFinished()),
+                     this,          SLOT  (slotSetupFinished()));
+    ui->AtelierWidget->setFillBatch(200);
+    ui->AtelierWidget->setup(&mExploitation);
+    // The schedule reads the Exploitation directly, it is ready at once
+    ui->ScheduleWidget->setup(&mExploitation);
+
+    startAutosave();
+}
+
+/**
+ * @brief Slot called after each batch inserted into the widget
+ *
+ * @param done  Number of rows already inserted
+ * @param total Total number of rows
+ */
+void MainWindow::slotSetupProgress(int done, int total)
+{
+    mProgress->setRange(0, total);
+    mProgress->setValue(done);
+}
+
+/**
+ * @brief Slot called when the widget is completely filled
+ *
+ */
+void MainWindow::slotSetupFinished(void)
+{
+    mProgress->hide();
+    showMemoryUsage();
+}
+
+/**
+ * @brief Estimate the memory used by the Exploitation and the widgets
+ *
+ * The total is shown into the status bar, the details are logged.
+ */
+void MainWindow::showMemoryUsage(void)
+{
+    MemoryUsage usage = mExploitation.memoryUsage();
+    ui->AtelierWidget->memoryUsage(usage);
+    ui->ScheduleWidget->memoryUsage(usage);
+
+    statusBar()->showMessage(tr("Ready (memory %1)")
+                             .arg(MemoryUsage::formatBytes(usage.total())), 2000);
+    qWarning() << "--=={ Memory usage }==--";
+    QStringList lines = usage.report();
+    for (int i = 0; i < lines.count(); i++)
+        qWarning() << lines.at(i).toStdString().c_str();
+}
+
+/**
+ * @brief Start to record the modifications into the autosave log
+ *
+ */
+void MainWindow::startAutosave(void)
+{
+    // Never overwrite an autosave that could not be recovered nor moved aside
+    if (( ! mLog.isOpen()) && ChangeLog::exists(AUTOSAVE_FILE))
+    {
+        qWarning() << "Autosave disabled : an old autosave is still present";
+        return;
+    }
+    if ( ! mLog.open(AUTOSAVE_FILE, &mExploitation))
+        qWarning() << "Autosave disabled :" << mLog.errorString();
+}
+
 /**
  * @brief Load some dummy datas into local Exploitation
  *
@@ -214,6 +443,7 @@ void MainWindow::loadTestData(void)
 
     Atelier *a2 = mExploitation.createAtelier("Troupeau");
     a2->addParameter("Nombre", 0);
+    a2->setParameterKind(0, AtelierColumn::KindInteger);
     Atelier * a2e1 = a2->addEntity();
     a2e1->setName("Bovins");
     a2e1->setParameterValue(0,  38);
@@ -9,8 +9,11 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QProgressBar>
 #include "data-model/atelier.h"
+#include "data-model/changelog.h"
 #include "data-model/exploitation.h"
+#include "data-model/loader.h"
 
 namespace Ui {
 class MainWindow;
@@ -26,20 +29,31 @@ public:
 
 protected:
     void loadTestData(void);
+    void loadFile(const QString &filename);
+    void showMemoryUsage(void);
+    void startAutosave(void);
 
 public slots:
+    void slotLoaded          (bool success);
+    void slotSetupProgress   (int done, int total);
+    void slotSetupFinished   (void);
     void entityAdded         (Atelier *entity,  int index);
     void entityDeleted       (Atelier *atelier, int index);
     void entityNameChanged   (Atelier *entity);
     void entityValueChanged  (Atelier *entity,  int index, double value);
+    void entityValuesChanged (Atelier *atelier, int row, int index, int rows, int columns);
     void entityRotationChanged(Atelier *entity);
     void parameterAdded      (Atelier *atelier, int index);
     void parameterDeleted    (Atelier *atelier, int index);
+    void parameterKindChanged(Atelier *atelier, int index);
     void parameterNameChanged(Atelier *atelier, int index);
 
 private:
     Ui::MainWindow *ui;
+    ExploitationLoader *mLoader;
+    QProgressBar       *mProgress;
     Exploitation    mExploitation;
+    ChangeLog       mLog;
 };
 
 #endif // MAINWINDOW_H
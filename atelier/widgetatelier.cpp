@@ -5,16 +5,39 @@
  *
  * Copyright (c) 2016 Agilack
  */
+#include <QApplication>
+#include <QClipboard>
 #include <QComboBox>
+#include <QInputDialog>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMenu>
+#include <QMessageBox>
+#include <QShortcut>
 #include <QTableWidget>
 #include <QListWidget>
 #include <QVBoxLayout>
 #include <QHeaderView>
+#include "data-model/trace.h"
 #include "widgetatelier.h"
 
+// Estimated memory of the data of one item (roles and values), besides text
+#define ITEM_DATA_BYTES 72
+
+/**
+ * @brief Estimate the memory used by one item of a table
+ *
+ * @param item Pointer to the item (may be NULL)
+ * @return qint64 Number of bytes (object, data of the roles and text)
+ */
+static qint64 itemBytes(QTableWidgetItem *item)
+{
+    if (item == 0)
+        return 0;
+    return sizeof(QTableWidgetItem) + ITEM_DATA_BYTES
+         + MemoryUsage::stringBytes(item->text());
+}
+
 /**
  * @brief Default constructor for Atelier widget
  *
@@ -23,6 +46,46 @@
 widgetAtelier::widgetAtelier(QWidget *parent) : QWidget(parent)
 {
     mExploitation = 0;
+    mCellSignals  = false;
+
+    // By default, tables are filled synchronously by setup()
+    mFillBatch = 0;
+    mFillDone  = 0;
+    mFillTotal = 0;
+    mFillTimer = new QTimer(this);
+    mFillTimer->setInterval(0);
+    QObject::connect(mFillTimer, SIGNAL(timeout()),
+                     this,       SLOT(slotFillBatch()));
+}
+
+/**
+ * @brief Add the memory used by the items of the tables to an estimation
+ *
+ * The cells are not walked : one item of the middle of each table gives the
+ * size of all its cells, and one row header the size of all row headers.
+ *
+ * @param usage Reference to the estimation
+ */
+void widgetAtelier::memoryUsage(MemoryUsage &usage)
+{
+    qint64 bytes = 0;
+    QList<QTableWidget *> tables = findChildren<QTableWidget *>();
+    for (int t = 0; t < tables.count(); ++t)
+    {
+        QTableWidget *table = tables.at(t);
+        int rows    = table->rowCount();
+        int columns = table->columnCount();
+        if (rows > 0)
+        {
+            bytes += rows * itemBytes(table->verticalHeaderItem(rows / 2));
+            if (columns > 0)
+                bytes += qint64(rows) * columns *
+                         itemBytes(table->item(rows / 2, columns / 2));
+        }
+        for (int c = 0; c < columns; ++c)
+            bytes += itemBytes(table->horizontalHeaderItem(c));
+    }
+    usage.add(MemoryUsage::CategoryWidgets, bytes);
 }
 
 /**
@@ -51,9 +114,49 @@ bool widgetAtelier::setup(Exploitation *exploitation)
     layout->addWidget(tabs);
     setLayout(layout);
     show();
+
+    // Start to fill the rows left empty by addTab (progressive mode)
+    if ( ! mFillNext.isEmpty())
+    {
+        emit setupProgress(mFillDone, mFillTotal);
+        mFillTimer->start();
+    }
+    else if (mFillBatch > 0)
+        emit setupFinished();
+
     return true;
 }
 
+/**
+ * @brief Select the signals emitted for block edits (paste, fill)
+ *
+ * By default a block edit emits a single entityValuesChanged. In
+ * compatibility mode, one entityValueChanged is emitted for each cell
+ * instead (slow for big blocks).
+ *
+ * @param enable True to emit one signal per cell
+ */
+void widgetAtelier::setCellSignals(bool enable)
+{
+    mCellSignals = enable;
+}
+
+/**
+ * @brief Configure the progressive fill of the tables
+ *
+ * When a batch size is set, setup() only creates the tabs and empty rows,
+ * then the rows are filled by batches from the event loop (visible rows
+ * first). The setupProgress and setupFinished signals follow this fill.
+ *
+ * @param rows Number of rows filled per batch (0 to fill synchronously)
+ */
+void widgetAtelier::setFillBatch(int rows)
+{
+    if (rows < 0)
+        rows = 0;
+    mFillBatch = rows;
+}
+
 /**
  * @brief Insert a new entity to the table
  *
@@ -66,32 +169,49 @@ void widgetAtelier::addEntity(QTableWidget *table, Atelier *entity)
     int row = table->rowCount();
     table->insertRow(row);
 
+    fillRow(table, row, entity);
+}
+
+/**
+ * @brief Fill the cells of one table row with the content of an entity
+ *
+ * @param table  Pointer to the table widget to modify
+ * @param row    Index of the row to fill
+ * @param entity Pointer to the entity shown by this row
+ */
+void widgetAtelier::fillRow(QTableWidget *table, int row, Atelier *entity)
+{
+    // Do not handle cellChanged signals while the row is filled
+    bool blocked = table->blockSignals(true);
+
     // Set Entity name into header column
     QTableWidgetItem *hItem = new QTableWidgetItem(entity->getName());
-    hItem->setData(Qt::UserRole, qVariantFromValue((void *)entity));
     table->setVerticalHeaderItem(row, hItem);
 
     // Set the Rotation name into the first data column
     QTableWidgetItem *rItem = new QTableWidgetItem();
-    rItem->setData(Qt::UserRole, qVariantFromValue((void *)entity));
     if (entity->getRotation())
     {
         Rotation *rot = entity->getRotation();
-        rItem->setData(Qt::UserRole+1, qVariantFromValue((void *)rot));
+        // Save the identifier of the selected Rotation
+        rItem->setData(Qt::UserRole, rot->getId());
         rItem->setText( rot->getName() );
     }
     table->setItem(row, 0, rItem);
 
-    // Set parameters values
+    // Set parameters values (the entity is found back from the row)
+    Atelier *atelier = entity->getParent();
     for (int i = 0; i < entity->countParameter(); ++i)
     {
         QString pvalue = QString::number(entity->getParameterValue(i));
         QTableWidgetItem *item = new QTableWidgetItem(pvalue);
-        // Save a pointer to the entity
-        QVariant vEntity = qVariantFromValue((void *)entity);
-        item->setData(Qt::UserRole, vEntity);
+        // Derived parameters are computed from their formula
+        if (atelier->isParameterDerived(i))
+            item->setFlags( item->flags() & ~Qt::ItemIsEditable);
         table->setItem(row, i+1, item);
     }
+
+    table->blockSignals(blocked);
 }
 
 /**
@@ -111,8 +231,8 @@ void widgetAtelier::addTab(Atelier *atelier)
     // Create a table to show Entities and Parameters
     QTableWidget *entityTable = new QTableWidget(page);
     entityTable->verticalHeader()->setVisible(true);
-    entityTable->setSelectionMode(QAbstractItemView::SingleSelection);
-    entityTable->setProperty("atelier", qVariantFromValue((void *)atelier));
+    entityTable->setSelectionMode(QAbstractItemView::ContiguousSelection);
+    entityTable->setProperty("atelier", atelier->getId());
 
     // Set a minimum height to show header when no parameter is defined
     entityTable->horizontalHeader()->setMinimumHeight(20);
@@ -133,7 +253,6 @@ void widgetAtelier::addTab(Atelier *atelier)
     {
         QTableWidgetItem *item = new QTableWidgetItem();
         item->setText( atelier->getParameterName(i) );
-        item->setData(Qt::UserRole, qVariantFromValue((void *)atelier));
         if (atelier->isParameterMandatory(i))
             item->setFlags( item->flags() ^ Qt::ItemIsEditable);
         else
@@ -159,16 +278,37 @@ void widgetAtelier::addTab(Atelier *atelier)
                      this,        SLOT  (slotNamesEdit(int)));
 
     // Insert atelier entities (one per row)
-    for (int i = 0; i < atelier->countEntity(); ++i)
-        addEntity(entityTable, atelier->getEntity(i));
+    if ((mFillBatch > 0) && (atelier->countEntity() > 0))
+    {
+        // Only create empty rows, they are filled later by slotFillBatch
+        entityTable->setRowCount(atelier->countEntity());
+        mFillNext.insert(entityTable, 0);
+        mFillTotal += atelier->countEntity();
+    }
+    else
+    {
+        for (int i = 0; i < atelier->countEntity(); ++i)
+            addEntity(entityTable, atelier->getEntity(i));
+    }
 
-    entityTable->setItemDelegate(new widgetAtelierDelegate(entityTable));
+    entityTable->setItemDelegate(new widgetAtelierDelegate(atelier, entityTable));
     entityTable->setEditTriggers(QAbstractItemView::DoubleClicked
                                     | QAbstractItemView::SelectedClicked);
 
     QObject::connect(entityTable, SIGNAL(cellChanged(int,int)),
                      this,        SLOT(slotCellChanged(int,int)));
 
+    // Block edits : context menu and keyboard shortcuts
+    entityTable->setContextMenuPolicy(Qt::CustomContextMenu);
+    QObject::connect(entityTable, SIGNAL(customContextMenuRequested(const QPoint &)),
+                     this,        SLOT  (slotCellMenu(const QPoint &)));
+    QShortcut *pasteKey = new QShortcut(QKeySequence::Paste, entityTable);
+    pasteKey->setContext(Qt::WidgetWithChildrenShortcut);
+    QObject::connect(pasteKey, SIGNAL(activated()), this, SLOT(pasteClipboard()));
+    QShortcut *fillKey = new QShortcut(QKeySequence("Ctrl+D"), entityTable);
+    fillKey->setContext(Qt::WidgetWithChildrenShortcut);
+    QObject::connect(fillKey,  SIGNAL(activated()), this, SLOT(fillDown()));
+
     QVBoxLayout *atelierLayout = new QVBoxLayout;
     atelierLayout->addWidget(entityTable);
     page->setLayout(atelierLayout);
@@ -176,6 +316,317 @@ void widgetAtelier::addTab(Atelier *atelier)
     tabs->addTab(page, atelier->getName());
 }
 
+/**
+ * @brief Get the table widget of the current tab
+ *
+ * @return Pointer to the table widget (or NULL)
+ */
+QTableWidget *widgetAtelier::currentTable(void)
+{
+    QTabWidget *tabs = this->findChild<QTabWidget *>("rootTabs");
+    if ((tabs == 0) || (tabs->currentWidget() == 0))
+        return 0;
+    return tabs->currentWidget()->findChild<QTableWidget *>();
+}
+
+/**
+ * @brief Copy the first row of the selection into the rows below
+ *
+ */
+void widgetAtelier::fillDown(void)
+{
+    TRACE_SPAN("widgetAtelier::fillDown");
+
+    QTableWidget *table = currentTable();
+    int row, column, rows, columns;
+    if ((table == 0) || ( ! selectedBlock(table, row, column, rows, columns)))
+        return;
+    if (rows < 2)
+        return;
+
+    Atelier *atelier = tableAtelier(table);
+    Atelier *first   = atelier->getEntity(row);
+    QVector<double> values(rows * columns);
+    for (int c = 0; c < columns; ++c)
+    {
+        double value = first->getParameterValue(column - 1 + c);
+        for (int r = 0; r < rows; ++r)
+            values[(r * columns) + c] = value;
+    }
+    setBlock(table, row, column, rows, columns, values);
+}
+
+/**
+ * @brief Fill the selection with a linear series, column by column
+ *
+ * The series starts at the value of the first row. The step is the
+ * difference between the two first rows when at least three rows are
+ * selected, else the step is 1.
+ */
+void widgetAtelier::fillSeries(void)
+{
+    TRACE_SPAN("widgetAtelier::fillSeries");
+
+    QTableWidget *table = currentTable();
+    int row, column, rows, columns;
+    if ((table == 0) || ( ! selectedBlock(table, row, column, rows, columns)))
+        return;
+    if (rows < 2)
+        return;
+
+    Atelier *atelier = tableAtelier(table);
+    QVector<double> values(rows * columns);
+    for (int c = 0; c < columns; ++c)
+    {
+        int index = column - 1 + c;
+        double start = atelier->getEntity(row)->getParameterValue(index);
+        double step  = 1;
+        if (rows > 2)
+            step = atelier->getEntity(row + 1)->getParameterValue(index) - start;
+        for (int r = 0; r < rows; ++r)
+            values[(r * columns) + c] = start + (r * step);
+    }
+    setBlock(table, row, column, rows, columns, values);
+}
+
+/**
+ * @brief Paste a block of values (tab separated text) from the clipboard
+ *
+ * The block starts at the top-left cell of the selection. A single value
+ * is copied into all selected cells. Cells that are not numbers keep
+ * their value, cells out of the table are ignored.
+ */
+void widgetAtelier::pasteClipboard(void)
+{
+    TRACE_SPAN("widgetAtelier::pasteClipboard");
+
+    QTableWidget *table = currentTable();
+    int row, column, rows, columns;
+    if ((table == 0) || ( ! selectedBlock(table, row, column, rows, columns)))
+        return;
+    Atelier *atelier = tableAtelier(table);
+
+    // Split the clipboard text into lines and cells
+    QString text = QApplication::clipboard()->text();
+    text.replace("\r\n", "\n");
+    if (text.endsWith('\n'))
+        text.chop(1);
+    if (text.isEmpty())
+        return;
+    QStringList lines = text.split('\n');
+    QList<QStringList> cells;
+    int width = 0;
+    for (int i = 0; i < lines.count(); ++i)
+    {
+        cells.append(lines.at(i).split('\t'));
+        width = qMax(width, cells.last().count());
+    }
+    // The Rotation column is not pasted
+    int skip = 0;
+    if (table->currentColumn() == 0)
+        skip = 1;
+
+    bool single = (lines.count() == 1) && (width == 1);
+    if ( ! single)
+    {
+        rows    = qMin(lines.count(), atelier->countEntity() - row);
+        columns = qMin(width - skip, atelier->countParameter() - (column - 1));
+        if ((rows <= 0) || (columns <= 0))
+            return;
+    }
+
+    // Start from the current values, then copy the numbers
+    QVector<double> values(rows * columns);
+    for (int r = 0; r < rows; ++r)
+    {
+        Atelier *entity = atelier->getEntity(row + r);
+        for (int c = 0; c < columns; ++c)
+        {
+            double value = entity->getParameterValue(column - 1 + c);
+            const QStringList &line = cells.at(single ? 0 : r);
+            int cell = single ? 0 : (skip + c);
+            if (cell < line.count())
+            {
+                bool ok;
+                double parsed = line.at(cell).trimmed().toDouble(&ok);
+                if (ok)
+                    value = parsed;
+            }
+            values[(r * columns) + c] = value;
+        }
+    }
+    setBlock(table, row, column, rows, columns, values);
+}
+
+/**
+ * @brief Get the selected block of parameter cells
+ *
+ * @param table   Pointer to the table widget
+ * @param row     Reference to the first row
+ * @param column  Reference to the first table column (1 or more)
+ * @param rows    Reference to the number of rows
+ * @param columns Reference to the number of columns
+ * @return boolean False if no parameter cell is selected
+ */
+bool widgetAtelier::selectedBlock(QTableWidget *table, int &row, int &column,
+                                  int &rows, int &columns)
+{
+    Atelier *atelier = tableAtelier(table);
+    if (atelier == 0)
+        return false;
+
+    QList<QTableWidgetSelectionRange> ranges = table->selectedRanges();
+    int lastRow, lastColumn;
+    if (ranges.isEmpty())
+    {
+        row = lastRow = table->currentRow();
+        column = lastColumn = table->currentColumn();
+    }
+    else
+    {
+        row        = ranges.first().topRow();
+        lastRow    = ranges.first().bottomRow();
+        column     = ranges.first().leftColumn();
+        lastColumn = ranges.first().rightColumn();
+    }
+
+    // First column holds the Rotation, parameters start at column 1
+    if (column < 1)
+        column = 1;
+    lastRow    = qMin(lastRow,    atelier->countEntity() - 1);
+    lastColumn = qMin(lastColumn, atelier->countParameter());
+    if ((row < 0) || (row > lastRow) || (column > lastColumn))
+        return false;
+
+    rows    = lastRow    - row    + 1;
+    columns = lastColumn - column + 1;
+    return true;
+}
+
+/**
+ * @brief Update a block of values into the Atelier then into the table
+ *
+ * @param table   Pointer to the table widget
+ * @param row     First row of the block
+ * @param column  First table column of the block (1 or more)
+ * @param rows    Number of rows
+ * @param columns Number of columns
+ * @param values  New values (row by row)
+ */
+void widgetAtelier::setBlock(QTableWidget *table, int row, int column,
+                             int rows, int columns, const QVector<double> &values)
+{
+    TRACE_SPAN("widgetAtelier::setBlock");
+
+    Atelier *atelier = tableAtelier(table);
+    if (atelier == 0)
+        return;
+    if (((row + rows) > atelier->countEntity()) ||
+        ((column - 1 + columns) > atelier->countParameter()))
+        return;
+
+    // An enum parameter may refuse some values, the others are stored
+    bool stored = atelier->setEntityValues(row, column - 1, rows, columns, values.constData());
+    blockChanged(table, row, column - 1, rows, columns);
+    if ( ! stored)
+        QMessageBox::warning(this, atelier->getName(),
+                             tr("Too many distinct values for an enum"));
+}
+
+/**
+ * @brief Show a modified block of values, then notify it
+ *
+ * @param table   Pointer to the table widget
+ * @param row     First modified row
+ * @param index   First modified parameter
+ * @param rows    Number of rows
+ * @param columns Number of parameters
+ */
+void widgetAtelier::blockChanged(QTableWidget *table, int row, int index,
+                                 int rows, int columns)
+{
+    Atelier *atelier = tableAtelier(table);
+
+    // Show the new values, derived parameters may be modified too
+    refreshValues(table, row, rows);
+
+    // Send a message to inform the world that a block has been updated
+    if (mCellSignals)
+    {
+        TRACE_SPAN("widgetAtelier::entityValueChanged");
+        for (int r = 0; r < rows; ++r)
+        {
+            Atelier *entity = atelier->getEntity(row + r);
+            for (int c = index; c < (index + columns); ++c)
+                emit entityValueChanged(entity, c, entity->getParameterValue(c));
+        }
+    }
+    else
+    {
+        TRACE_SPAN("widgetAtelier::entityValuesChanged");
+        emit entityValuesChanged(atelier, row, index, rows, columns);
+    }
+}
+
+/**
+ * @brief Show again the values of some rows
+ *
+ * Rows not filled yet (progressive setup) will read the Atelier later.
+ *
+ * @param table Pointer to the table widget
+ * @param row   First row to update
+ * @param rows  Number of rows
+ */
+void widgetAtelier::refreshValues(QTableWidget *table, int row, int rows)
+{
+    Atelier *atelier = tableAtelier(table);
+
+    bool blocked = table->blockSignals(true);
+    for (int r = row; r < (row + rows); ++r)
+    {
+        Atelier *entity = atelier->getEntity(r);
+        for (int i = 0; i < entity->countParameter(); ++i)
+        {
+            QTableWidgetItem *item = table->item(r, i + 1);
+            if (item)
+                item->setText(QString::number(entity->getParameterValue(i)));
+        }
+    }
+    table->blockSignals(blocked);
+}
+
+/**
+ * @brief Get the table widget under a header line-edit
+ *
+ * @param editor Pointer to a line-edit created by slotHeaderEdit or slotNamesEdit
+ * @return Pointer to the table widget (or NULL)
+ */
+QTableWidget *widgetAtelier::editorTable(QWidget *editor)
+{
+    // The editor overlays the viewport of a header, owned by the table
+    QWidget *viewport = editor->parentWidget();
+    if (viewport == 0)
+        return 0;
+    QHeaderView *headerView = qobject_cast<QHeaderView*>( viewport->parent() );
+    if (headerView == 0)
+        return 0;
+    return qobject_cast<QTableWidget*>( headerView->parent() );
+}
+
+/**
+ * @brief Get the Atelier shown into a table widget
+ *
+ * @param table Pointer to the table widget of one Atelier tab
+ * @return Pointer to the Atelier (or NULL if it does not exists anymore)
+ */
+Atelier *widgetAtelier::tableAtelier(QTableWidget *table)
+{
+    QVariant vAtelier = table->property("atelier");
+    if ( ! vAtelier.isValid())
+        return 0;
+    return mExploitation->getAtelierById(vAtelier.toUInt());
+}
+
 /**
  * @brief Slot called when the value of a cell is modified
  *
@@ -184,6 +635,8 @@ void widgetAtelier::addTab(Atelier *atelier)
  */
 void widgetAtelier::slotCellChanged(int row, int col)
 {
+    TRACE_SPAN("widgetAtelier::slotCellChanged");
+
     // Search the table widget that has emit signal
     QTableWidget *table = qobject_cast<QTableWidget*>( sender() );
     if (table == 0)
@@ -194,19 +647,21 @@ void widgetAtelier::slotCellChanged(int row, int col)
     if (item == 0)
         return;
 
+    // Get the entity associated with the modified row
+    Atelier *atelier = tableAtelier(table);
+    if ((atelier == 0) || (row >= atelier->countEntity()))
+        return;
+    Atelier *entity = atelier->getEntity(row);
+
     if (col == 0)
     {
-        // Get the Entity associated with modified item
-        QVariant vEntity = item->data(Qt::UserRole);
-        if ( ! vEntity.isValid())
-            return;
-        Atelier *entity = (Atelier *) vEntity.value<void *>();
-
         // Get the selected Rotation
-        QVariant vRotation = item->data(Qt::UserRole + 1);
+        QVariant vRotation = item->data(Qt::UserRole);
         if ( ! vRotation.isValid())
             return;
-        Rotation *rot = (Rotation *) vRotation.value<void *>();
+        Rotation *rot = mExploitation->getRotationById(vRotation.toUInt());
+        if (rot == 0)
+            return;
 
         // If the selected rotation is the same than previous ...
         if (rot == entity->getRotation())
@@ -217,6 +672,7 @@ void widgetAtelier::slotCellChanged(int row, int col)
         entity->setRotation(rot);
 
         // Send a message to inform the world that a new rotation is selected
+        TRACE_SPAN("widgetAtelier::entityRotationChanged");
         emit entityRotationChanged(entity);
     }
     else
@@ -224,19 +680,136 @@ void widgetAtelier::slotCellChanged(int row, int col)
         // Get the new value and convert it to double
         double newValue = item->text().toDouble();
 
-        // Get the associated entity
-        Atelier *entity = (Atelier *) item->data(Qt::UserRole).value<void *>();
-        if (entity == 0)
-            return;
+        // Update the entity parameter with the new value (an enum parameter
+        // may refuse it, its kind must then be modified explicitly)
+        bool stored = entity->setParameterValue(col - 1, newValue);
 
-        if (col < 1)
+        // Show the value really stored (see AtelierColumn::normalize), and
+        // the derived parameters computed again from it
+        refreshValues(table, row, 1);
+        if ( ! stored)
+        {
+            if (atelier->isParameterDerived(col - 1))
+                QMessageBox::warning(this, atelier->getParameterName(col - 1),
+                                     tr("This parameter is computed from a formula"));
+            else
+                QMessageBox::warning(this, atelier->getParameterName(col - 1),
+                                     tr("Too many distinct values for an enum"));
             return;
-
-        // Update the entity parameter with the new value
-        entity->setParameterValue(col - 1, newValue);
+        }
 
         // Send a message to inform the world that a value has been updated
-        emit entityValueChanged(entity, col - 1, newValue);
+        TRACE_SPAN("widgetAtelier::entityValueChanged");
+        emit entityValueChanged(entity, col - 1, entity->getParameterValue(col - 1));
+    }
+}
+
+/**
+ * @brief Slot called to show context menu on the table cells (right click)
+ *
+ * @param pos Mouse click position into table
+ */
+void widgetAtelier::slotCellMenu(const QPoint &pos)
+{
+    (void)pos;
+
+    QTableWidget *table = qobject_cast<QTableWidget*>( sender() );
+    if (table == 0)
+        return;
+
+    int row, column, rows, columns;
+    bool selected = selectedBlock(table, row, column, rows, columns);
+
+    QMenu ctxMenu(this);
+    QAction *actionPaste  = ctxMenu.addAction(tr("Paste"));
+    QAction *actionDown   = ctxMenu.addAction(tr("Fill down"));
+    QAction *actionSeries = ctxMenu.addAction(tr("Fill series"));
+    actionPaste ->setEnabled(selected);
+    actionDown  ->setEnabled(selected && (rows > 1));
+    actionSeries->setEnabled(selected && (rows > 1));
+
+    QAction *selectedAction = ctxMenu.exec(QCursor::pos());
+
+    if (selectedAction == 0)
+    {
+        // Nothing selected, nothing to do
+    }
+    else if (selectedAction == actionPaste)
+        pasteClipboard();
+    else if (selectedAction == actionDown)
+        fillDown();
+    else if (selectedAction == actionSeries)
+        fillSeries();
+}
+
+/**
+ * @brief Slot called from the event loop to fill a batch of rows
+ *
+ * A row is "filled" when his rotation cell exists. The rows visible into
+ * the current tab are filled first, then all tables are filled in order.
+ */
+void widgetAtelier::slotFillBatch(void)
+{
+    TRACE_SPAN("widgetAtelier::slotFillBatch");
+
+    int budget = mFillBatch;
+
+    // First, fill the rows visible into the current tab
+    QTableWidget *current = currentTable();
+    if (current && mFillNext.contains(current))
+    {
+        Atelier *atelier = tableAtelier(current);
+        int first = current->rowAt(0);
+        int last  = current->rowAt(current->viewport()->height() - 1);
+        if (first < 0)
+            first = 0;
+        if (last < 0)
+            last = current->rowCount() - 1;
+        for (int row = first; atelier && (row <= last) && (budget > 0); ++row)
+        {
+            if (current->item(row, 0) || (row >= atelier->countEntity()))
+                continue;
+            fillRow(current, row, atelier->getEntity(row));
+            mFillDone++;
+            budget--;
+        }
+    }
+
+    // Then, continue to fill all tables in order
+    QHash<QTableWidget *, int>::iterator it = mFillNext.begin();
+    while ((it != mFillNext.end()) && (budget > 0))
+    {
+        QTableWidget *table = it.key();
+        Atelier *atelier = tableAtelier(table);
+        int count = atelier ? qMin(atelier->countEntity(), table->rowCount()) : 0;
+        int row = it.value();
+        for (; (row < count) && (budget > 0); ++row)
+        {
+            if (table->item(row, 0))
+                continue;
+            fillRow(table, row, atelier->getEntity(row));
+            mFillDone++;
+            budget--;
+        }
+        if (row >= count)
+            it = mFillNext.erase(it);
+        else
+        {
+            it.value() = row;
+            ++it;
+        }
+    }
+
+    {
+        TRACE_SPAN("widgetAtelier::setupProgress");
+        emit setupProgress(qMin(mFillDone, mFillTotal), mFillTotal);
+    }
+
+    if (mFillNext.isEmpty())
+    {
+        mFillTimer->stop();
+        TRACE_SPAN("widgetAtelier::setupFinished");
+        emit setupFinished();
     }
 }
 
@@ -270,7 +843,6 @@ void widgetAtelier::slotHeaderEdit(int index)
     editor->move(editorX, 0);
     // Save a copy of the column index
     editor->setProperty("index", QVariant(index));
-    editor->setProperty("tableWidget", qVariantFromValue((void *)entityTable));
 
     // Catch the end-of-edition event
     QObject::connect(editor, SIGNAL(editingFinished()),
@@ -292,36 +864,49 @@ void widgetAtelier::slotHeaderEdit(int index)
  */
 void widgetAtelier::slotHeaderEditEnd(void)
 {
+    TRACE_SPAN("widgetAtelier::slotHeaderEditEnd");
+
     QLineEdit *editor = qobject_cast<QLineEdit*>( sender() );
+    if (editor == 0)
+        return;
 
-    QVariant vTable = editor->property("tableWidget");
+    QTableWidget *entityTable = editorTable(editor);
     QVariant vIndex = editor->property("index");
-    if ( (vIndex.isValid() == false) || (vTable.isValid() == false) )
+    if ( (vIndex.isValid() == false) || (entityTable == 0) )
         return;
 
-    QTableWidget *entityTable = (QTableWidget *) vTable.value<void *>();
-    QTableWidgetItem *item = entityTable->horizontalHeaderItem(vIndex.toInt());
+    int column = vIndex.toInt();
+    QTableWidgetItem *item = entityTable->horizontalHeaderItem(column);
 
     // Get a pointer to the associated Atelier
-    QVariant vAtelier = item->data(Qt::UserRole);
-    if ( ! vAtelier.isValid())
+    Atelier *atelier = tableAtelier(entityTable);
+    if ((atelier == 0) || (column < 1))
     {
         delete editor;
         return;
     }
-    Atelier *atelier = (Atelier *)vAtelier.value<void *>();
 
-    int index = vIndex.toInt();
+    // First column holds the Rotation, parameters start at column 1
+    int index = column - 1;
 
     QString newName(editor->text());
 
-    // Update the parameter name into Atelier
-    atelier->setParameterName(index, newName);
+    // Update the parameter name into Atelier (refused when a formula uses it)
+    if ( ! atelier->setParameterName(index, newName))
+    {
+        QMessageBox::warning(this, atelier->getParameterName(index),
+                             tr("A formula uses this name"));
+        delete editor;
+        return;
+    }
     // Update the parameter name into the table
     item->setText( newName );
 
     // Send a message to inform the world that a parameter has been renamed
-    emit parameterNameChanged(atelier, index);
+    {
+        TRACE_SPAN("widgetAtelier::parameterNameChanged");
+        emit parameterNameChanged(atelier, index);
+    }
 
     delete editor;
 }
@@ -344,24 +929,54 @@ void widgetAtelier::slotHeaderMenu(const QPoint &pos)
         return;
 
     // Search the associated Atelier
-    QVariant vAtelier = entityTable->property("atelier");
-    if ( ! vAtelier.isValid())
+    Atelier *atelier = tableAtelier(entityTable);
+    if (atelier == 0)
         return;
-    Atelier *atelier = (Atelier *) vAtelier.value<void *>();
 
     QMenu ctxMenu(this);
     QAction *actionAdd = ctxMenu.addAction(tr("Add parameter"));
 
+    // First column holds the Rotation, parameters start at column 1
     QAction *actionRemove = 0;
-    if (selectedColumn >= 0)
+    QAction *actionScale  = 0;
+    QAction *actionOffset = 0;
+    QAction *actionClamp  = 0;
+    QAction *actionSet    = 0;
+    QAction *actionFormula = 0;
+    QList<QAction *> actionKinds;
+    if (selectedColumn >= 1)
     {
         actionRemove = ctxMenu.addAction(tr("Remove parameter"));
-        if (atelier->isParameterMandatory(selectedColumn))
+        if (atelier->isParameterMandatory(selectedColumn - 1))
             actionRemove->setEnabled(false);
+
+        // Operations on the whole column (not for derived parameters)
+        QMenu *columnMenu = ctxMenu.addMenu(tr("Column"));
+        actionScale   = columnMenu->addAction(tr("Scale ..."));
+        actionOffset  = columnMenu->addAction(tr("Offset ..."));
+        actionClamp   = columnMenu->addAction(tr("Clamp ..."));
+        actionSet     = columnMenu->addAction(tr("Set value ..."));
+        actionFormula = columnMenu->addAction(tr("Apply formula ..."));
+        if (atelier->isParameterDerived(selectedColumn - 1))
+            columnMenu->menuAction()->setEnabled(false);
+
+        // Storage kind of the parameter values
+        QMenu *kindMenu = ctxMenu.addMenu(tr("Type"));
+        AtelierColumn::Kind current = atelier->getParameterKind(selectedColumn - 1);
+        for (int k = 0; k < AtelierColumn::KindLast; ++k)
+        {
+            QAction *action = kindMenu->addAction(AtelierColumn::kindName(AtelierColumn::Kind(k)));
+            action->setCheckable(true);
+            action->setChecked(k == current);
+            actionKinds.append(action);
+        }
     }
 
     QAction *selectedAction = ctxMenu.exec(QCursor::pos());
 
+    // Trace only the processing of the selected action, not the menu itself
+    TRACE_SPAN("widgetAtelier::slotHeaderMenu");
+
     // If the menu is closed without any action selected
     if (selectedAction == 0)
     {
@@ -374,42 +989,153 @@ void widgetAtelier::slotHeaderMenu(const QPoint &pos)
         atelier->addParameter("NewParameter", 0);
 
         // Send a message to inform the world that a new parameter has been added
-        emit parameterAdded(atelier, (atelier->countParameter() - 1) );
+        {
+            TRACE_SPAN("widgetAtelier::parameterAdded");
+            emit parameterAdded(atelier, (atelier->countParameter() - 1) );
+        }
 
         // Insert a new column to the table
         QTableWidgetItem *item = new QTableWidgetItem();
         item->setFlags ( Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable );
         item->setText("NewParameter");
-        item->setData(Qt::UserRole, qVariantFromValue((void *)atelier));
         int pos = entityTable->columnCount();
         // Increment the number of columns into table
         entityTable->setColumnCount( pos + 1);
 
         entityTable->setHorizontalHeaderItem(pos, item);
 
+        // Fill the new column (entities already hold the default value)
+        bool blocked = entityTable->blockSignals(true);
         for (int i = 0; i < entityTable->rowCount(); i++)
-        {
-            Atelier *entity = atelier->getEntity(i);
-
-            QTableWidgetItem *item = new QTableWidgetItem("0");
-            entityTable->setItem(i, pos, item);
-
-            // Save a pointer to the entity into cell
-            QVariant vEntity = qVariantFromValue((void *)entity);
-            item->setData(Qt::UserRole, vEntity);
-        }
+            entityTable->setItem(i, pos, new QTableWidgetItem("0"));
+        entityTable->blockSignals(blocked);
     }
     // If the "Remove" action has been selected
     else if (selectedAction == actionRemove)
     {
         // Delete the requested parameter into the Atelier
-        atelier->delParameter(selectedColumn);
+        if ( ! atelier->delParameter(selectedColumn - 1))
+        {
+            QMessageBox::warning(this, atelier->getParameterName(selectedColumn - 1),
+                                 tr("A formula uses this parameter"));
+            return;
+        }
         // Remove the selected column into the table widget
         entityTable->removeColumn(selectedColumn);
 
         // Send a message to inform the world that a parameter has been deleted
-        emit parameterDeleted(atelier, selectedColumn);
+        TRACE_SPAN("widgetAtelier::parameterDeleted");
+        emit parameterDeleted(atelier, selectedColumn - 1);
+    }
+    // Operations on the whole column
+    else if (selectedAction == actionScale)
+        columnOperation(entityTable, selectedColumn - 1, Atelier::ColumnScale);
+    else if (selectedAction == actionOffset)
+        columnOperation(entityTable, selectedColumn - 1, Atelier::ColumnOffset);
+    else if (selectedAction == actionClamp)
+        columnOperation(entityTable, selectedColumn - 1, Atelier::ColumnClamp);
+    else if (selectedAction == actionSet)
+        columnOperation(entityTable, selectedColumn - 1, Atelier::ColumnSet);
+    else if (selectedAction == actionFormula)
+        columnFormula(entityTable, selectedColumn - 1);
+    // A new storage kind has been selected
+    else if (actionKinds.contains(selectedAction))
+    {
+        int index = selectedColumn - 1;
+        AtelierColumn::Kind kind = AtelierColumn::Kind(actionKinds.indexOf(selectedAction));
+        if (kind == atelier->getParameterKind(index))
+            return;
+        if ( ! atelier->setParameterKind(index, kind))
+        {
+            QMessageBox::warning(this, atelier->getParameterName(index),
+                                 tr("Too many distinct values for an enum"));
+            return;
+        }
+        // Values have been converted
+        refreshValues(entityTable, 0, atelier->countEntity());
+
+        TRACE_SPAN("widgetAtelier::parameterKindChanged");
+        emit parameterKindChanged(atelier, index);
+    }
+}
+
+/**
+ * @brief Ask the arguments of a column operation, then apply it
+ *
+ * @param table Pointer to the table widget
+ * @param index Index of the parameter
+ * @param op    Operation to apply
+ */
+void widgetAtelier::columnOperation(QTableWidget *table, int index, Atelier::ColumnOp op)
+{
+    Atelier *atelier = tableAtelier(table);
+    QString name = atelier->getParameterName(index);
+    bool ok = false;
+    double a = 0;
+    double b = 0;
+
+    if (op == Atelier::ColumnClamp)
+    {
+        a = QInputDialog::getDouble(this, name, tr("Minimum"), 0,
+                                    -1e12, 1e12, 6, &ok);
+        if ( ! ok)
+            return;
+        b = QInputDialog::getDouble(this, name, tr("Maximum"), a,
+                                    a, 1e12, 6, &ok);
+    }
+    else if (op == Atelier::ColumnScale)
+        a = QInputDialog::getDouble(this, name, tr("Factor"), 1,
+                                    -1e12, 1e12, 6, &ok);
+    else if (op == Atelier::ColumnOffset)
+        a = QInputDialog::getDouble(this, name, tr("Offset"), 0,
+                                    -1e12, 1e12, 6, &ok);
+    else
+        a = QInputDialog::getDouble(this, name, tr("Value"), 0,
+                                    -1e12, 1e12, 6, &ok);
+    if ( ! ok)
+        return;
+
+    if ( ! atelier->applyColumn(index, op, a, b))
+    {
+        if (atelier->getParameterKind(index) == AtelierColumn::KindEnum)
+            QMessageBox::warning(this, name, tr("Too many distinct values for an enum"));
+        return;
+    }
+
+    TRACE_SPAN("widgetAtelier::columnOperation");
+    if (atelier->countEntity())
+        blockChanged(table, 0, index, atelier->countEntity(), 1);
+}
+
+/**
+ * @brief Ask a formula, then use it to set a whole column
+ *
+ * @param table Pointer to the table widget
+ * @param index Index of the parameter
+ */
+void widgetAtelier::columnFormula(QTableWidget *table, int index)
+{
+    Atelier *atelier = tableAtelier(table);
+    QString name = atelier->getParameterName(index);
+    bool ok = false;
+
+    QString formula = QInputDialog::getText(this, name, tr("Formula"),
+                                            QLineEdit::Normal, name, &ok);
+    if (( ! ok) || formula.isEmpty())
+        return;
+
+    if ( ! atelier->applyColumnFormula(index, formula))
+    {
+        if (atelier->getParameterKind(index) == AtelierColumn::KindEnum)
+            QMessageBox::warning(this, name, tr("Invalid formula, or too many distinct values for an enum : %1").arg(formula));
+        else
+            QMessageBox::warning(this, name, tr("Invalid formula : %1").arg(formula));
+        return;
     }
+
+    TRACE_SPAN("widgetAtelier::columnFormula");
+    if (atelier->countEntity())
+        blockChanged(table, 0, index, atelier->countEntity(), 1);
 }
 
 /**
@@ -428,6 +1154,9 @@ void widgetAtelier::slotNamesEdit(int index)
 
     QTableWidget *entityTable = qobject_cast<QTableWidget*>( headerView->parent() );
     QTableWidgetItem *item = entityTable->verticalHeaderItem(index);
+    // The row may not be filled yet (progressive setup)
+    if (item == 0)
+        return;
 
     // Test if this entity name can be modified
     if ( ! (item->flags() & Qt::ItemIsEditable))
@@ -443,7 +1172,6 @@ void widgetAtelier::slotNamesEdit(int index)
     editor->move(0, editorY);
     // Save a copy of the column index
     editor->setProperty("index", QVariant(index));
-    editor->setProperty("tableWidget", qVariantFromValue((void *)entityTable));
 
     // Catch the end-of-edition event
     QObject::connect(editor, SIGNAL(editingFinished()),
@@ -465,28 +1193,30 @@ void widgetAtelier::slotNamesEdit(int index)
  */
 void widgetAtelier::slotNamesEditEnd (void)
 {
+    TRACE_SPAN("widgetAtelier::slotNamesEditEnd");
+
     QLineEdit *editor = qobject_cast<QLineEdit*>( sender() );
     if (editor == 0)
         return;
 
-    QVariant vTable = editor->property("tableWidget");
+    // Get the table widget
+    QTableWidget *entityTable = editorTable(editor);
     QVariant vIndex = editor->property("index");
-    if ( (vIndex.isValid() == false) || (vTable.isValid() == false) )
+    if ( (vIndex.isValid() == false) || (entityTable == 0) )
         return;
 
-    // Get the table widget
-    QTableWidget *entityTable = (QTableWidget *) vTable.value<void *>();
+    int row = vIndex.toInt();
     // Get the item of the selected entity header
-    QTableWidgetItem *item = entityTable->verticalHeaderItem(vIndex.toInt());
+    QTableWidgetItem *item = entityTable->verticalHeaderItem(row);
 
-    // Get a pointer to the entity hitself
-    QVariant vEntity = item->data(Qt::UserRole);
-    if ( ! vEntity.isValid())
+    // Get a pointer to the entity hitself (one entity per row)
+    Atelier *atelier = tableAtelier(entityTable);
+    if ((atelier == 0) || (row >= atelier->countEntity()))
     {
         delete editor;
         return;
     }
-    Atelier *entity = (Atelier *)vEntity.value<void *>();
+    Atelier *entity = atelier->getEntity(row);
 
     // Update the entity name into the Atelier
     entity->setName(editor->text());
@@ -494,7 +1224,10 @@ void widgetAtelier::slotNamesEditEnd (void)
     item->setText( editor->text() );
 
     // Send a message to inform the world that an entity has been renamed
-    emit entityNameChanged(entity);
+    {
+        TRACE_SPAN("widgetAtelier::entityNameChanged");
+        emit entityNameChanged(entity);
+    }
 
     delete editor;
 }
@@ -515,10 +1248,9 @@ void widgetAtelier::slotNamesMenu(const QPoint &pos)
         return;
 
     // Search the associated Atelier
-    QVariant vAtelier = entityTable->property("atelier");
-    if ( ! vAtelier.isValid())
+    Atelier *atelier = tableAtelier(entityTable);
+    if (atelier == 0)
         return;
-    Atelier *atelier = (Atelier *) vAtelier.value<void *>();
 
     int selectedRow = headerView->logicalIndexAt(pos);
 
@@ -530,6 +1262,9 @@ void widgetAtelier::slotNamesMenu(const QPoint &pos)
 
     QAction *selectedAction = ctxMenu.exec(QCursor::pos());
 
+    // Trace only the processing of the selected action, not the menu itself
+    TRACE_SPAN("widgetAtelier::slotNamesMenu");
+
     // If the menu is closed without any action selected
     if (selectedAction == 0)
     {
@@ -542,7 +1277,10 @@ void widgetAtelier::slotNamesMenu(const QPoint &pos)
         entity->setName("NewEntity");
 
         // Send a message to inform the world that a new entity has been added
-        emit entityAdded(atelier, (atelier->countEntity() - 1));
+        {
+            TRACE_SPAN("widgetAtelier::entityAdded");
+            emit entityAdded(atelier, (atelier->countEntity() - 1));
+        }
 
         addEntity(entityTable, entity);
     }
@@ -553,15 +1291,19 @@ void widgetAtelier::slotNamesMenu(const QPoint &pos)
         atelier->removeEntity(selectedRow);
         // Remove the selected entity from table
         entityTable->removeRow(selectedRow);
+        // Keep the progressive fill position in sync with the rows
+        if (mFillNext.contains(entityTable) && (selectedRow < mFillNext.value(entityTable)))
+            mFillNext[entityTable]--;
 
         // Send a message to inform the world that an entity has been deleted
+        TRACE_SPAN("widgetAtelier::entityDeleted");
         emit entityDeleted(atelier, selectedRow);
     }
 }
 
-widgetAtelierDelegate::widgetAtelierDelegate(QObject *parent) : QStyledItemDelegate(parent)
+widgetAtelierDelegate::widgetAtelierDelegate(Atelier *atelier, QObject *parent) : QStyledItemDelegate(parent)
 {
-    // Nothing to do
+    mAtelier = atelier;
 }
 
 QWidget *widgetAtelierDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
@@ -592,11 +1334,10 @@ void widgetAtelierDelegate::setEditorData(QWidget *editor, const QModelIndex &in
     }
     else if (combo)
     {
-        // Get the Entity associated with selected item
-        QVariant vEntity = index.model()->data(index, Qt::UserRole);
-        if ( ! vEntity.isValid())
+        // Get the Entity associated with selected row
+        if (index.row() >= mAtelier->countEntity())
             return;
-        Atelier *entity = (Atelier *) vEntity.value<void *>();
+        Atelier *entity = mAtelier->getEntity(index.row());
         // Get the exploitation that owns this entity
         Exploitation *e = entity->getExploitation();
         if (e == 0)
@@ -610,7 +1351,8 @@ void widgetAtelierDelegate::setEditorData(QWidget *editor, const QModelIndex &in
         for (uint i = 0; i < e->countRotation(); ++i)
         {
             Rotation *rot = e->getRotation(i);
-            combo->addItem(rot->getName());
+            // Save the Rotation identifier with his name
+            combo->addItem(rot->getName(), rot->getId());
             // If this rotation is the currently selected
             if (currentRot == rot)
                 // Save the index, to preselect it after this loop
@@ -640,22 +1382,18 @@ void widgetAtelierDelegate::setModelData(QWidget *editor, QAbstractItemModel *mo
         if (selectedIndex < 0)
             return;
 
-        // Get the Entity associated with current edited cell
-        QVariant vEntity = index.model()->data(index, Qt::UserRole);
-        if ( ! vEntity.isValid())
-            return;
-        Atelier *entity = (Atelier *) vEntity.value<void *>();
-        // Get the exploitation that owns this entity
-        Exploitation *e = entity->getExploitation();
+        // Get the exploitation that owns the edited Atelier
+        Exploitation *e = mAtelier->getExploitation();
         if (e == 0)
             return;
 
-        // Get the rotation at the index of the combobox selection
-        Rotation *rot = e->getRotation(selectedIndex);
+        // Get the rotation identified by the combobox selection
+        uint rotId = combo->itemData(selectedIndex).toUInt();
+        Rotation *rot = e->getRotationById(rotId);
         if (rot == 0)
             return;
         // Update table item with the selected rotation
         model->setData(index, rot->getName());
-        model->setData(index, qVariantFromValue((void *)rot), Qt::UserRole+1);
+        model->setData(index, rot->getId(), Qt::UserRole);
     }
 }
@@ -8,10 +8,13 @@
 #ifndef WIDGETATELIER_H
 #define WIDGETATELIER_H
 
+#include <QHash>
 #include <QModelIndex>
 #include <QPoint>
 #include <QTableWidget>
 #include <QTabWidget>
+#include <QTimer>
+#include <QVector>
 #include <QWidget>
 #include "data-model/exploitation.h"
 
@@ -20,11 +23,27 @@ class widgetAtelier : public QWidget
     Q_OBJECT
 public:
     explicit widgetAtelier(QWidget *parent = 0);
+    void     memoryUsage(MemoryUsage &usage);
     bool     setup(Exploitation *exploitation);
+    void     setCellSignals(bool enable);
+    void     setFillBatch(int rows);
 protected:
     void addEntity(QTableWidget *table, Atelier *entity);
+    void fillRow  (QTableWidget *table, int row, Atelier *entity);
 private:
     void addTab(Atelier *atelier);
+    QTableWidget *currentTable(void);
+    void          blockChanged(QTableWidget *table, int row, int index,
+                               int rows, int columns);
+    void          columnFormula  (QTableWidget *table, int index);
+    void          columnOperation(QTableWidget *table, int index, Atelier::ColumnOp op);
+    QTableWidget *editorTable(QWidget *editor);
+    bool          selectedBlock(QTableWidget *table, int &row, int &column,
+                                int &rows, int &columns);
+    void          setBlock(QTableWidget *table, int row, int column,
+                           int rows, int columns, const QVector<double> &values);
+    void          refreshValues(QTableWidget *table, int row, int rows);
+    Atelier      *tableAtelier(QTableWidget *table);
 
 signals:
     void entityAdded         (Atelier *atelier, int index);
@@ -32,14 +51,23 @@ signals:
     void entityNameChanged   (Atelier *entity);
     void entityRotationChanged(Atelier *entity);
     void entityValueChanged  (Atelier *entity,  int index, double value);
+    void entityValuesChanged (Atelier *atelier, int row, int index, int rows, int columns);
     void parameterAdded      (Atelier *atelier, int index);
     void parameterDeleted    (Atelier *atelier, int index);
+    void parameterKindChanged(Atelier *atelier, int index);
     void parameterNameChanged(Atelier *atelier, int index);
+    void setupProgress       (int done, int total);
+    void setupFinished       (void);
 
 public slots:
+    void fillDown      (void);
+    void fillSeries    (void);
+    void pasteClipboard(void);
 
 private slots:
     void slotCellChanged  (int row, int column);
+    void slotCellMenu     (const QPoint &pos);
+    void slotFillBatch    (void);
     void slotHeaderEdit   (int index);
     void slotHeaderEditEnd(void);
     void slotHeaderMenu   (const QPoint &pos);
@@ -49,6 +77,14 @@ private slots:
 
 private:
     Exploitation *mExploitation;
+    // Emit one entityValueChanged per cell for block edits (compatibility)
+    bool          mCellSignals;
+    // Progressive fill of the tables (see setFillBatch)
+    QTimer       *mFillTimer;
+    int           mFillBatch;
+    int           mFillDone;
+    int           mFillTotal;
+    QHash<QTableWidget *, int> mFillNext;
 };
 
 #include <QStyledItemDelegate>
@@ -58,10 +94,12 @@ class widgetAtelierDelegate : public QStyledItemDelegate
 Q_OBJECT
 
 public:
-    widgetAtelierDelegate(QObject* parent = 0);
+    widgetAtelierDelegate(Atelier *atelier, QObject* parent = 0);
     QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const;
     void setEditorData(QWidget *editor, const QModelIndex &index) const;
     void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
+private:
+    Atelier *mAtelier;
 };
 
 
@@ -0,0 +1,701 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QHelpEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QToolTip>
+#include <QWheelEvent>
+#include "data-model/trace.h"
+#include "data-model/tree.h"
+#include "rotation/widgetTimeline.h"
+#include "widgetschedule.h"
+
+// Width of one year, in pixels (the last pixel is left blank)
+#define YEAR_WIDTH    12
+// Size of the fixed areas : years header at top, names at left
+#define HEADER_HEIGHT 20
+#define NAME_WIDTH   120
+// Size of a cached tile, in years and in pixel rows
+#define TILE_YEARS    16
+#define TILE_HEIGHT  256
+// Memory allowed to the tiles cache, in KB (each tile is 192 KB)
+#define TILES_CACHE_KB (64 * 1024)
+// Zoom limits : 16 pixels per entity, to 4096 entities per pixel
+#define LEVEL_MIN    -4
+#define LEVEL_MAX    12
+// Color of the years without activity
+#define EMPTY_COLOR  qRgb(238, 238, 238)
+
+/**
+ * @brief Default constructor for the Schedule widget
+ *
+ * @param parent
+ */
+widgetSchedule::widgetSchedule(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    mExploitation = 0;
+    mHorizon      = 50;
+    mLevel        = -2;
+    mRowsValid    = false;
+    mTiles.setMaxCost(TILES_CACHE_KB);
+
+    horizontalScrollBar()->setSingleStep(YEAR_WIDTH);
+}
+
+/**
+ * @brief Add the memory used by the rows and the caches to an estimation
+ *
+ * @param usage Reference to the estimation
+ */
+void widgetSchedule::memoryUsage(MemoryUsage &usage)
+{
+    // Cost of the tiles is in KB
+    qint64 bytes = qint64(mTiles.totalCost()) * 1024;
+    bytes += MemoryUsage::vectorBytes(mRows);
+    bytes += MemoryUsage::hashBytes(mFirstRows.count(), sizeof(Atelier *) + sizeof(int));
+    bytes += MemoryUsage::hashBytes(mSchedules.count(),
+                                    sizeof(Rotation *) + sizeof(QVector<QRgb>));
+    QHash<Rotation *, QVector<QRgb> >::const_iterator it;
+    for (it = mSchedules.constBegin(); it != mSchedules.constEnd(); ++it)
+        bytes += MemoryUsage::vectorBytes(it.value());
+    bytes += MemoryUsage::hashBytes(mScheduleHashes.count(), sizeof(Rotation *) + sizeof(quint64));
+    bytes += MemoryUsage::vectorBytes(mEmpty);
+    usage.add(MemoryUsage::CategoryWidgets, bytes);
+}
+
+/**
+ * @brief Initialize widget for a specific Exploitation
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean True if init success
+ */
+bool widgetSchedule::setup(Exploitation *exploitation)
+{
+    if (exploitation == 0)
+        return false;
+    mExploitation = exploitation;
+
+    mSchedules.clear();
+    mScheduleHashes.clear();
+    invalidateAll();
+    updateScrollBars();
+    viewport()->update();
+
+    return true;
+}
+
+/**
+ * @brief Get the number of years shown by the schedule
+ *
+ * @return integer Number of years
+ */
+int widgetSchedule::getHorizon(void)
+{
+    return mHorizon;
+}
+
+/**
+ * @brief Set the number of years shown by the schedule
+ *
+ * @param years Number of years (at least one)
+ */
+void widgetSchedule::setHorizon(int years)
+{
+    if (years < 1)
+        years = 1;
+    if (years == mHorizon)
+        return;
+    mHorizon = years;
+
+    mSchedules.clear();
+    mScheduleHashes.clear();
+    mTiles.clear();
+    updateScrollBars();
+    viewport()->update();
+}
+
+/**
+ * @brief Get the current level of detail
+ *
+ * @return integer Level (negative when zoomed in, positive when zoomed out)
+ */
+int widgetSchedule::getLevel(void)
+{
+    return mLevel;
+}
+
+/**
+ * @brief Set the level of detail, keep the top row of the view
+ *
+ * @param level New level (bounded to the supported levels)
+ */
+void widgetSchedule::setLevel(int level)
+{
+    zoom(level, 0);
+}
+
+/**
+ * @brief Change the level of detail around a point of the view
+ *
+ * @param level  New level (bounded to the supported levels)
+ * @param anchor Vertical position (into the chart) that stays in place
+ */
+void widgetSchedule::zoom(int level, int anchor)
+{
+    level = qBound(LEVEL_MIN, level, LEVEL_MAX);
+    if (level == mLevel)
+        return;
+
+    // Entity under the anchor, as a fractional row
+    double y   = verticalScrollBar()->value() + anchor;
+    double row = (mLevel < 0) ? (y / (1 << -mLevel)) : (y * (1 << mLevel));
+
+    // Tiles of the other levels stay into the cache
+    mLevel = level;
+    updateScrollBars();
+
+    y = (mLevel < 0) ? (row * (1 << -mLevel)) : (row / (1 << mLevel));
+    verticalScrollBar()->setValue((int)y - anchor);
+    viewport()->update();
+}
+
+// -------------------- Rows --------------------
+
+/**
+ * @brief Make the list of the entities shown, for all the ateliers
+ *
+ */
+void widgetSchedule::buildRows(void)
+{
+    TRACE_SPAN("widgetSchedule::buildRows");
+
+    mRows.clear();
+    mFirstRows.clear();
+    for (uint i = 0; i < mExploitation->countAtelier(); i++)
+    {
+        Atelier *atelier = mExploitation->getAtelier(i);
+        const AtelierTree *tree = atelier->getTree();
+
+        mFirstRows.insert(atelier, mRows.count());
+        // Node 0 is the atelier itself, the other nodes are the entities
+        for (int j = 1; j < tree->count(); j++)
+            mRows.append(tree->getNode(j));
+    }
+    mRowsValid = true;
+}
+
+/**
+ * @brief Get the height of the whole map at current level
+ *
+ * @return integer Height in pixels
+ */
+int widgetSchedule::contentHeight(void)
+{
+    if ( ! mRowsValid)
+        buildRows();
+
+    if (mLevel < 0)
+        return mRows.count() << -mLevel;
+    return (mRows.count() + (1 << mLevel) - 1) >> mLevel;
+}
+
+/**
+ * @brief Get the first row shown at a position of the map
+ *
+ * @param y Vertical position, in pixels from the top of the map
+ * @return integer Index of the row
+ */
+int widgetSchedule::rowAt(int y)
+{
+    return (mLevel < 0) ? (y >> -mLevel) : (y << mLevel);
+}
+
+/**
+ * @brief Forget all the rendered tiles and the list of rows
+ *
+ */
+void widgetSchedule::invalidateAll(void)
+{
+    mTiles.clear();
+    mRows.clear();
+    mFirstRows.clear();
+    mRowsValid = false;
+}
+
+// -------------------- Tiles --------------------
+
+/**
+ * @brief Get the color of each year of the horizon for a Rotation
+ *
+ * @param rot Pointer to the Rotation (may be NULL)
+ * @return Pointer to the colors, by year (index 0 for the first year)
+ */
+const QRgb *widgetSchedule::schedule(Rotation *rot)
+{
+    if (rot == 0)
+    {
+        if (mEmpty.count() != mHorizon)
+            mEmpty.fill(EMPTY_COLOR, mHorizon);
+        return mEmpty.constData();
+    }
+
+    QHash<Rotation *, QVector<QRgb> >::iterator it = mSchedules.find(rot);
+    if (it != mSchedules.end())
+        return it.value().constData();
+
+    // The first active plan of each year gives the color
+    QVector<QRgb> colors(mHorizon, EMPTY_COLOR);
+    QVector<bool> done  (mHorizon, false);
+    for (uint i = 0; i < rot->countPlans(); i++)
+    {
+        ActivityPlan *plan = rot->getPlan(i);
+        for (int year = 0; year < mHorizon; year++)
+        {
+            if (done[year] || ( ! plan->isActive(year + 1)))
+                continue;
+            colors[year] = widgetTimeline::planColor(plan->getName()).rgb();
+            done[year]   = true;
+        }
+    }
+    mScheduleHashes.insert(rot, rot->getHash());
+    return mSchedules.insert(rot, colors).value().constData();
+}
+
+/**
+ * @brief Forget the schedules of the Rotations modified since they were made
+ *
+ * The Rotations are compared by content hash, so a change of plans or
+ * duration is seen even when no signal tells it (and a removed Rotation is
+ * never read again). The tiles use the old colors, they are dropped too.
+ */
+void widgetSchedule::checkSchedules(void)
+{
+    if (mScheduleHashes.isEmpty())
+        return;
+
+    int found = 0;
+    for (uint i = 0; i < mExploitation->countRotation(); i++)
+    {
+        Rotation *rot = mExploitation->getRotation(i);
+        QHash<Rotation *, quint64>::const_iterator it = mScheduleHashes.constFind(rot);
+        if (it == mScheduleHashes.constEnd())
+            continue;
+        if (it.value() != rot->getHash())
+            break;
+        found++;
+    }
+    if (found == mScheduleHashes.count())
+        return;
+
+    mSchedules.clear();
+    mScheduleHashes.clear();
+    mTiles.clear();
+}
+
+/**
+ * @brief Get a tile of the map at current level, render it if needed
+ *
+ * @param rowBlock  Index of the block of pixel rows
+ * @param yearBlock Index of the block of years
+ * @return Pointer to the tile image (owned by the cache)
+ */
+QImage *widgetSchedule::tile(int rowBlock, int yearBlock)
+{
+    quint64 key = ((quint64)(mLevel - LEVEL_MIN) << 48) |
+                  ((quint64)rowBlock << 16) | (quint16)yearBlock;
+
+    QImage *image = mTiles.object(key);
+    if (image)
+        return image;
+
+    image = new QImage(TILE_YEARS * YEAR_WIDTH, TILE_HEIGHT, QImage::Format_RGB32);
+    renderTile(image, rowBlock, yearBlock);
+    mTiles.insert(key, image, (image->bytesPerLine() * TILE_HEIGHT) / 1024);
+
+    return image;
+}
+
+/**
+ * @brief Draw a block of the map at current level
+ *
+ * Each pixel row shows one entity (zoom in) or the mean color of a group
+ * of entities (zoom out). Rows are written directly into the image.
+ *
+ * @param image     Pointer to the tile to draw
+ * @param rowBlock  Index of the block of pixel rows
+ * @param yearBlock Index of the block of years
+ */
+void widgetSchedule::renderTile(QImage *image, int rowBlock, int yearBlock)
+{
+    TRACE_SPAN("widgetSchedule::renderTile");
+
+    image->fill(Qt::white);
+
+    int firstYear = yearBlock * TILE_YEARS;
+    int years     = qMin(TILE_YEARS, mHorizon - firstYear);
+    int rows      = mRows.count();
+    int group     = (mLevel > 0) ? (1 << mLevel) : 1;
+    int height    = (mLevel < 0) ? (1 << -mLevel) : 1;
+
+    QVector<QRgb> line(years);
+    QVector<int>  red(years), green(years), blue(years);
+    int lastRow = -1;
+
+    for (int py = 0; py < TILE_HEIGHT; py++)
+    {
+        int first = rowAt((rowBlock * TILE_HEIGHT) + py);
+        if (first >= rows)
+            break;
+
+        QRgb *pixels = reinterpret_cast<QRgb *>(image->scanLine(py));
+
+        // Zoom in : keep a blank line between the entities
+        if ((height >= 4) && ((((rowBlock * TILE_HEIGHT) + py + 1) % height) == 0))
+            continue;
+
+        if (first != lastRow)
+        {
+            lastRow = first;
+            int last = qMin(first + group, rows);
+            if (group == 1)
+            {
+                const QRgb *colors = schedule(mRows.at(first)->getRotation());
+                for (int i = 0; i < years; i++)
+                    line[i] = colors[firstYear + i];
+            }
+            else
+            {
+                // Zoom out : mean color of the group (entities often share
+                // the same Rotation, the last schedule is kept)
+                red  .fill(0);
+                green.fill(0);
+                blue .fill(0);
+                Rotation   *lastRot = 0;
+                const QRgb *colors  = schedule(0);
+                for (int row = first; row < last; row++)
+                {
+                    Rotation *rot = mRows.at(row)->getRotation();
+                    if (rot != lastRot)
+                    {
+                        colors  = schedule(rot);
+                        lastRot = rot;
+                    }
+                    for (int i = 0; i < years; i++)
+                    {
+                        QRgb c = colors[firstYear + i];
+                        red  [i] += qRed  (c);
+                        green[i] += qGreen(c);
+                        blue [i] += qBlue (c);
+                    }
+                }
+                int n = last - first;
+                for (int i = 0; i < years; i++)
+                    line[i] = qRgb(red[i] / n, green[i] / n, blue[i] / n);
+            }
+        }
+
+        for (int i = 0; i < years; i++)
+        {
+            QRgb *cell = pixels + (i * YEAR_WIDTH);
+            for (int x = 0; x < YEAR_WIDTH - 1; x++)
+                cell[x] = line[i];
+        }
+    }
+}
+
+// -------------------- Events --------------------
+
+/**
+ * @brief Draw the visible part of the schedule
+ *
+ * @param event Paint event, with the area to repaint
+ */
+void widgetSchedule::paintEvent(QPaintEvent *event)
+{
+    TRACE_SPAN("widgetSchedule::paintEvent");
+
+    QPainter painter(viewport());
+    QRect area = event->rect();
+    painter.fillRect(area, Qt::white);
+    if (mExploitation == 0)
+        return;
+    checkSchedules();
+
+    int x0     = horizontalScrollBar()->value();
+    int y0     = verticalScrollBar()->value();
+    int width  = viewport()->width();
+    int height = viewport()->height();
+    int bottom = contentHeight() - 1;
+
+    // Visible part of the map, in pixels
+    int left   = qMax(area.left() - NAME_WIDTH, 0) + x0;
+    int right  = qMin(area.right() - NAME_WIDTH + x0, (mHorizon * YEAR_WIDTH) - 1);
+    int top    = qMax(area.top() - HEADER_HEIGHT, 0) + y0;
+    int last   = qMin(area.bottom() - HEADER_HEIGHT + y0, bottom);
+
+    // Map : copy the visible tiles
+    if ((left <= right) && (top <= last))
+    {
+        painter.save();
+        painter.setClipRect(QRect(NAME_WIDTH, HEADER_HEIGHT,
+                                  width - NAME_WIDTH, height - HEADER_HEIGHT));
+        for (int rb = top / TILE_HEIGHT; rb <= last / TILE_HEIGHT; rb++)
+        {
+            for (int yb = left / (TILE_YEARS * YEAR_WIDTH); yb <= right / (TILE_YEARS * YEAR_WIDTH); yb++)
+            {
+                int x = NAME_WIDTH    + (yb * TILE_YEARS * YEAR_WIDTH) - x0;
+                int y = HEADER_HEIGHT + (rb * TILE_HEIGHT) - y0;
+                painter.drawImage(x, y, *tile(rb, yb));
+            }
+        }
+        painter.restore();
+    }
+
+    // Header : number of the visible years (one label every 5 years)
+    painter.fillRect(0, 0, width, HEADER_HEIGHT, QColor(232, 232, 232));
+    painter.setPen(Qt::black);
+    for (int i = left / YEAR_WIDTH; i <= right / YEAR_WIDTH; i++)
+    {
+        if (((i + 1) % 5) != 0)
+            continue;
+        int x = NAME_WIDTH + (i * YEAR_WIDTH) - x0;
+        painter.drawText(QRect(x - YEAR_WIDTH, 0, YEAR_WIDTH * 3, HEADER_HEIGHT),
+                         Qt::AlignCenter, QString::number(i + 1));
+    }
+
+    // Names : entities when rows are high enough, else the ateliers
+    painter.fillRect(0, HEADER_HEIGHT, NAME_WIDTH, height, QColor(240, 240, 240));
+    painter.setClipRect(QRect(0, HEADER_HEIGHT, NAME_WIDTH, height - HEADER_HEIGHT));
+    if (mLevel <= LEVEL_MIN)
+    {
+        int rowHeight = 1 << -mLevel;
+        for (int row = rowAt(top); (row < mRows.count()) && (row <= rowAt(last)); row++)
+        {
+            int y = HEADER_HEIGHT + (row * rowHeight) - y0;
+            painter.drawText(QRect(4, y, NAME_WIDTH - 8, rowHeight), Qt::AlignLeft | Qt::AlignVCenter,
+                             mRows.at(row)->getName());
+        }
+    }
+    else
+    {
+        QHash<Atelier *, int>::const_iterator it;
+        for (it = mFirstRows.constBegin(); it != mFirstRows.constEnd(); ++it)
+        {
+            int y = (mLevel < 0) ? (it.value() << -mLevel) : (it.value() >> mLevel);
+            y += HEADER_HEIGHT - y0;
+            if ((y < HEADER_HEIGHT - 20) || (y > height))
+                continue;
+            painter.drawLine(0, y, NAME_WIDTH, y);
+            painter.drawText(QRect(4, y, NAME_WIDTH - 8, 20), Qt::AlignLeft | Qt::AlignVCenter,
+                             it.key()->getName());
+        }
+    }
+}
+
+/**
+ * @brief Called when the widget is resized, update the scroll ranges
+ *
+ * @param event Resize event
+ */
+void widgetSchedule::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+/**
+ * @brief Called when the view is scrolled, the tiles are simply copied again
+ *
+ * @param dx Horizontal move (unused)
+ * @param dy Vertical move (unused)
+ */
+void widgetSchedule::scrollContentsBy(int dx, int dy)
+{
+    (void)dx;
+    (void)dy;
+    viewport()->update();
+}
+
+/**
+ * @brief Handle the tooltip events of the viewport (activity under the mouse)
+ *
+ * @param event Event received by the viewport
+ * @return boolean True if the event has been handled
+ */
+bool widgetSchedule::viewportEvent(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip)
+    {
+        QHelpEvent *help = static_cast<QHelpEvent *>(event);
+        QString text = toolTipText(help->pos());
+        if (text.isEmpty())
+            QToolTip::hideText();
+        else
+            QToolTip::showText(help->globalPos(), text, viewport());
+        return true;
+    }
+    return QAbstractScrollArea::viewportEvent(event);
+}
+
+/**
+ * @brief Mouse wheel : zoom with the Control key, else scroll
+ *
+ * @param event Wheel event
+ */
+void widgetSchedule::wheelEvent(QWheelEvent *event)
+{
+    if ( ! (event->modifiers() & Qt::ControlModifier))
+    {
+        QAbstractScrollArea::wheelEvent(event);
+        return;
+    }
+
+    int anchor = qMax(event->pos().y() - HEADER_HEIGHT, 0);
+    if (event->angleDelta().y() > 0)
+        zoom(mLevel - 1, anchor);
+    else if (event->angleDelta().y() < 0)
+        zoom(mLevel + 1, anchor);
+    event->accept();
+}
+
+/**
+ * @brief Get the description of the activity at a position of the viewport
+ *
+ * @param pos Position into the viewport
+ * @return Text for the tooltip (empty if no entity here)
+ */
+QString widgetSchedule::toolTipText(const QPoint &pos)
+{
+    if ((mExploitation == 0) || (pos.x() < NAME_WIDTH) || (pos.y() < HEADER_HEIGHT))
+        return QString();
+
+    int row = rowAt(pos.y() - HEADER_HEIGHT + verticalScrollBar()->value());
+    int col = (pos.x() - NAME_WIDTH + horizontalScrollBar()->value()) / YEAR_WIDTH;
+    if ((row >= mRows.count()) || (col >= mHorizon))
+        return QString();
+
+    Atelier  *entity = mRows.at(row);
+    Rotation *rot    = entity->getRotation();
+    QString text = tr("%1 (%2) - année %3").arg(entity->getName())
+                                           .arg(entity->getRoot()->getName())
+                                           .arg(col + 1);
+    if (mLevel > 0)
+        text += tr("\n%1 entités par ligne").arg(1 << mLevel);
+    if (rot == 0)
+        return text;
+
+    text += "\n" + rot->getName() + " :";
+    for (uint i = 0; i < rot->countPlans(); i++)
+    {
+        ActivityPlan *plan = rot->getPlan(i);
+        if (plan->isActive(col + 1))
+            text += "\n" + plan->getName();
+    }
+    return text;
+}
+
+/**
+ * @brief Update the range of the scroll bars for the current content
+ *
+ */
+void widgetSchedule::updateScrollBars(void)
+{
+    int content = mExploitation ? contentHeight() : 0;
+    int w = viewport()->width()  - NAME_WIDTH;
+    int h = viewport()->height() - HEADER_HEIGHT;
+
+    horizontalScrollBar()->setPageStep(w);
+    horizontalScrollBar()->setRange(0, qMax((mHorizon * YEAR_WIDTH) - w, 0));
+    verticalScrollBar()->setPageStep(h);
+    verticalScrollBar()->setSingleStep((mLevel < 0) ? (1 << -mLevel) : 1);
+    verticalScrollBar()->setRange(0, qMax(content - h, 0));
+}
+
+// -------------------- Slots --------------------
+
+/**
+ * @brief Slot called when an entity has been added to an Atelier
+ *
+ * The rows of the following ateliers move, so all tiles are rendered again.
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Row of the new entity into the Atelier
+ */
+void widgetSchedule::slotEntityAdded(Atelier *atelier, int index)
+{
+    (void)atelier;
+    (void)index;
+    invalidateAll();
+    updateScrollBars();
+    viewport()->update();
+}
+
+/**
+ * @brief Slot called when an entity has been removed from an Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Old row of the entity into the Atelier
+ */
+void widgetSchedule::slotEntityDeleted(Atelier *atelier, int index)
+{
+    (void)atelier;
+    (void)index;
+    invalidateAll();
+    updateScrollBars();
+    viewport()->update();
+}
+
+/**
+ * @brief Slot called when an entity is renamed (names are not cached)
+ *
+ * @param entity Pointer to the renamed entity
+ */
+void widgetSchedule::slotEntityNameChanged(Atelier *entity)
+{
+    (void)entity;
+    viewport()->update(0, HEADER_HEIGHT, NAME_WIDTH, viewport()->height());
+}
+
+/**
+ * @brief Slot called when the Rotation of an entity is modified
+ *
+ * Only the tiles that contain this entity are rendered again, at all the
+ * levels of detail.
+ *
+ * @param entity Pointer to the modified entity
+ */
+void widgetSchedule::slotEntityRotationChanged(Atelier *entity)
+{
+    if ((mExploitation == 0) || ( ! mRowsValid))
+        return;
+
+    Atelier *atelier = entity->getRoot();
+    if ( ! mFirstRows.contains(atelier))
+        return;
+    int row = mFirstRows.value(atelier) + atelier->getTree()->indexOf(entity) - 1;
+
+    int yearBlocks = (mHorizon + TILE_YEARS - 1) / TILE_YEARS;
+    for (int level = LEVEL_MIN; level <= LEVEL_MAX; level++)
+    {
+        // Pixel rows of the entity at this level
+        int first = (level < 0) ? (row << -level) : (row >> level);
+        int last  = (level < 0) ? (first + (1 << -level) - 1) : first;
+        for (int rb = first / TILE_HEIGHT; rb <= last / TILE_HEIGHT; rb++)
+        {
+            for (int yb = 0; yb < yearBlocks; yb++)
+                mTiles.remove(((quint64)(level - LEVEL_MIN) << 48) |
+                              ((quint64)rb << 16) | (quint16)yb);
+        }
+    }
+
+    // Repaint the pixel rows of the entity (if visible)
+    int y = (mLevel < 0) ? (row << -mLevel) : (row >> mLevel);
+    y += HEADER_HEIGHT - verticalScrollBar()->value();
+    viewport()->update(0, y, viewport()->width(), (mLevel < 0) ? (1 << -mLevel) : 1);
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef WIDGETSCHEDULE_H
+#define WIDGETSCHEDULE_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+#include "data-model/exploitation.h"
+
+/*
+ * The schedule is a heatmap of the activity of each entity (rows, all the
+ * ateliers one after the other) for each year (columns). A cell has the
+ * color of the ActivityPlan performed this year by the Rotation of the
+ * entity.
+ *
+ * The zoom is a level of detail : at negative levels a row is 2^-level
+ * pixels high, at positive levels one pixel shows the mean color of 2^level
+ * entities. The map is rendered by tiles for each level, kept into a cache,
+ * so scrolling only copies the visible tiles.
+ */
+class widgetSchedule : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    explicit widgetSchedule(QWidget *parent = 0);
+    int      getHorizon(void);
+    int      getLevel  (void);
+    void     setHorizon(int years);
+    void     setLevel  (int level);
+    void     memoryUsage(MemoryUsage &usage);
+    bool     setup(Exploitation *exploitation);
+
+public slots:
+    void slotEntityAdded          (Atelier *atelier, int index);
+    void slotEntityDeleted        (Atelier *atelier, int index);
+    void slotEntityNameChanged    (Atelier *entity);
+    void slotEntityRotationChanged(Atelier *entity);
+
+protected:
+    void paintEvent (QPaintEvent  *event);
+    void resizeEvent(QResizeEvent *event);
+    void scrollContentsBy(int dx, int dy);
+    bool viewportEvent(QEvent *event);
+    void wheelEvent (QWheelEvent  *event);
+
+private:
+    void    buildRows    (void);
+    void    checkSchedules(void);
+    int     contentHeight(void);
+    void    invalidateAll(void);
+    void    renderTile   (QImage *image, int rowBlock, int yearBlock);
+    int     rowAt        (int y);
+    const QRgb *schedule (Rotation *rot);
+    QImage *tile         (int rowBlock, int yearBlock);
+    QString toolTipText  (const QPoint &pos);
+    void    updateScrollBars(void);
+    void    zoom         (int level, int anchor);
+private:
+    Exploitation *mExploitation;
+    int           mHorizon;
+    int           mLevel;
+    // Entities shown (all ateliers), and first row of each atelier
+    QVector<Atelier *>    mRows;
+    QHash<Atelier *, int> mFirstRows;
+    bool                  mRowsValid;
+    // Color of each year for each Rotation (and for no Rotation), with the
+    // content hash of the Rotation when its colors were computed
+    QHash<Rotation *, QVector<QRgb> > mSchedules;
+    QHash<Rotation *, quint64>        mScheduleHashes;
+    QVector<QRgb>         mEmpty;
+    // Rendered tiles, by level, row block and year block
+    QCache<quint64, QImage> mTiles;
+};
+
+#endif // WIDGETSCHEDULE_H
@@ -0,0 +1,69 @@
+##
+ # This file is part of VLE, a framework for multi-modeling,
+ # simulation and analysis of complex dynamical systems.
+ # http://www.vle-project.org
+ #
+ # Copyright (c) 2016 Agilack
+
+QT       += core
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = batch
+TEMPLATE = app
+
+INCLUDEPATH += ../
+
+# Uncomment to enable data-model instrumentation counters
+#DEFINES += VLE_EA_INSTRUMENT
+
+SOURCES += main.cpp \
+        batchRunner.cpp \
+        patchCheck.cpp \
+        snapshotStress.cpp \
+        ../data-model/exploitation.cpp \
+        ../data-model/atelier.cpp \
+        ../data-model/analyzer.cpp \
+        ../data-model/changelog.cpp \
+        ../data-model/column.cpp \
+        ../data-model/expression.cpp \
+        ../data-model/hash.cpp \
+        ../data-model/rotation.cpp \
+        ../data-model/parameter.cpp \
+        ../data-model/patch.cpp \
+        ../data-model/memoryusage.cpp \
+        ../data-model/montecarlo.cpp \
+        ../data-model/optimizer.cpp \
+        ../data-model/reader.cpp \
+        ../data-model/seriesreader.cpp \
+        ../data-model/snapshot.cpp \
+        ../data-model/timeseries.cpp \
+        ../data-model/tree.cpp \
+        ../data-model/vpzwriter.cpp \
+        ../data-model/instrument.cpp
+
+HEADERS  += batchRunner.h \
+            patchCheck.h \
+            snapshotStress.h \
+            ../data-model/exploitation.h \
+            ../data-model/atelier.h \
+            ../data-model/analyzer.h \
+            ../data-model/changelog.h \
+            ../data-model/column.h \
+            ../data-model/expression.h \
+            ../data-model/hash.h \
+            ../data-model/rotation.h \
+            ../data-model/parameter.h \
+            ../data-model/patch.h \
+            ../data-model/memoryusage.h \
+            ../data-model/montecarlo.h \
+            ../data-model/optimizer.h \
+            ../data-model/reader.h \
+            ../data-model/seriesreader.h \
+            ../data-model/snapshot.h \
+            ../data-model/timeseries.h \
+            ../data-model/tree.h \
+            ../data-model/vpzwriter.h \
+            ../data-model/instrument.h
@@ -0,0 +1,282 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QVector>
+#include "data-model/analyzer.h"
+#include "data-model/reader.h"
+#include "data-model/tree.h"
+#include "data-model/vpzwriter.h"
+#include "batchRunner.h"
+
+/**
+ * @brief Default constructor for the batch runner
+ *
+ * @param output Pointer to the device where results are written
+ */
+BatchRunner::BatchRunner(QIODevice *output)
+{
+    mOutput     = output;
+    mSlots      = 0;
+    mMaxPending = 2 * QThread::idealThreadCount();
+    mFailed     = 0;
+    mProcessed  = 0;
+}
+
+/**
+ * @brief Get the number of scenarios that can't be loaded
+ *
+ * @return integer Number of failed scenarios
+ */
+int BatchRunner::countFailed(void)
+{
+    return mFailed;
+}
+
+/**
+ * @brief Get the number of scenarios processed (failed or not)
+ *
+ * @return integer Number of processed scenarios
+ */
+int BatchRunner::countProcessed(void)
+{
+    return mProcessed;
+}
+
+/**
+ * @brief Process all scenarios found into a list of files or directories
+ *
+ * Scenarios are read and evaluated by the worker pool. The number of
+ * Exploitation(s) alive at the same time is bounded by the "max pending"
+ * value, so memory usage does not depend on the number of files.
+ *
+ * @param paths List of scenario files and/or directories to scan
+ * @return boolean True if all scenarios have been processed successfully
+ */
+bool BatchRunner::run(const QStringList &paths)
+{
+    mSlots = new QSemaphore(mMaxPending);
+
+    for (int i = 0; i < paths.count(); ++i)
+    {
+        QFileInfo info(paths.at(i));
+        if (info.isDir())
+        {
+            QDirIterator it(paths.at(i), QStringList() << "*.xml",
+                            QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                submit(it.next());
+        }
+        else
+            submit(paths.at(i));
+    }
+
+    // Wait the end of the last scenarios
+    mPool.waitForDone();
+
+    delete mSlots;
+    mSlots = 0;
+
+    return (mFailed == 0);
+}
+
+/**
+ * @brief Set a directory where each scenario is exported as VLE .vpz
+ *
+ * @param path Name of the directory (empty to disable export)
+ */
+void BatchRunner::setExportDir(const QString &path)
+{
+    mExportDir = path;
+}
+
+/**
+ * @brief Set the maximum number of scenarios loaded at the same time
+ *
+ * @param count Number of scenarios
+ */
+void BatchRunner::setMaxPending(int count)
+{
+    if (count < 1)
+        return;
+    mMaxPending = count;
+}
+
+/**
+ * @brief Set the number of worker threads
+ *
+ * @param count Number of threads
+ */
+void BatchRunner::setMaxThreads(int count)
+{
+    if (count < 1)
+        return;
+    mPool.setMaxThreadCount(count);
+}
+
+/**
+ * @brief Called by a task when the processing of one scenario is finished
+ *
+ * @param success True if the scenario has been loaded successfully
+ * @param result  Text of the summary to write to output
+ */
+void BatchRunner::taskDone(bool success, const QString &result)
+{
+    QMutexLocker locker(&mOutputLock);
+
+    mOutput->write( result.toUtf8() );
+
+    mProcessed++;
+    if ( ! success)
+        mFailed++;
+
+    locker.unlock();
+
+    // Allow the next scenario to be started
+    mSlots->release();
+}
+
+/**
+ * @brief Queue one scenario file, wait if too many are already pending
+ *
+ * @param filename Name of the scenario file
+ */
+void BatchRunner::submit(const QString &filename)
+{
+    mSlots->acquire();
+
+    BatchTask *task = new BatchTask(this, filename);
+    task->setExportDir(mExportDir);
+    mPool.start(task);
+}
+
+// -------------------- Task --------------------
+
+BatchTask::BatchTask(BatchRunner *runner, const QString &filename)
+{
+    mRunner   = runner;
+    mFilename = filename;
+}
+
+/**
+ * @brief Load one scenario and compute his summary (called by a worker)
+ *
+ */
+void BatchTask::run()
+{
+    Exploitation exploitation;
+    ExploitationReader reader(&exploitation);
+
+    if ( ! reader.read(mFilename))
+    {
+        QString msg = QString("%1\terror\t%2\n").arg(mFilename)
+                                               .arg(reader.errorString());
+        mRunner->taskDone(false, msg);
+        return;
+    }
+
+    QString result = summarize(&exploitation);
+
+    // Export the Exploitation to VLE (if requested)
+    if ( ! mExportDir.isEmpty())
+    {
+        QString vpzName = QString("%1/%2.vpz").arg(mExportDir)
+                              .arg(QFileInfo(mFilename).completeBaseName());
+        VpzWriter writer(&exploitation);
+        if ( ! writer.write(vpzName))
+        {
+            result += QString("%1\terror\t%2: %3\n").arg(mFilename).arg(vpzName)
+                                                    .arg(writer.errorString());
+            mRunner->taskDone(false, result);
+            return;
+        }
+    }
+
+    mRunner->taskDone(true, result);
+}
+
+/**
+ * @brief Set the directory where the scenario is exported as VLE .vpz
+ *
+ * @param path Name of the directory (empty to disable export)
+ */
+void BatchTask::setExportDir(const QString &path)
+{
+    mExportDir = path;
+}
+
+/**
+ * @brief Compute per-atelier and per-rotation summaries of an Exploitation
+ *
+ * @param exploitation Pointer to the Exploitation to summarize
+ * @return QString One tab-separated line per Atelier and per Rotation, one
+ *                 line with the count of rotation errors and warnings, and
+ *                 one line with the estimated memory (total, then by category)
+ */
+QString BatchTask::summarize(Exploitation *exploitation)
+{
+    QString result;
+    QTextStream out(&result);
+
+    for (uint i = 0; i < exploitation->countAtelier(); ++i)
+    {
+        Atelier *a = exploitation->getAtelier(i);
+
+        // Sums over the leaves of the Atelier (entities without sub-entities,
+        // see AtelierTree::aggregate), the count printed is the same
+        const AtelierTree *tree = a->getTree();
+        int leafCount = 0;
+        for (int n = 1; n < tree->count(); ++n)
+        {
+            if (tree->getSize(n) == 1)
+                leafCount++;
+        }
+
+        out << mFilename << "\tatelier\t" << a->getName()
+            << "\t" << leafCount;
+        for (int k = 0; k < a->countParameter(); ++k)
+        {
+            AtelierTree::Aggregate sum = tree->aggregate(0, k);
+            double mean = sum.count ? (sum.sum / sum.count) : 0;
+            out << "\t" << a->getParameterName(k)
+                << "=" << sum.sum << "/" << mean;
+        }
+        out << "\n";
+    }
+
+    for (uint i = 0; i < exploitation->countRotation(); ++i)
+    {
+        Rotation *rot = exploitation->getRotation(i);
+        out << mFilename << "\trotation\t" << rot->getName()
+            << "\t" << (qulonglong)rot->getDuration()
+            << "\t" << rot->countPlans()
+            << "\t" << rot->countUsers() << "\n";
+    }
+
+    // Consistency of the rotations (the batch already uses one thread per file)
+    RotationAnalyzer analyzer;
+    analyzer.setMaxThreads(1);
+    analyzer.analyze(exploitation);
+    out << mFilename << "\tissues\t" << analyzer.countErrors()
+        << "\t" << (analyzer.count() - analyzer.countErrors()) << "\n";
+
+    // Estimated memory of the data-model, in bytes
+    MemoryUsage usage = exploitation->memoryUsage();
+    out << mFilename << "\tmemory\t" << usage.total()
+        << "\t" << usage.get(MemoryUsage::CategoryParameters)
+        << "\t" << usage.get(MemoryUsage::CategoryRotations)
+        << "\t" << usage.get(MemoryUsage::CategoryEntities)
+        << "\t" << usage.get(MemoryUsage::CategoryValues)
+        << "\t" << usage.get(MemoryUsage::CategoryStrings) << "\n";
+
+    out.flush();
+    return result;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QIODevice>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include "data-model/exploitation.h"
+
+class BatchRunner
+{
+public:
+    explicit BatchRunner(QIODevice *output);
+    int  countFailed   (void);
+    int  countProcessed(void);
+    bool run(const QStringList &paths);
+    void setExportDir (const QString &path);
+    void setMaxPending(int count);
+    void setMaxThreads(int count);
+    void taskDone   (bool success, const QString &result);
+private:
+    void submit(const QString &filename);
+private:
+    QString     mExportDir;
+    QIODevice  *mOutput;
+    QMutex      mOutputLock;
+    QThreadPool mPool;
+    QSemaphore *mSlots;
+    int         mMaxPending;
+    int         mFailed;
+    int         mProcessed;
+};
+
+class BatchTask : public QRunnable
+{
+public:
+    BatchTask(BatchRunner *runner, const QString &filename);
+    void run();
+    void setExportDir(const QString &path);
+private:
+    QString summarize(Exploitation *exploitation);
+private:
+    BatchRunner *mRunner;
+    QString      mFilename;
+    QString      mExportDir;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,466 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include "data-model/instrument.h"
+#include "data-model/montecarlo.h"
+#include "data-model/optimizer.h"
+#include "data-model/patch.h"
+#include "data-model/reader.h"
+#include "data-model/seriesreader.h"
+#include "batchRunner.h"
+#include "patchCheck.h"
+#include "snapshotStress.h"
+
+/**
+ * @brief Read a scenario, then the series of his parameters
+ *
+ * @param filename     Name of the scenario file
+ * @param series       Name of the series file (empty for none, see SeriesReader)
+ * @param exploitation Pointer to the Exploitation to fill
+ * @return boolean True on success (errors are written on stderr)
+ */
+static bool readScenario(const QString &filename, const QString &series,
+                         Exploitation *exploitation)
+{
+    QTextStream err(stderr);
+
+    ExploitationReader reader(exploitation);
+    if ( ! reader.read(filename))
+    {
+        err << filename << " : " << reader.errorString() << "\n";
+        return false;
+    }
+    if (series.isEmpty())
+        return true;
+
+    SeriesReader seriesReader(exploitation);
+    if ( ! seriesReader.read(series))
+    {
+        err << series << " : " << seriesReader.errorString() << "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the patch between two scenarios, then check it
+ *
+ * The patch is applied on a new copy of the source scenario, the result
+ * must have the same content hash than the destination scenario.
+ *
+ * @param from      Name of the source scenario file
+ * @param to        Name of the destination scenario file
+ * @param patchFile Name of the patch file to write
+ * @return integer Exit code of the program
+ */
+static int runDiff(const QString &from, const QString &to, const QString &patchFile)
+{
+    QTextStream err(stderr);
+    Exploitation source, destination, copy;
+
+    ExploitationReader sourceReader(&source);
+    ExploitationReader destReader(&destination);
+    ExploitationReader copyReader(&copy);
+    if ( ! sourceReader.read(from))
+    {
+        err << from << " : " << sourceReader.errorString() << "\n";
+        return 1;
+    }
+    if ( ! destReader.read(to))
+    {
+        err << to << " : " << destReader.errorString() << "\n";
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    ExploitationPatch patch;
+    patch.diff(&source, &destination);
+    qint64 elapsed = timer.elapsed();
+
+    if ( ! patch.save(patchFile))
+    {
+        err << patchFile << " : " << patch.errorString() << "\n";
+        return 1;
+    }
+    err << patch.count() << " operation(s) in " << elapsed << " ms\n";
+
+    // Check the patch file : source + patch == destination
+    ExploitationPatch check;
+    if ( ( ! copyReader.read(from)) || ( ! check.load(patchFile)) ||
+         ( ! check.apply(&copy)))
+    {
+        err << "Patch check failed : " << check.errorString() << "\n";
+        return 2;
+    }
+    if (copy.getHash() != destination.getHash())
+    {
+        err << "Patch check failed : patched content differs\n";
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief Search the best rotation of each entity of a scenario
+ *
+ * The settings file contains one setting per line ('#' for comments) :
+ *   weight <formula>
+ *   coefficient <plan name> = <formula>
+ *   max-share <rotation name> = <share from 0 to 1>
+ *   time <milliseconds>
+ *   seed <number>
+ *   year <number>
+ *
+ * With a year, the parameters that have series (see --series) take their
+ * value of this year. The assignment found is written as "entity, atelier,
+ * rotation" lines.
+ *
+ * @param filename Name of the scenario file
+ * @param series   Name of the series file (empty for none)
+ * @param settings Name of the optimizer settings file
+ * @param threads  Number of threads (0 for default)
+ * @param output   Pointer to the device where assignment is written
+ * @return integer Exit code of the program
+ */
+static int runOptimize(const QString &filename, const QString &series,
+                       const QString &settings, int threads, QIODevice *output)
+{
+    QTextStream err(stderr);
+    Exploitation exploitation;
+
+    if ( ! readScenario(filename, series, &exploitation))
+        return 1;
+
+    QFile file(settings);
+    if ( ! file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        err << settings << " : " << file.errorString() << "\n";
+        return 1;
+    }
+
+    RotationOptimizer optimizer;
+    if (threads > 0)
+        optimizer.setMaxThreads(threads);
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while ( ! in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        lineNumber++;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QString keyword = line.section(' ', 0, 0);
+        QString value   = line.section(' ', 1).trimmed();
+        QString name    = value.section('=', 0, 0).trimmed();
+        QString arg     = value.section('=', 1).trimmed();
+        bool valid = true;
+
+        if (keyword == "weight")
+            optimizer.setWeight(value);
+        else if (keyword == "coefficient")
+            optimizer.setCoefficient(name, arg);
+        else if (keyword == "max-share")
+        {
+            Rotation *rot = 0;
+            for (uint i = 0; i < exploitation.countRotation(); i++)
+            {
+                if (exploitation.getRotation(i)->getName() == name)
+                    rot = exploitation.getRotation(i);
+            }
+            double share = arg.toDouble(&valid);
+            if (rot && valid)
+                optimizer.setMaxShare(rot, share);
+            else
+                valid = false;
+        }
+        else if (keyword == "time")
+            optimizer.setTimeBudget(value.toInt(&valid));
+        else if (keyword == "seed")
+            optimizer.setSeed(value.toUInt(&valid));
+        else if (keyword == "year")
+            optimizer.setYear(value.toInt(&valid));
+        else
+            valid = false;
+
+        if ( ! valid)
+        {
+            err << settings << ":" << lineNumber << " : invalid setting\n";
+            return 1;
+        }
+    }
+
+    if ( ! optimizer.optimize(&exploitation))
+    {
+        err << "Optimization failed : " << optimizer.errorString() << "\n";
+        return 2;
+    }
+
+    QTextStream out(output);
+    for (int i = 0; i < optimizer.countEntities(); i++)
+    {
+        Atelier *entity = optimizer.getEntity(i);
+        out << entity->getName() << "\t" << entity->getParent()->getName()
+            << "\t" << optimizer.getRotation(i)->getName() << "\n";
+    }
+    out.flush();
+
+    err << "Objective " << optimizer.getInitialObjective() << " ---> "
+        << optimizer.getObjective() << " (overflow " << optimizer.getOverflow()
+        << ", " << optimizer.countIterations() << " moves)\n";
+    return 0;
+}
+
+/**
+ * @brief Estimate the distribution of an outcome of a scenario
+ *
+ * The settings file contains one setting per line ('#' for comments) :
+ *   formula <formula>
+ *   distribution <parameter name> = <law> <a> <b> [c]
+ *   samples <number>
+ *   seed <number>
+ *   quantiles <probability> ...
+ *   year <number>
+ *
+ * The laws are uniform (min max), normal (mean deviation), triangular
+ * (min mode max) and lognormal (mean and deviation of the log). With a
+ * year, the parameters that have series (see --series) take their value
+ * of this year. The statistics are written as "name, value" lines.
+ *
+ * @param filename Name of the scenario file
+ * @param series   Name of the series file (empty for none)
+ * @param settings Name of the Monte Carlo settings file
+ * @param threads  Number of threads (0 for default)
+ * @param output   Pointer to the device where statistics are written
+ * @return integer Exit code of the program
+ */
+static int runMonteCarlo(const QString &filename, const QString &series,
+                         const QString &settings, int threads, QIODevice *output)
+{
+    QTextStream err(stderr);
+    Exploitation exploitation;
+
+    if ( ! readScenario(filename, series, &exploitation))
+        return 1;
+
+    QFile file(settings);
+    if ( ! file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        err << settings << " : " << file.errorString() << "\n";
+        return 1;
+    }
+
+    MonteCarloEngine engine;
+    if (threads > 0)
+        engine.setMaxThreads(threads);
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while ( ! in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        lineNumber++;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QString keyword = line.section(' ', 0, 0);
+        QString value   = line.section(' ', 1).trimmed();
+        bool valid = true;
+
+        if (keyword == "formula")
+            engine.setFormula(value);
+        else if (keyword == "distribution")
+        {
+            QString name = value.section('=', 0, 0).trimmed();
+            QStringList args = value.section('=', 1).simplified().split(' ');
+            MonteCarloEngine::Law law = MonteCarloEngine::lawFromName(args.at(0));
+            QVector<double> numbers(3, 0);
+            for (int i = 1; valid && (i < args.count()) && (i < 4); i++)
+                numbers[i - 1] = args.at(i).toDouble(&valid);
+            if ((law == MonteCarloEngine::LawLast) || (args.count() < 3))
+                valid = false;
+            else
+                engine.setDistribution(name, law, numbers.at(0), numbers.at(1), numbers.at(2));
+        }
+        else if (keyword == "samples")
+            engine.setSamples(value.toLongLong(&valid));
+        else if (keyword == "seed")
+            engine.setSeed(value.toUInt(&valid));
+        else if (keyword == "year")
+            engine.setYear(value.toInt(&valid));
+        else if (keyword == "quantiles")
+        {
+            QStringList args = value.simplified().split(' ');
+            QVector<double> probabilities;
+            for (int i = 0; valid && (i < args.count()); i++)
+                probabilities.append(args.at(i).toDouble(&valid));
+            engine.setQuantiles(probabilities);
+        }
+        else
+            valid = false;
+
+        if ( ! valid)
+        {
+            err << settings << ":" << lineNumber << " : invalid setting\n";
+            return 1;
+        }
+    }
+
+    if ( ! engine.run(&exploitation))
+    {
+        err << "Monte Carlo failed : " << engine.errorString() << "\n";
+        return 2;
+    }
+
+    QTextStream out(output);
+    out << "samples\t"  << engine.countSamples() << "\n";
+    out << "nominal\t"  << engine.getNominal()   << "\n";
+    out << "mean\t"     << engine.getMean()      << "\n";
+    out << "stddev\t"   << engine.getStdDev()    << "\n";
+    out << "min\t"      << engine.getMinimum()   << "\n";
+    out << "max\t"      << engine.getMaximum()   << "\n";
+    for (int i = 0; i < engine.countQuantiles(); i++)
+        out << "q" << engine.getQuantileProbability(i) << "\t"
+            << engine.getQuantile(i) << "\n";
+    out.flush();
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Evaluate a set of Exploitation scenarios");
+    parser.addHelpOption();
+    QCommandLineOption optThreads("j", "Number of worker threads", "threads");
+    QCommandLineOption optPending("p", "Maximum number of scenarios loaded at once", "count");
+    QCommandLineOption optOutput ("o", "Write results into file (default: stdout)", "file");
+    QCommandLineOption optExport ("x", "Export each scenario as VLE .vpz into directory", "dir");
+    QCommandLineOption optStress ("stress", "Run the snapshot stress test for some seconds", "seconds");
+    QCommandLineOption optDiff   ("diff", "Write the patch between two scenarios into file", "patch");
+    QCommandLineOption optPatchCheck("patch-check", "Check the patches of some randomly edited scenarios", "rounds");
+    QCommandLineOption optMonteCarlo("montecarlo", "Estimate the distribution of an outcome of one scenario with settings file", "settings");
+    QCommandLineOption optOptimize("optimize", "Optimize the rotations of one scenario with settings file", "settings");
+    QCommandLineOption optSeries ("series", "Load the series of the parameters from file (with --montecarlo or --optimize)", "file");
+    parser.addOption(optThreads);
+    parser.addOption(optPending);
+    parser.addOption(optOutput);
+    parser.addOption(optExport);
+    parser.addOption(optStress);
+    parser.addOption(optDiff);
+    parser.addOption(optPatchCheck);
+    parser.addOption(optMonteCarlo);
+    parser.addOption(optOptimize);
+    parser.addOption(optSeries);
+    parser.addPositionalArgument("paths", "Scenario files or directories");
+    parser.process(app);
+
+    // Snapshot stress test (-j gives the number of reader threads)
+    if (parser.isSet(optStress))
+    {
+        int readers = QThread::idealThreadCount();
+        if (parser.isSet(optThreads))
+            readers = parser.value(optThreads).toInt();
+        SnapshotStress stress(readers);
+        QTextStream err(stderr);
+        return stress.run(parser.value(optStress).toInt(), err) ? 0 : 2;
+    }
+
+    // Round-trip test of the patches
+    if (parser.isSet(optPatchCheck))
+    {
+        PatchCheck check;
+        QTextStream err(stderr);
+        return check.run(parser.value(optPatchCheck).toInt(), err) ? 0 : 2;
+    }
+
+    QStringList paths = parser.positionalArguments();
+    if (paths.isEmpty())
+        parser.showHelp(1);
+
+    // Patch between two scenarios (source then destination)
+    if (parser.isSet(optDiff))
+    {
+        if (paths.count() != 2)
+            parser.showHelp(1);
+        return runDiff(paths.at(0), paths.at(1), parser.value(optDiff));
+    }
+
+    QFile output;
+    bool opened;
+    if (parser.isSet(optOutput))
+    {
+        output.setFileName(parser.value(optOutput));
+        opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    else
+        opened = output.open(stdout, QIODevice::WriteOnly);
+    if ( ! opened)
+    {
+        QTextStream(stderr) << "Failed to open output : " << output.errorString() << "\n";
+        return 1;
+    }
+
+    // Uncertainty of one scenario
+    if (parser.isSet(optMonteCarlo))
+    {
+        if (paths.count() != 1)
+            parser.showHelp(1);
+        int threads = parser.isSet(optThreads) ? parser.value(optThreads).toInt() : 0;
+        return runMonteCarlo(paths.at(0), parser.value(optSeries),
+                             parser.value(optMonteCarlo), threads, &output);
+    }
+
+    // Rotations optimization of one scenario
+    if (parser.isSet(optOptimize))
+    {
+        if (paths.count() != 1)
+            parser.showHelp(1);
+        int threads = parser.isSet(optThreads) ? parser.value(optThreads).toInt() : 0;
+        return runOptimize(paths.at(0), parser.value(optSeries),
+                           parser.value(optOptimize), threads, &output);
+    }
+
+    BatchRunner runner(&output);
+    if (parser.isSet(optThreads))
+        runner.setMaxThreads(parser.value(optThreads).toInt());
+    if (parser.isSet(optPending))
+        runner.setMaxPending(parser.value(optPending).toInt());
+    if (parser.isSet(optExport))
+        runner.setExportDir(parser.value(optExport));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool success = runner.run(paths);
+
+    output.close();
+
+    // Report throughput
+    double seconds = timer.elapsed() / 1000.0;
+    double rate = (seconds > 0) ? (runner.countProcessed() / seconds) : 0;
+    QTextStream(stderr) << runner.countProcessed() << " farm(s) in "
+                        << seconds << " s (" << rate << " farms/s), "
+                        << runner.countFailed() << " failed\n";
+
+    // Dump data-model counters (only when built with instrumentation)
+    if (Instrument::isEnabled())
+    {
+        QTextStream err(stderr);
+        Instrument::dump(err);
+    }
+
+    return success ? 0 : 2;
+}
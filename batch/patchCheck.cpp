@@ -0,0 +1,348 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QBuffer>
+#include <QByteArray>
+#include <QtGlobal>
+#include "data-model/patch.h"
+#include "patchCheck.h"
+
+#define CHECK_ENTITIES 40
+#define CHECK_EDITS    20
+
+/**
+ * @brief Default constructor
+ *
+ */
+PatchCheck::PatchCheck()
+{
+    mColumns = 0;
+}
+
+/**
+ * @brief Run the round-trip test
+ *
+ * Each destination is also rebuilt from a full snapshot (the patch from an
+ * empty Exploitation, used by the autosave).
+ *
+ * The first round makes the same edits each time : sub-entities inserted
+ * and moved, a column inserted between two others and some series. The
+ * following rounds make random edits.
+ *
+ * @param rounds Number of rounds
+ * @param out    Stream where the report is written
+ * @return boolean True if all the patched copies match their destination
+ */
+bool PatchCheck::run(int rounds, QTextStream &out)
+{
+    int errors = 0;
+    for (int i = 0; i < qMax(rounds, 1); ++i)
+    {
+        if ( ! check(i, out))
+            errors++;
+    }
+
+    out << "patch check: " << qMax(rounds, 1) << " round(s), "
+        << errors << " failed\n";
+    out.flush();
+
+    return (errors == 0);
+}
+
+/**
+ * @brief Make the source Exploitation (the same for each call)
+ *
+ * @param exploitation Pointer to the empty Exploitation to fill
+ */
+void PatchCheck::build(Exploitation *exploitation)
+{
+    exploitation->setParameter("Price", 2);
+    Rotation *rotations[2];
+    rotations[0] = exploitation->createRotation("Wheat-Corn", 2);
+    rotations[0]->addPlan(0, "Wheat");
+    rotations[0]->addPlan(1, "Corn");
+    rotations[1] = exploitation->createRotation("Rape", 1);
+    rotations[1]->addPlan(0, "Rape");
+
+    Atelier *crops = exploitation->createAtelier("Crops");
+    crops->addParameter("Area",  1);
+    crops->addParameter("Yield", 5);
+    crops->addParameter("Cost",  100);
+    crops->setParameterKind(2, AtelierColumn::KindInteger);
+    crops->setParameterMandatory(0);
+    crops->addDerivedParameter("Margin", "Area * Yield * Price - Cost");
+
+    // Some names are used by many fields (matched by occurrence)
+    for (int i = 0; i < CHECK_ENTITIES; ++i)
+    {
+        Atelier *field = crops->addEntity();
+        field->setName(QString("Field #%1").arg(i % 8));
+        field->setParameterValue(0, 1 + (i % 5));
+        field->setParameterValue(1, 4 + (i % 3));
+        field->setRotation(rotations[i % 2]);
+        if ((i % 4) != 0)
+            continue;
+        for (int j = 0; j < 3; ++j)
+        {
+            Atelier *plot = field->addEntity();
+            plot->setName(QString("Plot #%1").arg(j));
+            plot->setParameterValue(0, 0.5 * (j + 1));
+        }
+    }
+
+    QVector<int>    years;
+    QVector<double> values;
+    years  << 2010 << 2014;
+    values << 5.0  << 7.0;
+    TimeSeries series;
+    series.setPoints(years, values, TimeSeries::ModeLinear);
+    crops->getEntity(1)->setParameterSeries(1, series);
+
+    Atelier *herd = exploitation->createAtelier("Herd");
+    herd->addParameter("Size", 10);
+    for (int i = 0; i < 5; ++i)
+    {
+        Atelier *group = herd->addEntity();
+        group->setName(QString("Group #%1").arg(i));
+        group->setParameterValue(0, 10 + i);
+    }
+}
+
+/**
+ * @brief Compare a patched copy of the source with the destination
+ *
+ * @param seed Round of the test (0 for the fixed edits)
+ * @param out  Stream where the errors are written
+ * @return boolean True if the patched copy matches the destination
+ */
+bool PatchCheck::check(uint seed, QTextStream &out)
+{
+    Exploitation source;
+    Exploitation destination;
+    Exploitation copy;
+    build(&source);
+    build(&destination);
+    build(&copy);
+
+    if (seed == 0)
+    {
+        Atelier *crops = destination.getAtelier(0);
+        // Sub-entities : a new one into a field, one moved before the others
+        Atelier *field = crops->getEntity(4);
+        field->insertEntity(1)->setName("Plot #new");
+        field->getEntity(3)->setParameterValue(1, 9);
+        field->removeEntity(0);
+        field->insertEntity(2)->setName("Plot #0");
+        crops->getEntity(6)->addEntity()->setName("Plot #first");
+        // A column between the first two
+        crops->insertParameter(1, "Extra", 3);
+        crops->getEntity(2)->setParameterValue(1, 4);
+        // Series of some fields and of some plots
+        QVector<int>    years;
+        QVector<double> values;
+        years  << 2012 << 2016;
+        values << 1.0  << 2.0;
+        TimeSeries series;
+        series.setPoints(years, values);
+        crops->getEntity(3)->setParameterSeries(2, series);
+        field->getEntity(1)->setParameterSeries(0, series);
+    }
+    else
+    {
+        qsrand(seed);
+        edit(&destination, 1 + (qrand() % CHECK_EDITS));
+    }
+
+    ExploitationPatch patch;
+    patch.diff(&source, &destination);
+
+    // Through a patch file
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    bool saved = patch.save(&buffer);
+    buffer.close();
+    buffer.open(QIODevice::ReadOnly);
+    ExploitationPatch loaded;
+    if (( ! saved) || ( ! loaded.load(&buffer)) || ( ! loaded.apply(&copy)))
+    {
+        out << "round " << seed << " : " << loaded.errorString() << "\n";
+        return false;
+    }
+    if (copy.getHash() != destination.getHash())
+    {
+        out << "round " << seed << " : patched content differs ("
+            << patch.count() << " operations)\n";
+        return false;
+    }
+
+    // Full snapshot (patch from an empty Exploitation, see ChangeLog)
+    Exploitation empty;
+    Exploitation rebuilt;
+    ExploitationPatch snapshot;
+    snapshot.diff(&empty, &destination);
+    if (( ! snapshot.apply(&rebuilt)) || (rebuilt.getHash() != destination.getHash()))
+    {
+        out << "round " << seed << " : snapshot content differs\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Make random edits on an Exploitation
+ *
+ * @param exploitation Pointer to the Exploitation to modify
+ * @param count        Number of edits
+ */
+void PatchCheck::edit(Exploitation *exploitation, int count)
+{
+    for (int n = 0; n < count; ++n)
+    {
+        Atelier *atelier = exploitation->getAtelier(qrand() % exploitation->countAtelier());
+        Atelier *entity  = pickEntity(atelier, false);
+        Atelier *owner   = pickEntity(atelier, true);
+        int column = qrand() % atelier->countParameter();
+        bool derived = atelier->isParameterDerived(column);
+
+        switch (qrand() % 13)
+        {
+            case 0:
+                // Modify one value
+                if (entity && ! entity->getParent()->isParameterDerived(column))
+                    entity->setParameterValue(column, qrand() % 50);
+                break;
+            case 1:
+            {
+                // New entity (or sub-entity) at any position
+                Atelier *newEntity = owner->insertEntity(qrand() % (owner->countEntity() + 1));
+                newEntity->setName(QString("New #%1").arg(qrand() % 3));
+                if ( ! owner->isParameterDerived(column))
+                    newEntity->setParameterValue(column, qrand() % 50);
+                break;
+            }
+            case 2:
+                // Remove one entity
+                if (entity)
+                    entity->getParent()->removeEntity(entity->getRow());
+                break;
+            case 3:
+            {
+                // Move one entity (his values are kept)
+                if (entity == 0)
+                    break;
+                Atelier *parent = entity->getParent();
+                QString name = entity->getName();
+                QVector<double> values;
+                for (int i = 0; i < entity->countParameter(); ++i)
+                    values.append(entity->getParameterValue(i));
+                parent->removeEntity(entity->getRow());
+                Atelier *moved = parent->insertEntity(qrand() % (parent->countEntity() + 1));
+                moved->setName(name);
+                for (int i = 0; i < values.count(); ++i)
+                {
+                    if ( ! parent->isParameterDerived(i))
+                        moved->setParameterValue(i, values.at(i));
+                }
+                break;
+            }
+            case 4:
+                // New column between the others
+                atelier->insertParameter(qrand() % (atelier->countParameter() + 1),
+                                         QString("Extra #%1").arg(mColumns++), qrand() % 10);
+                break;
+            case 5:
+                // Remove a column (only the new ones, formulas do not use them)
+                if (atelier->getParameterName(column).startsWith("Extra"))
+                    atelier->delParameter(column);
+                break;
+            case 6:
+            {
+                // Series of some entities of an Atelier (or entity)
+                if (owner->countEntity() == 0)
+                    break;
+                QVector<int> rows;
+                QVector<TimeSeries> series;
+                QVector<int>    years;
+                QVector<double> values;
+                int first = 2010 + (qrand() % 4);
+                years  << first << (first + (qrand() % 6));
+                values << (qrand() % 10) << (qrand() % 10);
+                for (int r = 0; r < owner->countEntity(); ++r)
+                {
+                    if ((qrand() % 3) != 0)
+                        continue;
+                    TimeSeries values_;
+                    values_.setPoints(years, values, TimeSeries::Mode(qrand() % TimeSeries::ModeLast));
+                    rows.append(r);
+                    series.append(values_);
+                }
+                if ( ! rows.isEmpty())
+                    owner->setEntitySeries(column, rows, series);
+                break;
+            }
+            case 7:
+                owner->dropParameterSeries(column);
+                break;
+            case 8:
+                // Kind of a plain parameter (enums may not convert)
+                if (owner->getParameter(column) && ! derived)
+                    owner->setParameterKind(column, AtelierColumn::Kind(qrand() % AtelierColumn::KindEnum));
+                break;
+            case 9:
+                if (owner->getParameter(column))
+                    owner->setParameterMandatory(column, (qrand() % 2) == 0);
+                break;
+            case 10:
+                if ( ! derived)
+                    owner->setParameterDefault(column, qrand() % 20);
+                break;
+            case 11:
+                if (entity == 0)
+                    break;
+                if ((qrand() % 2) == 0)
+                    entity->setName(QString("Renamed #%1").arg(qrand() % 3));
+                else if (exploitation->countRotation() > 0)
+                    entity->setRotation(exploitation->getRotation(qrand() % exploitation->countRotation()));
+                else
+                    entity->setRotation(0);
+                break;
+            default:
+                // Formula of a new column, or a global parameter
+                if (atelier->getParameterName(column).startsWith("Extra") &&
+                    owner->getParameter(column))
+                    owner->setParameterFormula(column, (qrand() % 2) ? "Area * 2" : QString());
+                else
+                    exploitation->setParameter("Price", qrand() % 5);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Select a random entity of an Atelier, at any depth
+ *
+ * @param atelier   Pointer to the top-level Atelier
+ * @param container True to select an Atelier that may hold entities (the
+ *                  top-level one included)
+ * @return Pointer to the entity (NULL if there is none)
+ */
+Atelier *PatchCheck::pickEntity(Atelier *atelier, bool container)
+{
+    Atelier *entity = atelier;
+    while (entity->countEntity() > 0)
+    {
+        if (container && ((qrand() % 3) == 0))
+            break;
+        entity = entity->getEntity(qrand() % entity->countEntity());
+        if (( ! container) && ((qrand() % 2) == 0))
+            break;
+    }
+    if (( ! container) && (entity == atelier))
+        return 0;
+    return entity;
+}
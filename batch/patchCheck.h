@@ -0,0 +1,37 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef PATCHCHECK_H
+#define PATCHCHECK_H
+
+#include <QList>
+#include <QTextStream>
+#include "data-model/exploitation.h"
+
+/*
+ * Round-trip test of the patches : a source Exploitation is edited at
+ * random (values, entities and sub-entities moved or inserted, columns
+ * inserted between others, series, kinds ...), then the patch between the
+ * source and the edited copy is saved, loaded and applied on another copy
+ * of the source. Both results must have the same content hash. A full
+ * snapshot of the edited copy must give the same content hash too.
+ */
+class PatchCheck
+{
+public:
+    PatchCheck();
+    bool run(int rounds, QTextStream &out);
+private:
+    void     build (Exploitation *exploitation);
+    void     edit  (Exploitation *exploitation, int count);
+    bool     check (uint seed, QTextStream &out);
+    Atelier *pickEntity(Atelier *atelier, bool container);
+private:
+    int mColumns;
+};
+
+#endif // PATCHCHECK_H
@@ -0,0 +1,193 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QElapsedTimer>
+#include <QList>
+#include <QtGlobal>
+#include "snapshotStress.h"
+
+/*
+ * Invariants checked by readers : the global parameter "Total" is always
+ * the sum of the first parameter of all entities, and the second parameter
+ * of an entity is twice the first one. The writer keeps them before each
+ * publish, so a torn or freed snapshot breaks them. Values are integers,
+ * the sums are exact.
+ */
+
+#define STRESS_ENTITIES 1000
+
+/**
+ * @brief Default constructor
+ *
+ * @param readers Number of reader threads
+ */
+SnapshotStress::SnapshotStress(int readers)
+{
+    mReaders = qBound(1, readers, SNAPSHOT_MAX_READERS);
+}
+
+/**
+ * @brief Run the stress test
+ *
+ * @param seconds Duration of the test
+ * @param out     Stream where the report is written
+ * @return boolean True if no reader has seen an inconsistent snapshot
+ */
+bool SnapshotStress::run(int seconds, QTextStream &out)
+{
+    Exploitation exploitation;
+    Atelier *atelier = exploitation.createAtelier("Stress");
+    atelier->addParameter("Value", 0);
+    atelier->addParameter("Other", 0);
+
+    double total = 0;
+    for (int i = 0; i < STRESS_ENTITIES; ++i)
+    {
+        Atelier *entity = atelier->addEntity();
+        entity->setName(QString("Entity #%1").arg(i));
+        entity->setParameterValue(0, i % 100);
+        entity->setParameterValue(1, (i % 100) * 2);
+        total += i % 100;
+    }
+    exploitation.setParameter("Total", total);
+
+    SnapshotPublisher publisher;
+    publisher.publish(&exploitation);
+
+    // Start readers
+    QAtomicInt stop(0);
+    QList<SnapshotStressReader *> readers;
+    for (int i = 0; i < mReaders; ++i)
+    {
+        SnapshotStressReader *reader = new SnapshotStressReader(&publisher, &stop);
+        readers.append(reader);
+        reader->start();
+    }
+
+    // Edit and publish until the end of the test
+    QElapsedTimer timer;
+    timer.start();
+    qsrand(1);
+    quint64 edits = 0;
+    while (timer.elapsed() < (seconds * 1000))
+    {
+        for (int n = 0; n < 16; ++n)
+        {
+            int action = qrand() % 100;
+            if ((action < 5) && (atelier->countEntity() > (STRESS_ENTITIES / 2)))
+            {
+                // Remove one entity
+                int row = qrand() % atelier->countEntity();
+                total -= atelier->getEntity(row)->getParameterValue(0);
+                atelier->removeEntity(row);
+            }
+            else if ((action < 10) && (atelier->countEntity() < (STRESS_ENTITIES * 2)))
+            {
+                // Add one entity
+                Atelier *entity = atelier->addEntity();
+                entity->setName("New");
+                entity->setParameterValue(0, action);
+                entity->setParameterValue(1, action * 2);
+                total += action;
+            }
+            else
+            {
+                // Modify one value
+                Atelier *entity = atelier->getEntity(qrand() % atelier->countEntity());
+                double value = qrand() % 100;
+                total += value - entity->getParameterValue(0);
+                entity->setParameterValue(0, value);
+                entity->setParameterValue(1, value * 2);
+            }
+            edits++;
+        }
+        exploitation.setParameter("Total", total);
+        publisher.publish(&exploitation);
+    }
+
+    stop.storeRelease(1);
+    quint64 reads  = 0;
+    quint64 errors = 0;
+    for (int i = 0; i < readers.count(); ++i)
+    {
+        readers.at(i)->wait();
+        reads  += readers.at(i)->countReads();
+        errors += readers.at(i)->countErrors();
+        delete readers.at(i);
+    }
+
+    out << "snapshot stress: " << edits << " edits, "
+        << publisher.getVersion() << " versions published, "
+        << reads << " snapshots read by " << mReaders << " reader(s), "
+        << errors << " inconsistent, "
+        << publisher.countRetired() << " retired not freed\n";
+    out.flush();
+
+    return (errors == 0);
+}
+
+// -------------------- Reader --------------------
+
+SnapshotStressReader::SnapshotStressReader(SnapshotPublisher *publisher, QAtomicInt *stop)
+{
+    mPublisher = publisher;
+    mStop      = stop;
+    mErrors    = 0;
+    mReads     = 0;
+}
+
+quint64 SnapshotStressReader::countErrors(void)
+{
+    return mErrors;
+}
+
+quint64 SnapshotStressReader::countReads(void)
+{
+    return mReads;
+}
+
+/**
+ * @brief Acquire snapshots in loop and check them
+ *
+ */
+void SnapshotStressReader::run(void)
+{
+    int slot = mPublisher->registerReader();
+    if (slot < 0)
+        return;
+
+    quint64 lastVersion = 0;
+    while (mStop->loadAcquire() == 0)
+    {
+        SnapshotGuard guard(mPublisher, slot);
+        const ExploitationSnapshot *snapshot = guard.get();
+        if (snapshot == 0)
+            continue;
+
+        const SnapshotAtelier &atelier = snapshot->getAtelier(0);
+        bool valid = true;
+        double sum = 0;
+        for (int i = 0; i < atelier.countEntity(); ++i)
+        {
+            sum += atelier.getValue(i, 0);
+            if (atelier.getValue(i, 1) != (atelier.getValue(i, 0) * 2))
+                valid = false;
+        }
+        if (sum != snapshot->getParameterValue("Total"))
+            valid = false;
+        // Versions seen by one reader never go back
+        if (snapshot->getVersion() < lastVersion)
+            valid = false;
+
+        if ( ! valid)
+            mErrors++;
+        lastVersion = snapshot->getVersion();
+        mReads++;
+    }
+
+    mPublisher->unregisterReader(slot);
+}
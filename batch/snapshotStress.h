@@ -0,0 +1,45 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef SNAPSHOTSTRESS_H
+#define SNAPSHOTSTRESS_H
+
+#include <QAtomicInteger>
+#include <QTextStream>
+#include <QThread>
+#include "data-model/snapshot.h"
+
+/*
+ * Stress test of the snapshot publisher : the main thread edits an
+ * Exploitation and publishes new versions while reader threads check
+ * that every snapshot they acquire is consistent.
+ */
+class SnapshotStress
+{
+public:
+    explicit SnapshotStress(int readers);
+    bool run(int seconds, QTextStream &out);
+private:
+    int mReaders;
+};
+
+class SnapshotStressReader : public QThread
+{
+public:
+    SnapshotStressReader(SnapshotPublisher *publisher, QAtomicInt *stop);
+    quint64 countErrors(void);
+    quint64 countReads (void);
+protected:
+    void run(void);
+private:
+    SnapshotPublisher *mPublisher;
+    QAtomicInt        *mStop;
+    quint64            mErrors;
+    quint64            mReads;
+};
+
+#endif // SNAPSHOTSTRESS_H
@@ -0,0 +1,452 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <algorithm>
+#include "analyzer.h"
+#include "instrument.h"
+#include "tree.h"
+
+// Number of rotations and of entities checked by one task
+#define ROTATION_CHUNK  256
+#define ENTITY_CHUNK   4096
+
+/**
+ * @brief Default constructor, the report is empty
+ *
+ */
+RotationAnalyzer::RotationAnalyzer()
+{
+    mExploitation = 0;
+}
+
+/**
+ * @brief Check all the Rotations and all the entities of an Exploitation
+ *
+ * The previous report is replaced. Rotations with the same content hash
+ * than during the previous analysis are not checked again.
+ *
+ * @param exploitation Pointer to the Exploitation to check
+ * @return boolean True if the analysis has been done
+ */
+bool RotationAnalyzer::analyze(Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("RotationAnalyzer::analyze");
+
+    if (exploitation == 0)
+        return false;
+    // Cached issues are only valid for the same Exploitation
+    if (exploitation != mExploitation)
+        mCache.clear();
+    mExploitation = exploitation;
+    mIssues.clear();
+
+    // Inputs : all rotations, then all ateliers and entities (with sub-entities)
+    int rotations = exploitation->countRotation();
+    mRotations.resize(rotations);
+    mKnown.clear();
+    mKnown.reserve(rotations);
+    for (int i = 0; i < rotations; i++)
+    {
+        mRotations[i] = exploitation->getRotation(i);
+        mKnown.insert(mRotations.at(i), i);
+    }
+    mEntities.clear();
+    for (uint i = 0; i < exploitation->countAtelier(); i++)
+    {
+        const AtelierTree *tree = exploitation->getAtelier(i)->getTree();
+        for (int j = 0; j < tree->count(); j++)
+            mEntities.append(tree->getNode(j));
+    }
+    int entities = mEntities.count();
+    int chunks   = (entities + ENTITY_CHUNK - 1) / ENTITY_CHUNK;
+
+    mRotationIssues = QVector< QList<Issue> >(rotations);
+    mEntityIssues   = QVector< QList<Issue> >(chunks);
+    mUsers          = QVector< QHash<Rotation *, int> >(chunks);
+    INSTRUMENT_ALLOC(rotations + chunks);
+
+    // Small Exploitations (common case after an edit) are checked inline
+    if ((rotations <= ROTATION_CHUNK) && (chunks <= 1))
+    {
+        checkRotations(0, rotations);
+        if (chunks)
+            checkEntities(0, entities, 0);
+    }
+    else
+    {
+        for (int i = 0; i < rotations; i += ROTATION_CHUNK)
+            mPool.start(new RotationAnalyzerTask(this, false, i,
+                                                 qMin(ROTATION_CHUNK, rotations - i), 0));
+        for (int i = 0; i < chunks; i++)
+            mPool.start(new RotationAnalyzerTask(this, true, i * ENTITY_CHUNK,
+                                                 qMin(ENTITY_CHUNK, entities - (i * ENTITY_CHUNK)), i));
+        mPool.waitForDone();
+    }
+
+    // Merge the users counted by each chunk
+    QHash<Rotation *, int> users;
+    for (int i = 0; i < chunks; i++)
+    {
+        QHash<Rotation *, int>::const_iterator it;
+        for (it = mUsers.at(i).constBegin(); it != mUsers.at(i).constEnd(); ++it)
+            users[it.key()] += it.value();
+    }
+
+    // Report : rotations first (in Exploitation order), then entities
+    QHash<uint, Cache> cache;
+    cache.reserve(rotations);
+    for (int i = 0; i < rotations; i++)
+    {
+        Rotation *rot = mRotations.at(i);
+        mIssues += mRotationIssues.at(i);
+
+        Cache entry;
+        entry.hash   = rot->getHash();
+        entry.issues = mRotationIssues.at(i);
+        cache.insert(rot->getId(), entry);
+
+        int used = users.value(rot, 0);
+        if (used != rot->countUsers())
+        {
+            Issue issue = newIssue(IssueUsersMismatch, rot);
+            issue.count = used;
+            mIssues.append(issue);
+        }
+    }
+    for (int i = 0; i < chunks; i++)
+        mIssues += mEntityIssues.at(i);
+    // Removed rotations are forgotten
+    mCache = cache;
+
+    // Do not keep pointers to the Exploitation
+    mRotations.clear();
+    mEntities.clear();
+    mKnown.clear();
+    mRotationIssues.clear();
+    mEntityIssues.clear();
+    mUsers.clear();
+
+    return true;
+}
+
+/**
+ * @brief Forget the report and the issues kept for each Rotation
+ *
+ */
+void RotationAnalyzer::clear(void)
+{
+    mIssues.clear();
+    mCache.clear();
+    mExploitation = 0;
+}
+
+/**
+ * @brief Check a range of Rotations (called from a task)
+ *
+ * @param first Index of the first Rotation
+ * @param count Number of Rotations
+ */
+void RotationAnalyzer::checkRotations(int first, int count)
+{
+    INSTRUMENT_CALL("RotationAnalyzer::checkRotations");
+
+    for (int i = first; i < (first + count); i++)
+    {
+        Rotation *rot = mRotations.at(i);
+
+        // Not modified since last analysis, reuse the issues
+        QHash<uint, Cache>::const_iterator it = mCache.constFind(rot->getId());
+        if ((it != mCache.constEnd()) && (it.value().hash == rot->getHash()))
+        {
+            mRotationIssues[i] = it.value().issues;
+            continue;
+        }
+        checkRotation(rot, mRotationIssues[i]);
+    }
+}
+
+/**
+ * @brief Check the plans of one Rotation
+ *
+ * Plans positions are years of the cycle, from 1 to the duration. Each
+ * year should have exactly one plan.
+ *
+ * @param rot    Pointer to the Rotation
+ * @param issues List where issues are appended
+ */
+void RotationAnalyzer::checkRotation(Rotation *rot, QList<Issue> &issues)
+{
+    uint  plans    = rot->countPlans();
+    ulong duration = rot->getDuration();
+
+    if (plans == 0)
+    {
+        issues.append(newIssue(IssueEmpty, rot));
+        return;
+    }
+    if (duration == 0)
+    {
+        issues.append(newIssue(IssueNoDuration, rot));
+        return;
+    }
+
+    QVector<ulong> years;
+    years.reserve(plans);
+    for (uint i = 0; i < plans; i++)
+    {
+        ulong position = rot->getPlan(i)->getPosition();
+        if ((position < 1) || (position > duration))
+        {
+            Issue issue = newIssue(IssueOutOfRange, rot);
+            issue.plan = i;
+            issue.year = position;
+            issues.append(issue);
+            continue;
+        }
+        years.append(position);
+    }
+    std::sort(years.begin(), years.end());
+
+    // Walk the sorted years : holes are gaps, equal years are duplicates
+    ulong expected = 1;
+    int   i = 0;
+    while (i < years.count())
+    {
+        ulong year = years.at(i);
+        if (year > expected)
+        {
+            Issue issue = newIssue(IssueGap, rot);
+            issue.year  = expected;
+            issue.count = year - expected;
+            issues.append(issue);
+        }
+        int next = i + 1;
+        while ((next < years.count()) && (years.at(next) == year))
+            next++;
+        if (next - i > 1)
+        {
+            Issue issue = newIssue(IssueDuplicateYear, rot);
+            issue.year  = year;
+            issue.count = next - i;
+            issues.append(issue);
+        }
+        expected = year + 1;
+        i = next;
+    }
+    if (expected <= duration)
+    {
+        Issue issue = newIssue(IssueGap, rot);
+        issue.year  = expected;
+        issue.count = duration - expected + 1;
+        issues.append(issue);
+    }
+}
+
+/**
+ * @brief Check the Rotation of a range of entities (called from a task)
+ *
+ * @param first Index of the first entity
+ * @param count Number of entities
+ * @param chunk Index of the chunk (where results are stored)
+ */
+void RotationAnalyzer::checkEntities(int first, int count, int chunk)
+{
+    INSTRUMENT_CALL("RotationAnalyzer::checkEntities");
+
+    QList<Issue>           &issues = mEntityIssues[chunk];
+    QHash<Rotation *, int> &users  = mUsers[chunk];
+
+    for (int i = first; i < (first + count); i++)
+    {
+        Atelier  *entity = mEntities.at(i);
+        Rotation *rot    = entity->getRotation();
+        if (rot == 0)
+        {
+            // A top-level Atelier usually has no rotation, only entities do
+            if (entity->getParent())
+                issues.append(newIssue(IssueNoRotation, 0, entity));
+        }
+        else if ( ! mKnown.contains(rot))
+            issues.append(newIssue(IssueUnknownRotation, 0, entity));
+        else
+            users[rot]++;
+    }
+}
+
+/**
+ * @brief Create an issue with default values
+ *
+ * @param type   Type of the issue
+ * @param rot    Pointer to the Rotation (or NULL)
+ * @param entity Pointer to the entity (or NULL)
+ * @return Issue New issue
+ */
+RotationAnalyzer::Issue RotationAnalyzer::newIssue(IssueType type, Rotation *rot, Atelier *entity)
+{
+    Issue issue;
+    issue.type     = type;
+    issue.rotation = rot;
+    issue.entity   = entity;
+    issue.plan     = -1;
+    issue.year     = 0;
+    issue.count    = 0;
+    return issue;
+}
+
+// -------------------- Report --------------------
+
+/**
+ * @brief Get the number of issues found by the last analysis
+ *
+ * @return integer Number of issues
+ */
+int RotationAnalyzer::count(void)
+{
+    return mIssues.count();
+}
+
+/**
+ * @brief Get the number of errors (see isError) found by the last analysis
+ *
+ * @return integer Number of errors
+ */
+int RotationAnalyzer::countErrors(void)
+{
+    int result = 0;
+    for (int i = 0; i < mIssues.count(); i++)
+    {
+        if (isError(mIssues.at(i).type))
+            result++;
+    }
+    return result;
+}
+
+/**
+ * @brief Get the number of issues of one type
+ *
+ * @param type Type of issues to count
+ * @return integer Number of issues
+ */
+int RotationAnalyzer::countIssues(IssueType type)
+{
+    int result = 0;
+    for (int i = 0; i < mIssues.count(); i++)
+    {
+        if (mIssues.at(i).type == type)
+            result++;
+    }
+    return result;
+}
+
+/**
+ * @brief Get one issue of the last analysis
+ *
+ * @param index Index of the issue
+ * @return Issue Reference to the issue
+ */
+const RotationAnalyzer::Issue &RotationAnalyzer::getIssue(int index)
+{
+    return mIssues.at(index);
+}
+
+/**
+ * @brief Test if a type of issue is an error (else it is a warning)
+ *
+ * Errors are inconsistent datas, warnings are incomplete rotations.
+ *
+ * @param type Type of issue
+ * @return boolean True for an error
+ */
+bool RotationAnalyzer::isError(IssueType type)
+{
+    return (type == IssueOutOfRange)      ||
+           (type == IssueUnknownRotation) ||
+           (type == IssueUsersMismatch);
+}
+
+/**
+ * @brief Get a readable description of an issue
+ *
+ * @param issue Issue to describe
+ * @return QString One line of text
+ */
+QString RotationAnalyzer::describe(const Issue &issue)
+{
+    QString rotName = issue.rotation ? issue.rotation->getName() : QString();
+    QString entName = issue.entity   ? issue.entity->getName()   : QString();
+
+    switch (issue.type)
+    {
+        case IssueEmpty:
+            return QString("Rotation %1 has no plan").arg(rotName);
+        case IssueNoDuration:
+            return QString("Rotation %1 has plans but no duration").arg(rotName);
+        case IssueOutOfRange:
+            return QString("Rotation %1 : plan %2 at year %3 is out of the cycle (%4 years)")
+                   .arg(rotName).arg(issue.rotation->getPlan(issue.plan)->getName())
+                   .arg(issue.year).arg(issue.rotation->getDuration());
+        case IssueDuplicateYear:
+            return QString("Rotation %1 : %2 plans at year %3")
+                   .arg(rotName).arg(issue.count).arg(issue.year);
+        case IssueGap:
+            if (issue.count == 1)
+                return QString("Rotation %1 : no plan at year %2")
+                       .arg(rotName).arg(issue.year);
+            return QString("Rotation %1 : no plan from year %2 to %3")
+                   .arg(rotName).arg(issue.year).arg(issue.year + issue.count - 1);
+        case IssueNoRotation:
+            return QString("Entity %1 has no rotation").arg(entName);
+        case IssueUnknownRotation:
+            return QString("Entity %1 uses a rotation not into the Exploitation").arg(entName);
+        case IssueUsersMismatch:
+            return QString("Rotation %1 : %2 users known, %3 entities use it")
+                   .arg(rotName).arg(issue.rotation->countUsers()).arg(issue.count);
+        default:
+            break;
+    }
+    return QString();
+}
+
+/**
+ * @brief Set the maximum number of threads used by an analysis
+ *
+ * @param count Number of threads
+ */
+void RotationAnalyzer::setMaxThreads(int count)
+{
+    if (count > 0)
+        mPool.setMaxThreadCount(count);
+}
+
+// -------------------- Task --------------------
+
+/**
+ * @brief Create a task that checks a range of rotations or entities
+ *
+ * @param analyzer Pointer to the analyzer that owns the results
+ * @param entities True to check entities, false to check rotations
+ * @param first    Index of the first item
+ * @param count    Number of items
+ * @param chunk    Index of the chunk (for entities)
+ */
+RotationAnalyzerTask::RotationAnalyzerTask(RotationAnalyzer *analyzer, bool entities,
+                                           int first, int count, int chunk)
+{
+    mAnalyzer = analyzer;
+    mEntities = entities;
+    mFirst    = first;
+    mCount    = count;
+    mChunk    = chunk;
+}
+
+void RotationAnalyzerTask::run()
+{
+    if (mEntities)
+        mAnalyzer->checkEntities(mFirst, mCount, mChunk);
+    else
+        mAnalyzer->checkRotations(mFirst, mCount);
+}
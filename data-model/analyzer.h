@@ -0,0 +1,102 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <QHash>
+#include <QList>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include "exploitation.h"
+
+/*
+ * A RotationAnalyzer checks the consistency of the Rotations of an
+ * Exploitation (plans into the cycle, duplicate years, gaps) and of the
+ * Rotation assigned to each entity. The result is a list of issues.
+ *
+ * Rotations and entities are checked by chunks on a thread pool. The issues
+ * of each Rotation are kept with his content hash, so an analysis after an
+ * edit only checks again the modified Rotations.
+ */
+class RotationAnalyzer
+{
+public:
+    enum IssueType {
+        IssueEmpty,           // rotation without plan
+        IssueNoDuration,      // rotation with plans but without duration
+        IssueOutOfRange,      // plan position outside [1, duration]
+        IssueDuplicateYear,   // more than one plan the same year of the cycle
+        IssueGap,             // years of the cycle without plan
+        IssueNoRotation,      // entity without rotation
+        IssueUnknownRotation, // entity uses a rotation not into the Exploitation
+        IssueUsersMismatch,   // users index of the rotation differs from the entities
+        IssueLast
+    };
+    struct Issue
+    {
+        IssueType type;
+        Rotation *rotation; // NULL for an entity without (or unknown) rotation
+        Atelier  *entity;   // NULL for an issue of the rotation itself
+        int       plan;     // index of the plan (-1 if none)
+        ulong     year;     // first year of the cycle (0 if none)
+        ulong     count;    // number of years (gaps) or of plans (duplicates)
+    };
+public:
+    RotationAnalyzer();
+    bool    analyze(Exploitation *exploitation);
+    void    clear  (void);
+    int     count  (void);
+    int     countErrors(void);
+    int     countIssues(IssueType type);
+    const Issue &getIssue(int index);
+    static QString describe(const Issue &issue);
+    static bool    isError (IssueType type);
+    void    setMaxThreads(int count);
+private:
+    friend class RotationAnalyzerTask;
+    struct Cache
+    {
+        quint64      hash;
+        QList<Issue> issues;
+    };
+    void    checkEntities (int first, int count, int chunk);
+    void    checkRotations(int first, int count);
+    static void checkRotation(Rotation *rot, QList<Issue> &issues);
+    static Issue newIssue(IssueType type, Rotation *rot, Atelier *entity = 0);
+private:
+    Exploitation *mExploitation;
+    QList<Issue>  mIssues;
+    QThreadPool   mPool;
+    // Inputs and per-chunk results, only valid during analyze()
+    QVector<Rotation *>      mRotations;
+    QVector<Atelier *>       mEntities;
+    QHash<Rotation *, int>   mKnown;
+    QVector< QList<Issue> >  mRotationIssues;
+    QVector< QList<Issue> >  mEntityIssues;
+    QVector< QHash<Rotation *, int> > mUsers;
+    // Issues of each Rotation (by identifier) for his last content hash
+    QHash<uint, Cache> mCache;
+};
+
+class RotationAnalyzerTask : public QRunnable
+{
+public:
+    RotationAnalyzerTask(RotationAnalyzer *analyzer, bool entities,
+                         int first, int count, int chunk);
+    void run();
+private:
+    RotationAnalyzer *mAnalyzer;
+    bool mEntities;
+    int  mFirst;
+    int  mCount;
+    int  mChunk;
+};
+
+#endif // ANALYZER_H
@@ -5,8 +5,25 @@
  *
  * Copyright (c) 2016 Agilack
  */
+#include <algorithm>
+#include <string.h>
 #include "atelier.h"
 #include "exploitation.h"
+#include "hash.h"
+#include "instrument.h"
+#include "tree.h"
+
+/**
+ * @brief Make the key of an entity into a parameter index
+ *
+ * @param value  Value of the parameter
+ * @param entity Pointer to the entity
+ * @return AtelierIndexKey Key, unique for each entity
+ */
+static AtelierIndexKey indexKey(double value, Atelier *entity)
+{
+    return AtelierIndexKey(value, quintptr(entity));
+}
 
 /**
  * @brief Default constructor for Atelier object
@@ -15,11 +32,19 @@
  */
 Atelier::Atelier(Atelier *parent)
 {
+    mId  = 0;
+    mRow = 0;
     mName.clear();
     mEntities.clear();
     mExploitation = 0;
     mParent   = parent;
+    mRoot     = parent ? parent->mRoot : this;
+    mTree     = 0;
+    mTreeValid = false;
     mRotation = 0;
+    mDerived  = 0;
+    mHash     = 0;
+    mHashValid = false;
 }
 
 /**
@@ -29,11 +54,19 @@ Atelier::Atelier(Atelier *parent)
  */
 Atelier::Atelier(Exploitation * exploitation)
 {
+    mId  = 0;
+    mRow = 0;
     mName.clear();
     mEntities.clear();
     mExploitation = exploitation;
     mParent   = 0;
+    mRoot     = this;
+    mTree     = 0;
+    mTreeValid = false;
     mRotation = 0;
+    mDerived  = 0;
+    mHash     = 0;
+    mHashValid = false;
 }
 
 /**
@@ -42,6 +75,8 @@ Atelier::Atelier(Exploitation * exploitation)
  */
 Atelier::~Atelier()
 {
+    INSTRUMENT_CALL("Atelier::~Atelier");
+
     while( ! mEntities.isEmpty())
     {
         // Get the first list item
@@ -62,16 +97,137 @@ Atelier::~Atelier()
         // Then, delete it
         delete parameter;
     }
+
+    delete mTree;
+
+    // Remove this entity from the users of his Rotation
+    if (mRotation)
+        mRotation->mUsers.remove(this);
+
+    // Remove this Atelier from the identifiers table
+    Exploitation *e = getExploitation();
+    if (e)
+        e->unregisterAtelier(this);
 }
 
+/**
+ * @brief Get the Exploitation that owns this Atelier (or entity)
+ *
+ * @return Pointer to the Exploitation (or NULL)
+ */
 Exploitation *Atelier::getExploitation(void)
 {
-    if (mExploitation)
-        return mExploitation;
-    else if (mParent)
-        return mParent->getExploitation();
+    return mRoot->mExploitation;
+}
+
+/**
+ * @brief Add the memory used by this Atelier and his entities to an estimation
+ *
+ * The structure (objects, lists and tree) and the values of the parameters
+ * (columns, indexes, formulas and series) are counted separately.
+ *
+ * @param usage Reference to the estimation
+ * @return integer Number of entities (sub-entities included)
+ */
+int Atelier::memoryUsage(MemoryUsage &usage)
+{
+    qint64 structure = sizeof(Atelier)
+                     + MemoryUsage::listBytes(mEntities.count())
+                     + MemoryUsage::listBytes(mParameters.count());
+    if (mTree)
+        structure += mTree->memoryUsage();
+    usage.add(MemoryUsage::CategoryEntities, structure);
+
+    qint64 values  = 0;
+    qint64 strings = MemoryUsage::stringBytes(mName);
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        AtelierParameter *parameter = mParameters.at(i);
+        values += sizeof(AtelierParameter) + parameter->mColumn->memoryUsage();
+        if (parameter->mIndex)
+            values += MemoryUsage::mapBytes(parameter->mIndex->count(),
+                                            sizeof(AtelierIndexKey) + sizeof(Atelier *));
+        if (parameter->mExpression)
+            values += parameter->mExpression->memoryUsage();
+        if (parameter->mSeries)
+            values += parameter->mSeries->memoryUsage();
+        strings += MemoryUsage::stringBytes(parameter->mName);
+    }
+    usage.add(MemoryUsage::CategoryValues,  values);
+    usage.add(MemoryUsage::CategoryStrings, strings);
+
+    int entities = mEntities.count();
+    for (int i = 0; i < mEntities.count(); ++i)
+        entities += mEntities.at(i)->memoryUsage(usage);
+    return entities;
+}
+
+/**
+ * @brief Get the content hash of this Atelier (or entity)
+ *
+ * The hash covers the name, the content of the Rotation (name, duration
+ * and plans, see Rotation::getHash), the parameters of the entities (name,
+ * kind, mandatory flag, formula and default value), the values of an
+ * entity and the hashes of all entities, so a modified entity changes the
+ * hash of his Atelier. Editing a Rotation changes the hash of all the
+ * entities that use it. It is computed again only for the modified
+ * sub-trees.
+ *
+ * @return quint64 Hash of the Atelier content
+ */
+quint64 Atelier::getHash(void)
+{
+    if (mHashValid)
+        return mHash;
+
+    INSTRUMENT_CALL("Atelier::getHash");
+
+    quint64 hash = ContentHash::combine(ContentHash::SeedAtelier,
+                                        ContentHash::fromString(mName));
+    if (mRotation)
+        hash = ContentHash::combine(hash, mRotation->getHash());
     else
-        return 0;
+        hash = ContentHash::combine(hash, 0);
+
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        AtelierParameter *parameter = mParameters.at(i);
+        hash = ContentHash::combine(hash, ContentHash::fromString(parameter->mName));
+        hash = ContentHash::combine(hash, parameter->mColumn->getKind());
+        hash = ContentHash::combine(hash, parameter->mMandatory ? 1 : 0);
+        if (parameter->mExpression)
+            hash = ContentHash::combine(hash, ContentHash::fromString(parameter->mExpression->getText()));
+        hash = ContentHash::combine(hash, ContentHash::fromDouble(parameter->mValue));
+    }
+    // Values of an entity are stored into the columns of his parent
+    if (mParent)
+    {
+        for (int i = 0; i < mParent->mParameters.count(); ++i)
+        {
+            hash = ContentHash::combine(hash, ContentHash::fromDouble(getParameterValue(i)));
+            const SeriesTable *series = mParent->mParameters.at(i)->mSeries;
+            if (series)
+                hash = ContentHash::combine(hash, series->getHash(mRow));
+        }
+    }
+
+    hash = ContentHash::combine(hash, mEntities.count());
+    for (int i = 0; i < mEntities.count(); ++i)
+        hash = ContentHash::combine(hash, mEntities.at(i)->getHash());
+
+    mHash      = hash;
+    mHashValid = true;
+    return mHash;
+}
+
+/**
+ * @brief Get the Atelier identifier (unique into his Exploitation)
+ *
+ * @return uint Identifier, 0 if the Atelier is not into an Exploitation
+ */
+uint Atelier::getId(void)
+{
+    return mId;
 }
 
 /**
@@ -84,6 +240,65 @@ const QString &Atelier::getName(void)
     return mName;
 }
 
+/**
+ * @brief Get the Atelier that owns this entity
+ *
+ * @return Pointer to the parent Atelier (NULL for a top-level Atelier)
+ */
+Atelier *Atelier::getParent(void)
+{
+    return mParent;
+}
+
+/**
+ * @brief Get the top-level Atelier of this entity
+ *
+ * @return Pointer to the root Atelier (this for a top-level Atelier)
+ */
+Atelier *Atelier::getRoot(void)
+{
+    return mRoot;
+}
+
+/**
+ * @brief Get the flat tree of the top-level Atelier and all his entities
+ *
+ * The tree is built again only after entities have been added or removed.
+ * The pointer stays valid as long as the top-level Atelier exists, but
+ * the content only until the next modification of the structure.
+ *
+ * @return Pointer to the tree of the root Atelier
+ */
+const AtelierTree *Atelier::getTree(void)
+{
+    if (mRoot != this)
+        return mRoot->getTree();
+
+    INSTRUMENT_CALL("Atelier::getTree");
+
+    if (mTree == 0)
+    {
+        mTree = new AtelierTree();
+        INSTRUMENT_ALLOC(1);
+    }
+    if ( ! mTreeValid)
+    {
+        mTree->build(this);
+        mTreeValid = true;
+    }
+    return mTree;
+}
+
+/**
+ * @brief Get the position of this entity into his parent Atelier
+ *
+ * @return integer Row of the entity (0 for a top-level Atelier)
+ */
+int Atelier::getRow(void)
+{
+    return mRow;
+}
+
 /**
  * @brief Get the current Rotation used by the Atelier
  *
@@ -102,6 +317,7 @@ Rotation *Atelier::getRotation(void)
 void Atelier::setName(const QString &name)
 {
     mName = name;
+    invalidateHash();
 }
 
 /**
@@ -111,11 +327,7 @@ void Atelier::setName(const QString &name)
  */
 Atelier *Atelier::addEntity(void)
 {
-    Atelier *newEntity = new Atelier(this);
-    for (int i = 0; i < mParameters.count(); ++i)
-        newEntity->addParameter( mParameters.at(i) );
-    mEntities.push_back(newEntity);
-    return newEntity;
+    return insertEntity(mEntities.count());
 }
 
 /**
@@ -139,6 +351,57 @@ Atelier *Atelier::getEntity(int index)
     return mEntities.at(index);
 }
 
+/**
+ * @brief Create a new entity at a given position into Atelier
+ *
+ * The entities from this row move down by one row.
+ *
+ * @param row Position of the new entity (countEntity() to append it)
+ * @return Pointer to the newly created Atelier (NULL for an invalid row)
+ */
+Atelier *Atelier::insertEntity(int row)
+{
+    INSTRUMENT_CALL("Atelier::insertEntity");
+
+    if ((row < 0) || (row > mEntities.count()))
+        return 0;
+
+    // A first sub-entity : his parameters are the ones of this entity
+    if (mParent && mParameters.isEmpty())
+        inheritParameters();
+
+    Atelier *newEntity = new Atelier(this);
+    INSTRUMENT_ALLOC(1);
+    newEntity->mRow = row;
+    mEntities.insert(row, newEntity);
+    for (int i = row + 1; i < mEntities.count(); ++i)
+        mEntities.at(i)->mRow = i;
+    mRoot->mTreeValid = false;
+    invalidateHash();
+
+    // Insert the default values of the new entity into columns and indexes
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        AtelierParameter *parameter = mParameters.at(i);
+        parameter->mColumn->insert(row, parameter->getValue());
+        if (parameter->mIndex)
+            parameter->mIndex->insert(indexKey(parameter->getValue(), newEntity), newEntity);
+        if (parameter->mSeries)
+            parameter->mSeries->insert(row, parameter->getValue());
+    }
+
+    // Compute the derived parameters of the new entity
+    if (mDerived)
+        updateDerived(QString(), row, 1);
+
+    // Give an identifier to the new entity
+    Exploitation *e = getExploitation();
+    if (e)
+        e->registerAtelier(newEntity);
+
+    return newEntity;
+}
+
 /**
  * @brief Remove one entity from current Atelier
  *
@@ -146,210 +409,1406 @@ Atelier *Atelier::getEntity(int index)
  */
 void Atelier::removeEntity(int index)
 {
+    INSTRUMENT_CALL("Atelier::removeEntity");
+
     if (index > (mEntities.count() - 1))
         return;
 
     Atelier *oldEntity = mEntities.at(index);
     mEntities.removeAt(index);
+
+    // Remove the values of this entity from indexes and columns
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        AtelierParameter *parameter = mParameters.at(i);
+        if (parameter->mIndex)
+            parameter->mIndex->remove(indexKey(oldEntity->getParameterValue(i), oldEntity));
+        parameter->mColumn->remove(index);
+        if (parameter->mSeries)
+            parameter->mSeries->remove(index);
+    }
+    // Following entities move up by one row
+    for (int i = index; i < mEntities.count(); ++i)
+        mEntities.at(i)->mRow = i;
+
     delete oldEntity;
+    mRoot->mTreeValid = false;
+    invalidateHash();
 }
 
 /**
- * @brief Create a new parameter
+ * @brief Set the values of a block of entities parameters at once
  *
- * @param name String of the parameter name
- * @param initialValue Default value for this parameter
+ * Derived parameters are computed once for the whole block (instead of
+ * once per value with setParameterValue).
+ *
+ * @param row     Row of the first entity
+ * @param index   Index of the first parameter
+ * @param rows    Number of entities
+ * @param columns Number of parameters
+ * @param values  Pointer to the values (row by row, rows x columns)
+ * @return boolean False if the block is out of the Atelier, or if an enum
+ *                 parameter refused a value (see setParameterValue)
  */
-void Atelier::addParameter(const QString &name, double initialValue)
+bool Atelier::setEntityValues(int row, int index, int rows, int columns,
+                              const double *values)
 {
-    AtelierParameter *newParam = new AtelierParameter();
-    newParam->setName (name);
-    newParam->setValue(initialValue);
+    INSTRUMENT_CALL("Atelier::setEntityValues");
 
-    mParameters.push_back(newParam);
+    if ((row < 0) || (index < 0) || (rows <= 0) || (columns <= 0))
+        return false;
+    if (((row + rows) > mEntities.count()) || ((index + columns) > mParameters.count()))
+        return false;
 
-    if ( ! mEntities.isEmpty())
+    bool result = true;
+    for (int r = 0; r < rows; ++r)
     {
-        int index = (mParameters.count() - 1);
-        for (int i = 0; i < mEntities.count(); i++)
+        Atelier *entity = mEntities.at(row + r);
+        for (int c = 0; c < columns; ++c)
         {
-            Atelier *entity = mEntities.at(i);
-            entity->addParameter(newParam);
-            entity->setParameterValue(index, initialValue);
+            if ( ! entity->storeValue(index + c, *values++))
+                result = false;
         }
     }
+
+    // Update the derived parameters of the modified rows
+    if (mDerived)
+        updateDerived(QString(), row, rows);
+
+    return result;
 }
 
 /**
- * @brief Create a new parameter from another
+ * @brief Modify one parameter of all entities at once
  *
- * @param parameter Pointer to the source parameter
+ * The column is copied into an array, modified by a single loop, then
+ * stored back. Derived parameters are updated once for the whole column.
+ *
+ * @param index Index of the parameter (derived parameters are refused)
+ * @param op    Operation to apply
+ * @param a     Factor, offset, constant or minimum (see ColumnOp)
+ * @param b     Maximum for ColumnClamp, unused for other operations
+ * @return boolean False if the parameter can not be modified (or if an enum
+ *                 parameter can not hold the results)
  */
-void Atelier::addParameter(AtelierParameter *parameter)
+bool Atelier::applyColumn(int index, ColumnOp op, double a, double b)
 {
-    AtelierParameter *newParam = new AtelierParameter();
-    newParam->setName ( parameter->getName()  );
-    newParam->setValue( parameter->getValue() );
+    INSTRUMENT_CALL("Atelier::applyColumn");
 
-    mParameters.push_back(newParam);
-}
+    if ((index < 0) || (index >= mParameters.count()) || isParameterDerived(index))
+        return false;
+    if ((op == ColumnClamp) && (a > b))
+        return false;
 
-/**
- * @brief Get the number of parameters into this Atelier
- * @return integer Current number of parameters
- */
-int Atelier::countParameter(void)
-{
-    return mParameters.count();
+    int count = mEntities.count();
+    const AtelierColumn *source = mParameters.at(index)->mColumn;
+    QVector<double> column(count);
+    INSTRUMENT_ALLOC(1);
+    double *values = column.data();
+    for (int r = 0; r < count; ++r)
+        values[r] = source->value(r);
+
+    switch (op)
+    {
+        case ColumnScale:
+            for (int r = 0; r < count; ++r)
+                values[r] *= a;
+            break;
+        case ColumnOffset:
+            for (int r = 0; r < count; ++r)
+                values[r] += a;
+            break;
+        case ColumnClamp:
+            for (int r = 0; r < count; ++r)
+                values[r] = qBound(a, values[r], b);
+            break;
+        case ColumnSet:
+            for (int r = 0; r < count; ++r)
+                values[r] = a;
+            break;
+    }
+
+    return storeColumn(index, values);
 }
 
 /**
- * @brief Delete one of the parameters
+ * @brief Set one parameter of all entities with a formula
  *
- * @param index Parameter to remove
+ * The formula is evaluated once, like a derived parameter, but the
+ * parameter keeps the results as plain values. It may use the parameter
+ * itself (ex: "Rendement * 1.05").
+ *
+ * @param index   Index of the parameter (derived parameters are refused)
+ * @param formula Text of the formula
+ * @return boolean False if the formula is invalid or uses an unknown name
+ *                 (or if an enum parameter can not hold the results)
  */
-void Atelier::delParameter(int index)
+bool Atelier::applyColumnFormula(int index, const QString &formula)
 {
-    if (index > (mParameters.count() - 1))
-        return;
+    INSTRUMENT_CALL("Atelier::applyColumnFormula");
 
-    // Remove the selected parameter into all entities
-    for (int i = 0; i < mEntities.count(); i++)
-    {
-        Atelier *entity = mEntities.at(i);
-        entity->delParameter(index);
-    }
+    if ((index < 0) || (index >= mParameters.count()) || isParameterDerived(index))
+        return false;
 
-    AtelierParameter *oldParameter = mParameters.at(index);
+    Expression expr;
+    if ( ! expr.compile(formula))
+        return false;
 
-    // Remove the selected parameter into the local parameter list
-    mParameters.removeAt(index);
+    QVector<double> column(mEntities.count());
+    INSTRUMENT_ALLOC(1);
+    if ( ! evaluateColumn(&expr, 0, mEntities.count(), column.data()))
+        return false;
 
-    delete oldParameter;
+    return storeColumn(index, column.constData());
 }
 
 /**
- * @brief Get the name of one parameter
+ * @brief Evaluate a formula for all entities, without storing the results
  *
- * @param index
- * @return QString Parameter name
+ * The formula may use the parameters of the entities and the global
+ * parameters of the Exploitation. With a year, the parameters that have
+ * series take their value of this year.
+ *
+ * @param formula Text of the formula
+ * @param values  Reference to the results (one per entity)
+ * @param year    Year (0 to use the values of the entities)
+ * @return boolean False if the formula is invalid or uses an unknown name
  */
-QString Atelier::getParameterName(int index)
+bool Atelier::evaluateFormula(const QString &formula, QVector<double> &values, int year)
 {
-    if (index > (mParameters.count() - 1))
-        return QString();
+    INSTRUMENT_CALL("Atelier::evaluateFormula");
+
+    Expression expr;
+    if ( ! expr.compile(formula))
+        return false;
 
-    return mParameters.at(index)->getName();
+    values.resize(mEntities.count());
+    INSTRUMENT_ALLOC(1);
+    return evaluateColumn(&expr, 0, mEntities.count(), values.data(), year);
 }
 
 /**
- * @brief Get the value of one parameter
+ * @brief Store one parameter of all entities, then update derived ones
  *
- * @param index
- * @return double Current value of the parameter
+ * The column is written in one pass (see AtelierColumn::setValues), not
+ * entity by entity.
+ *
+ * @param index  Index of the parameter
+ * @param values Pointer to the values (one per entity)
+ * @return boolean False if an enum parameter can not hold these values
+ *                 (the parameter is left unmodified)
  */
-double Atelier::getParameterValue(int index)
+bool Atelier::storeColumn(int index, const double *values)
 {
-    if (index > (mParameters.count() - 1))
-        return 0;
+    INSTRUMENT_CALL("Atelier::storeColumn");
+
+    AtelierParameter *parameter = mParameters.at(index);
+    AtelierColumn    *column    = parameter->mColumn;
+    if ( ! column->setValues(values, mEntities.count()))
+        return false;
+
+    // Rebuild the sorted index once, with the converted values
+    if (parameter->mIndex)
+    {
+        parameter->mIndex->clear();
+        for (int r = 0; r < mEntities.count(); ++r)
+        {
+            Atelier *entity = mEntities.at(r);
+            parameter->mIndex->insert(indexKey(column->value(r), entity), entity);
+        }
+    }
 
-    return mParameters.at(index)->getValue();
+    // All entities are modified, their parents are invalidated once
+    for (int r = 0; r < mEntities.count(); ++r)
+        mEntities.at(r)->mHashValid = false;
+    invalidateHash();
+
+    if (mDerived)
+        updateDerived(mParameters.at(index)->getName(), 0, mEntities.count());
+    return true;
 }
 
 /**
- * @brief Check if a parameter is mandatory (or not)
+ * @brief Create a sorted index on one parameter of the entities
  *
- * @param index
- * @return bool
+ * The index is then updated for each modification of an entity value,
+ * and is used by findEntities to answer range queries.
+ *
+ * @param index Index of the parameter
+ * @return boolean True if the index exists (created or already there)
  */
-bool Atelier::isParameterMandatory(int index)
+bool Atelier::createIndex(int index)
 {
-    if (index > (mParameters.count() - 1))
+    INSTRUMENT_CALL("Atelier::createIndex");
+
+    if ((index < 0) || (index > (mParameters.count() - 1)))
         return false;
 
-    return mParameters.at(index)->isMandatory();
+    AtelierParameter *parameter = mParameters.at(index);
+    if (parameter->mIndex)
+        return true;
+
+    parameter->mIndex = new AtelierIndex();
+    INSTRUMENT_ALLOC(1);
+    for (int i = 0; i < mEntities.count(); ++i)
+    {
+        Atelier *entity = mEntities.at(i);
+        parameter->mIndex->insert(indexKey(entity->getParameterValue(index), entity), entity);
+    }
+    return true;
 }
 
 /**
- * @brief Mark a parameter as mandatory
+ * @brief Delete the sorted index of one parameter
  *
- * @param index
+ * @param index Index of the parameter
  */
-void Atelier::setParameterMandatory(int index)
+void Atelier::dropIndex(int index)
 {
-    if (index > (mParameters.count() - 1))
+    if ((index < 0) || (index > (mParameters.count() - 1)))
         return;
 
-    mParameters.at(index)->setMandatory();
+    AtelierParameter *parameter = mParameters.at(index);
+    delete parameter->mIndex;
+    parameter->mIndex = 0;
 }
 
 /**
- * @brief Set the name of a parameter (rename it)
+ * @brief Search the entities that match all the specified ranges
  *
- * @param index
- * @param name New name to set
+ * When at least one range is on an indexed parameter, only the entities
+ * of the smallest indexed range are tested. Without any index, all
+ * entities are scanned.
+ *
+ * @param ranges List of conditions (all must match)
+ * @return List of the matching entities rows (sorted)
  */
-void Atelier::setParameterName(int index, QString &name)
+QList<int> Atelier::findEntities(const QList<AtelierRange> &ranges)
 {
-    if (index > (mParameters.count() - 1))
-        return;
+    INSTRUMENT_CALL("Atelier::findEntities");
 
-    mParameters.at(index)->setName(name);
+    typedef AtelierIndex::const_iterator IndexIterator;
+    QList<int> result;
 
-    if ( ! mEntities.isEmpty())
+    // Get the bounds of each indexed range
+    QList<IndexIterator> begins;
+    QList<IndexIterator> ends;
+    for (int i = 0; i < ranges.count(); ++i)
     {
-        for (int i = 0; i < mEntities.count(); i++)
-            mEntities.at(i)->setParameterName(index, name);
+        const AtelierRange &range = ranges.at(i);
+        // An empty range can not match anything
+        if ((range.getMin() > range.getMax()) ||
+            (range.isStrict() && (range.getMin() == range.getMax())))
+            return result;
+        if ( ! hasIndex(range.getParameter()))
+            continue;
+        const AtelierIndex *map = mParameters.at(range.getParameter())->mIndex;
+        // Entities sort after (value, 0) and before (value, max)
+        AtelierIndexKey minFirst(range.getMin(), 0);
+        AtelierIndexKey minLast (range.getMin(), ~quintptr(0));
+        AtelierIndexKey maxFirst(range.getMax(), 0);
+        AtelierIndexKey maxLast (range.getMax(), ~quintptr(0));
+        IndexIterator first = range.isStrict() ? map->upperBound(minLast)
+                                               : map->lowerBound(minFirst);
+        IndexIterator last  = range.isStrict() ? map->lowerBound(maxFirst)
+                                               : map->upperBound(maxLast);
+        // No entity into this range, nothing can match
+        if (first == last)
+            return result;
+        begins.append(first);
+        ends.append(last);
+    }
+
+    // Candidate entities : from the smallest indexed range, or all entities
+    QList<Atelier *> candidates;
+    if (begins.isEmpty())
+        candidates = mEntities;
+    else
+    {
+        // Walk all ranges together, the first one to end is the smallest
+        QList<IndexIterator> walk(begins);
+        int smallest = -1;
+        while (smallest < 0)
+        {
+            for (int i = 0; i < walk.count(); ++i)
+            {
+                if (walk.at(i) == ends.at(i))
+                {
+                    smallest = i;
+                    break;
+                }
+                ++walk[i];
+            }
+        }
+        for (IndexIterator it = begins.at(smallest); it != ends.at(smallest); ++it)
+            candidates.append(it.value());
+    }
+
+    // Test all ranges on the candidates
+    for (int i = 0; i < candidates.count(); ++i)
+    {
+        Atelier *entity = candidates.at(i);
+        bool match = true;
+        for (int j = 0; match && (j < ranges.count()); ++j)
+        {
+            const AtelierRange &range = ranges.at(j);
+            match = range.contains(entity->getParameterValue(range.getParameter()));
+        }
+        if (match)
+            result.append(entity->mRow);
     }
+    std::sort(result.begin(), result.end());
+
+    return result;
 }
 
 /**
- * @brief Set the value of a parameter
+ * @brief Test if a parameter has a sorted index
  *
- * @param index
- * @param value New value for the specified parameter
+ * @param index Index of the parameter
+ * @return boolean True if the parameter is indexed
  */
-void Atelier::setParameterValue(int index, double value)
+bool Atelier::hasIndex(int index)
 {
-    if (index > (mParameters.count() - 1))
-        return;
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
 
-    AtelierParameter *parameter = mParameters.at(index);
-    parameter->setValue(value);
+    return (mParameters.at(index)->mIndex != 0);
 }
 
 /**
- * @brief Set the rotation used by this Atelier
+ * @brief Create a new parameter computed from a formula
  *
- * @param rotation Pointer to the Rotation to use
+ * The formula may use the other parameters of the entities and the global
+ * parameters of the Exploitation (ex: "Surface * PrixBle * 0.8").
+ *
+ * @param name    String of the parameter name
+ * @param formula Formula of the parameter
+ * @return boolean True on success (false if the formula is not valid)
  */
-void Atelier::setRotation(Rotation *rotation)
+bool Atelier::addDerivedParameter(const QString &name, const QString &formula)
 {
-    mRotation = rotation;
-}
+    addParameter(name, 0);
+    if (setParameterFormula(mParameters.count() - 1, formula))
+        return true;
 
-// -------------------- Parameters --------------------
+    delParameter(mParameters.count() - 1);
+    return false;
+}
 
-AtelierParameter::AtelierParameter(AtelierParameter *model)
+/**
+ * @brief Compute the value of a derived parameter for some entities
+ *
+ * @param index Index of the derived parameter
+ * @param first Row of the first entity to update
+ * @param count Number of entities to update
+ * @return boolean False if a variable of the formula is unknown
+ */
+bool Atelier::computeDerived(int index, int first, int count)
 {
-    mMandatory = false;
-    mName.clear();
-    mValue = 0;
+    INSTRUMENT_CALL("Atelier::computeDerived");
 
-    // Init from model
-    if (model)
+    Expression *expr = mParameters.at(index)->mExpression;
+    if (expr == 0)
+        return false;
+    if (count <= 0)
+        return true;
+
+    QVector<double> result(count);
+    if ( ! evaluateColumn(expr, first, count, result.data()))
+        return false;
+
+    bool stored = true;
+    for (int r = 0; r < count; ++r)
     {
-        mName  = model->getName();
-        mValue = model->getValue();
-        if (model->isMandatory())
-            mMandatory = true;
+        if ( ! mEntities.at(first + r)->storeValue(index, result.at(r)))
+            stored = false;
     }
+    return stored;
 }
 
-QString AtelierParameter::getName(void)
+/**
+ * @brief Evaluate a formula for some entities
+ *
+ * All input values are first gathered into columns, then the formula is
+ * evaluated for all rows at once.
+ *
+ * @param expr   Pointer to the compiled formula
+ * @param first  Row of the first entity
+ * @param count  Number of entities
+ * @param output Pointer to the results (count values)
+ * @param year   Year of the series to use (0 to use the values of the entities)
+ * @return boolean False if a variable of the formula is unknown
+ */
+bool Atelier::evaluateColumn(Expression *expr, int first, int count, double *output,
+                             int year)
 {
-    return mName;
-}
+    const QStringList &vars = expr->getVariables();
+    Exploitation *e = getExploitation();
+
+    QVector< QVector<double> > columns(vars.count());
+    QVector<double> scalars(vars.count(), 0);
+    QVector<int>    strides(vars.count(), 0);
+    for (int v = 0; v < vars.count(); ++v)
+    {
+        // A variable is a parameter of the entities ...
+        int column = parameterIndex(vars.at(v));
+        if (column >= 0)
+        {
+            const AtelierColumn *source = mParameters.at(column)->mColumn;
+            // Values of the year are read from the series table at once
+            const double *slice = year ? getYearValues(column, year) : 0;
+            QVector<double> &values = columns[v];
+            values.resize(count);
+            if (slice)
+                memcpy(values.data(), slice + first, count * sizeof(double));
+            else
+            {
+                for (int r = 0; r < count; ++r)
+                    values[r] = source->value(first + r);
+            }
+            strides[v] = 1;
+            continue;
+        }
+        // ... or a global parameter of the Exploitation
+        Parameter *global = e ? e->getParameter(vars.at(v)) : 0;
+        if (global == 0)
+            return false;
+        scalars[v] = year ? global->getValue(year) : global->getValue();
+    }
+
+    QVector<const double *> inputs(vars.count());
+    for (int v = 0; v < vars.count(); ++v)
+    {
+        if (strides.at(v))
+            inputs[v] = columns.at(v).constData();
+        else
+            inputs[v] = scalars.constData() + v;
+    }
+
+    expr->evaluate(inputs, strides, count, output);
+
+    return true;
+}
+
+/**
+ * @brief Get the derived parameters to compute after a modification
+ *
+ * The derived parameters form a dependency graph (a formula may use
+ * another derived parameter). The returned list contains the parameters
+ * that use the modified value, directly or not, sorted so that each one
+ * comes after the parameters it depends on.
+ *
+ * @param name  Name of the modified value (empty to get all derived)
+ * @param order Reference to the list that receive the parameters indexes
+ * @return boolean False if the formulas contain a dependency cycle
+ */
+bool Atelier::derivedOrder(const QString &name, QList<int> &order)
+{
+    order.clear();
+
+    // Search the affected derived parameters
+    QList<int> affected;
+    QStringList changed;
+    if ( ! name.isEmpty())
+        changed.append(name);
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        if (mParameters.at(i)->mExpression && name.isEmpty())
+            affected.append(i);
+    }
+    for (int n = 0; n < changed.count(); ++n)
+    {
+        for (int i = 0; i < mParameters.count(); ++i)
+        {
+            Expression *expr = mParameters.at(i)->mExpression;
+            if ((expr == 0) || affected.contains(i))
+                continue;
+            if (expr->getVariables().contains(changed.at(n)))
+            {
+                affected.append(i);
+                changed.append(mParameters.at(i)->getName());
+            }
+        }
+    }
+
+    // Sort them : depth-first walk of the dependencies
+    QVector<int> state(mParameters.count(), 0); // 1: in progress, 2: done
+    QList<int> stack;
+    for (int a = 0; a < affected.count(); ++a)
+    {
+        if (state.at(affected.at(a)))
+            continue;
+        stack.append(affected.at(a));
+        while ( ! stack.isEmpty())
+        {
+            int current = stack.last();
+            if (state.at(current) == 0)
+            {
+                state[current] = 1;
+                const QStringList &vars = mParameters.at(current)->mExpression->getVariables();
+                for (int v = 0; v < vars.count(); ++v)
+                {
+                    int dep = parameterIndex(vars.at(v));
+                    if ((dep < 0) || ! affected.contains(dep))
+                        continue;
+                    if (state.at(dep) == 1)
+                        return false;
+                    if (state.at(dep) == 0)
+                        stack.append(dep);
+                }
+            }
+            else
+            {
+                stack.removeLast();
+                if (state.at(current) == 1)
+                {
+                    state[current] = 2;
+                    order.append(current);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the formula of a derived parameter
+ *
+ * @param index Index of the parameter
+ * @return QString Formula (empty if the parameter is not derived)
+ */
+QString Atelier::getParameterFormula(int index)
+{
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return QString();
+
+    Expression *expr = mParameters.at(index)->mExpression;
+    if (expr == 0)
+        return QString();
+    return expr->getText();
+}
+
+/**
+ * @brief Test if a parameter is computed from a formula
+ *
+ * @param index Index of the parameter
+ * @return boolean True for a derived parameter
+ */
+bool Atelier::isParameterDerived(int index)
+{
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
+
+    return (mParameters.at(index)->mExpression != 0);
+}
+
+/**
+ * @brief Search a parameter by his name
+ *
+ * @param name Name of the parameter
+ * @return integer Index of the parameter (-1 if not found)
+ */
+int Atelier::parameterIndex(const QString &name)
+{
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        if (mParameters.at(i)->getName() == name)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Set (or remove) the formula of a parameter
+ *
+ * The formula is compiled once, then the values of all entities are
+ * computed (with the derived parameters that depend on this one).
+ *
+ * @param index   Index of the parameter
+ * @param formula Formula to use, empty to make it a plain parameter
+ * @return boolean False on syntax error, unknown variable or dependency cycle
+ */
+bool Atelier::setParameterFormula(int index, const QString &formula)
+{
+    INSTRUMENT_CALL("Atelier::setParameterFormula");
+
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
+
+    AtelierParameter *parameter = mParameters.at(index);
+    Expression *old = parameter->mExpression;
+
+    if (formula.isEmpty())
+    {
+        if (old)
+            mDerived--;
+        delete old;
+        parameter->mExpression = 0;
+        invalidateHash();
+        return true;
+    }
+
+    Expression *expr = new Expression();
+    INSTRUMENT_ALLOC(1);
+    if ( ! expr->compile(formula))
+    {
+        delete expr;
+        return false;
+    }
+
+    // Each variable must be a parameter of the entities or a global one
+    const QStringList &vars = expr->getVariables();
+    Exploitation *e = getExploitation();
+    for (int v = 0; v < vars.count(); ++v)
+    {
+        if (parameterIndex(vars.at(v)) >= 0)
+            continue;
+        if (e && e->getParameter(vars.at(v)))
+            continue;
+        delete expr;
+        return false;
+    }
+
+    // Refuse a formula that (indirectly) uses his own result
+    parameter->mExpression = expr;
+    QList<int> order;
+    if ( ! derivedOrder(QString(), order))
+    {
+        parameter->mExpression = old;
+        delete expr;
+        return false;
+    }
+    if (old == 0)
+        mDerived++;
+    delete old;
+    invalidateHash();
+
+    // Compute this parameter, then the ones that use it
+    computeDerived(index, 0, mEntities.count());
+    updateDerived(parameter->getName(), 0, mEntities.count());
+
+    return true;
+}
+
+/**
+ * @brief Compute all derived parameters of all entities
+ *
+ * @return boolean False if a formula uses an unknown variable
+ */
+bool Atelier::updateDerived(void)
+{
+    return updateDerived(QString(), 0, mEntities.count());
+}
+
+/**
+ * @brief Compute the derived parameters that use a modified value
+ *
+ * @param name Name of the modified parameter (entity or global)
+ * @return boolean False if a formula uses an unknown variable
+ */
+bool Atelier::updateDerived(const QString &name)
+{
+    return updateDerived(name, 0, mEntities.count());
+}
+
+/**
+ * @brief Compute the derived parameters that use a value, for some rows
+ *
+ * @param name  Name of the modified parameter (empty for all derived)
+ * @param first Row of the first entity to update
+ * @param count Number of entities to update
+ * @return boolean False if a formula can not be computed
+ */
+bool Atelier::updateDerived(const QString &name, int first, int count)
+{
+    INSTRUMENT_CALL("Atelier::updateDerived");
+
+    if (mDerived == 0)
+        return true;
+
+    QList<int> order;
+    if ( ! derivedOrder(name, order))
+        return false;
+
+    bool result = true;
+    for (int i = 0; i < order.count(); ++i)
+    {
+        if ( ! computeDerived(order.at(i), first, count))
+            result = false;
+    }
+    return result;
+}
+
+/**
+ * @brief Create a new parameter
+ *
+ * @param name String of the parameter name
+ * @param initialValue Default value for this parameter
+ */
+void Atelier::addParameter(const QString &name, double initialValue)
+{
+    insertParameter(mParameters.count(), name, initialValue);
+}
+
+/**
+ * @brief Create a new parameter at a given position
+ *
+ * @param index        Position of the new parameter (countParameter() to append it)
+ * @param name         String of the parameter name
+ * @param initialValue Default value for this parameter
+ */
+void Atelier::insertParameter(int index, const QString &name, double initialValue)
+{
+    INSTRUMENT_CALL("Atelier::insertParameter");
+
+    if ((index < 0) || (index > mParameters.count()))
+        return;
+
+    AtelierParameter *newParam = new AtelierParameter();
+    INSTRUMENT_ALLOC(1);
+    newParam->setName (name);
+    newParam->setValue(initialValue);
+
+    // All entities start with the initial value (stored once)
+    newParam->mColumn->reset(mEntities.count(), initialValue);
+
+    mParameters.insert(index, newParam);
+    invalidateHash();
+
+    // Entities that hold sub-entities give them the new parameter too
+    for (int i = 0; i < mEntities.count(); i++)
+    {
+        Atelier *entity = mEntities.at(i);
+        entity->invalidateHash();
+        if ( ! entity->mParameters.isEmpty())
+            entity->insertParameter(index, name, initialValue);
+    }
+}
+
+/**
+ * @brief Create a new parameter from another
+ *
+ * @param parameter Pointer to the source parameter
+ */
+void Atelier::addParameter(AtelierParameter *parameter)
+{
+    addParameter(parameter->getName(), parameter->getValue());
+
+    int index = mParameters.count() - 1;
+    setParameterKind(index, parameter->mColumn->getKind());
+    if (parameter->isMandatory())
+        setParameterMandatory(index);
+}
+
+/**
+ * @brief Get the number of parameters into this Atelier
+ * @return integer Current number of parameters
+ */
+int Atelier::countParameter(void)
+{
+    if (mParent)
+        return mParent->mParameters.count();
+    return mParameters.count();
+}
+
+/**
+ * @brief Delete one of the parameters
+ *
+ * A parameter used by a formula (of this Atelier or of an entity, see
+ * isNameUsed) is not deleted, the formula must be modified first.
+ *
+ * @param index Parameter to remove
+ * @return boolean False if the parameter does not exist or is used
+ */
+bool Atelier::delParameter(int index)
+{
+    INSTRUMENT_CALL("Atelier::delParameter");
+
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
+    if (isNameUsed(mParameters.at(index)->getName()))
+        return false;
+
+    dropParameter(index);
+    return true;
+}
+
+/**
+ * @brief Delete one of the parameters, even if a formula uses it
+ *
+ * Only used to replay a patch : the formulas are modified by the
+ * following operations.
+ *
+ * @param index Parameter to remove
+ */
+void Atelier::dropParameter(int index)
+{
+    // Remove the selected parameter into entities that hold sub-entities
+    for (int i = 0; i < mEntities.count(); i++)
+    {
+        Atelier *entity = mEntities.at(i);
+        entity->invalidateHash();
+        if ( ! entity->mParameters.isEmpty())
+            entity->dropParameter(index);
+    }
+
+    AtelierParameter *oldParameter = mParameters.at(index);
+    if (oldParameter->mExpression)
+        mDerived--;
+
+    // Remove the selected parameter into the local parameter list
+    mParameters.removeAt(index);
+
+    delete oldParameter;
+    invalidateHash();
+}
+
+/**
+ * @brief Get the name of one parameter
+ *
+ * @param index
+ * @return QString Parameter name
+ */
+QString Atelier::getParameterName(int index)
+{
+    INSTRUMENT_CALL("Atelier::getParameterName");
+
+    AtelierParameter *parameter = definition(index);
+    if (parameter == 0)
+        return QString();
+
+    return parameter->getName();
+}
+
+/**
+ * @brief Get the value of one parameter
+ *
+ * @param index
+ * @return double Current value of the parameter
+ */
+double Atelier::getParameterValue(int index)
+{
+    INSTRUMENT_CALL("Atelier::getParameterValue");
+
+    AtelierParameter *parameter = definition(index);
+    if (parameter == 0)
+        return 0;
+
+    // Value of an entity, or default value for a top-level Atelier
+    if (mParent)
+        return parameter->mColumn->value(mRow);
+    return parameter->getValue();
+}
+
+/**
+ * @brief Check if a parameter is mandatory (or not)
+ *
+ * @param index
+ * @return bool
+ */
+bool Atelier::isParameterMandatory(int index)
+{
+    AtelierParameter *parameter = definition(index);
+    if (parameter == 0)
+        return false;
+
+    return parameter->isMandatory();
+}
+
+/**
+ * @brief Mark a parameter as mandatory (or optional)
+ *
+ * @param index
+ * @param mandatory False to make the parameter optional again
+ */
+void Atelier::setParameterMandatory(int index, bool mandatory)
+{
+    if (index > (mParameters.count() - 1))
+        return;
+
+    mParameters.at(index)->setMandatory(mandatory);
+    invalidateHash();
+}
+
+/**
+ * @brief Test if a formula uses a name
+ *
+ * The formulas of this Atelier and of his entities (at any depth) are
+ * searched.
+ *
+ * @param name Name of a parameter (entity or global)
+ * @return boolean True if a formula uses this name
+ */
+bool Atelier::isNameUsed(const QString &name)
+{
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        Expression *expr = mParameters.at(i)->mExpression;
+        if (expr && expr->getVariables().contains(name))
+            return true;
+    }
+    for (int i = 0; i < mEntities.count(); ++i)
+    {
+        Atelier *entity = mEntities.at(i);
+        if (( ! entity->mParameters.isEmpty()) && entity->isNameUsed(name))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Set the name of a parameter (rename it)
+ *
+ * Formulas use the parameters by name : a parameter used by a formula is
+ * not renamed, nor renamed to a name that a formula uses (see isNameUsed).
+ *
+ * @param index
+ * @param name New name to set
+ * @return boolean False if the parameter does not exist or a name is used
+ */
+bool Atelier::setParameterName(int index, QString &name)
+{
+    INSTRUMENT_CALL("Atelier::setParameterName");
+
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
+    QString oldName = mParameters.at(index)->getName();
+    if (name == oldName)
+        return true;
+    if ((mParent == 0) && (isNameUsed(oldName) || isNameUsed(name)))
+        return false;
+
+    mParameters.at(index)->setName(name);
+    invalidateHash();
+
+    // Entities that hold sub-entities have their own copy of the name
+    for (int i = 0; i < mEntities.count(); i++)
+    {
+        if ( ! mEntities.at(i)->mParameters.isEmpty())
+            mEntities.at(i)->setParameterName(index, name);
+    }
+    return true;
+}
+
+/**
+ * @brief Get the definition of a parameter for the entities of this Atelier
+ *
+ * An entity holds his own definitions only once he has sub-entities (or
+ * a default value of his own, see setParameterDefault).
+ *
+ * @param index Index of the parameter
+ * @return Pointer to the parameter (NULL if not found)
+ */
+AtelierParameter *Atelier::getParameter(int index)
+{
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return 0;
+
+    return mParameters.at(index);
+}
+
+/**
+ * @brief Set the default value of a parameter for the entities of this Atelier
+ *
+ * For an entity, this is the value of his next sub-entities : the first
+ * call copies the parameters of the parent Atelier (see inheritParameters).
+ * For a top-level Atelier, this is the same as setParameterValue.
+ *
+ * @param index Index of the parameter
+ * @param value New default value
+ * @return boolean False if the parameter does not exist
+ */
+bool Atelier::setParameterDefault(int index, double value)
+{
+    if ((index < 0) || (index > (countParameter() - 1)))
+        return false;
+
+    if (mParent && mParameters.isEmpty())
+        inheritParameters();
+
+    // New entities use the default value of the column
+    AtelierParameter *parameter = mParameters.at(index);
+    if ( ! parameter->mColumn->setDefault(value))
+        return false;
+    parameter->setValue(parameter->mColumn->normalize(value));
+    invalidateHash();
+    return true;
+}
+
+/**
+ * @brief Get the storage kind of a parameter
+ *
+ * @param index Index of the parameter
+ * @return Kind of the parameter (KindDouble if not found)
+ */
+AtelierColumn::Kind Atelier::getParameterKind(int index)
+{
+    AtelierParameter *parameter = definition(index);
+    if (parameter == 0)
+        return AtelierColumn::KindDouble;
+
+    return parameter->mColumn->getKind();
+}
+
+/**
+ * @brief Set the storage kind of a parameter
+ *
+ * The values of all entities (and the default value) are converted to
+ * the new kind, derived parameters that use them are computed again.
+ *
+ * @param index Index of the parameter
+ * @param kind  New kind of the parameter
+ * @return boolean False if the values can not be converted
+ */
+bool Atelier::setParameterKind(int index, AtelierColumn::Kind kind)
+{
+    INSTRUMENT_CALL("Atelier::setParameterKind");
+
+    if ((index < 0) || (index > (mParameters.count() - 1)))
+        return false;
+
+    AtelierParameter *parameter = mParameters.at(index);
+    if (parameter->mColumn->getKind() == kind)
+        return true;
+    if ( ! parameter->mColumn->convert(kind))
+        return false;
+    parameter->setValue(parameter->mColumn->normalize(parameter->getValue()));
+
+    // Converted values : the indexes and hashes must be built again
+    if (parameter->mIndex)
+    {
+        dropIndex(index);
+        createIndex(index);
+    }
+    for (int i = 0; i < mEntities.count(); i++)
+        mEntities.at(i)->invalidateHash();
+    invalidateHash();
+
+    if (mDerived)
+        updateDerived(parameter->getName(), 0, mEntities.count());
+    return true;
+}
+
+/**
+ * @brief Get the definition of one parameter of this Atelier (or entity)
+ *
+ * The parameters of an entity are defined by his parent Atelier.
+ *
+ * @param index Index of the parameter
+ * @return Pointer to the parameter (NULL if not found)
+ */
+AtelierParameter *Atelier::definition(int index)
+{
+    const QList<AtelierParameter *> &parameters = mParent ? mParent->mParameters : mParameters;
+    if ((index < 0) || (index > (parameters.count() - 1)))
+        return 0;
+
+    return parameters.at(index);
+}
+
+/**
+ * @brief Copy the parameters of an entity for his sub-entities
+ *
+ * The current values of the entity become the default values of his
+ * sub-entities.
+ */
+void Atelier::inheritParameters(void)
+{
+    INSTRUMENT_CALL("Atelier::inheritParameters");
+
+    for (int i = 0; i < mParent->mParameters.count(); ++i)
+    {
+        AtelierParameter *model = mParent->mParameters.at(i);
+        AtelierParameter *parameter = new AtelierParameter(model);
+        INSTRUMENT_ALLOC(1);
+        parameter->setValue(getParameterValue(i));
+        parameter->mColumn->setDefault(parameter->getValue());
+        mParameters.append(parameter);
+    }
+}
+
+/**
+ * @brief Mark the content hash of this Atelier (and parents) as modified
+ *
+ * A valid hash implies that all the entities hashes are valid too, so the
+ * walk stops at the first parent already marked.
+ */
+void Atelier::invalidateHash(void)
+{
+    Atelier *atelier = this;
+    while (atelier && atelier->mHashValid)
+    {
+        atelier->mHashValid = false;
+        atelier = atelier->mParent;
+    }
+}
+
+/**
+ * @brief Set the value of a parameter
+ *
+ * An enum parameter holds at most 256 distinct values : a new one is
+ * refused when all are used, the kind must then be modified explicitly
+ * (see setParameterKind). A derived parameter is computed from his
+ * formula, his value can not be set.
+ *
+ * @param index
+ * @param value New value for the specified parameter
+ * @return boolean False if the parameter does not exist, is derived or
+ *                 refused the value
+ */
+bool Atelier::setParameterValue(int index, double value)
+{
+    INSTRUMENT_CALL("Atelier::setParameterValue");
+
+    if ((index < 0) || (index > (countParameter() - 1)))
+        return false;
+    if (definition(index)->mExpression)
+        return false;
+
+    if ( ! storeValue(index, value))
+        return false;
+
+    // Update the derived parameters that use this value
+    if (mParent && mParent->mDerived)
+        mParent->updateDerived(mParent->mParameters.at(index)->getName(), mRow, 1);
+    return true;
+}
+
+/**
+ * @brief Store the value of a parameter (without derived parameters update)
+ *
+ * @param index Index of the parameter
+ * @param value New value for the specified parameter
+ * @return boolean False if an enum parameter can not hold this value
+ */
+bool Atelier::storeValue(int index, double value)
+{
+    AtelierParameter *parameter = definition(index);
+    value = parameter->mColumn->normalize(value);
+
+    // Default value of a top-level Atelier (used by the new entities)
+    if (mParent == 0)
+    {
+        if ( ! parameter->mColumn->setDefault(value))
+            return false;
+        parameter->setValue(value);
+        invalidateHash();
+        return true;
+    }
+
+    // An enum column may refuse a new distinct value
+    double old = parameter->mColumn->value(mRow);
+    if ( ! parameter->mColumn->setValue(mRow, value))
+        return false;
+
+    // Keep the index of the parent Atelier sorted
+    if (parameter->mIndex && (old != value))
+    {
+        parameter->mIndex->remove(indexKey(old, this));
+        parameter->mIndex->insert(indexKey(value, this), this);
+    }
+
+    invalidateHash();
+    return true;
+}
+
+/**
+ * @brief Set the rotation used by this Atelier
+ *
+ * @param rotation Pointer to the Rotation to use
+ */
+void Atelier::setRotation(Rotation *rotation)
+{
+    if (rotation == mRotation)
+        return;
+
+    // Update the users of the old and new Rotations
+    if (mRotation)
+        mRotation->mUsers.remove(this);
+    if (rotation)
+        rotation->mUsers.insert(this);
+
+    mRotation = rotation;
+    invalidateHash();
+}
+
+// -------------------- Series --------------------
+
+/**
+ * @brief Remove the values of each year of one parameter
+ *
+ * @param index Index of the parameter
+ */
+void Atelier::dropParameterSeries(int index)
+{
+    if ((index < 0) || (index >= mParameters.count()))
+        return;
+
+    AtelierParameter *parameter = mParameters.at(index);
+    if (parameter->mSeries == 0)
+        return;
+    delete parameter->mSeries;
+    parameter->mSeries = 0;
+
+    for (int i = 0; i < mEntities.count(); i++)
+        mEntities.at(i)->invalidateHash();
+}
+
+/**
+ * @brief Get the values of each year of one parameter of an entity
+ *
+ * @param index Index of the parameter
+ * @return TimeSeries Values (empty if the parameter has no series)
+ */
+TimeSeries Atelier::getParameterSeries(int index)
+{
+    AtelierParameter *parameter = definition(index);
+    if ((mParent == 0) || (parameter == 0) || (parameter->mSeries == 0))
+        return TimeSeries();
+    return parameter->mSeries->getSeries(mRow);
+}
+
+/**
+ * @brief Get the value of a parameter of an entity for one year
+ *
+ * @param index Index of the parameter
+ * @param year  Year
+ * @return double Value of the year, or the value of the entity when the
+ *                parameter has no series
+ */
+double Atelier::getParameterValue(int index, int year)
+{
+    AtelierParameter *parameter = definition(index);
+    if (mParent && parameter && parameter->mSeries)
+        return parameter->mSeries->value(mRow, year);
+    return getParameterValue(index);
+}
+
+/**
+ * @brief Get the values of one parameter of all entities for one year
+ *
+ * @param index Index of the parameter
+ * @param year  Year
+ * @return Pointer to the values, one per entity (NULL if no series)
+ */
+const double *Atelier::getYearValues(int index, int year)
+{
+    if ((index < 0) || (index >= mParameters.count()))
+        return 0;
+
+    const SeriesTable *series = mParameters.at(index)->mSeries;
+    if (series == 0)
+        return 0;
+    return series->slice(year);
+}
+
+/**
+ * @brief Test if a parameter has values for each year
+ *
+ * @param index Index of the parameter
+ * @return boolean True if some series are set
+ */
+bool Atelier::hasParameterSeries(int index)
+{
+    AtelierParameter *parameter = definition(index);
+    return parameter && parameter->mSeries;
+}
+
+/**
+ * @brief Set the values of each year of one parameter for some entities
+ *
+ * The first series of a parameter creates his table : other entities then
+ * keep their current value for all years. The values of the years are
+ * independent of the value of the entity (see setParameterValue).
+ *
+ * @param index  Index of the parameter
+ * @param rows   Rows of the entities
+ * @param series Values of each entity
+ * @return boolean False if a row or a series is invalid
+ */
+bool Atelier::setEntitySeries(int index, const QVector<int> &rows,
+                              const QVector<TimeSeries> &series)
+{
+    INSTRUMENT_CALL("Atelier::setEntitySeries");
+
+    if ((index < 0) || (index >= mParameters.count()))
+        return false;
+
+    AtelierParameter *parameter = mParameters.at(index);
+    if (parameter->mSeries == 0)
+    {
+        QVector<double> values(mEntities.count());
+        for (int r = 0; r < mEntities.count(); ++r)
+            values[r] = parameter->mColumn->value(r);
+        parameter->mSeries = new SeriesTable();
+        INSTRUMENT_ALLOC(1);
+        parameter->mSeries->reset(values);
+    }
+    if ( ! parameter->mSeries->setSeries(rows, series))
+        return false;
+
+    for (int i = 0; i < rows.count(); i++)
+        mEntities.at(rows.at(i))->invalidateHash();
+    return true;
+}
+
+/**
+ * @brief Set the values of each year of one parameter of an entity
+ *
+ * @param index  Index of the parameter
+ * @param series Values of the entity
+ * @return boolean False if this is not an entity, or the series is invalid
+ */
+bool Atelier::setParameterSeries(int index, const TimeSeries &series)
+{
+    if (mParent == 0)
+        return false;
+    return mParent->setEntitySeries(index, QVector<int>(1, mRow),
+                                    QVector<TimeSeries>(1, series));
+}
+
+// -------------------- Parameters --------------------
+
+AtelierParameter::AtelierParameter(AtelierParameter *model)
+{
+    mMandatory = false;
+    mName.clear();
+    mValue = 0;
+    mIndex = 0;
+    mExpression = 0;
+    mSeries = 0;
+
+    // Init from model (without the values of the entities)
+    if (model)
+    {
+        mName  = model->getName();
+        mValue = model->getValue();
+        if (model->isMandatory())
+            mMandatory = true;
+        mColumn = new AtelierColumn(model->mColumn->getKind());
+    }
+    else
+        mColumn = new AtelierColumn();
+}
+
+AtelierParameter::~AtelierParameter()
+{
+    delete mIndex;
+    delete mExpression;
+    delete mColumn;
+    delete mSeries;
+}
+
+AtelierColumn::Kind AtelierParameter::getKind(void)
+{
+    return mColumn->getKind();
+}
+
+QString AtelierParameter::getName(void)
+{
+    return mName;
+}
 
 double AtelierParameter::getValue(void)
 {
@@ -361,9 +1820,9 @@ bool AtelierParameter::isMandatory(void)
     return mMandatory;
 }
 
-void AtelierParameter::setMandatory(void)
+void AtelierParameter::setMandatory(bool mandatory)
 {
-    mMandatory = true;
+    mMandatory = mandatory;
 }
 
 void AtelierParameter::setName(const QString &name)
@@ -375,3 +1834,48 @@ void AtelierParameter::setValue(double value)
 {
     mValue = value;
 }
+
+// -------------------- Ranges --------------------
+
+/**
+ * @brief Constructor of a range condition on one parameter
+ *
+ * @param parameter Index of the parameter
+ * @param min       Lower bound (use -qInf() for no lower bound)
+ * @param max       Upper bound (use qInf() for no upper bound)
+ * @param strict    True to exclude the bounds hitself
+ */
+AtelierRange::AtelierRange(int parameter, double min, double max, bool strict)
+{
+    mParameter = parameter;
+    mMin       = min;
+    mMax       = max;
+    mStrict    = strict;
+}
+
+bool AtelierRange::contains(double value) const
+{
+    if (mStrict)
+        return (value > mMin) && (value < mMax);
+    return (value >= mMin) && (value <= mMax);
+}
+
+double AtelierRange::getMax(void) const
+{
+    return mMax;
+}
+
+double AtelierRange::getMin(void) const
+{
+    return mMin;
+}
+
+int AtelierRange::getParameter(void) const
+{
+    return mParameter;
+}
+
+bool AtelierRange::isStrict(void) const
+{
+    return mStrict;
+}
@@ -9,44 +9,134 @@
 #define ATELIER_H
 
 #include <QList>
+#include <QMap>
+#include <QPair>
 #include <QString>
+#include <QVector>
+#include "column.h"
+#include "expression.h"
+#include "memoryusage.h"
 #include "rotation.h"
+#include "timeseries.h"
 
 class Exploitation;
 class AtelierParameter;
+class AtelierRange;
+class AtelierTree;
+
+// Key of a parameter index : the value, then the entity (so keys are unique)
+typedef QPair<double, quintptr> AtelierIndexKey;
+typedef QMap<AtelierIndexKey, Atelier *> AtelierIndex;
 
 class Atelier
 {
+public:
+    // Operations on one parameter of all entities (see applyColumn)
+    enum ColumnOp {
+        ColumnScale,  // value * a
+        ColumnOffset, // value + a
+        ColumnClamp,  // value bounded into [a, b]
+        ColumnSet     // a
+    };
 public:
     explicit Atelier(Atelier *parent = 0);
     explicit Atelier(Exploitation *exploitation);
     ~Atelier();
+    quint64 getHash(void);
+    uint getId(void);
     const QString &getName(void);
+    Atelier *getParent(void);
+    Atelier *getRoot(void);
+    const AtelierTree *getTree(void);
+    int  getRow(void);
     void setName(const QString &name);
     Exploitation *getExploitation(void);
+    int  memoryUsage(MemoryUsage &usage);
     // Entities
     Atelier *addEntity   (void);
     int      countEntity (void);
     Atelier *getEntity   (int index);
+    Atelier *insertEntity(int row);
     void     removeEntity(int index);
+    bool     setEntityValues(int row, int index, int rows, int columns,
+                             const double *values);
+    // Column operations (one parameter of all entities)
+    bool     applyColumn       (int index, ColumnOp op, double a, double b = 0);
+    bool     applyColumnFormula(int index, const QString &formula);
+    bool     evaluateFormula   (const QString &formula, QVector<double> &values,
+                                int year = 0);
+    // Parameter indexes (sorted values of the entities)
+    bool       createIndex (int index);
+    void       dropIndex   (int index);
+    QList<int> findEntities(const QList<AtelierRange> &ranges);
+    bool       hasIndex    (int index);
+    // Derived parameters (computed from a formula)
+    bool    addDerivedParameter(const QString &name, const QString &formula);
+    QString getParameterFormula(int index);
+    bool    isParameterDerived (int index);
+    bool    setParameterFormula(int index, const QString &formula);
+    bool    updateDerived(void);
+    bool    updateDerived(const QString &name);
     // Parameters
     void addParameter(const QString &name, double initialValue);
     void addParameter(AtelierParameter *parameter);
     int  countParameter(void);
-    void delParameter(int index);
+    bool delParameter(int index);
+    void insertParameter(int index, const QString &name, double initialValue);
+    AtelierParameter *getParameter(int index);
+    AtelierColumn::Kind getParameterKind(int index);
     QString getParameterName(int index);
     double  getParameterValue(int index);
     Rotation *getRotation(void);
+    bool    isNameUsed(const QString &name);
     bool    isParameterMandatory(int index);
-    void    setParameterValue(int index, double value);
-    void    setParameterMandatory(int index);
-    void    setParameterName(int index, QString &name);
+    bool    setParameterDefault(int index, double value);
+    bool    setParameterKind (int index, AtelierColumn::Kind kind);
+    bool    setParameterValue(int index, double value);
+    void    setParameterMandatory(int index, bool mandatory = true);
+    bool    setParameterName(int index, QString &name);
     void    setRotation(Rotation *rotation);
+    // Values of each year (see SeriesTable)
+    void       dropParameterSeries(int index);
+    TimeSeries getParameterSeries (int index);
+    double     getParameterValue  (int index, int year);
+    const double *getYearValues   (int index, int year);
+    bool       hasParameterSeries (int index);
+    bool       setEntitySeries    (int index, const QVector<int> &rows,
+                                   const QVector<TimeSeries> &series);
+    bool       setParameterSeries (int index, const TimeSeries &series);
 private:
+    bool computeDerived(int index, int first, int count);
+    AtelierParameter *definition(int index);
+    bool derivedOrder  (const QString &name, QList<int> &order);
+    void dropParameter (int index);
+    bool evaluateColumn(Expression *expr, int first, int count, double *output,
+                        int year = 0);
+    void inheritParameters(void);
+    void invalidateHash(void);
+    int  parameterIndex(const QString &name);
+    bool storeColumn   (int index, const double *values);
+    bool storeValue    (int index, double value);
+    bool updateDerived (const QString &name, int first, int count);
+private:
+    friend class AtelierTree;
+    friend class Exploitation;
+    friend class ExploitationPatch;
+    friend class Rotation;
+    uint          mId;
+    int           mRow;
     Atelier      *mParent;
+    Atelier      *mRoot;
     Exploitation *mExploitation;
+    // Flat copy of the structure (only for a top-level Atelier)
+    AtelierTree  *mTree;
+    bool          mTreeValid;
     QString   mName;
     Rotation *mRotation;
+    int       mDerived;
+    quint64   mHash;
+    bool      mHashValid;
+    // Parameters of the entities (with their values, see AtelierColumn)
     QList<AtelierParameter *> mParameters;
     QList<Atelier *>          mEntities;
 };
@@ -55,16 +145,44 @@ class AtelierParameter
 {
 public:
     explicit AtelierParameter(AtelierParameter *model = 0);
+    ~AtelierParameter();
+    AtelierColumn::Kind getKind(void);
     QString getName (void);
     double  getValue(void);
     bool    isMandatory(void);
-    void    setMandatory(void);
+    void    setMandatory(bool mandatory = true);
     void    setName (const QString &name);
     void    setValue(double value);
 private:
+    friend class Atelier;
+    friend class AtelierTree;
     QString mName;
     bool    mMandatory;
     double  mValue;
+    // Sorted values of the entities (only for an indexed Atelier parameter)
+    AtelierIndex *mIndex;
+    // Formula of a derived parameter (only for an Atelier parameter)
+    Expression *mExpression;
+    // Values of this parameter for all the entities
+    AtelierColumn *mColumn;
+    // Values of each year for all the entities (only when series are set)
+    SeriesTable *mSeries;
+};
+
+class AtelierRange
+{
+public:
+    explicit AtelierRange(int parameter, double min, double max, bool strict = false);
+    bool   contains(double value) const;
+    double getMax(void) const;
+    double getMin(void) const;
+    int    getParameter(void) const;
+    bool   isStrict(void) const;
+private:
+    int    mParameter;
+    double mMin;
+    double mMax;
+    bool   mStrict;
 };
 
 #endif // ATELIER_H
@@ -0,0 +1,1110 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QtGlobal>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <QDataStream>
+#include <QSaveFile>
+#include "changelog.h"
+#include "instrument.h"
+#include "patch.h"
+
+#define CHANGELOG_LOG_MAGIC   0x5645414C
+#define CHANGELOG_SNAP_MAGIC  0x56454153
+#define CHANGELOG_VERSION     2
+// Pending records are written at once above this size (bytes)
+#define CHANGELOG_MAX_PENDING 65536
+// Sanity limit for the size of one record (bytes)
+#define CHANGELOG_MAX_RECORD  (1024 * 1024)
+
+// Fields of a Record that are stored into the log, for each type
+enum RecordField { FieldAtelier = 0x01, FieldRow  = 0x02, FieldColumn = 0x04,
+                   FieldName    = 0x08, FieldText = 0x10, FieldValue  = 0x20,
+                   FieldNumber  = 0x40, FieldPath = 0x80 };
+
+static const quint8 recordFields[] = {
+    0,
+    FieldName    | FieldValue,                              // GlobalValue
+    FieldName,                                              // GlobalRemove
+    FieldName    | FieldText,                               // GlobalRename
+    FieldName    | FieldNumber,                             // RotationAdd
+    FieldName,                                              // RotationRemove
+    FieldName    | FieldText,                               // RotationRename
+    FieldName    | FieldNumber,                             // RotationDuration
+    FieldName    | FieldRow   | FieldText   | FieldNumber,  // Plan
+    FieldName    | FieldRow,                                // PlanTruncate
+    FieldAtelier | FieldPath  | FieldRow    | FieldText,    // EntityAdd
+    FieldAtelier | FieldPath  | FieldRow,                   // EntityRemove
+    FieldAtelier | FieldPath  | FieldRow    | FieldText,    // EntityName
+    FieldAtelier | FieldPath  | FieldRow    | FieldText,    // EntityRotation
+    FieldAtelier | FieldPath  | FieldRow    | FieldColumn | FieldValue, // EntityValue
+    FieldAtelier | FieldPath  | FieldColumn | FieldText | FieldValue,   // ColumnAdd
+    FieldAtelier | FieldPath  | FieldColumn,                // ColumnRemove
+    FieldAtelier | FieldPath  | FieldColumn | FieldText,    // ColumnName
+    FieldAtelier | FieldPath  | FieldColumn | FieldNumber   // ColumnKind
+};
+
+/**
+ * @brief Compute the checksum of a record (FNV-1a)
+ *
+ * @param data Content of the record
+ * @return quint32 Checksum
+ */
+static quint32 recordChecksum(const QByteArray &data)
+{
+    quint32 hash = 0x811c9dc5;
+    const char *p = data.constData();
+    for (int i = 0; i < data.size(); ++i)
+    {
+        hash ^= (quint8)p[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/**
+ * @brief Write the content of a file to the disk (not only to the system)
+ *
+ * @param file Reference to an opened file
+ * @return boolean True on success
+ */
+static bool syncFile(QFile &file)
+{
+    if ( ! file.flush())
+        return false;
+#ifdef Q_OS_WIN
+    return (_commit(file.handle()) == 0);
+#else
+    return (fsync(file.handle()) == 0);
+#endif
+}
+
+/**
+ * @brief Default constructor, no log is opened
+ *
+ * @param parent Pointer to the parent object
+ */
+ChangeLog::ChangeLog(QObject *parent)
+    : QObject(parent)
+{
+    mExploitation = 0;
+    mGeneration   = 0;
+    mPendingCount = 0;
+    mReplayed     = 0;
+    mCompactSize  = 4 * 1024 * 1024;
+    mRotationsValid = false;
+
+    // Records of the same burst of edits are committed together
+    mCommitTimer = new QTimer(this);
+    mCommitTimer->setSingleShot(true);
+    mCommitTimer->setInterval(200);
+    QObject::connect(mCommitTimer, SIGNAL(timeout()),
+                     this,         SLOT  (slotCommit()));
+}
+
+/**
+ * @brief Default destructor, pending records are written
+ *
+ */
+ChangeLog::~ChangeLog()
+{
+    close();
+}
+
+/**
+ * @brief Append a record to the pending group
+ *
+ * @param record Record to append
+ */
+void ChangeLog::append(const Record &record)
+{
+    if ( ! mFile.isOpen())
+        return;
+
+    QByteArray payload;
+    {
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        quint8 fields = recordFields[record.type];
+        out << (quint8)record.type;
+        if (fields & FieldAtelier)
+            out << record.atelier;
+        if (fields & FieldPath)
+            out << record.path;
+        if (fields & FieldRow)
+            out << record.row;
+        if (fields & FieldColumn)
+            out << record.column;
+        if (fields & FieldName)
+            out << record.name;
+        if (fields & FieldText)
+            out << record.text;
+        if (fields & FieldValue)
+            out << record.value;
+        if (fields & FieldNumber)
+            out << record.number;
+    }
+
+    // Each record starts with his size and checksum (detect torn writes)
+    QDataStream out(&mPending, QIODevice::WriteOnly | QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << (quint32)payload.size() << recordChecksum(payload);
+    out.writeRawData(payload.constData(), payload.size());
+    mPendingCount++;
+
+    if (mPending.size() >= CHANGELOG_MAX_PENDING)
+        flush();
+    else if ( ! mCommitTimer->isActive())
+        mCommitTimer->start();
+}
+
+/**
+ * @brief Apply one record (read from the log) on the Exploitation
+ *
+ * @param record Record to apply
+ * @return boolean False if the record does not match the Exploitation
+ */
+bool ChangeLog::applyRecord(const Record &record)
+{
+    Exploitation *e = mExploitation;
+
+    // Global parameters
+    if (record.type == RecGlobalValue)
+    {
+        e->setParameter(record.name, record.value);
+        return true;
+    }
+    if (record.type == RecGlobalRemove)
+        return e->removeParameter(record.name);
+    if (record.type == RecGlobalRename)
+    {
+        Parameter *parameter = e->getParameter(record.name);
+        if (parameter == 0)
+            return false;
+        return e->renameParameter(parameter, record.text);
+    }
+
+    // Rotations
+    if (record.type == RecRotationAdd)
+    {
+        Rotation *rot = e->createRotation(record.name, record.number);
+        if (rot == 0)
+            return false;
+        if (mRotationsValid && ( ! mRotations.contains(record.name)))
+            mRotations.insert(record.name, rot);
+        return true;
+    }
+    if ((record.type >= RecRotationRemove) && (record.type <= RecPlanTruncate))
+    {
+        Rotation *rot = rotation(record.name);
+        if (rot == 0)
+            return false;
+        if (record.type == RecRotationRemove)
+        {
+            mRotationsValid = false;
+            return e->removeRotation(rot);
+        }
+        if (record.type == RecRotationRename)
+        {
+            mRotationsValid = false;
+            rot->setName(record.text);
+        }
+        else if (record.type == RecRotationDuration)
+            rot->setDuration(record.number);
+        else if (record.type == RecPlan)
+        {
+            if (record.row < (int)rot->countPlans())
+            {
+                ActivityPlan *plan = rot->getPlan(record.row);
+                plan->setName(record.text);
+                plan->setPosition(record.number);
+            }
+            else if (record.row == (int)rot->countPlans())
+                rot->addPlan(record.number, record.text);
+            else
+                return false;
+        }
+        else
+        {
+            while ((int)rot->countPlans() > record.row)
+                rot->removePlan(rot->countPlans() - 1);
+        }
+        return true;
+    }
+
+    // Ateliers and entities (at any depth)
+    Atelier *atelier = findAtelier(record);
+    if (atelier == 0)
+        return false;
+
+    if (record.type == RecEntityAdd)
+    {
+        Atelier *entity = atelier->insertEntity(record.row);
+        if (entity == 0)
+            return false;
+        entity->setName(record.text);
+        return true;
+    }
+    if (record.type == RecColumnAdd)
+    {
+        if ((record.column < 0) || (record.column > atelier->countParameter()))
+            return false;
+        atelier->insertParameter(record.column, record.text, record.value);
+        return true;
+    }
+    if ((record.type == RecColumnRemove) || (record.type == RecColumnName) ||
+        (record.type == RecColumnKind))
+    {
+        if ((record.column < 0) || (record.column >= atelier->countParameter()))
+            return false;
+        if (record.type == RecColumnRemove)
+            return atelier->delParameter(record.column);
+        if (record.type == RecColumnKind)
+            return atelier->setParameterKind(record.column, AtelierColumn::Kind(record.number));
+
+        QString name(record.text);
+        return atelier->setParameterName(record.column, name);
+    }
+
+    if ((record.row < 0) || (record.row >= atelier->countEntity()))
+        return false;
+    Atelier *entity = atelier->getEntity(record.row);
+
+    if (record.type == RecEntityRemove)
+        atelier->removeEntity(record.row);
+    else if (record.type == RecEntityName)
+        entity->setName(record.text);
+    else if (record.type == RecEntityRotation)
+    {
+        Rotation *rot = 0;
+        if ( ! record.text.isEmpty())
+        {
+            rot = rotation(record.text);
+            if (rot == 0)
+                return false;
+        }
+        entity->setRotation(rot);
+    }
+    else if (record.type == RecEntityValue)
+    {
+        if ((record.column < 0) || (record.column >= entity->countParameter()))
+            return false;
+        return entity->setParameterValue(record.column, record.value);
+    }
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * @brief Get the index of an Atelier into the Exploitation
+ *
+ * @param atelier Pointer to a top-level Atelier
+ * @return integer Index of the Atelier (-1 if not found)
+ */
+int ChangeLog::atelierIndex(Atelier *atelier)
+{
+    for (uint i = 0; i < mExploitation->countAtelier(); ++i)
+    {
+        if (mExploitation->getAtelier(i) == atelier)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Get the Atelier (top-level or entity) of a record
+ *
+ * @param record Record that contains the position of the Atelier
+ * @return Pointer to the Atelier (NULL if not found)
+ */
+Atelier *ChangeLog::findAtelier(const Record &record)
+{
+    if ((record.atelier < 0) || (record.atelier >= (int)mExploitation->countAtelier()))
+        return 0;
+    Atelier *atelier = mExploitation->getAtelier(record.atelier);
+    for (int i = 0; i < record.path.count(); ++i)
+    {
+        int row = record.path.at(i);
+        if ((row < 0) || (row >= atelier->countEntity()))
+            return 0;
+        atelier = atelier->getEntity(row);
+    }
+    return atelier;
+}
+
+/**
+ * @brief Write the pending records, then close the log
+ *
+ * The log and snapshot files are kept (see discard).
+ */
+void ChangeLog::close(void)
+{
+    if (mFile.isOpen())
+    {
+        flush();
+        mFile.close();
+    }
+    mCommitTimer->stop();
+    mPending.clear();
+    mPendingCount = 0;
+    mExploitation = 0;
+}
+
+/**
+ * @brief Replace the log by a full snapshot of the Exploitation
+ *
+ * The snapshot is written into a new file before the log is cleared, so a
+ * crash during compaction always leaves a usable autosave.
+ *
+ * @return boolean True on success
+ */
+bool ChangeLog::compact(void)
+{
+    INSTRUMENT_CALL("ChangeLog::compact");
+
+    if (mExploitation == 0)
+        return false;
+
+    // Pending records are already into the snapshot
+    mCommitTimer->stop();
+    mPending.clear();
+    mPendingCount = 0;
+
+    quint32 generation = mGeneration + 1;
+
+    // A full snapshot is the patch from an empty Exploitation : it holds
+    // the sub-entities, the definitions of the columns and the series too
+    Exploitation empty;
+    ExploitationPatch patch;
+    patch.diff(&empty, mExploitation);
+
+    QSaveFile snapshot(mFilename + ".snapshot");
+    if ( ! snapshot.open(QIODevice::WriteOnly))
+    {
+        mError = snapshot.errorString();
+        return false;
+    }
+    QDataStream out(&snapshot);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << (quint32)CHANGELOG_SNAP_MAGIC << (quint32)CHANGELOG_VERSION << generation;
+    if ( ! patch.save(&snapshot))
+    {
+        mError = patch.errorString();
+        snapshot.cancelWriting();
+        return false;
+    }
+    if ( ! snapshot.commit())
+    {
+        mError = snapshot.errorString();
+        return false;
+    }
+
+    return startLog(generation, true);
+}
+
+/**
+ * @brief Get the number of records not written to disk yet
+ *
+ * @return integer Number of pending records
+ */
+int ChangeLog::countPending(void)
+{
+    return mPendingCount;
+}
+
+/**
+ * @brief Get the number of records replayed by the last recover()
+ *
+ * @return integer Number of records
+ */
+int ChangeLog::countReplayed(void)
+{
+    return mReplayed;
+}
+
+/**
+ * @brief Move the files of the autosave aside (".bak" suffix)
+ *
+ * Used when an autosave can not be completely recovered, so that a new
+ * log does not overwrite the records that could not be replayed.
+ */
+void ChangeLog::backup(void)
+{
+    QString names[2] = { mFilename, mFilename + ".snapshot" };
+    for (int i = 0; i < 2; ++i)
+    {
+        if ( ! QFile::exists(names[i]))
+            continue;
+        QFile::remove(names[i] + ".bak");
+        QFile::rename(names[i], names[i] + ".bak");
+    }
+}
+
+/**
+ * @brief Close the log and remove his files (ex: after a clean exit)
+ *
+ */
+void ChangeLog::discard(void)
+{
+    mPending.clear();
+    mPendingCount = 0;
+    close();
+    if (mFilename.isEmpty())
+        return;
+    QFile::remove(mFilename);
+    QFile::remove(mFilename + ".snapshot");
+}
+
+/**
+ * @brief Get the last error message
+ *
+ * @return QString Error message
+ */
+QString ChangeLog::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Test if an autosave exists (ex: left by a crash)
+ *
+ * @param filename Name of the log file
+ * @return boolean True if an autosave can be recovered
+ */
+bool ChangeLog::exists(const QString &filename)
+{
+    return QFile::exists(filename + ".snapshot");
+}
+
+/**
+ * @brief Write all pending records with a single sync to disk
+ *
+ * The log is compacted when it becomes too big.
+ *
+ * @return boolean True on success
+ */
+bool ChangeLog::flush(void)
+{
+    INSTRUMENT_CALL("ChangeLog::flush");
+
+    mCommitTimer->stop();
+    if (mPending.isEmpty())
+        return true;
+    if ( ! mFile.isOpen())
+        return false;
+
+    if ((mFile.write(mPending) != mPending.size()) || ( ! syncFile(mFile)))
+    {
+        mError = mFile.errorString();
+        return false;
+    }
+    mPending.clear();
+    mPendingCount = 0;
+
+    if (mFile.size() > mCompactSize)
+        return compact();
+    return true;
+}
+
+/**
+ * @brief Test if the log is ready to record modifications
+ *
+ * @return boolean True if opened
+ */
+bool ChangeLog::isOpen(void)
+{
+    return mFile.isOpen();
+}
+
+/**
+ * @brief Initialize a new record, with default fields
+ *
+ * @param type Type of the record
+ * @return Record
+ */
+ChangeLog::Record ChangeLog::newRecord(RecordType type)
+{
+    Record record;
+    record.type    = type;
+    record.atelier = 0;
+    record.row     = 0;
+    record.column  = 0;
+    record.value   = 0;
+    record.number  = 0;
+    return record;
+}
+
+/**
+ * @brief Start a new log for an Exploitation (replace any old autosave)
+ *
+ * @param filename     Name of the log file
+ * @param exploitation Pointer to the Exploitation to record
+ * @return boolean True on success
+ */
+bool ChangeLog::open(const QString &filename, Exploitation *exploitation)
+{
+    close();
+    mError.clear();
+    mFilename     = filename;
+    mExploitation = exploitation;
+    mGeneration   = 0;
+    mReplayed     = 0;
+
+    // First snapshot, then an empty log
+    if ( ! compact())
+    {
+        mExploitation = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read and check the header of a log or snapshot file
+ *
+ * @param device     Pointer to the opened file
+ * @param magic      Expected magic number
+ * @param generation Reference to the value that receive the generation
+ * @return boolean True if the header is valid
+ */
+bool ChangeLog::readHeader(QIODevice *device, quint32 magic, quint32 &generation)
+{
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 fileMagic, version;
+    in >> fileMagic >> version >> generation;
+    if (in.status() != QDataStream::Ok)
+        return false;
+    return ((fileMagic == magic) && (version == CHANGELOG_VERSION));
+}
+
+/**
+ * @brief Load the snapshot file into the Exploitation
+ *
+ * @param filename   Name of the snapshot file
+ * @param generation Reference to the value that receive the generation
+ * @return boolean True on success
+ */
+bool ChangeLog::readSnapshot(const QString &filename, quint32 &generation)
+{
+    QFile file(filename);
+    if ( ! file.open(QIODevice::ReadOnly))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    if ( ! readHeader(&file, CHANGELOG_SNAP_MAGIC, generation))
+    {
+        mError = "Invalid autosave snapshot";
+        return false;
+    }
+
+    ExploitationPatch patch;
+    if (( ! patch.load(&file)) || ( ! patch.apply(mExploitation)))
+    {
+        mError = patch.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Rebuild an Exploitation from an autosave, then continue to record
+ *
+ * The last snapshot is loaded, then the complete records of the log are
+ * replayed (an incomplete last record, written during a crash, is ignored).
+ * A new snapshot is then written with the recovered content.
+ *
+ * When the snapshot can not be loaded, or a record can not be replayed,
+ * the autosave files are moved aside (see backup) and the Exploitation
+ * holds a partial content : the caller should clear it.
+ *
+ * @param filename     Name of the log file
+ * @param exploitation Pointer to an empty Exploitation
+ * @return boolean True if all the records have been recovered
+ */
+bool ChangeLog::recover(const QString &filename, Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("ChangeLog::recover");
+
+    close();
+    mError.clear();
+    mFilename     = filename;
+    mExploitation = exploitation;
+    mReplayed     = 0;
+    mRotationsValid = false;
+
+    quint32 snapGeneration;
+    if ( ! readSnapshot(filename + ".snapshot", snapGeneration))
+    {
+        backup();
+        mExploitation = 0;
+        return false;
+    }
+    mGeneration = snapGeneration;
+
+    // A log older than the snapshot is already included into it (crash
+    // during compaction), a missing or empty log contains nothing more
+    QFile log(filename);
+    quint32 logGeneration;
+    bool    complete = true;
+    if (log.open(QIODevice::ReadOnly) &&
+        readHeader(&log, CHANGELOG_LOG_MAGIC, logGeneration) &&
+        (logGeneration == snapGeneration))
+    {
+        QDataStream in(&log);
+        in.setVersion(QDataStream::Qt_5_0);
+        while (log.bytesAvailable() >= 8)
+        {
+            quint32 size, checksum;
+            in >> size >> checksum;
+            if ((size > CHANGELOG_MAX_RECORD) || (log.bytesAvailable() < size))
+                break;
+            QByteArray payload = log.read(size);
+            if (recordChecksum(payload) != checksum)
+                break;
+
+            QDataStream data(payload);
+            data.setVersion(QDataStream::Qt_5_0);
+            quint8 type;
+            data >> type;
+            if ((type == 0) || (type >= RecLast))
+                break;
+            Record record = newRecord((RecordType)type);
+            quint8 fields = recordFields[type];
+            if (fields & FieldAtelier)
+                data >> record.atelier;
+            if (fields & FieldPath)
+                data >> record.path;
+            if (fields & FieldRow)
+                data >> record.row;
+            if (fields & FieldColumn)
+                data >> record.column;
+            if (fields & FieldName)
+                data >> record.name;
+            if (fields & FieldText)
+                data >> record.text;
+            if (fields & FieldValue)
+                data >> record.value;
+            if (fields & FieldNumber)
+                data >> record.number;
+            if (data.status() != QDataStream::Ok)
+                break;
+
+            if ( ! applyRecord(record))
+            {
+                mError = QString("Record %1 does not match the snapshot").arg(mReplayed);
+                complete = false;
+                break;
+            }
+            mReplayed++;
+        }
+    }
+    log.close();
+
+    // Keep the records that could not be replayed
+    if ( ! complete)
+    {
+        backup();
+        mExploitation = 0;
+        return false;
+    }
+
+    // Start again from a snapshot of the recovered content
+    return compact();
+}
+
+/**
+ * @brief Search a Rotation by name
+ *
+ * @param name Name of the Rotation
+ * @return Pointer to the first Rotation with this name (or NULL)
+ */
+Rotation *ChangeLog::rotation(const QString &name)
+{
+    if ( ! mRotationsValid)
+    {
+        mRotations.clear();
+        for (uint i = 0; i < mExploitation->countRotation(); ++i)
+        {
+            Rotation *rot = mExploitation->getRotation(i);
+            if ( ! mRotations.contains(rot->getName()))
+                mRotations.insert(rot->getName(), rot);
+        }
+        mRotationsValid = true;
+    }
+    return mRotations.value(name, 0);
+}
+
+/**
+ * @brief Set the delay between a modification and his write to disk
+ *
+ * @param msec Delay in milliseconds (all records of this delay are
+ *             written together)
+ */
+void ChangeLog::setCommitDelay(int msec)
+{
+    mCommitTimer->setInterval(msec);
+}
+
+/**
+ * @brief Set the size of the log that triggers a compaction
+ *
+ * @param bytes Maximum size of the log file
+ */
+void ChangeLog::setCompactSize(qint64 bytes)
+{
+    mCompactSize = bytes;
+}
+
+/**
+ * @brief Set the position of an Atelier into a record
+ *
+ * @param record  Record that receive the index of the top-level Atelier and
+ *                the rows of the entities down to this Atelier
+ * @param atelier Pointer to the Atelier (top-level or entity)
+ */
+void ChangeLog::setPosition(Record &record, Atelier *atelier)
+{
+    record.path.clear();
+    while (atelier->getParent())
+    {
+        record.path.prepend(atelier->getRow());
+        atelier = atelier->getParent();
+    }
+    record.atelier = atelierIndex(atelier);
+}
+
+/**
+ * @brief Slot called by timer to commit the pending records
+ *
+ */
+void ChangeLog::slotCommit(void)
+{
+    flush();
+}
+
+/**
+ * @brief Open the log file
+ *
+ * @param generation Generation of the snapshot used by this log
+ * @param truncate   True to remove the old content of the file
+ * @return boolean True on success
+ */
+bool ChangeLog::startLog(quint32 generation, bool truncate)
+{
+    if (mFile.isOpen())
+        mFile.close();
+
+    mFile.setFileName(mFilename);
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (truncate)
+        mode |= QIODevice::Truncate;
+    if ( ! mFile.open(mode))
+    {
+        mError = mFile.errorString();
+        return false;
+    }
+
+    if (truncate)
+    {
+        QDataStream out(&mFile);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << (quint32)CHANGELOG_LOG_MAGIC << (quint32)CHANGELOG_VERSION << generation;
+        if ( ! syncFile(mFile))
+        {
+            mError = mFile.errorString();
+            mFile.close();
+            return false;
+        }
+    }
+    else
+        mFile.seek(mFile.size());
+
+    mGeneration = generation;
+    return true;
+}
+
+// -------------------- Records --------------------
+
+/**
+ * @brief Record a new entity (with default values)
+ *
+ * @param atelier Pointer to the Atelier
+ * @param row     Row of the new entity
+ */
+void ChangeLog::recordEntityAdded(Atelier *atelier, int row)
+{
+    Record record = newRecord(RecEntityAdd);
+    setPosition(record, atelier);
+    record.row     = row;
+    record.text    = atelier->getEntity(row)->getName();
+    append(record);
+}
+
+/**
+ * @brief Record the deletion of an entity
+ *
+ * @param atelier Pointer to the Atelier
+ * @param row     Row of the deleted entity
+ */
+void ChangeLog::recordEntityDeleted(Atelier *atelier, int row)
+{
+    Record record = newRecord(RecEntityRemove);
+    setPosition(record, atelier);
+    record.row     = row;
+    append(record);
+}
+
+/**
+ * @brief Record the new name of an entity
+ *
+ * @param entity Pointer to the modified entity
+ */
+void ChangeLog::recordEntityName(Atelier *entity)
+{
+    Record record = newRecord(RecEntityName);
+    setPosition(record, entity->getParent());
+    record.row     = entity->getRow();
+    record.text    = entity->getName();
+    append(record);
+}
+
+/**
+ * @brief Record the new Rotation of an entity
+ *
+ * @param entity Pointer to the modified entity
+ */
+void ChangeLog::recordEntityRotation(Atelier *entity)
+{
+    Record record = newRecord(RecEntityRotation);
+    setPosition(record, entity->getParent());
+    record.row     = entity->getRow();
+    if (entity->getRotation())
+        record.text = entity->getRotation()->getName();
+    append(record);
+}
+
+/**
+ * @brief Record the new value of an entity parameter
+ *
+ * @param entity Pointer to the modified entity
+ * @param index  Index of the parameter
+ * @param value  New value
+ */
+void ChangeLog::recordEntityValue(Atelier *entity, int index, double value)
+{
+    Record record = newRecord(RecEntityValue);
+    setPosition(record, entity->getParent());
+    record.row     = entity->getRow();
+    record.column  = index;
+    record.value   = value;
+    append(record);
+}
+
+/**
+ * @brief Record the values of a block of entities (paste, fill)
+ *
+ * @param atelier Pointer to the Atelier
+ * @param row     First entity of the block
+ * @param index   First parameter of the block
+ * @param rows    Number of entities
+ * @param columns Number of parameters
+ */
+void ChangeLog::recordEntityValues(Atelier *atelier, int row, int index, int rows, int columns)
+{
+    Record record = newRecord(RecEntityValue);
+    setPosition(record, atelier);
+    for (int r = row; r < (row + rows); ++r)
+    {
+        Atelier *entity = atelier->getEntity(r);
+        record.row = r;
+        for (int c = index; c < (index + columns); ++c)
+        {
+            record.column = c;
+            record.value  = entity->getParameterValue(c);
+            append(record);
+        }
+    }
+}
+
+/**
+ * @brief Record a new parameter of an Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Index of the new parameter
+ */
+void ChangeLog::recordParameterAdded(Atelier *atelier, int index)
+{
+    Record record = newRecord(RecColumnAdd);
+    setPosition(record, atelier);
+    record.column  = index;
+    record.text    = atelier->getParameterName(index);
+    record.value   = atelier->getParameterValue(index);
+    append(record);
+}
+
+/**
+ * @brief Record the deletion of a parameter of an Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Index of the deleted parameter
+ */
+void ChangeLog::recordParameterDeleted(Atelier *atelier, int index)
+{
+    Record record = newRecord(RecColumnRemove);
+    setPosition(record, atelier);
+    record.column  = index;
+    append(record);
+}
+
+/**
+ * @brief Record the new kind of a parameter of an Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Index of the modified parameter
+ */
+void ChangeLog::recordParameterKind(Atelier *atelier, int index)
+{
+    Record record = newRecord(RecColumnKind);
+    setPosition(record, atelier);
+    record.column  = index;
+    record.number  = atelier->getParameterKind(index);
+    append(record);
+}
+
+/**
+ * @brief Record the new name of a parameter of an Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Index of the renamed parameter
+ */
+void ChangeLog::recordParameterName(Atelier *atelier, int index)
+{
+    Record record = newRecord(RecColumnName);
+    setPosition(record, atelier);
+    record.column  = index;
+    record.text    = atelier->getParameterName(index);
+    append(record);
+}
+
+/**
+ * @brief Record the deletion of a global parameter
+ *
+ * @param name Name of the deleted parameter
+ */
+void ChangeLog::recordGlobalRemoved(const QString &name)
+{
+    Record record = newRecord(RecGlobalRemove);
+    record.name = name;
+    append(record);
+}
+
+/**
+ * @brief Record the new name of a global parameter
+ *
+ * @param oldName Previous name of the parameter
+ * @param newName New name of the parameter
+ */
+void ChangeLog::recordGlobalRenamed(const QString &oldName, const QString &newName)
+{
+    Record record = newRecord(RecGlobalRename);
+    record.name = oldName;
+    record.text = newName;
+    append(record);
+}
+
+/**
+ * @brief Record the value of a global parameter (created if needed)
+ *
+ * @param name  Name of the parameter
+ * @param value New value
+ */
+void ChangeLog::recordGlobalValue(const QString &name, double value)
+{
+    Record record = newRecord(RecGlobalValue);
+    record.name  = name;
+    record.value = value;
+    append(record);
+}
+
+/**
+ * @brief Record the content of a Rotation (duration and plans)
+ *
+ * Used for all modifications of the plans : a Rotation only has a few.
+ *
+ * @param rotation Pointer to the modified Rotation
+ */
+void ChangeLog::recordRotation(Rotation *rotation)
+{
+    Record record = newRecord(RecRotationDuration);
+    record.name   = rotation->getName();
+    record.number = rotation->getDuration();
+    append(record);
+
+    for (uint i = 0; i < rotation->countPlans(); ++i)
+    {
+        ActivityPlan *plan = rotation->getPlan(i);
+        Record planRecord = newRecord(RecPlan);
+        planRecord.name   = rotation->getName();
+        planRecord.row    = i;
+        planRecord.text   = plan->getName();
+        planRecord.number = plan->getPosition();
+        append(planRecord);
+    }
+
+    Record truncate = newRecord(RecPlanTruncate);
+    truncate.name = rotation->getName();
+    truncate.row  = rotation->countPlans();
+    append(truncate);
+}
+
+/**
+ * @brief Record a new Rotation
+ *
+ * @param rotation Pointer to the new Rotation
+ */
+void ChangeLog::recordRotationAdded(Rotation *rotation)
+{
+    Record record = newRecord(RecRotationAdd);
+    record.name   = rotation->getName();
+    record.number = rotation->getDuration();
+    append(record);
+    recordRotation(rotation);
+}
+
+/**
+ * @brief Record the deletion of a Rotation
+ *
+ * @param name Name of the deleted Rotation
+ */
+void ChangeLog::recordRotationDeleted(const QString &name)
+{
+    Record record = newRecord(RecRotationRemove);
+    record.name = name;
+    append(record);
+}
+
+/**
+ * @brief Record the new name of a Rotation
+ *
+ * @param oldName Previous name of the Rotation
+ * @param newName New name of the Rotation
+ */
+void ChangeLog::recordRotationRenamed(const QString &oldName, const QString &newName)
+{
+    Record record = newRecord(RecRotationRename);
+    record.name = oldName;
+    record.text = newName;
+    append(record);
+}
@@ -0,0 +1,138 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include "exploitation.h"
+
+/*
+ * A ChangeLog is an autosave file for an Exploitation. Each modification
+ * (the ones announced by the widgets) is appended as a small binary record.
+ * Records are kept into memory and written by groups, with a single sync
+ * to disk for each group, so recording an edit costs a few microseconds.
+ *
+ * The log always starts from a full snapshot of the Exploitation (written
+ * by open and each compaction). After a crash, recover() loads the last
+ * snapshot then replays the complete records that follow it. An autosave
+ * that can not be completely recovered is moved aside (".bak" files).
+ *
+ * An Atelier is identified by the index of his top-level Atelier and the
+ * rows of the entities down to him (empty for a top-level one), entities
+ * and parameter columns by their position, global parameters and rotations
+ * by their name.
+ */
+class ChangeLog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChangeLog(QObject *parent = 0);
+    ~ChangeLog();
+    void    close  (void);
+    bool    compact(void);
+    int     countPending (void);
+    int     countReplayed(void);
+    void    discard(void);
+    QString errorString(void);
+    static bool exists(const QString &filename);
+    bool    flush  (void);
+    bool    isOpen (void);
+    bool    open   (const QString &filename, Exploitation *exploitation);
+    bool    recover(const QString &filename, Exploitation *exploitation);
+    void    setCommitDelay(int msec);
+    void    setCompactSize(qint64 bytes);
+    // Ateliers and entities
+    void    recordEntityAdded    (Atelier *atelier, int row);
+    void    recordEntityDeleted  (Atelier *atelier, int row);
+    void    recordEntityName     (Atelier *entity);
+    void    recordEntityRotation (Atelier *entity);
+    void    recordEntityValue    (Atelier *entity, int index, double value);
+    void    recordEntityValues   (Atelier *atelier, int row, int index, int rows, int columns);
+    void    recordParameterAdded  (Atelier *atelier, int index);
+    void    recordParameterDeleted(Atelier *atelier, int index);
+    void    recordParameterKind   (Atelier *atelier, int index);
+    void    recordParameterName   (Atelier *atelier, int index);
+    // Global parameters
+    void    recordGlobalRemoved(const QString &name);
+    void    recordGlobalRenamed(const QString &oldName, const QString &newName);
+    void    recordGlobalValue  (const QString &name, double value);
+    // Rotations
+    void    recordRotation       (Rotation *rotation);
+    void    recordRotationAdded  (Rotation *rotation);
+    void    recordRotationDeleted(const QString &name);
+    void    recordRotationRenamed(const QString &oldName, const QString &newName);
+private slots:
+    void    slotCommit(void);
+private:
+    enum RecordType {
+        RecGlobalValue = 1,  // name, value
+        RecGlobalRemove,     // name
+        RecGlobalRename,     // name, text (new name)
+        RecRotationAdd,      // name, number (duration)
+        RecRotationRemove,   // name
+        RecRotationRename,   // name, text (new name)
+        RecRotationDuration, // name, number
+        RecPlan,             // name, row (plan index), text, number (position)
+        RecPlanTruncate,     // name, row (new count of plans)
+        RecEntityAdd,        // atelier, path, row, text (entity name)
+        RecEntityRemove,     // atelier, path, row
+        RecEntityName,       // atelier, path, row, text
+        RecEntityRotation,   // atelier, path, row, text (empty for none)
+        RecEntityValue,      // atelier, path, row, column, value
+        RecColumnAdd,        // atelier, path, column, text, value (default)
+        RecColumnRemove,     // atelier, path, column
+        RecColumnName,       // atelier, path, column, text
+        RecColumnKind,       // atelier, path, column, number (kind)
+        RecLast
+    };
+    struct Record
+    {
+        RecordType type;
+        qint32  atelier;
+        QList<qint32> path;
+        qint32  row;
+        qint32  column;
+        QString name;
+        QString text;
+        double  value;
+        quint64 number;
+    };
+    Record  newRecord(RecordType type);
+    void    append(const Record &record);
+    bool    applyRecord(const Record &record);
+    int     atelierIndex(Atelier *atelier);
+    void    backup(void);
+    Atelier *findAtelier(const Record &record);
+    bool    readHeader(QIODevice *device, quint32 magic, quint32 &generation);
+    bool    readSnapshot(const QString &filename, quint32 &generation);
+    Rotation *rotation(const QString &name);
+    void    setPosition(Record &record, Atelier *atelier);
+    bool    startLog(quint32 generation, bool truncate);
+private:
+    Exploitation *mExploitation;
+    QString    mFilename;
+    QFile      mFile;
+    QString    mError;
+    quint32    mGeneration;
+    QByteArray mPending;
+    int        mPendingCount;
+    int        mReplayed;
+    QTimer    *mCommitTimer;
+    qint64     mCompactSize;
+    // Rotations by name, rebuilt when a rotation is removed or renamed
+    QHash<QString, Rotation *> mRotations;
+    bool       mRotationsValid;
+};
+
+#endif // CHANGELOG_H
@@ -0,0 +1,909 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QtAlgorithms>
+#include <QtNumeric>
+#include "column.h"
+#include "instrument.h"
+#include "memoryusage.h"
+
+// Memory used by one exception of a sparse column (row and value)
+#define COLUMN_EXCEPTION_BITS 96
+
+static const char *kindNames[AtelierColumn::KindLast] = {
+    "double", "float", "integer", "boolean", "enum"
+};
+
+// Memory used by one value of a dense column, for each kind
+static const int kindBits[AtelierColumn::KindLast] = {
+    64, 32, 32, 1, 8
+};
+
+static bool sameValue(double a, double b)
+{
+    return (a == b) || (qIsNaN(a) && qIsNaN(b));
+}
+
+/**
+ * @brief Count the distinct values of a list (up to a limit)
+ *
+ * @param values List of values
+ * @param limit  Stop counting after this number
+ * @return integer Number of distinct values (at most limit)
+ */
+static int countDistinct(const QVector<double> &values, int limit)
+{
+    QVector<double> found;
+    for (int i = 0; (i < values.count()) && (found.count() < limit); ++i)
+    {
+        int j = 0;
+        while ((j < found.count()) && ! sameValue(found.at(j), values.at(i)))
+            j++;
+        if (j == found.count())
+            found.append(values.at(i));
+    }
+    return found.count();
+}
+
+/**
+ * @brief Default constructor, the column is empty
+ *
+ * @param kind Storage kind of the values
+ */
+AtelierColumn::AtelierColumn(Kind kind)
+{
+    mKind       = kind;
+    mCount      = 0;
+    mDefault    = 0;
+    mExceptions = 0;
+    mSparse     = true;
+}
+
+/**
+ * @brief Insert a value at the end of the column (for a new entity)
+ *
+ * @param value Value to insert
+ * @return boolean False if an enum column can not hold this value
+ */
+bool AtelierColumn::append(double value)
+{
+    value = normalize(value);
+
+    if ( ! prepare(value))
+        return false;
+
+    if (mSparse)
+    {
+        if ( ! sameValue(value, mDefault))
+        {
+            mRows.append(mCount);
+            mOverrides.append(value);
+            mExceptions++;
+        }
+        mCount++;
+    }
+    else
+    {
+        resize(mCount + 1);
+        storeDense(mCount - 1, value);
+        if ( ! sameValue(value, mDefault))
+            mExceptions++;
+    }
+    checkLayout();
+    return true;
+}
+
+/**
+ * @brief Change the storage kind of the column
+ *
+ * All values are converted to the new kind (ex: rounded for an integer
+ * column). An enum column can not hold more than 256 distinct values,
+ * in that case the column is left unmodified.
+ *
+ * @param kind New kind of the column
+ * @return boolean False if the values can not be converted
+ */
+bool AtelierColumn::convert(Kind kind)
+{
+    INSTRUMENT_CALL("AtelierColumn::convert");
+
+    if ((kind < KindDouble) || (kind >= KindLast))
+        return false;
+    if (kind == mKind)
+        return true;
+
+    QVector<double> values(mCount);
+    INSTRUMENT_ALLOC(1);
+    for (int i = 0; i < mCount; ++i)
+        values[i] = normalize(kind, value(i));
+
+    if (kind == KindEnum)
+    {
+        values.append(mDefault);
+        if (countDistinct(values, 257) > 256)
+            return false;
+        values.removeLast();
+    }
+
+    // Build the converted column, then replace this one
+    AtelierColumn column(kind);
+    column.reset(0, mDefault);
+    for (int i = 0; i < mCount; ++i)
+        column.append(values.at(i));
+    *this = column;
+
+    return true;
+}
+
+/**
+ * @brief Get the number of values (one per entity)
+ *
+ * @return integer Number of values
+ */
+int AtelierColumn::count(void) const
+{
+    return mCount;
+}
+
+/**
+ * @brief Get the number of values that differ from the default value
+ *
+ * @return integer Number of exceptions
+ */
+int AtelierColumn::countExceptions(void) const
+{
+    return mExceptions;
+}
+
+/**
+ * @brief Get the memory that the values would use with the dense layout
+ *
+ * @return qint64 Number of bytes (one value of the kind per entity)
+ */
+qint64 AtelierColumn::denseSize(void) const
+{
+    return ((qint64(mCount) * kindBits[mKind]) + 7) / 8;
+}
+
+/**
+ * @brief Get the default value of the column
+ *
+ * @return double Default value
+ */
+double AtelierColumn::getDefault(void) const
+{
+    return mDefault;
+}
+
+/**
+ * @brief Get the storage kind of the values
+ *
+ * The kind is only modified by convert, never by a write.
+ *
+ * @return Kind Kind of the column
+ */
+AtelierColumn::Kind AtelierColumn::getKind(void) const
+{
+    return mKind;
+}
+
+/**
+ * @brief Test the current layout of the column
+ *
+ * @return boolean True if only the exceptions are stored
+ */
+bool AtelierColumn::isSparse(void) const
+{
+    return mSparse;
+}
+
+/**
+ * @brief Get the memory used by this column (object and buffers)
+ *
+ * @return qint64 Number of bytes
+ */
+qint64 AtelierColumn::memoryUsage(void) const
+{
+    return sizeof(AtelierColumn)
+         + MemoryUsage::vectorBytes(mRows)
+         + MemoryUsage::vectorBytes(mOverrides)
+         + MemoryUsage::vectorBytes(mDoubles)
+         + MemoryUsage::vectorBytes(mFloats)
+         + MemoryUsage::vectorBytes(mIntegers)
+         + MemoryUsage::vectorBytes(mBits)
+         + MemoryUsage::vectorBytes(mCodes)
+         + MemoryUsage::vectorBytes(mDictionary);
+}
+
+/**
+ * @brief Get the value really stored for a value of this column
+ *
+ * @param value Value to convert
+ * @return double Converted value
+ */
+double AtelierColumn::normalize(double value) const
+{
+    return normalize(mKind, value);
+}
+
+/**
+ * @brief Insert a value before one row
+ *
+ * @param row   Index of the new value (count() to append it)
+ * @param value Value to insert (converted to the kind of the column)
+ * @return boolean False if the row is invalid or if an enum column can
+ *                 not hold this value
+ */
+bool AtelierColumn::insert(int row, double value)
+{
+    if ((row < 0) || (row > mCount))
+        return false;
+    if (row == mCount)
+        return append(value);
+
+    value = normalize(value);
+
+    if ( ! prepare(value))
+        return false;
+
+    if (mSparse)
+    {
+        QVector<qint32>::iterator it = qLowerBound(mRows.begin(), mRows.end(), row);
+        int i = it - mRows.begin();
+        // Following exceptions move down by one row
+        for (int j = i; j < mRows.count(); ++j)
+            mRows[j]++;
+        if ( ! sameValue(value, mDefault))
+        {
+            mRows.insert(i, row);
+            mOverrides.insert(i, value);
+            mExceptions++;
+        }
+        mCount++;
+        checkLayout();
+        return true;
+    }
+
+    switch (mKind)
+    {
+        case KindDouble:
+            mDoubles.insert(row, value);
+            break;
+        case KindFloat:
+            mFloats.insert(row, float(value));
+            break;
+        case KindInteger:
+            mIntegers.insert(row, qint32(value));
+            break;
+        case KindBoolean:
+            // Move the following bits up by one position
+            mBits.resize((mCount + 32) >> 5);
+            for (int i = mCount; i > row; --i)
+            {
+                quint32 mask = 1u << (i & 31);
+                if (mBits.at((i - 1) >> 5) & (1u << ((i - 1) & 31)))
+                    mBits[i >> 5] |= mask;
+                else
+                    mBits[i >> 5] &= ~mask;
+            }
+            break;
+        case KindEnum:
+            mCodes.insert(row, 0);
+            break;
+        default:
+            break;
+    }
+    mCount++;
+    if ((mKind == KindBoolean) || (mKind == KindEnum))
+        storeDense(row, value);
+    if ( ! sameValue(value, mDefault))
+        mExceptions++;
+    checkLayout();
+    return true;
+}
+
+/**
+ * @brief Remove one value of the column (for a removed entity)
+ *
+ * @param row Index of the value to remove
+ */
+void AtelierColumn::remove(int row)
+{
+    if ((row < 0) || (row >= mCount))
+        return;
+
+    if (mSparse)
+    {
+        QVector<qint32>::iterator it = qLowerBound(mRows.begin(), mRows.end(), row);
+        int i = it - mRows.begin();
+        if ((i < mRows.count()) && (mRows.at(i) == row))
+        {
+            mRows.remove(i);
+            mOverrides.remove(i);
+            mExceptions--;
+        }
+        // Following exceptions move up by one row
+        for (; i < mRows.count(); ++i)
+            mRows[i]--;
+        mCount--;
+        checkLayout();
+        return;
+    }
+
+    if ( ! sameValue(denseValue(row), mDefault))
+        mExceptions--;
+
+    switch (mKind)
+    {
+        case KindDouble:
+            mDoubles.remove(row);
+            break;
+        case KindFloat:
+            mFloats.remove(row);
+            break;
+        case KindInteger:
+            mIntegers.remove(row);
+            break;
+        case KindBoolean:
+            // Move the following bits down by one position
+            for (int i = row; i < (mCount - 1); ++i)
+            {
+                quint32 mask = 1u << (i & 31);
+                if (mBits.at((i + 1) >> 5) & (1u << ((i + 1) & 31)))
+                    mBits[i >> 5] |= mask;
+                else
+                    mBits[i >> 5] &= ~mask;
+            }
+            break;
+        case KindEnum:
+            mCodes.remove(row);
+            break;
+        default:
+            break;
+    }
+    mCount--;
+    if (mKind == KindBoolean)
+        mBits.resize((mCount + 31) >> 5);
+    checkLayout();
+}
+
+/**
+ * @brief Set all values of the column at once
+ *
+ * The column becomes sparse, so the cost does not depend on the number
+ * of values.
+ *
+ * @param count Number of values
+ * @param value Value of all rows (the new default value)
+ */
+void AtelierColumn::reset(int count, double value)
+{
+    mRows.clear();
+    mOverrides.clear();
+    mDoubles.clear();
+    mFloats.clear();
+    mIntegers.clear();
+    mBits.clear();
+    mCodes.clear();
+    mDictionary.clear();
+
+    mSparse     = true;
+    mCount      = qMax(count, 0);
+    mDefault    = normalize(value);
+    mExceptions = 0;
+}
+
+/**
+ * @brief Modify the default value, the values of the rows are kept
+ *
+ * The exceptions are counted again from the new default value.
+ *
+ * @param value New default value (converted to the kind of the column)
+ * @return boolean False if an enum column can not hold this value
+ */
+bool AtelierColumn::setDefault(double value)
+{
+    INSTRUMENT_CALL("AtelierColumn::setDefault");
+
+    value = normalize(value);
+    if (sameValue(value, mDefault))
+        return true;
+    if ( ! prepare(value))
+        return false;
+
+    if (mSparse)
+    {
+        // Rows that used the old default become exceptions
+        QVector<double> values(mCount);
+        INSTRUMENT_ALLOC(1);
+        for (int i = 0; i < mCount; ++i)
+            values[i] = this->value(i);
+        mDefault = value;
+        mRows.clear();
+        mOverrides.clear();
+        for (int i = 0; i < mCount; ++i)
+        {
+            if (sameValue(values.at(i), mDefault))
+                continue;
+            mRows.append(i);
+            mOverrides.append(values.at(i));
+        }
+        mExceptions = mRows.count();
+    }
+    else
+    {
+        mDefault = value;
+        mExceptions = 0;
+        for (int i = 0; i < mCount; ++i)
+        {
+            if ( ! sameValue(denseValue(i), mDefault))
+                mExceptions++;
+        }
+    }
+    checkLayout();
+    return true;
+}
+
+/**
+ * @brief Set one value of the column
+ *
+ * An enum column refuses a new distinct value when the values already
+ * used fill his dictionary : the column must be converted first (see
+ * convert), the kind is never modified here.
+ *
+ * @param row   Index of the value
+ * @param value New value (converted to the kind of the column)
+ * @return boolean False if the row is invalid or if an enum column can
+ *                 not hold this value
+ */
+bool AtelierColumn::setValue(int row, double value)
+{
+    if ((row < 0) || (row >= mCount))
+        return false;
+
+    value = normalize(value);
+
+    if ( ! prepare(value))
+    {
+        // The old value of the row may be his last use : free it, then retry
+        double old = this->value(row);
+        if (sameValue(old, mDefault))
+            return false;
+        setValue(row, mDefault);
+        packDictionary();
+        if ( ! prepare(value))
+        {
+            setValue(row, old);
+            return false;
+        }
+    }
+
+    if (mSparse)
+    {
+        QVector<qint32>::iterator it = qLowerBound(mRows.begin(), mRows.end(), row);
+        int  i     = it - mRows.begin();
+        bool found = (i < mRows.count()) && (mRows.at(i) == row);
+        if (sameValue(value, mDefault))
+        {
+            if ( ! found)
+                return true;
+            mRows.remove(i);
+            mOverrides.remove(i);
+            mExceptions--;
+        }
+        else if (found)
+        {
+            mOverrides[i] = value;
+            return true;
+        }
+        else
+        {
+            mRows.insert(i, row);
+            mOverrides.insert(i, value);
+            mExceptions++;
+        }
+    }
+    else
+    {
+        bool wasException = ! sameValue(denseValue(row), mDefault);
+        storeDense(row, value);
+        bool isException  = ! sameValue(value, mDefault);
+        if (wasException == isException)
+            return true;
+        mExceptions += isException ? 1 : -1;
+    }
+    checkLayout();
+    return true;
+}
+
+/**
+ * @brief Set all values of the column from an array
+ *
+ * The default value is kept. The exceptions are rebuilt in one pass, then
+ * the layout is selected once.
+ *
+ * @param values Pointer to the new values (converted to the kind)
+ * @param count  Number of values (the new size of the column)
+ * @return boolean False if an enum column can not hold these values (the
+ *                 column is left unmodified)
+ */
+bool AtelierColumn::setValues(const double *values, int count)
+{
+    INSTRUMENT_CALL("AtelierColumn::setValues");
+
+    if (mKind == KindEnum)
+    {
+        QVector<double> distinct(qMax(count, 0) + 1);
+        INSTRUMENT_ALLOC(1);
+        for (int i = 0; i < count; ++i)
+            distinct[i] = normalize(values[i]);
+        distinct[distinct.count() - 1] = mDefault;
+        if (countDistinct(distinct, 257) > 256)
+            return false;
+    }
+
+    reset(count, mDefault);
+    for (int i = 0; i < mCount; ++i)
+    {
+        double value = normalize(values[i]);
+        if (sameValue(value, mDefault))
+            continue;
+        mRows.append(i);
+        mOverrides.append(value);
+    }
+    mExceptions = mRows.count();
+    if (mKind == KindEnum)
+        packDictionary();
+    checkLayout();
+    return true;
+}
+
+/**
+ * @brief Get the memory that the values would use with the sparse layout
+ *
+ * @return qint64 Number of bytes (row and value of each exception)
+ */
+qint64 AtelierColumn::sparseSize(void) const
+{
+    return (qint64(mExceptions) * COLUMN_EXCEPTION_BITS) / 8;
+}
+
+/**
+ * @brief Get one value of the column
+ *
+ * @param row Index of the value
+ * @return double Value (0 if the row is out of the column)
+ */
+double AtelierColumn::value(int row) const
+{
+    if ((row < 0) || (row >= mCount))
+        return 0;
+
+    if (mSparse)
+    {
+        int i = exception(row);
+        return (i < 0) ? mDefault : mOverrides.at(i);
+    }
+    return denseValue(row);
+}
+
+/**
+ * @brief Select the layout that uses less memory
+ *
+ * The column becomes dense when the exceptions cost more than one value
+ * per row, and sparse again when they cost less than the half (so a
+ * column does not switch back and forth around the limit).
+ */
+void AtelierColumn::checkLayout(void)
+{
+    qint64 sparseBits = qint64(mExceptions) * COLUMN_EXCEPTION_BITS;
+    qint64 denseBits  = qint64(mCount) * kindBits[mKind];
+
+    if (mSparse && (sparseBits > denseBits))
+        setDense(true);
+    else if (( ! mSparse) && ((sparseBits * 2) < denseBits))
+        setDense(false);
+}
+
+/**
+ * @brief Get one value of a dense column
+ *
+ * @param row Index of the value
+ * @return double Value
+ */
+double AtelierColumn::denseValue(int row) const
+{
+    switch (mKind)
+    {
+        case KindDouble:
+            return mDoubles.at(row);
+        case KindFloat:
+            return mFloats.at(row);
+        case KindInteger:
+            return mIntegers.at(row);
+        case KindBoolean:
+            return (mBits.at(row >> 5) & (1u << (row & 31))) ? 1 : 0;
+        case KindEnum:
+            return mDictionary.at(mCodes.at(row));
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Get the index of a value into the enum dictionary
+ *
+ * The dictionary keeps the values that are no longer used, so it is
+ * rebuilt from the used ones before a new value is refused.
+ *
+ * @param value Value to search (inserted if not found)
+ * @return integer Index of the value (-1 if the dictionary is full)
+ */
+int AtelierColumn::enumCode(double value)
+{
+    // The default value is always into the dictionary
+    if (mDictionary.isEmpty())
+        mDictionary.append(mDefault);
+    for (int i = 0; i < mDictionary.count(); ++i)
+    {
+        if (sameValue(mDictionary.at(i), value))
+            return i;
+    }
+    if (mDictionary.count() > 255)
+        packDictionary();
+    if (mDictionary.count() > 255)
+        return -1;
+    mDictionary.append(value);
+    return mDictionary.count() - 1;
+}
+
+/**
+ * @brief Search the exception of a row into a sparse column
+ *
+ * @param row Index of the row
+ * @return integer Index of the exception (-1 if the row uses the default)
+ */
+int AtelierColumn::exception(int row) const
+{
+    QVector<qint32>::const_iterator it = qLowerBound(mRows.constBegin(), mRows.constEnd(), row);
+    if ((it == mRows.constEnd()) || (*it != row))
+        return -1;
+    return it - mRows.constBegin();
+}
+
+/**
+ * @brief Rebuild the enum dictionary with the values still used
+ *
+ * The default value is always kept, the codes of a dense column are
+ * updated.
+ */
+void AtelierColumn::packDictionary(void)
+{
+    INSTRUMENT_CALL("AtelierColumn::packDictionary");
+
+    QVector<double> dictionary;
+    dictionary.append(mDefault);
+    if (mSparse)
+    {
+        for (int i = 0; i < mOverrides.count(); ++i)
+        {
+            double value = mOverrides.at(i);
+            int j = 0;
+            while ((j < dictionary.count()) && ! sameValue(dictionary.at(j), value))
+                j++;
+            if (j == dictionary.count())
+                dictionary.append(value);
+        }
+    }
+    else
+    {
+        // New code of each old code (-1 while unused)
+        QVector<int> codes(mDictionary.count(), -1);
+        int def = -1;
+        for (int i = 0; i < mDictionary.count(); ++i)
+        {
+            if (sameValue(mDictionary.at(i), mDefault))
+                def = i;
+        }
+        if (def >= 0)
+            codes[def] = 0;
+        for (int i = 0; i < mCount; ++i)
+        {
+            int code = mCodes.at(i);
+            if (codes.at(code) < 0)
+            {
+                codes[code] = dictionary.count();
+                dictionary.append(mDictionary.at(code));
+            }
+            mCodes[i] = quint8(codes.at(code));
+        }
+    }
+    mDictionary = dictionary;
+}
+
+/**
+ * @brief Make sure that a value can be stored with the kind of the column
+ *
+ * @param value Value that will be stored (already converted to the kind)
+ * @return boolean False if the dictionary of an enum column is full
+ */
+bool AtelierColumn::prepare(double value)
+{
+    return (mKind != KindEnum) || (enumCode(value) >= 0);
+}
+
+/**
+ * @brief Set the number of values of a dense column
+ *
+ * @param count New number of values
+ */
+void AtelierColumn::resize(int count)
+{
+    switch (mKind)
+    {
+        case KindDouble:
+            mDoubles.resize(count);
+            break;
+        case KindFloat:
+            mFloats.resize(count);
+            break;
+        case KindInteger:
+            mIntegers.resize(count);
+            break;
+        case KindBoolean:
+            mBits.resize((count + 31) >> 5);
+            break;
+        case KindEnum:
+            mCodes.resize(count);
+            break;
+        default:
+            break;
+    }
+    mCount = count;
+}
+
+/**
+ * @brief Change the layout of the column
+ *
+ * The values of an enum column are always into his dictionary (see
+ * prepare), so the dense codes can be built without a kind change.
+ *
+ * @param dense True to store one value per row, false for the exceptions
+ */
+void AtelierColumn::setDense(bool dense)
+{
+    INSTRUMENT_CALL("AtelierColumn::setDense");
+
+    if (dense == ! mSparse)
+        return;
+
+    if (dense)
+    {
+        QVector<double> values(mCount, mDefault);
+        INSTRUMENT_ALLOC(1);
+        for (int i = 0; i < mRows.count(); ++i)
+            values[mRows.at(i)] = mOverrides.at(i);
+        if (mKind == KindEnum)
+            packDictionary();
+        mRows.clear();
+        mOverrides.clear();
+
+        mSparse = false;
+        resize(mCount);
+        for (int i = 0; i < mCount; ++i)
+            storeDense(i, values.at(i));
+    }
+    else
+    {
+        for (int i = 0; i < mCount; ++i)
+        {
+            double value = denseValue(i);
+            if (sameValue(value, mDefault))
+                continue;
+            mRows.append(i);
+            mOverrides.append(value);
+        }
+        mDoubles.clear();
+        mFloats.clear();
+        mIntegers.clear();
+        mBits.clear();
+        mCodes.clear();
+        mSparse = true;
+    }
+}
+
+/**
+ * @brief Store one value into a dense column
+ *
+ * @param row   Index of the value
+ * @param value Value to store (already converted to the kind)
+ */
+void AtelierColumn::storeDense(int row, double value)
+{
+    switch (mKind)
+    {
+        case KindDouble:
+            mDoubles[row] = value;
+            break;
+        case KindFloat:
+            mFloats[row] = float(value);
+            break;
+        case KindInteger:
+            mIntegers[row] = qint32(value);
+            break;
+        case KindBoolean:
+            if (value != 0)
+                mBits[row >> 5] |=  (1u << (row & 31));
+            else
+                mBits[row >> 5] &= ~(1u << (row & 31));
+            break;
+        case KindEnum:
+            mCodes[row] = quint8(qMax(enumCode(value), 0));
+            break;
+        default:
+            break;
+    }
+}
+
+// -------------------- Kinds --------------------
+
+/**
+ * @brief Search a kind by his name
+ *
+ * @param name Name of the kind (ex: "integer")
+ * @param kind Reference to the kind found
+ * @return boolean False if the name is unknown
+ */
+bool AtelierColumn::kindFromName(const QString &name, Kind &kind)
+{
+    for (int i = 0; i < KindLast; ++i)
+    {
+        if (name == kindNames[i])
+        {
+            kind = Kind(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the name of a kind (used into files)
+ *
+ * @param kind Kind of column
+ * @return QString Name of the kind
+ */
+QString AtelierColumn::kindName(Kind kind)
+{
+    if ((kind < KindDouble) || (kind >= KindLast))
+        return QString();
+    return kindNames[kind];
+}
+
+/**
+ * @brief Convert a value to a kind of column
+ *
+ * @param kind  Kind of column
+ * @param value Value to convert
+ * @return double Converted value
+ */
+double AtelierColumn::normalize(Kind kind, double value)
+{
+    switch (kind)
+    {
+        case KindFloat:
+            return float(value);
+        case KindInteger:
+            if (qIsNaN(value))
+                return 0;
+            return qint32(qRound64(qBound(-2147483648.0, value, 2147483647.0)));
+        case KindBoolean:
+            return (value != 0) ? 1 : 0;
+        default:
+            return value;
+    }
+}
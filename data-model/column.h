@@ -0,0 +1,95 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <QString>
+#include <QVector>
+
+/*
+ * An AtelierColumn holds the values of one parameter for all the entities
+ * of an Atelier. The storage depends on the kind of the parameter :
+ * doubles (8 bytes per entity), 32-bit floats (4 bytes), integers (4
+ * bytes), booleans (1 bit) or enums (1 byte, the index of the value into
+ * a dictionary of at most 256 distinct values).
+ *
+ * Most entities keep the default value of a parameter, so a column starts
+ * sparse : the default value is stored once, with the sorted list of the
+ * entities that use another value. The column becomes dense when this
+ * list costs more memory than one value per entity, and sparse again when
+ * it costs less than the half.
+ *
+ * Values are always read and written as doubles. A written value is first
+ * converted to the kind of the column (see normalize). An enum column
+ * refuses a new distinct value when 256 are already used, the kind is only
+ * modified by convert.
+ */
+class AtelierColumn
+{
+public:
+    enum Kind {
+        KindDouble,
+        KindFloat,
+        KindInteger,
+        KindBoolean,
+        KindEnum,
+        KindLast
+    };
+public:
+    explicit AtelierColumn(Kind kind = KindDouble);
+    bool   append  (double value);
+    bool   convert (Kind kind);
+    int    count   (void) const;
+    int    countExceptions(void) const;
+    qint64 denseSize(void) const;
+    double getDefault(void) const;
+    Kind   getKind (void) const;
+    bool   insert  (int row, double value);
+    bool   isSparse(void) const;
+    qint64 memoryUsage(void) const;
+    double normalize(double value) const;
+    void   remove  (int row);
+    void   reset   (int count, double value);
+    bool   setDefault(double value);
+    bool   setValue(int row, double value);
+    bool   setValues(const double *values, int count);
+    qint64 sparseSize(void) const;
+    double value   (int row) const;
+    static bool    kindFromName(const QString &name, Kind &kind);
+    static QString kindName    (Kind kind);
+    static double  normalize   (Kind kind, double value);
+private:
+    void   checkLayout(void);
+    double denseValue(int row) const;
+    int    enumCode  (double value);
+    int    exception (int row) const;
+    void   packDictionary(void);
+    bool   prepare   (double value);
+    void   resize    (int count);
+    void   setDense  (bool dense);
+    void   storeDense(int row, double value);
+private:
+    Kind   mKind;
+    int    mCount;
+    // Default value, and number of values that differ from it
+    double mDefault;
+    int    mExceptions;
+    // Sparse layout : rows (sorted) and values of the exceptions
+    bool   mSparse;
+    QVector<qint32>  mRows;
+    QVector<double>  mOverrides;
+    // Dense layout : one value per entity
+    QVector<double>  mDoubles;
+    QVector<float>   mFloats;
+    QVector<qint32>  mIntegers;
+    QVector<quint32> mBits;
+    QVector<quint8>  mCodes;
+    QVector<double>  mDictionary;
+};
+
+#endif // COLUMN_H
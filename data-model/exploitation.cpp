@@ -6,6 +6,8 @@
  * Copyright (c) 2016 Agilack
  */
 #include "exploitation.h"
+#include "hash.h"
+#include "instrument.h"
 
 /**
  * @brief Default constructor
@@ -14,6 +16,8 @@
 Exploitation::Exploitation()
 {
     mAteliers.clear();
+    // Identifier 0 is reserved (invalid)
+    mNextId = 1;
 }
 
 /**
@@ -22,6 +26,20 @@ Exploitation::Exploitation()
  */
 Exploitation::~Exploitation()
 {
+    INSTRUMENT_CALL("Exploitation::~Exploitation");
+
+    clear();
+}
+
+/**
+ * @brief Delete all Ateliers, global parameters and Rotations
+ *
+ */
+void Exploitation::clear(void)
+{
+    // Everything is deleted, no need to update identifiers one by one
+    mAtelierIds.clear();
+
     while( ! mAteliers.isEmpty())
     {
         // Get the first list item
@@ -51,6 +69,10 @@ Exploitation::~Exploitation()
         // Then, delete it
         delete r;
     }
+
+    mParameterIds.clear();
+    mRotationIds.clear();
+    mNextId = 1;
 }
 
 /**
@@ -61,8 +83,12 @@ Exploitation::~Exploitation()
  */
 Parameter *Exploitation::addParameter(const QString &name)
 {
+    INSTRUMENT_CALL("Exploitation::addParameter");
+    INSTRUMENT_ALLOC(1);
+
     Parameter *p = new Parameter(name);
     mParameters.push_back(p);
+    registerParameter(p);
     return p;
 }
 
@@ -104,15 +130,19 @@ uint Exploitation::countRotation(void)
  */
 Atelier *Exploitation::createAtelier(const QString &name)
 {
+    INSTRUMENT_CALL("Exploitation::createAtelier");
+
     // Sanity check
     if (name.isEmpty())
         return NULL;
 
     // Allocate a new Atelier
     Atelier *a = new Atelier(this);
+    INSTRUMENT_ALLOC(1);
     a->setName(name);
     // Then, insert it into this exploitation
     mAteliers.push_back(a);
+    registerAtelier(a);
 
     return a;
 }
@@ -126,14 +156,18 @@ Atelier *Exploitation::createAtelier(const QString &name)
  */
 Rotation *Exploitation::createRotation(const QString &name, ulong duration)
 {
+    INSTRUMENT_CALL("Exploitation::createRotation");
+
     if (name.isEmpty())
         return 0;
 
     // Create a new Rotation
     Rotation *newRotation = new Rotation(name, duration);
+    INSTRUMENT_ALLOC(1);
 
     // Insert it to the local cache
     mRotations.push_back(newRotation);
+    registerRotation(newRotation);
 
     return newRotation;
 }
@@ -152,6 +186,43 @@ Atelier *Exploitation::getAtelier(int index)
     return mAteliers.at(index);
 }
 
+/**
+ * @brief Get an Atelier (or an entity), identified by his unique identifier
+ *
+ * @param id Identifier of the Atelier
+ * @return Pointer to the requested Atelier (or NULL if not found)
+ */
+Atelier *Exploitation::getAtelierById(uint id)
+{
+    return mAtelierIds.value(id, 0);
+}
+
+/**
+ * @brief Get the content hash of the whole Exploitation
+ *
+ * Combine the hashes of the global parameters, rotations and ateliers.
+ * Only the modified ateliers and rotations compute their hash again, so
+ * comparing the hash of each Atelier with a previous value gives the
+ * modified sub-trees (ex: to reuse simulation results of the others).
+ *
+ * @return quint64 Hash of the Exploitation content
+ */
+quint64 Exploitation::getHash(void)
+{
+    INSTRUMENT_CALL("Exploitation::getHash");
+
+    quint64 hash = ContentHash::SeedExploitation;
+    for (int i = 0; i < mParameters.count(); ++i)
+        hash = ContentHash::combine(hash, mParameters.at(i)->getHash());
+    hash = ContentHash::combine(hash, mRotations.count());
+    for (int i = 0; i < mRotations.count(); ++i)
+        hash = ContentHash::combine(hash, mRotations.at(i)->getHash());
+    hash = ContentHash::combine(hash, mAteliers.count());
+    for (int i = 0; i < mAteliers.count(); ++i)
+        hash = ContentHash::combine(hash, mAteliers.at(i)->getHash());
+    return hash;
+}
+
 /**
  * @brief Get a Parameter, identified by his index
  *
@@ -166,6 +237,33 @@ Parameter *Exploitation::getParameter(int index)
     return mParameters.at(index);
 }
 
+/**
+ * @brief Get a Parameter, identified by his name
+ *
+ * @param name Name of the requested parameter
+ * @return Pointer to the requested parameter (or NULL if not found)
+ */
+Parameter *Exploitation::getParameter(const QString &name)
+{
+    for (int i = 0; i < mParameters.count(); ++i)
+    {
+        if (mParameters.at(i)->getName() == name)
+            return mParameters.at(i);
+    }
+    return 0;
+}
+
+/**
+ * @brief Get a Parameter, identified by his unique identifier
+ *
+ * @param id Identifier of the Parameter
+ * @return Pointer to the requested parameter (or NULL if not found)
+ */
+Parameter *Exploitation::getParameterById(uint id)
+{
+    return mParameterIds.value(id, 0);
+}
+
 /**
  * @brief Get the value of a Parameter
  *
@@ -174,6 +272,8 @@ Parameter *Exploitation::getParameter(int index)
  */
 double Exploitation::getParameterValue(const QString &name)
 {
+    INSTRUMENT_CALL("Exploitation::getParameterValue");
+
     // Search the requested parameter
     for (int i = 0; i < mParameters.count(); ++i)
     {
@@ -197,6 +297,17 @@ Rotation *Exploitation::getRotation(uint index)
     return mRotations.at(index);
 }
 
+/**
+ * @brief Get one Rotation, identified by his unique identifier
+ *
+ * @param id Identifier of the Rotation
+ * @return Pointer to the Rotation object (or NULL if not found)
+ */
+Rotation *Exploitation::getRotationById(uint id)
+{
+    return mRotationIds.value(id, 0);
+}
+
 /**
  * @brief Insert an already allocated Atelier into current Exploitation
  *
@@ -207,7 +318,113 @@ void Exploitation::insertAtelier(Atelier *atelier)
     if (atelier == NULL)
         return;
 
+    // A top-level Atelier must know his Exploitation
+    if ((atelier->mExploitation == 0) && (atelier->mParent == 0))
+        atelier->mExploitation = this;
+
     mAteliers.push_back(atelier);
+    registerAtelier(atelier);
+}
+
+/**
+ * @brief Estimate the memory used by the Exploitation
+ *
+ * The estimation is made from the size of the objects and of their
+ * containers (see MemoryUsage), the values themselves are not read.
+ *
+ * @return MemoryUsage Estimation by category and by Atelier
+ */
+MemoryUsage Exploitation::memoryUsage(void)
+{
+    INSTRUMENT_CALL("Exploitation::memoryUsage");
+
+    MemoryUsage usage;
+    usage.add(MemoryUsage::CategoryParameters,
+              MemoryUsage::listBytes(mParameters.count()) +
+              MemoryUsage::hashBytes(mParameterIds.count(), sizeof(uint) + sizeof(Parameter *)));
+    usage.add(MemoryUsage::CategoryRotations,
+              MemoryUsage::listBytes(mRotations.count()) +
+              MemoryUsage::hashBytes(mRotationIds.count(), sizeof(uint) + sizeof(Rotation *)));
+    usage.add(MemoryUsage::CategoryEntities, sizeof(Exploitation) +
+              MemoryUsage::listBytes(mAteliers.count()) +
+              MemoryUsage::hashBytes(mAtelierIds.count(), sizeof(uint) + sizeof(Atelier *)));
+
+    for (int i = 0; i < mParameters.count(); ++i)
+        mParameters.at(i)->memoryUsage(usage);
+    for (int i = 0; i < mRotations.count(); ++i)
+        mRotations.at(i)->memoryUsage(usage);
+
+    // Each Atelier is summarized with the difference of the categories
+    for (int i = 0; i < mAteliers.count(); ++i)
+    {
+        Atelier *atelier = mAteliers.at(i);
+        qint64 structure = usage.get(MemoryUsage::CategoryEntities);
+        qint64 values    = usage.get(MemoryUsage::CategoryValues);
+        int entities = atelier->memoryUsage(usage);
+        usage.addAtelier(atelier->getName(), entities,
+                         usage.get(MemoryUsage::CategoryEntities) - structure,
+                         usage.get(MemoryUsage::CategoryValues)   - values);
+    }
+    return usage;
+}
+
+/**
+ * @brief Test if a formula uses a global parameter
+ *
+ * A formula variable is first an entity parameter : the formulas of an
+ * Atelier that has a parameter with this name do not use the global one.
+ *
+ * @param name Name of the global parameter
+ * @return Boolean value, true if at least one formula uses it
+ */
+bool Exploitation::isParameterUsed(const QString &name)
+{
+    for (int i = 0; i < mAteliers.count(); ++i)
+    {
+        Atelier *atelier = mAteliers.at(i);
+        if ((atelier->parameterIndex(name) < 0) && atelier->isNameUsed(name))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Give an identifier to an Atelier and all his entities
+ *
+ * @param atelier Pointer to the Atelier (or entity) to register
+ */
+void Exploitation::registerAtelier(Atelier *atelier)
+{
+    if (atelier->mId == 0)
+        atelier->mId = mNextId++;
+    mAtelierIds.insert(atelier->mId, atelier);
+
+    for (int i = 0; i < atelier->countEntity(); ++i)
+        registerAtelier( atelier->getEntity(i) );
+}
+
+/**
+ * @brief Give an identifier to a Parameter
+ *
+ * @param param Pointer to the Parameter to register
+ */
+void Exploitation::registerParameter(Parameter *param)
+{
+    if (param->mId == 0)
+        param->mId = mNextId++;
+    mParameterIds.insert(param->mId, param);
+}
+
+/**
+ * @brief Give an identifier to a Rotation
+ *
+ * @param rotation Pointer to the Rotation to register
+ */
+void Exploitation::registerRotation(Rotation *rotation)
+{
+    if (rotation->mId == 0)
+        rotation->mId = mNextId++;
+    mRotationIds.insert(rotation->mId, rotation);
 }
 
 /**
@@ -217,6 +434,8 @@ void Exploitation::insertAtelier(Atelier *atelier)
  */
 bool Exploitation::removeRotation(Rotation *rotation)
 {
+    INSTRUMENT_CALL("Exploitation::removeRotation");
+
     bool result = false;
 
     for (int i = 0; i < mRotations.size(); ++i)
@@ -225,7 +444,8 @@ bool Exploitation::removeRotation(Rotation *rotation)
         {
             // Remove item at current position from the list
             mRotations.removeAt(i);
-            // Delete it
+            mRotationIds.remove(rotation->getId());
+            // Delete it (entities that use it are reset to no-rotation)
             delete rotation;
             // That's all folks
             result = true;
@@ -235,6 +455,27 @@ bool Exploitation::removeRotation(Rotation *rotation)
     return result;
 }
 
+/**
+ * @brief Remove one Atelier from Exploitation, and delete it
+ *
+ * @param atelier Pointer to an existing Atelier
+ * @return Boolean value, true on success
+ */
+bool Exploitation::removeAtelier(Atelier *atelier)
+{
+    INSTRUMENT_CALL("Exploitation::removeAtelier");
+
+    int index = mAteliers.indexOf(atelier);
+    if (index < 0)
+        return false;
+
+    mAteliers.removeAt(index);
+    // Identifiers of the Atelier and his entities are removed by destructor
+    delete atelier;
+
+    return true;
+}
+
 /**
  * @brief Remove one Parameter from Exploitation, identified by a pointer on it
  *
@@ -243,14 +484,20 @@ bool Exploitation::removeRotation(Rotation *rotation)
  */
 bool Exploitation::removeParameter(Parameter *param)
 {
+    INSTRUMENT_CALL("Exploitation::removeParameter");
+
     int index = mParameters.indexOf(param);
     if (index < 0)
         return false;
+    // A parameter used by a formula is kept, the formula must change first
+    if (isParameterUsed(param->getName()))
+        return false;
 
     // Get a copy of this parameter
     Parameter *old = mParameters.at(index);
     // Remove the specified parameter ...
     mParameters.removeAt(index);
+    mParameterIds.remove(old->getId());
     // ... and delete it
     delete old;
 
@@ -265,25 +512,11 @@ bool Exploitation::removeParameter(Parameter *param)
  */
 bool Exploitation::removeParameter(const QString &name)
 {
-    bool result = false;
-
-    // Search the requested parameter
-    for (int i = 0; i < mParameters.count(); ++i)
-    {
-        if (mParameters.at(i)->getName() == name)
-        {
-            // Get a copy of this parameter
-            Parameter *old = mParameters.at(i);
-            // Remove the specified parameter ...
-            mParameters.removeAt(i);
-            // ... and delete it
-            delete old;
+    Parameter *param = getParameter(name);
+    if (param == 0)
+        return false;
 
-            result = true;
-            break;
-        }
-    }
-    return result;
+    return removeParameter(param);
 }
 
 /**
@@ -293,17 +526,45 @@ bool Exploitation::removeParameter(const QString &name)
  */
 bool Exploitation::removeRotation(uint index)
 {
+    INSTRUMENT_CALL("Exploitation::removeRotation");
+
     if (index > (countRotation() - 1))
         return false;
 
     // Take the specified Rotation from Exploitation
     Rotation *r = mRotations.takeAt(index);
-    // Delete it
+    mRotationIds.remove(r->getId());
+    // Delete it (entities that use it are reset to no-rotation)
     delete r;
 
     return true;
 }
 
+/**
+ * @brief Rename a global parameter
+ *
+ * Formulas use the parameters by name : a parameter used by a formula is
+ * not renamed.
+ *
+ * @param param Pointer to the parameter to rename
+ * @param name  New name
+ * @return Boolean value, false if the parameter is unknown or used
+ */
+bool Exploitation::renameParameter(Parameter *param, const QString &name)
+{
+    INSTRUMENT_CALL("Exploitation::renameParameter");
+
+    if ( ! mParameters.contains(param))
+        return false;
+    if (param->getName() == name)
+        return true;
+    if (isParameterUsed(param->getName()) || isParameterUsed(name))
+        return false;
+
+    param->setName(name);
+    return true;
+}
+
 /**
  * @brief Set a new value for a global parameter
  *
@@ -312,24 +573,59 @@ bool Exploitation::removeRotation(uint index)
  */
 void Exploitation::setParameter(const QString &name, double value)
 {
-    Parameter *p = 0;
+    INSTRUMENT_CALL("Exploitation::setParameter");
 
     // Search the requested parameter
-    for (int i = 0; i < mParameters.count(); ++i)
-    {
-        if (mParameters.at(i)->getName() == name)
-        {
-            p = mParameters.at(i);
-            break;
-        }
-    }
+    Parameter *p = getParameter(name);
 
     // If the requested parameter does not exists yet, create it
     if (p == 0)
     {
         p = new Parameter(name);
+        INSTRUMENT_ALLOC(1);
         mParameters.push_back(p);
+        registerParameter(p);
     }
 
     p->setValue(value);
+
+    // Update the derived parameters (of all Ateliers) that use this one
+    for (int i = 0; i < mAteliers.count(); ++i)
+        updateDerived(mAteliers.at(i), name);
+}
+
+/**
+ * @brief Update the derived parameters that use a global one, at any depth
+ *
+ * Entities that hold sub-entities have their own parameters, and so may
+ * have their own formulas.
+ *
+ * @param atelier Pointer to the Atelier (or entity holding sub-entities)
+ * @param name    Name of the modified global parameter
+ */
+void Exploitation::updateDerived(Atelier *atelier, const QString &name)
+{
+    atelier->updateDerived(name);
+
+    for (int i = 0; i < atelier->mEntities.count(); ++i)
+    {
+        Atelier *entity = atelier->mEntities.at(i);
+        if ( ! entity->mParameters.isEmpty())
+            updateDerived(entity, name);
+    }
+}
+
+/**
+ * @brief Remove an Atelier (or an entity) from the identifiers table
+ *
+ * @param atelier Pointer to the Atelier (or entity) being deleted
+ */
+void Exploitation::unregisterAtelier(Atelier *atelier)
+{
+    if (atelier->mId == 0)
+        return;
+
+    QHash<uint, Atelier *>::iterator it = mAtelierIds.find(atelier->mId);
+    if ((it != mAtelierIds.end()) && (it.value() == atelier))
+        mAtelierIds.erase(it);
 }
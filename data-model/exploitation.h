@@ -8,9 +8,11 @@
 #ifndef EXPLOITATION_H
 #define EXPLOITATION_H
 #include <QtGlobal>
+#include <QHash>
 #include <QList>
 #include <QString>
 #include "atelier.h"
+#include "memoryusage.h"
 #include "parameter.h"
 #include "rotation.h"
 
@@ -20,25 +22,46 @@ public:
     Exploitation();
     ~Exploitation();
     Parameter*addParameter(const QString &name);
+    void      clear(void);
     uint      countAtelier  (void);
     uint      countParameter(void);
     uint      countRotation (void);
     Atelier  *createAtelier (const QString &name);
     Rotation *createRotation(const QString &name, ulong duration);
     Atelier  *getAtelier  (int index);
+    Atelier  *getAtelierById(uint id);
+    quint64   getHash(void);
     Parameter*getParameter(int index);
+    Parameter*getParameter(const QString &name);
+    Parameter*getParameterById(uint id);
     double    getParameterValue(const QString &name);
     Rotation *getRotation(uint index);
+    Rotation *getRotationById(uint id);
     void      insertAtelier(Atelier *atelier);
+    MemoryUsage memoryUsage(void);
+    void      registerAtelier  (Atelier *atelier);
+    bool      removeAtelier(Atelier *atelier);
     bool      removeParameter(Parameter *param);
     bool      removeParameter(const QString &name);
     bool      removeRotation(Rotation *rotation);
     bool      removeRotation(uint index);
+    bool      renameParameter(Parameter *param, const QString &name);
     void      setParameter(const QString &name, double value);
+    void      unregisterAtelier(Atelier *atelier);
+private:
+    bool      isParameterUsed(const QString &name);
+    void      registerParameter(Parameter *param);
+    void      registerRotation (Rotation *rotation);
+    void      updateDerived(Atelier *atelier, const QString &name);
 private:
     QList<Atelier *>  mAteliers;
     QList<Parameter*> mParameters;
     QList<Rotation *> mRotations;
+    // Identifiers tables
+    uint mNextId;
+    QHash<uint, Atelier  *> mAtelierIds;
+    QHash<uint, Parameter*> mParameterIds;
+    QHash<uint, Rotation *> mRotationIds;
 };
 
 #endif // EXPLOITATION_H
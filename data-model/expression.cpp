@@ -0,0 +1,535 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QtMath>
+#include "expression.h"
+#include "instrument.h"
+#include "memoryusage.h"
+
+// Number of rows evaluated together by each instruction
+#define EXPRESSION_CHUNK 256
+
+/**
+ * @brief Default constructor for an (empty) Expression
+ *
+ */
+Expression::Expression()
+{
+    mPos      = 0;
+    mDepth    = 0;
+    mMaxDepth = 0;
+}
+
+/**
+ * @brief Parse a formula and compile it
+ *
+ * @param text Formula to compile
+ * @return boolean True on success (see errorString on failure)
+ */
+bool Expression::compile(const QString &text)
+{
+    INSTRUMENT_CALL("Expression::compile");
+
+    mText = text;
+    mError.clear();
+    mPos      = 0;
+    mDepth    = 0;
+    mMaxDepth = 0;
+    mCode.clear();
+    mConstants.clear();
+    mVariables.clear();
+
+    bool success = parseExpression();
+    if (success)
+    {
+        skipSpaces();
+        if (mPos < mText.length())
+        {
+            mError = QString("Unexpected \"%1\" at position %2")
+                         .arg(mText.at(mPos)).arg(mPos + 1);
+            success = false;
+        }
+    }
+    if ( ! success)
+    {
+        mCode.clear();
+        mConstants.clear();
+        mVariables.clear();
+    }
+    return success;
+}
+
+/**
+ * @brief Get a description of the last compile error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString Expression::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Get the source text of the formula
+ *
+ * @return QString
+ */
+const QString &Expression::getText(void)
+{
+    return mText;
+}
+
+/**
+ * @brief Get the names of the variables used by the formula
+ *
+ * The position of a name into this list is the index of the matching
+ * input for evaluate().
+ *
+ * @return QStringList
+ */
+const QStringList &Expression::getVariables(void)
+{
+    return mVariables;
+}
+
+/**
+ * @brief Test if the expression has been successfully compiled
+ *
+ * @return boolean
+ */
+bool Expression::isValid(void)
+{
+    return ( ! mCode.isEmpty());
+}
+
+/**
+ * @brief Get the memory used by the compiled formula
+ *
+ * @return qint64 Number of bytes (object, bytecode, text and variables)
+ */
+qint64 Expression::memoryUsage(void) const
+{
+    qint64 bytes = sizeof(Expression)
+                 + MemoryUsage::vectorBytes(mCode)
+                 + MemoryUsage::vectorBytes(mConstants)
+                 + MemoryUsage::stringBytes(mText)
+                 + MemoryUsage::listBytes(mVariables.count());
+    for (int i = 0; i < mVariables.count(); i++)
+        bytes += MemoryUsage::stringBytes(mVariables.at(i));
+    return bytes;
+}
+
+/**
+ * @brief Evaluate the formula for one set of values
+ *
+ * @param values Value of each variable (same order than getVariables)
+ * @return double Result
+ */
+double Expression::evaluate(const QVector<double> &values) const
+{
+    QVector<const double *> inputs(mVariables.count());
+    QVector<int> strides(mVariables.count(), 0);
+    for (int i = 0; i < inputs.count(); ++i)
+        inputs[i] = (i < values.count()) ? (values.constData() + i) : 0;
+
+    double result = 0;
+    evaluate(inputs, strides, 1, &result);
+    return result;
+}
+
+/**
+ * @brief Evaluate the formula over a column of rows
+ *
+ * Each instruction is applied to a chunk of rows before the next one, so
+ * the bytecode is decoded once per chunk and not once per row.
+ *
+ * @param inputs  Pointer to the values of each variable
+ * @param strides Distance between two rows into each input (0 for a
+ *                scalar value, shared by all rows)
+ * @param count   Number of rows
+ * @param output  Pointer to the buffer that receives one result per row
+ */
+void Expression::evaluate(const QVector<const double *> &inputs,
+                          const QVector<int> &strides,
+                          int count, double *output) const
+{
+    INSTRUMENT_CALL("Expression::evaluate");
+
+    if (mCode.isEmpty())
+    {
+        for (int i = 0; i < count; ++i)
+            output[i] = 0;
+        return;
+    }
+
+    QVector<double> stack(mMaxDepth * EXPRESSION_CHUNK);
+    double *columns = stack.data();
+
+    for (int base = 0; base < count; base += EXPRESSION_CHUNK)
+    {
+        int n   = qMin(EXPRESSION_CHUNK, count - base);
+        int top = 0;
+
+        for (int pc = 0; pc < mCode.count(); ++pc)
+        {
+            const Instruction &ins = mCode.at(pc);
+            double *dst = columns + (top * EXPRESSION_CHUNK);
+            double *a   = dst - (2 * EXPRESSION_CHUNK);
+            double *b   = dst - EXPRESSION_CHUNK;
+
+            switch (ins.op)
+            {
+                case OpConst:
+                {
+                    double value = mConstants.at(ins.arg);
+                    for (int i = 0; i < n; ++i)
+                        dst[i] = value;
+                    top++;
+                    break;
+                }
+                case OpLoad:
+                {
+                    const double *src = inputs.at(ins.arg);
+                    int stride = strides.at(ins.arg);
+                    if (src == 0)
+                    {
+                        for (int i = 0; i < n; ++i)
+                            dst[i] = 0;
+                    }
+                    else if (stride == 0)
+                    {
+                        for (int i = 0; i < n; ++i)
+                            dst[i] = *src;
+                    }
+                    else
+                    {
+                        src += base * stride;
+                        for (int i = 0; i < n; ++i)
+                            dst[i] = src[i * stride];
+                    }
+                    top++;
+                    break;
+                }
+                case OpAdd:
+                    for (int i = 0; i < n; ++i)
+                        a[i] += b[i];
+                    top--;
+                    break;
+                case OpSub:
+                    for (int i = 0; i < n; ++i)
+                        a[i] -= b[i];
+                    top--;
+                    break;
+                case OpMul:
+                    for (int i = 0; i < n; ++i)
+                        a[i] *= b[i];
+                    top--;
+                    break;
+                case OpDiv:
+                    for (int i = 0; i < n; ++i)
+                        a[i] /= b[i];
+                    top--;
+                    break;
+                case OpPow:
+                    for (int i = 0; i < n; ++i)
+                        a[i] = qPow(a[i], b[i]);
+                    top--;
+                    break;
+                case OpMin:
+                    for (int i = 0; i < n; ++i)
+                        a[i] = qMin(a[i], b[i]);
+                    top--;
+                    break;
+                case OpMax:
+                    for (int i = 0; i < n; ++i)
+                        a[i] = qMax(a[i], b[i]);
+                    top--;
+                    break;
+                case OpNeg:
+                    for (int i = 0; i < n; ++i)
+                        b[i] = -b[i];
+                    break;
+                case OpAbs:
+                    for (int i = 0; i < n; ++i)
+                        b[i] = qAbs(b[i]);
+                    break;
+            }
+        }
+
+        // The result is the only value left on the stack
+        for (int i = 0; i < n; ++i)
+            output[base + i] = columns[i];
+    }
+}
+
+/**
+ * @brief Append one instruction to the bytecode
+ *
+ * @param op  Operation code
+ * @param arg Argument (constant or variable index)
+ */
+void Expression::emitOp(OpCode op, int arg)
+{
+    Instruction ins;
+    ins.op  = op;
+    ins.arg = arg;
+    mCode.append(ins);
+
+    // Track the stack size needed by evaluate()
+    if ((op == OpConst) || (op == OpLoad))
+        mDepth++;
+    else if ((op != OpNeg) && (op != OpAbs))
+        mDepth--;
+    if (mDepth > mMaxDepth)
+        mMaxDepth = mDepth;
+}
+
+/**
+ * @brief Parse a sum or a difference of terms
+ *
+ * @return boolean True on success
+ */
+bool Expression::parseExpression(void)
+{
+    if ( ! parseTerm())
+        return false;
+
+    while (true)
+    {
+        skipSpaces();
+        if (mPos >= mText.length())
+            break;
+        QChar c = mText.at(mPos);
+        if ((c != '+') && (c != '-'))
+            break;
+        mPos++;
+        if ( ! parseTerm())
+            return false;
+        emitOp((c == '+') ? OpAdd : OpSub);
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a product or a quotient of factors
+ *
+ * @return boolean True on success
+ */
+bool Expression::parseTerm(void)
+{
+    if ( ! parseFactor())
+        return false;
+
+    while (true)
+    {
+        skipSpaces();
+        if (mPos >= mText.length())
+            break;
+        QChar c = mText.at(mPos);
+        if ((c != '*') && (c != '/'))
+            break;
+        mPos++;
+        if ( ! parseFactor())
+            return false;
+        emitOp((c == '*') ? OpMul : OpDiv);
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a signed value, with an optional exponent
+ *
+ * @return boolean True on success
+ */
+bool Expression::parseFactor(void)
+{
+    skipSpaces();
+    if (mPos < mText.length())
+    {
+        QChar c = mText.at(mPos);
+        if ((c == '-') || (c == '+'))
+        {
+            mPos++;
+            if ( ! parseFactor())
+                return false;
+            if (c == '-')
+                emitOp(OpNeg);
+            return true;
+        }
+    }
+
+    if ( ! parsePrimary())
+        return false;
+
+    skipSpaces();
+    if ((mPos < mText.length()) && (mText.at(mPos) == '^'))
+    {
+        mPos++;
+        // Exponent is right associative : 2^3^2 = 2^(3^2)
+        if ( ! parseFactor())
+            return false;
+        emitOp(OpPow);
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a number, a variable, a function call or a sub-expression
+ *
+ * @return boolean True on success
+ */
+bool Expression::parsePrimary(void)
+{
+    skipSpaces();
+    if (mPos >= mText.length())
+    {
+        mError = "Unexpected end of formula";
+        return false;
+    }
+
+    QChar c = mText.at(mPos);
+
+    // Sub-expression
+    if (c == '(')
+    {
+        mPos++;
+        if ( ! parseExpression())
+            return false;
+        skipSpaces();
+        if ((mPos >= mText.length()) || (mText.at(mPos) != ')'))
+        {
+            mError = QString("Missing \")\" at position %1").arg(mPos + 1);
+            return false;
+        }
+        mPos++;
+        return true;
+    }
+
+    // Numeric constant
+    if (c.isDigit() || (c == '.'))
+    {
+        int start = mPos;
+        while ((mPos < mText.length()) &&
+               (mText.at(mPos).isDigit() || (mText.at(mPos) == '.')))
+            mPos++;
+        // Optional exponent (ex: 1.5e3)
+        if ((mPos < mText.length()) && (mText.at(mPos).toLower() == 'e'))
+        {
+            int save = mPos++;
+            if ((mPos < mText.length()) &&
+                ((mText.at(mPos) == '+') || (mText.at(mPos) == '-')))
+                mPos++;
+            if ((mPos < mText.length()) && mText.at(mPos).isDigit())
+            {
+                while ((mPos < mText.length()) && mText.at(mPos).isDigit())
+                    mPos++;
+            }
+            else
+                mPos = save;
+        }
+        bool valid;
+        double value = mText.mid(start, mPos - start).toDouble(&valid);
+        if ( ! valid)
+        {
+            mError = QString("Invalid number at position %1").arg(start + 1);
+            return false;
+        }
+        mConstants.append(value);
+        emitOp(OpConst, mConstants.count() - 1);
+        return true;
+    }
+
+    // Variable or function
+    QString name;
+    if ( ! parseName(name))
+        return false;
+
+    skipSpaces();
+    if ((mPos < mText.length()) && (mText.at(mPos) == '(') &&
+        ((name == "min") || (name == "max") || (name == "abs")))
+    {
+        mPos++;
+        int args = (name == "abs") ? 1 : 2;
+        for (int i = 0; i < args; ++i)
+        {
+            if ( ! parseExpression())
+                return false;
+            skipSpaces();
+            QChar expected = (i == (args - 1)) ? QChar(')') : QChar(',');
+            if ((mPos >= mText.length()) || (mText.at(mPos) != expected))
+            {
+                mError = QString("Missing \"%1\" at position %2")
+                             .arg(expected).arg(mPos + 1);
+                return false;
+            }
+            mPos++;
+        }
+        if (name == "min")
+            emitOp(OpMin);
+        else if (name == "max")
+            emitOp(OpMax);
+        else
+            emitOp(OpAbs);
+        return true;
+    }
+
+    int index = mVariables.indexOf(name);
+    if (index < 0)
+    {
+        mVariables.append(name);
+        index = mVariables.count() - 1;
+    }
+    emitOp(OpLoad, index);
+    return true;
+}
+
+/**
+ * @brief Parse a variable name (plain or between double quotes)
+ *
+ * @param name Reference to the string that receive the name
+ * @return boolean True on success
+ */
+bool Expression::parseName(QString &name)
+{
+    int start = mPos;
+
+    if (mText.at(mPos) == '"')
+    {
+        int end = mText.indexOf('"', mPos + 1);
+        if (end < 0)
+        {
+            mError = QString("Missing '\"' after position %1").arg(start + 1);
+            return false;
+        }
+        name = mText.mid(mPos + 1, end - mPos - 1);
+        mPos = end + 1;
+        return true;
+    }
+
+    QChar c = mText.at(mPos);
+    if ( ! (c.isLetter() || (c == '_')))
+    {
+        mError = QString("Unexpected \"%1\" at position %2").arg(c).arg(mPos + 1);
+        return false;
+    }
+    while ((mPos < mText.length()) &&
+           (mText.at(mPos).isLetterOrNumber() || (mText.at(mPos) == '_')))
+        mPos++;
+
+    name = mText.mid(start, mPos - start);
+    return true;
+}
+
+/**
+ * @brief Move the parser position after white spaces
+ *
+ */
+void Expression::skipSpaces(void)
+{
+    while ((mPos < mText.length()) && mText.at(mPos).isSpace())
+        mPos++;
+}
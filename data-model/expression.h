@@ -0,0 +1,64 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/*
+ * An arithmetic formula (ex: "Surface * PrixBle * 0.8") compiled once into
+ * a small stack bytecode. Variables are parameter names, they are numbered
+ * in order of first use (see getVariables) and bound at evaluation time.
+ *
+ * Supported : numbers, + - * / ^, parenthesis, unary minus, the functions
+ * min(a,b) max(a,b) abs(a), and names between double quotes when they
+ * contain spaces or symbols (ex: "Champ #1").
+ */
+class Expression
+{
+public:
+    Expression();
+    bool    compile(const QString &text);
+    QString errorString(void);
+    const QString     &getText(void);
+    const QStringList &getVariables(void);
+    bool    isValid(void);
+    qint64  memoryUsage(void) const;
+    double  evaluate(const QVector<double> &values) const;
+    void    evaluate(const QVector<const double *> &inputs,
+                     const QVector<int> &strides,
+                     int count, double *output) const;
+private:
+    enum OpCode { OpConst, OpLoad, OpAdd, OpSub, OpMul, OpDiv, OpPow,
+                  OpNeg, OpMin, OpMax, OpAbs };
+    struct Instruction
+    {
+        OpCode op;
+        int    arg;
+    };
+    void emitOp(OpCode op, int arg = 0);
+    bool parseExpression(void);
+    bool parseTerm(void);
+    bool parseFactor(void);
+    bool parsePrimary(void);
+    bool parseName(QString &name);
+    void skipSpaces(void);
+private:
+    QString  mText;
+    QString  mError;
+    int      mPos;
+    int      mDepth;
+    int      mMaxDepth;
+    QVector<Instruction> mCode;
+    QVector<double>      mConstants;
+    QStringList          mVariables;
+};
+
+#endif // EXPRESSION_H
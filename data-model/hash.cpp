@@ -0,0 +1,73 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <cstring>
+#include "hash.h"
+
+/**
+ * @brief Final mix of a 64 bits value (from splitmix64)
+ *
+ * @param value Value to mix
+ * @return quint64 Mixed value
+ */
+static quint64 mix(quint64 value)
+{
+    value ^= value >> 30;
+    value *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+    value ^= value >> 27;
+    value *= Q_UINT64_C(0x94d049bb133111eb);
+    value ^= value >> 31;
+    return value;
+}
+
+/**
+ * @brief Append a value to a hash (order dependent)
+ *
+ * @param seed  Current hash
+ * @param value Value (or hash of a child) to append
+ * @return quint64 New hash
+ */
+quint64 ContentHash::combine(quint64 seed, quint64 value)
+{
+    return mix(seed ^ (value + Q_UINT64_C(0x9e3779b97f4a7c15) + (seed << 6) + (seed >> 2)));
+}
+
+/**
+ * @brief Get the hash of a double value
+ *
+ * @param value Value to hash
+ * @return quint64 Hash (equal for 0.0 and -0.0, and for all NaN)
+ */
+quint64 ContentHash::fromDouble(double value)
+{
+    if (value == 0)
+        value = 0;
+    if (value != value)
+        return mix(Q_UINT64_C(0x7ff8000000000000));
+
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return mix(bits);
+}
+
+/**
+ * @brief Get the hash of a string (FNV-1a on UTF-16 units)
+ *
+ * @param text String to hash
+ * @return quint64 Hash
+ */
+quint64 ContentHash::fromString(const QString &text)
+{
+    quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+    const QChar *data = text.constData();
+    for (int i = 0; i < text.length(); ++i)
+    {
+        hash ^= data[i].unicode();
+        hash *= Q_UINT64_C(0x100000001b3);
+    }
+    return mix(hash ^ (quint64)text.length());
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef HASH_H
+#define HASH_H
+
+#include <QString>
+#include <QtGlobal>
+
+/*
+ * 64 bits content hashes used to detect modifications of the data model.
+ * Each object hashes his own content with the hashes of his children, so
+ * two equal hashes mean (with a very high probability) equal sub-trees.
+ */
+class ContentHash
+{
+public:
+    // Seed of each kind of object, so different objects never collide
+    enum Seed { SeedParameter = 1, SeedRotation, SeedPlan, SeedAtelier,
+                SeedExploitation };
+    static quint64 combine   (quint64 seed, quint64 value);
+    static quint64 fromDouble(double value);
+    static quint64 fromString(const QString &text);
+};
+
+#endif // HASH_H
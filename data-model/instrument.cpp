@@ -0,0 +1,185 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include "instrument.h"
+
+// Head of the list of all counters created so far
+static InstrumentCounter *counterList = 0;
+static QMutex             counterLock;
+
+/**
+ * @brief Default constructor for an instrumentation counter
+ *
+ * Counters are created as static variables (see INSTRUMENT_CALL) and are
+ * registered into a global list, used by Instrument::dump and reset.
+ *
+ * @param name Name of the instrumented method
+ */
+InstrumentCounter::InstrumentCounter(const char *name)
+{
+    mName = name;
+
+    QMutexLocker locker(&counterLock);
+    mNext = counterList;
+    counterList = this;
+}
+
+/**
+ * @brief Add some allocations to this counter
+ *
+ * @param count Number of objects allocated
+ */
+void InstrumentCounter::addAllocation(qint64 count)
+{
+    mAllocations.fetchAndAddRelaxed(count);
+}
+
+/**
+ * @brief Register one call of the instrumented method
+ *
+ * @param nsecs Duration of the call (in nanoseconds)
+ */
+void InstrumentCounter::addCall(qint64 nsecs)
+{
+    mCalls.fetchAndAddRelaxed(1);
+    mTime.fetchAndAddRelaxed(nsecs);
+}
+
+qint64 InstrumentCounter::countAllocations(void)
+{
+    return mAllocations.load();
+}
+
+qint64 InstrumentCounter::countCalls(void)
+{
+    return mCalls.load();
+}
+
+const char *InstrumentCounter::getName(void)
+{
+    return mName;
+}
+
+/**
+ * @brief Get the cumulative time spent into the instrumented method
+ *
+ * @return qint64 Time in nanoseconds
+ */
+qint64 InstrumentCounter::getTime(void)
+{
+    return mTime.load();
+}
+
+InstrumentCounter *InstrumentCounter::next(void)
+{
+    return mNext;
+}
+
+void InstrumentCounter::reset(void)
+{
+    mCalls.store(0);
+    mAllocations.store(0);
+    mTime.store(0);
+}
+
+// -------------------- Scope --------------------
+
+/**
+ * @brief Start measuring one call of an instrumented method
+ *
+ * @param counter Pointer to the counter of the method
+ */
+InstrumentScope::InstrumentScope(InstrumentCounter *counter)
+{
+    mCounter = counter;
+    mTimer.start();
+}
+
+/**
+ * @brief End of the instrumented call, update the counter
+ *
+ */
+InstrumentScope::~InstrumentScope()
+{
+    mCounter->addCall( mTimer.nsecsElapsed() );
+}
+
+// -------------------- Instrument --------------------
+
+/**
+ * @brief Write the current value of all counters
+ *
+ * @param out Text stream where the report is written
+ */
+void Instrument::dump(QTextStream &out)
+{
+    if ( ! isEnabled())
+    {
+        out << "Instrumentation disabled (build with VLE_EA_INSTRUMENT)\n";
+        return;
+    }
+
+    // Overloaded methods share the same name, merge them and sort by name
+    QMap<QString, QList<qint64> > counters;
+    {
+        QMutexLocker locker(&counterLock);
+        for (InstrumentCounter *c = counterList; c; c = c->next())
+        {
+            QList<qint64> &values = counters[c->getName()];
+            if (values.isEmpty())
+                values << 0 << 0 << 0;
+            values[0] += c->countCalls();
+            values[1] += c->countAllocations();
+            values[2] += c->getTime();
+        }
+    }
+
+    out << "method\tcalls\tallocations\ttime(us)\tmean(ns)\n";
+
+    QMap<QString, QList<qint64> >::const_iterator it;
+    for (it = counters.constBegin(); it != counters.constEnd(); ++it)
+    {
+        qint64 calls = it.value().at(0);
+        if (calls == 0)
+            continue;
+        out << it.key()
+            << "\t" << calls
+            << "\t" << it.value().at(1)
+            << "\t" << (it.value().at(2) / 1000)
+            << "\t" << (it.value().at(2) / calls) << "\n";
+    }
+    out.flush();
+}
+
+/**
+ * @brief Test if the data-model has been built with instrumentation
+ *
+ * @return boolean True if counters are available
+ */
+bool Instrument::isEnabled(void)
+{
+#ifdef VLE_EA_INSTRUMENT
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Clear all counters
+ *
+ */
+void Instrument::reset(void)
+{
+    QMutexLocker locker(&counterLock);
+    for (InstrumentCounter *c = counterList; c; c = c->next())
+        c->reset();
+}
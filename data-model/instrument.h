@@ -0,0 +1,70 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+/*
+ * Instrumentation of the data-model is disabled by default. To enable it,
+ * build with VLE_EA_INSTRUMENT defined (see "DEFINES" into .pro files).
+ * When disabled, INSTRUMENT_* macros expands to nothing.
+ */
+
+class InstrumentCounter
+{
+public:
+    explicit InstrumentCounter(const char *name);
+    void addAllocation(qint64 count);
+    void addCall(qint64 nsecs);
+    const char *getName(void);
+    InstrumentCounter *next(void);
+    void reset(void);
+    qint64 countAllocations(void);
+    qint64 countCalls(void);
+    qint64 getTime(void);
+private:
+    const char *mName;
+    InstrumentCounter     *mNext;
+    QAtomicInteger<qint64> mCalls;
+    QAtomicInteger<qint64> mAllocations;
+    QAtomicInteger<qint64> mTime;
+};
+
+class InstrumentScope
+{
+public:
+    explicit InstrumentScope(InstrumentCounter *counter);
+    ~InstrumentScope();
+private:
+    InstrumentCounter *mCounter;
+    QElapsedTimer      mTimer;
+};
+
+class Instrument
+{
+public:
+    static void dump(QTextStream &out);
+    static bool isEnabled(void);
+    static void reset(void);
+};
+
+#ifdef VLE_EA_INSTRUMENT
+#define INSTRUMENT_CALL(name) \
+    static InstrumentCounter instrCounter(name); \
+    InstrumentScope instrScope(&instrCounter)
+#define INSTRUMENT_ALLOC(count) \
+    instrCounter.addAllocation(count)
+#else
+#define INSTRUMENT_CALL(name)
+#define INSTRUMENT_ALLOC(count)
+#endif
+
+#endif // INSTRUMENT_H
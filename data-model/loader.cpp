@@ -0,0 +1,106 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include "loader.h"
+#include "reader.h"
+
+/*
+ * Reader used by the worker thread, forward the progress of the parser
+ * to the loader (only when the percentage changes, to not flood the GUI
+ * event loop with queued signals).
+ */
+class LoaderReader : public ExploitationReader
+{
+public:
+    LoaderReader(Exploitation *exploitation, ExploitationLoader *loader)
+        : ExploitationReader(exploitation)
+    {
+        mLoader  = loader;
+        mPercent = -1;
+    }
+protected:
+    void progress(qint64 position, qint64 size)
+    {
+        if (size <= 0)
+            return;
+        int percent = (int)((position * 100) / size);
+        if (percent == mPercent)
+            return;
+        mPercent = percent;
+        emit mLoader->progress(percent);
+    }
+private:
+    ExploitationLoader *mLoader;
+    int                 mPercent;
+};
+
+/**
+ * @brief Default constructor for an Exploitation loader
+ *
+ * @param exploitation Pointer to the (empty) Exploitation to fill
+ * @param parent       Parent QObject
+ */
+ExploitationLoader::ExploitationLoader(Exploitation *exploitation, QObject *parent)
+    : QThread(parent)
+{
+    mExploitation = exploitation;
+}
+
+/**
+ * @brief Default destructor, wait the end of a running load
+ *
+ */
+ExploitationLoader::~ExploitationLoader()
+{
+    wait();
+}
+
+/**
+ * @brief Get a description of the last error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString ExploitationLoader::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Start to load a scenario file
+ *
+ * The "progress" signal is emitted while the file is parsed, then the
+ * "loaded" signal is emitted when the Exploitation is ready.
+ *
+ * @param filename Name of the file to read
+ * @return boolean True if the load has been started
+ */
+bool ExploitationLoader::load(const QString &filename)
+{
+    if (isRunning())
+        return false;
+
+    mFilename = filename;
+    mError.clear();
+    start();
+    return true;
+}
+
+/**
+ * @brief Worker thread entry point
+ *
+ */
+void ExploitationLoader::run(void)
+{
+    LoaderReader reader(mExploitation, this);
+
+    bool success = reader.read(mFilename);
+    if ( ! success)
+        mError = reader.errorString();
+
+    emit progress(100);
+    emit loaded(success);
+}
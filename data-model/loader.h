@@ -0,0 +1,38 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <QString>
+#include <QThread>
+#include "exploitation.h"
+
+/*
+ * Load a scenario file into an Exploitation from a worker thread. The
+ * Exploitation must not be used by the caller until "loaded" is received.
+ */
+class ExploitationLoader : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ExploitationLoader(Exploitation *exploitation, QObject *parent = 0);
+    ~ExploitationLoader();
+    QString errorString(void);
+    bool    load(const QString &filename);
+signals:
+    void progress(int percent);
+    void loaded(bool success);
+protected:
+    void run(void);
+private:
+    Exploitation *mExploitation;
+    QString       mFilename;
+    QString       mError;
+};
+
+#endif // LOADER_H
@@ -0,0 +1,216 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QStringList>
+#include "memoryusage.h"
+
+/**
+ * @brief Default constructor, all categories are empty
+ *
+ */
+MemoryUsage::MemoryUsage()
+{
+    for (int i = 0; i < CategoryLast; i++)
+        mBytes[i] = 0;
+}
+
+/**
+ * @brief Add some bytes to one category
+ *
+ * @param category Category of the memory
+ * @param bytes    Number of bytes
+ */
+void MemoryUsage::add(Category category, qint64 bytes)
+{
+    if ((category < 0) || (category >= CategoryLast))
+        return;
+    mBytes[category] += bytes;
+}
+
+/**
+ * @brief Add the summary of one top-level Atelier
+ *
+ * @param name      Name of the Atelier
+ * @param entities  Number of entities (sub-entities included)
+ * @param structure Bytes of the objects of the Atelier and of his entities
+ * @param values    Bytes of the values of the parameters
+ */
+void MemoryUsage::addAtelier(const QString &name, int entities,
+                             qint64 structure, qint64 values)
+{
+    AtelierUsage usage;
+    usage.name      = name;
+    usage.entities  = entities;
+    usage.structure = structure;
+    usage.values    = values;
+    mAteliers.append(usage);
+}
+
+/**
+ * @brief Get the number of top-level Ateliers
+ *
+ * @return integer Number of Ateliers
+ */
+int MemoryUsage::countAteliers(void) const
+{
+    return mAteliers.count();
+}
+
+/**
+ * @brief Get the bytes of one category
+ *
+ * @param category Category of the memory
+ * @return qint64 Number of bytes
+ */
+qint64 MemoryUsage::get(Category category) const
+{
+    if ((category < 0) || (category >= CategoryLast))
+        return 0;
+    return mBytes[category];
+}
+
+/**
+ * @brief Get the summary of one top-level Atelier
+ *
+ * @param index Index of the Atelier
+ * @return AtelierUsage Reference to the summary
+ */
+const MemoryUsage::AtelierUsage &MemoryUsage::getAtelier(int index) const
+{
+    return mAteliers.at(index);
+}
+
+/**
+ * @brief Get the bytes of all the categories
+ *
+ * @return qint64 Number of bytes
+ */
+qint64 MemoryUsage::total(void) const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < CategoryLast; i++)
+        bytes += mBytes[i];
+    return bytes;
+}
+
+/**
+ * @brief Make a readable report of the estimation
+ *
+ * @return QStringList One line per category, the total, then one line per Atelier
+ */
+QStringList MemoryUsage::report(void) const
+{
+    QStringList lines;
+    for (int i = 0; i < CategoryLast; i++)
+    {
+        lines << QString("%1 %2").arg(categoryName((Category)i), -12)
+                                 .arg(formatBytes(mBytes[i]));
+    }
+    lines << QString("%1 %2").arg("Total", -12).arg(formatBytes(total()));
+
+    for (int i = 0; i < mAteliers.count(); i++)
+    {
+        const AtelierUsage &a = mAteliers.at(i);
+        lines << QString("Atelier %1 : %2 entities, structure %3, values %4")
+                 .arg(a.name).arg(a.entities)
+                 .arg(formatBytes(a.structure)).arg(formatBytes(a.values));
+    }
+    return lines;
+}
+
+/**
+ * @brief Get the name of a category
+ *
+ * @param category Category of the memory
+ * @return QString Name of the category
+ */
+QString MemoryUsage::categoryName(Category category)
+{
+    switch (category)
+    {
+        case CategoryParameters: return "Parameters";
+        case CategoryRotations:  return "Rotations";
+        case CategoryEntities:   return "Entities";
+        case CategoryValues:     return "Values";
+        case CategoryStrings:    return "Strings";
+        case CategoryWidgets:    return "Widgets";
+        default:                 return QString();
+    }
+}
+
+/**
+ * @brief Format a number of bytes with a unit (B, KB or MB)
+ *
+ * @param bytes Number of bytes
+ * @return QString Formatted size
+ */
+QString MemoryUsage::formatBytes(qint64 bytes)
+{
+    if (bytes < 1024)
+        return QString("%1 B").arg(bytes);
+    if (bytes < (1024 * 1024))
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+/**
+ * @brief Estimate the size of a QHash or a QSet
+ *
+ * @param count     Number of entries
+ * @param entrySize Size of the key and of the value of an entry
+ * @return qint64 Number of bytes (nodes and buckets)
+ */
+qint64 MemoryUsage::hashBytes(int count, int entrySize)
+{
+    if (count == 0)
+        return 0;
+    // Node : next pointer and hash value, then one bucket per entry
+    qint64 node = sizeof(void *) + sizeof(uint) + entrySize;
+    return ContainerHeader + (qint64(count) * (node + sizeof(void *)));
+}
+
+/**
+ * @brief Estimate the size of a QList of pointers
+ *
+ * @param count Number of entries
+ * @return qint64 Number of bytes
+ */
+qint64 MemoryUsage::listBytes(int count)
+{
+    if (count == 0)
+        return 0;
+    return ContainerHeader + (qint64(count) * sizeof(void *));
+}
+
+/**
+ * @brief Estimate the size of a QMap or a QMultiMap
+ *
+ * @param count     Number of entries
+ * @param entrySize Size of the key and of the value of an entry
+ * @return qint64 Number of bytes
+ */
+qint64 MemoryUsage::mapBytes(int count, int entrySize)
+{
+    if (count == 0)
+        return 0;
+    // Node : parent (with color), left and right pointers
+    qint64 node = (3 * sizeof(void *)) + entrySize;
+    return ContainerHeader + (qint64(count) * node);
+}
+
+/**
+ * @brief Estimate the size of the characters of a string
+ *
+ * @param text Reference to the string
+ * @return qint64 Number of bytes (0 for a null string)
+ */
+qint64 MemoryUsage::stringBytes(const QString &text)
+{
+    if (text.isNull())
+        return 0;
+    return ContainerHeader + ((qint64(text.capacity()) + 1) * sizeof(QChar));
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+
+/*
+ * A MemoryUsage is an estimation of the memory used by an Exploitation (see
+ * Exploitation::memoryUsage), by category and by Atelier.
+ *
+ * Sizes are computed from the size of the objects and from the count or
+ * the capacity of their containers, without walking the values : the cost
+ * of the estimation only depends on the number of objects. The overhead of
+ * the allocator is not counted, and shared strings are counted once for
+ * each of their users.
+ */
+class MemoryUsage
+{
+public:
+    enum Category {
+        CategoryParameters, // global parameters (and their series)
+        CategoryRotations,  // rotations and plans
+        CategoryEntities,   // Ateliers and entities objects, lists and trees
+        CategoryValues,     // values of the entities parameters (columns,
+                            // indexes, formulas and series)
+        CategoryStrings,    // characters of the names
+        CategoryWidgets,    // items and caches of the widgets
+        CategoryLast
+    };
+    struct AtelierUsage
+    {
+        QString name;
+        int     entities;   // number of entities, sub-entities included
+        qint64  structure;  // bytes of CategoryEntities
+        qint64  values;     // bytes of CategoryValues
+    };
+public:
+    MemoryUsage();
+    void    add(Category category, qint64 bytes);
+    void    addAtelier(const QString &name, int entities,
+                       qint64 structure, qint64 values);
+    int     countAteliers(void) const;
+    qint64  get(Category category) const;
+    const AtelierUsage &getAtelier(int index) const;
+    qint64  total(void) const;
+    QStringList report(void) const;
+    static QString categoryName(Category category);
+    static QString formatBytes(qint64 bytes);
+    static qint64  hashBytes  (int count, int entrySize);
+    static qint64  listBytes  (int count);
+    static qint64  mapBytes   (int count, int entrySize);
+    static qint64  stringBytes(const QString &text);
+    template <typename T>
+    static qint64  vectorBytes(const QVector<T> &vector)
+    {
+        if (vector.capacity() == 0)
+            return 0;
+        return ContainerHeader + (qint64(vector.capacity()) * sizeof(T));
+    }
+private:
+    // Size of the header of the shared data of a Qt container
+    static const int ContainerHeader = 24;
+    qint64 mBytes[CategoryLast];
+    QList<AtelierUsage> mAteliers;
+};
+
+#endif // MEMORYUSAGE_H
@@ -0,0 +1,833 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QtMath>
+#include <QtNumeric>
+#include <algorithm>
+#include <string.h>
+#include "hash.h"
+#include "instrument.h"
+#include "montecarlo.h"
+
+// Number of samples evaluated by one task
+#define SAMPLE_BATCH 256
+// Number of batches of each thread between two reductions
+#define ROUND_BATCHES 4
+
+/**
+ * @brief Get one value of a counter-based random generator
+ *
+ * The value only depends on the key and on the counter (SplitMix64 output
+ * function), so any sample can be drawn without the previous ones.
+ *
+ * @param key     Key of the random stream
+ * @param counter Number of the value into the stream
+ * @return quint64 Random value
+ */
+static inline quint64 counterRandom(quint64 key, quint64 counter)
+{
+    quint64 z = key + (counter * Q_UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Get one uniform value of a random stream, into ]0, 1[
+ *
+ * @param key     Key of the random stream
+ * @param counter Number of the value into the stream
+ * @return double Random value
+ */
+static inline double counterUniform(quint64 key, quint64 counter)
+{
+    return ((counterRandom(key, counter) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Get one standard normal value of a random stream (Box-Muller)
+ *
+ * @param key     Key of the random stream
+ * @param counter Number of the sample (uses values 2n and 2n+1)
+ * @return double Random value
+ */
+static inline double counterNormal(quint64 key, quint64 counter)
+{
+    double u1 = counterUniform(key, 2 * counter);
+    double u2 = counterUniform(key, (2 * counter) + 1);
+    return qSqrt(-2.0 * qLn(u1)) * qCos(2.0 * M_PI * u2);
+}
+
+// -------------------- Quantile estimator --------------------
+
+/**
+ * @brief Default constructor
+ *
+ * @param probability Probability of the quantile, into [0, 1]
+ */
+QuantileEstimator::QuantileEstimator(double probability)
+{
+    double p = qBound(0.0, probability, 1.0);
+    mProbability = p;
+    mCount       = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        mHeights  [i] = 0;
+        mPositions[i] = i + 1;
+    }
+    mDesired[0] = 1;
+    mDesired[1] = 1 + (2 * p);
+    mDesired[2] = 1 + (4 * p);
+    mDesired[3] = 3 + (2 * p);
+    mDesired[4] = 5;
+    mIncrement[0] = 0;
+    mIncrement[1] = p / 2;
+    mIncrement[2] = p;
+    mIncrement[3] = (1 + p) / 2;
+    mIncrement[4] = 1;
+}
+
+/**
+ * @brief Add one value to the stream
+ *
+ * @param value New value
+ */
+void QuantileEstimator::add(double value)
+{
+    // The first five values are the initial markers
+    if (mCount < 5)
+    {
+        mHeights[mCount++] = value;
+        if (mCount == 5)
+            std::sort(mHeights, mHeights + 5);
+        return;
+    }
+
+    // Find the cell of the value, extend the extremes if needed
+    int k = 0;
+    if (value < mHeights[0])
+        mHeights[0] = value;
+    else if (value >= mHeights[4])
+    {
+        mHeights[4] = value;
+        k = 3;
+    }
+    else
+    {
+        while (value >= mHeights[k + 1])
+            k++;
+    }
+
+    for (int i = k + 1; i < 5; i++)
+        mPositions[i] += 1;
+    for (int i = 0; i < 5; i++)
+        mDesired[i] += mIncrement[i];
+
+    // Move the middle markers that are too far from their desired position
+    for (int i = 1; i < 4; i++)
+    {
+        double d = mDesired[i] - mPositions[i];
+        if (((d >=  1) && ((mPositions[i + 1] - mPositions[i]) >  1)) ||
+            ((d <= -1) && ((mPositions[i - 1] - mPositions[i]) < -1)))
+        {
+            int step = (d > 0) ? 1 : -1;
+            double height = parabolic(i, step);
+            if ((mHeights[i - 1] < height) && (height < mHeights[i + 1]))
+                mHeights[i] = height;
+            else
+                mHeights[i] = linear(i, step);
+            mPositions[i] += step;
+        }
+    }
+    mCount++;
+}
+
+/**
+ * @brief Get the number of values added
+ *
+ * @return qint64 Number of values
+ */
+qint64 QuantileEstimator::count(void) const
+{
+    return mCount;
+}
+
+/**
+ * @brief Get the probability of the followed quantile
+ *
+ * @return double Probability
+ */
+double QuantileEstimator::getProbability(void) const
+{
+    return mProbability;
+}
+
+/**
+ * @brief Get the current estimation of the quantile
+ *
+ * @return double Quantile (NaN if no value)
+ */
+double QuantileEstimator::getValue(void) const
+{
+    if (mCount == 0)
+        return qQNaN();
+    if (mCount < 5)
+    {
+        double sorted[5];
+        std::copy(mHeights, mHeights + mCount, sorted);
+        std::sort(sorted, sorted + mCount);
+        return sorted[qRound(mProbability * (mCount - 1))];
+    }
+    return mHeights[2];
+}
+
+/**
+ * @brief Piecewise-parabolic prediction of a marker height
+ *
+ * @param i Index of the marker
+ * @param d Direction of the move (-1 or 1)
+ * @return double New height
+ */
+double QuantileEstimator::parabolic(int i, double d) const
+{
+    double n0 = mPositions[i - 1];
+    double n1 = mPositions[i];
+    double n2 = mPositions[i + 1];
+    return mHeights[i] + (d / (n2 - n0)) *
+           (((n1 - n0 + d) * (mHeights[i + 1] - mHeights[i]) / (n2 - n1)) +
+            ((n2 - n1 - d) * (mHeights[i] - mHeights[i - 1]) / (n1 - n0)));
+}
+
+/**
+ * @brief Linear prediction of a marker height
+ *
+ * @param i Index of the marker
+ * @param d Direction of the move (-1 or 1)
+ * @return double New height
+ */
+double QuantileEstimator::linear(int i, int d) const
+{
+    return mHeights[i] + (d * (mHeights[i + d] - mHeights[i]) /
+                          (mPositions[i + d] - mPositions[i]));
+}
+
+// -------------------- Engine --------------------
+
+/**
+ * @brief Default constructor
+ *
+ */
+MonteCarloEngine::MonteCarloEngine()
+{
+    mSamples  = 10000;
+    mSeed     = 1;
+    mYear     = 0;
+    mMaxCount = 0;
+    mProbabilities << 0.05 << 0.25 << 0.5 << 0.75 << 0.95;
+    mCount   = 0;
+    mMean    = 0;
+    mM2      = 0;
+    mMinimum = 0;
+    mMaximum = 0;
+    mNominal = 0;
+}
+
+/**
+ * @brief Draw the samples and compute the statistics of the outcome
+ *
+ * The Exploitation is only read, it must not be modified during the run.
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean False if the problem can't be built (see errorString)
+ */
+bool MonteCarloEngine::run(Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("MonteCarloEngine::run");
+
+    mError.clear();
+    mCount   = 0;
+    mMean    = 0;
+    mM2      = 0;
+    mMinimum = qInf();
+    mMaximum = -qInf();
+    mQuantiles.clear();
+    for (int i = 0; i < mProbabilities.count(); i++)
+        mQuantiles.append(QuantileEstimator(mProbabilities.at(i)));
+
+    if (exploitation == 0)
+    {
+        mError = "No Exploitation";
+        return false;
+    }
+    if ( ! buildProblem(exploitation))
+        return false;
+
+    // Samples are evaluated by rounds of a few batches for each thread, then
+    // the sums are reduced in order : only one round is kept in memory, and
+    // the result does not depend on the order of the tasks
+    int batches = qMax(mPool.maxThreadCount(), 1) * ROUND_BATCHES;
+    mTotals.resize(batches * SAMPLE_BATCH);
+    INSTRUMENT_ALLOC(1);
+
+    qint64 done = 0;
+    while (done < mSamples)
+    {
+        qint64 first = done;
+        for (int slot = 0; (slot < batches) && (first < mSamples); slot++)
+        {
+            int count = (int)qMin<qint64>(SAMPLE_BATCH, mSamples - first);
+            mPool.start(new MonteCarloTask(this, slot, first, count));
+            first += count;
+        }
+        mPool.waitForDone();
+
+        reduce(mTotals.constData(), (int)(first - done));
+        done = first;
+    }
+
+    mTotals.clear();
+    mBlocks.clear();
+    return true;
+}
+
+/**
+ * @brief Compile the formula and gather the inputs of each Atelier
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean False if the formula or a distribution is invalid
+ */
+bool MonteCarloEngine::buildProblem(Exploitation *exploitation)
+{
+    if (mSamples <= 0)
+    {
+        mError = "No sample";
+        return false;
+    }
+    if ( ! mExpression.compile(mFormula))
+    {
+        mError = QString("Invalid formula \"%1\" : %2")
+                 .arg(mFormula).arg(mExpression.errorString());
+        return false;
+    }
+
+    // Uncertain parameters, sorted by name so laws always have the same index
+    QStringList names = mDistributions.keys();
+    names.sort();
+    mLaws.clear();
+    mKeys.clear();
+    for (int i = 0; i < names.count(); i++)
+    {
+        Distribution dist = mDistributions.value(names.at(i));
+        if (exploitation->getParameter(names.at(i)) == 0)
+        {
+            mError = QString("Unknown parameter %1").arg(names.at(i));
+            return false;
+        }
+        if ( ! isValid(dist))
+        {
+            mError = QString("Invalid distribution of %1").arg(names.at(i));
+            return false;
+        }
+        mLaws.append(dist);
+        // The random stream of a parameter depends on his name, not on the
+        // other uncertain parameters
+        mKeys.append(ContentHash::combine(mSeed, ContentHash::fromString(names.at(i))));
+    }
+
+    // Variables of the formula that may be global parameters
+    const QStringList &vars = mExpression.getVariables();
+    mUncertain.fill(-1, vars.count());
+    mFixed.fill(qQNaN(), vars.count());
+    for (int v = 0; v < vars.count(); v++)
+    {
+        Parameter *global = exploitation->getParameter(vars.at(v));
+        if (global == 0)
+            continue;
+        mFixed[v]     = mYear ? global->getValue(mYear) : global->getValue();
+        mUncertain[v] = names.indexOf(vars.at(v));
+    }
+
+    // Entities of each Atelier, with a column for each entity parameter
+    mBlocks.clear();
+    mMaxCount = 0;
+    mNominal  = 0;
+    for (uint i = 0; i < exploitation->countAtelier(); i++)
+    {
+        Atelier *atelier = exploitation->getAtelier(i);
+        Block block;
+        block.count = atelier->countEntity();
+        if (block.count == 0)
+            continue;
+        block.columns.resize(vars.count());
+
+        for (int v = 0; v < vars.count(); v++)
+        {
+            int found = -1;
+            for (int p = 0; p < atelier->countParameter(); p++)
+            {
+                if (atelier->getParameterName(p) == vars.at(v))
+                    found = p;
+            }
+            // Values of the year are read from the series table at once
+            const double *year = 0;
+            if (mYear && (found >= 0))
+                year = atelier->getYearValues(found, mYear);
+            // An entity parameter hides the global one with the same name
+            if (year)
+            {
+                block.columns[v].resize(block.count);
+                memcpy(block.columns[v].data(), year, block.count * sizeof(double));
+            }
+            else if (found >= 0)
+                atelier->evaluateFormula(QString("\"%1\"").arg(vars.at(v)),
+                                         block.columns[v]);
+            else if (qIsNaN(mFixed.at(v)))
+            {
+                mError = QString("Atelier %1 : unknown parameter %2")
+                         .arg(atelier->getName()).arg(vars.at(v));
+                return false;
+            }
+        }
+
+        // Outcome with the current values of the global parameters
+        QVector<const double *> inputs(vars.count());
+        QVector<int>            strides(vars.count(), 0);
+        QVector<double>         output(block.count);
+        for (int v = 0; v < vars.count(); v++)
+        {
+            if (block.columns.at(v).isEmpty())
+                inputs[v] = mFixed.constData() + v;
+            else
+            {
+                inputs[v]  = block.columns.at(v).constData();
+                strides[v] = 1;
+            }
+        }
+        mExpression.evaluate(inputs, strides, block.count, output.data());
+        for (int r = 0; r < block.count; r++)
+            mNominal += output.at(r);
+
+        mMaxCount = qMax(mMaxCount, block.count);
+        mBlocks.append(block);
+    }
+    return true;
+}
+
+/**
+ * @brief Draw the values of all uncertain parameters for some samples
+ *
+ * @param first  Number of the first sample
+ * @param count  Number of samples
+ * @param values Pointer to the values (count values for each law)
+ */
+void MonteCarloEngine::draw(qint64 first, int count, double *values) const
+{
+    for (int l = 0; l < mLaws.count(); l++)
+    {
+        const Distribution &d = mLaws.at(l);
+        quint64 key = mKeys.at(l);
+        double *out = values + (l * count);
+
+        switch (d.law)
+        {
+            case LawUniform:
+                for (int i = 0; i < count; i++)
+                    out[i] = d.a + ((d.b - d.a) * counterUniform(key, first + i));
+                break;
+            case LawNormal:
+                for (int i = 0; i < count; i++)
+                    out[i] = d.a + (d.b * counterNormal(key, first + i));
+                break;
+            case LawTriangular:
+            {
+                double range = d.c - d.a;
+                double split = (range > 0) ? ((d.b - d.a) / range) : 0;
+                for (int i = 0; i < count; i++)
+                {
+                    double u = counterUniform(key, first + i);
+                    if (u < split)
+                        out[i] = d.a + qSqrt(u * range * (d.b - d.a));
+                    else
+                        out[i] = d.c - qSqrt((1 - u) * range * (d.c - d.b));
+                }
+                break;
+            }
+            case LawLogNormal:
+                for (int i = 0; i < count; i++)
+                    out[i] = qExp(d.a + (d.b * counterNormal(key, first + i)));
+                break;
+            default:
+                for (int i = 0; i < count; i++)
+                    out[i] = qQNaN();
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Evaluate the outcome of one batch of samples
+ *
+ * @param slot  Index of the batch into the round (see mTotals)
+ * @param first Number of the first sample
+ * @param count Number of samples
+ */
+void MonteCarloEngine::evaluate(int slot, qint64 first, int count)
+{
+    int vars = mUncertain.count();
+
+    QVector<double> drawn(mLaws.count() * count);
+    draw(first, count, drawn.data());
+
+    double *totals = mTotals.data() + (slot * SAMPLE_BATCH);
+    for (int i = 0; i < count; i++)
+        totals[i] = 0;
+
+    QVector<double>         output(mMaxCount);
+    QVector<const double *> inputs(vars);
+    QVector<int>            strides(vars, 0);
+    for (int b = 0; b < mBlocks.count(); b++)
+    {
+        const Block &block = mBlocks.at(b);
+        for (int v = 0; v < vars; v++)
+        {
+            if (block.columns.at(v).isEmpty())
+            {
+                inputs[v]  = mFixed.constData() + v;
+                strides[v] = 0;
+            }
+            else
+            {
+                inputs[v]  = block.columns.at(v).constData();
+                strides[v] = 1;
+            }
+        }
+
+        // All entities of the block at once, for each sample
+        for (int i = 0; i < count; i++)
+        {
+            for (int v = 0; v < vars; v++)
+            {
+                if (strides.at(v) || (mUncertain.at(v) < 0))
+                    continue;
+                inputs[v] = drawn.constData() + (mUncertain.at(v) * count) + i;
+            }
+            mExpression.evaluate(inputs, strides, block.count, output.data());
+
+            double sum = 0;
+            for (int r = 0; r < block.count; r++)
+                sum += output.at(r);
+            totals[i] += sum;
+        }
+    }
+}
+
+/**
+ * @brief Add the outcome of some samples to the statistics
+ *
+ * @param totals Pointer to the outcomes
+ * @param count  Number of samples
+ */
+void MonteCarloEngine::reduce(const double *totals, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        double x = totals[i];
+        mCount++;
+        double delta = x - mMean;
+        mMean += delta / mCount;
+        mM2   += delta * (x - mMean);
+        mMinimum = qMin(mMinimum, x);
+        mMaximum = qMax(mMaximum, x);
+        for (int q = 0; q < mQuantiles.count(); q++)
+            mQuantiles[q].add(x);
+    }
+}
+
+/**
+ * @brief Forget the distributions and the results
+ *
+ */
+void MonteCarloEngine::clear(void)
+{
+    mDistributions.clear();
+    mQuantiles.clear();
+    mBlocks.clear();
+    mLaws.clear();
+    mKeys.clear();
+    mError.clear();
+    mCount = 0;
+}
+
+// -------------------- Settings --------------------
+
+/**
+ * @brief Set the distribution of one global parameter
+ *
+ * @param parameter Name of the global parameter
+ * @param law       Law of the distribution
+ * @param a         First argument of the law (see Law)
+ * @param b         Second argument of the law
+ * @param c         Third argument of the law (triangular only)
+ */
+void MonteCarloEngine::setDistribution(const QString &parameter, Law law,
+                                       double a, double b, double c)
+{
+    Distribution dist;
+    dist.law = law;
+    dist.a   = a;
+    dist.b   = b;
+    dist.c   = c;
+    mDistributions.insert(parameter, dist);
+}
+
+/**
+ * @brief Set the formula of the outcome of one entity
+ *
+ * @param formula Formula of entity and global parameters
+ */
+void MonteCarloEngine::setFormula(const QString &formula)
+{
+    mFormula = formula;
+}
+
+/**
+ * @brief Set the maximum number of threads used to evaluate the samples
+ *
+ * @param count Number of threads
+ */
+void MonteCarloEngine::setMaxThreads(int count)
+{
+    mPool.setMaxThreadCount(qMax(count, 1));
+}
+
+/**
+ * @brief Set the quantiles to estimate
+ *
+ * @param probabilities Probability of each quantile, into [0, 1]
+ */
+void MonteCarloEngine::setQuantiles(const QVector<double> &probabilities)
+{
+    mProbabilities.clear();
+    for (int i = 0; i < probabilities.count(); i++)
+    {
+        double p = probabilities.at(i);
+        if ((p >= 0) && (p <= 1))
+            mProbabilities.append(p);
+    }
+}
+
+/**
+ * @brief Set the number of samples to draw
+ *
+ * @param count Number of samples
+ */
+void MonteCarloEngine::setSamples(qint64 count)
+{
+    mSamples = count;
+}
+
+/**
+ * @brief Set the seed of the random streams
+ *
+ * @param seed Seed value
+ */
+void MonteCarloEngine::setSeed(quint32 seed)
+{
+    mSeed = seed;
+}
+
+/**
+ * @brief Set the year of the outcome
+ *
+ * Derived parameters keep the value of the entities.
+ *
+ * @param year Year (0 to use the values of the entities)
+ */
+void MonteCarloEngine::setYear(int year)
+{
+    mYear = year;
+}
+
+/**
+ * @brief Test if the arguments of a distribution are consistent
+ *
+ * @param distribution Reference to the distribution
+ * @return boolean True if values can be drawn
+ */
+bool MonteCarloEngine::isValid(const Distribution &distribution)
+{
+    const Distribution &d = distribution;
+    switch (d.law)
+    {
+        case LawUniform:
+            return (d.a <= d.b);
+        case LawNormal:
+        case LawLogNormal:
+            return (d.b >= 0);
+        case LawTriangular:
+            return (d.a <= d.b) && (d.b <= d.c);
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Get a law from his name
+ *
+ * @param name Name of the law (uniform, normal, triangular or lognormal)
+ * @return Law Law (LawLast if the name is unknown)
+ */
+MonteCarloEngine::Law MonteCarloEngine::lawFromName(const QString &name)
+{
+    QString n = name.toLower();
+    if (n == "uniform")
+        return LawUniform;
+    if (n == "normal")
+        return LawNormal;
+    if (n == "triangular")
+        return LawTriangular;
+    if (n == "lognormal")
+        return LawLogNormal;
+    return LawLast;
+}
+
+// -------------------- Results --------------------
+
+/**
+ * @brief Get the number of estimated quantiles
+ *
+ * @return integer Number of quantiles
+ */
+int MonteCarloEngine::countQuantiles(void)
+{
+    return mQuantiles.count();
+}
+
+/**
+ * @brief Get the number of samples of the last run
+ *
+ * @return qint64 Number of samples
+ */
+qint64 MonteCarloEngine::countSamples(void)
+{
+    return mCount;
+}
+
+/**
+ * @brief Get the message of the last error
+ *
+ * @return QString Error message
+ */
+QString MonteCarloEngine::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Get the largest outcome of all samples
+ *
+ * @return double Maximum
+ */
+double MonteCarloEngine::getMaximum(void)
+{
+    return mCount ? mMaximum : 0;
+}
+
+/**
+ * @brief Get the mean outcome of all samples
+ *
+ * @return double Mean
+ */
+double MonteCarloEngine::getMean(void)
+{
+    return mMean;
+}
+
+/**
+ * @brief Get the smallest outcome of all samples
+ *
+ * @return double Minimum
+ */
+double MonteCarloEngine::getMinimum(void)
+{
+    return mCount ? mMinimum : 0;
+}
+
+/**
+ * @brief Get the outcome with the current values of the parameters
+ *
+ * @return double Outcome without uncertainty
+ */
+double MonteCarloEngine::getNominal(void)
+{
+    return mNominal;
+}
+
+/**
+ * @brief Get the estimation of one quantile
+ *
+ * @param index Index of the quantile (see setQuantiles)
+ * @return double Quantile (NaN if no result)
+ */
+double MonteCarloEngine::getQuantile(int index)
+{
+    if ((index < 0) || (index >= mQuantiles.count()))
+        return qQNaN();
+    return mQuantiles.at(index).getValue();
+}
+
+/**
+ * @brief Get the probability of one quantile
+ *
+ * @param index Index of the quantile (see setQuantiles)
+ * @return double Probability (NaN if no result)
+ */
+double MonteCarloEngine::getQuantileProbability(int index)
+{
+    if ((index < 0) || (index >= mQuantiles.count()))
+        return qQNaN();
+    return mQuantiles.at(index).getProbability();
+}
+
+/**
+ * @brief Get the standard deviation of the outcome of all samples
+ *
+ * @return double Standard deviation
+ */
+double MonteCarloEngine::getStdDev(void)
+{
+    if (mCount < 2)
+        return 0;
+    return qSqrt(mM2 / (mCount - 1));
+}
+
+// -------------------- Task --------------------
+
+/**
+ * @brief Create a task that evaluates one batch of samples
+ *
+ * @param engine Pointer to the engine that owns the results
+ * @param slot   Index of the batch into the round
+ * @param first  Number of the first sample
+ * @param count  Number of samples
+ */
+MonteCarloTask::MonteCarloTask(MonteCarloEngine *engine, int slot, qint64 first, int count)
+{
+    mEngine = engine;
+    mSlot   = slot;
+    mFirst  = first;
+    mCount  = count;
+}
+
+/**
+ * @brief Evaluate the samples of the batch (called by a worker)
+ *
+ */
+void MonteCarloTask::run()
+{
+    mEngine->evaluate(mSlot, mFirst, mCount);
+}
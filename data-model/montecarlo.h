@@ -0,0 +1,156 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include <QHash>
+#include <QRunnable>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include "exploitation.h"
+#include "expression.h"
+
+/*
+ * A QuantileEstimator follows one quantile of a stream of values with the
+ * P-square algorithm : five markers are moved as values are added, so the
+ * values themselves are never stored.
+ */
+class QuantileEstimator
+{
+public:
+    explicit QuantileEstimator(double probability = 0.5);
+    void   add(double value);
+    qint64 count(void) const;
+    double getProbability(void) const;
+    double getValue(void) const;
+private:
+    double parabolic(int i, double d) const;
+    double linear   (int i, int d) const;
+private:
+    double mProbability;
+    qint64 mCount;
+    double mHeights  [5];
+    double mPositions[5];
+    double mDesired  [5];
+    double mIncrement[5];
+};
+
+/*
+ * A MonteCarloEngine estimates the distribution of an outcome of the
+ * Exploitation when some global parameters are uncertain. The outcome is
+ * the sum over all entities of a formula (ex: "Surface * Rendement * PrixBle")
+ * of the entity parameters and of the global parameters.
+ *
+ * Each sample draws a value for each uncertain parameter. Random values only
+ * depend on the seed, the parameter and the sample number, so the result is
+ * the same whatever the number of threads. Samples are evaluated by batches
+ * on a thread pool, then reduced into the mean, the extremes and the
+ * requested quantiles (see QuantileEstimator).
+ *
+ * The outcome may be the one of a year (see setYear) : the parameters that
+ * have series take their value of this year.
+ */
+class MonteCarloEngine
+{
+public:
+    enum Law {
+        LawUniform,    // a = minimum, b = maximum
+        LawNormal,     // a = mean, b = standard deviation
+        LawTriangular, // a = minimum, b = mode, c = maximum
+        LawLogNormal,  // a = mean of the log, b = standard deviation of the log
+        LawLast
+    };
+    struct Distribution
+    {
+        Law    law;
+        double a;
+        double b;
+        double c;
+    };
+public:
+    MonteCarloEngine();
+    void    clear(void);
+    int     countQuantiles(void);
+    qint64  countSamples  (void);
+    QString errorString(void);
+    double  getMaximum(void);
+    double  getMean   (void);
+    double  getMinimum(void);
+    double  getNominal(void);
+    double  getQuantile(int index);
+    double  getQuantileProbability(int index);
+    double  getStdDev (void);
+    bool    run(Exploitation *exploitation);
+    void    setDistribution(const QString &parameter, Law law,
+                            double a, double b, double c = 0);
+    void    setFormula   (const QString &formula);
+    void    setMaxThreads(int count);
+    void    setQuantiles (const QVector<double> &probabilities);
+    void    setSamples   (qint64 count);
+    void    setSeed      (quint32 seed);
+    void    setYear      (int year);
+    static bool    isValid(const Distribution &distribution);
+    static Law     lawFromName(const QString &name);
+private:
+    friend class MonteCarloTask;
+    // Entities of one Atelier, with a column for each variable of the
+    // formula that is an entity parameter (empty for a global parameter)
+    struct Block
+    {
+        int count;
+        QVector< QVector<double> > columns;
+    };
+    bool    buildProblem(Exploitation *exploitation);
+    void    draw    (qint64 first, int count, double *values) const;
+    void    evaluate(int slot, qint64 first, int count);
+    void    reduce  (const double *totals, int count);
+private:
+    // Settings
+    QString mFormula;
+    QHash<QString, Distribution> mDistributions;
+    QVector<double> mProbabilities;
+    qint64  mSamples;
+    quint32 mSeed;
+    int     mYear;
+    QThreadPool mPool;
+    QString mError;
+    // Problem : the formula, the source of each variable, and the entities
+    Expression        mExpression;
+    QVector<Block>    mBlocks;
+    QVector<int>      mUncertain;    // index of the distribution, or -1
+    QVector<double>   mFixed;        // value of the global parameter
+    QVector<Distribution> mLaws;
+    QVector<quint64>  mKeys;         // key of the random stream of each law
+    int               mMaxCount;
+    // Sum of each sample of the running round (one slot per batch)
+    QVector<double>   mTotals;
+    // Results
+    QVector<QuantileEstimator> mQuantiles;
+    qint64  mCount;
+    double  mMean;
+    double  mM2;
+    double  mMinimum;
+    double  mMaximum;
+    double  mNominal;
+};
+
+class MonteCarloTask : public QRunnable
+{
+public:
+    MonteCarloTask(MonteCarloEngine *engine, int slot, qint64 first, int count);
+    void run();
+private:
+    MonteCarloEngine *mEngine;
+    int    mSlot;
+    qint64 mFirst;
+    int    mCount;
+};
+
+#endif // MONTECARLO_H
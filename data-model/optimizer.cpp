@@ -0,0 +1,606 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QElapsedTimer>
+#include <QtMath>
+#include <QtNumeric>
+#include "instrument.h"
+#include "optimizer.h"
+
+// Temperature at the end of the search, relative to the initial one
+#define TEMPERATURE_END 1e-4
+// Number of random moves used to estimate the initial temperature
+#define TEMPERATURE_SAMPLES 100
+
+/**
+ * @brief Next value of a SplitMix64 random generator
+ *
+ * @param state Reference to the state of the generator
+ * @return quint64 Random value
+ */
+static inline quint64 nextRandom(quint64 &state)
+{
+    quint64 z = (state += Q_UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Default constructor, weight of all entities is 1
+ *
+ */
+RotationOptimizer::RotationOptimizer()
+{
+    mWeight    = "1";
+    mBudget    = 1000;
+    mSeed      = 1;
+    mYear      = 0;
+    mPlanNames = 0;
+    mPenalty   = 0;
+    mObjective        = 0;
+    mInitialObjective = 0;
+    mOverflow         = 0;
+    mIterations       = 0;
+}
+
+/**
+ * @brief Search the best Rotation of each entity of an Exploitation
+ *
+ * The Exploitation is only read, use apply() to assign the result. The
+ * Exploitation must not be modified between optimize() and apply().
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean False if the problem can't be built (see errorString)
+ */
+bool RotationOptimizer::optimize(Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("RotationOptimizer::optimize");
+
+    mError.clear();
+    mBest.clear();
+    mIterations = 0;
+
+    if (exploitation == 0)
+    {
+        mError = "No Exploitation";
+        return false;
+    }
+    if ( ! buildProblem(exploitation))
+        return false;
+
+    // Each thread runs his own annealing, with his own random sequence
+    int tasks = qMax(mPool.maxThreadCount(), 1);
+    mTaskBest       = QVector< QVector<int> >(tasks);
+    mTaskValue      = QVector<double>(tasks, 0);
+    mTaskIterations = QVector<qint64>(tasks, 0);
+    INSTRUMENT_ALLOC(tasks);
+    for (int t = 0; t < tasks; t++)
+        mPool.start(new RotationOptimizerTask(this, t));
+    mPool.waitForDone();
+
+    int best = 0;
+    for (int t = 0; t < tasks; t++)
+    {
+        mIterations += mTaskIterations.at(t);
+        if (mTaskValue.at(t) > mTaskValue.at(best))
+            best = t;
+    }
+    mBest = mTaskBest.at(best);
+    mTaskBest.clear();
+
+    // Objective and overflow of the best assignment, computed again
+    QVector<double> load(mRotations.count(), 0);
+    mObjective = 0;
+    for (int e = 0; e < mEntities.count(); e++)
+    {
+        mObjective += score(e, mBest.at(e));
+        load[mBest.at(e)] += mWeights.at(e);
+    }
+    mOverflow = 0;
+    for (int r = 0; r < mRotations.count(); r++)
+        mOverflow += overflow(r, load.at(r));
+
+    return true;
+}
+
+/**
+ * @brief Evaluate the formulas and make the tables used by the search
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean False if a formula can't be evaluated
+ */
+bool RotationOptimizer::buildProblem(Exploitation *exploitation)
+{
+    int rotations = exploitation->countRotation();
+    if (rotations == 0)
+    {
+        mError = "No rotation";
+        return false;
+    }
+
+    // Rotations : plans as indexes of plan names, and length of the cycle
+    QHash<QString, int>    names;
+    QHash<Rotation *, int> rotIndex;
+    double maxRate = 0;
+    mRotations.resize(rotations);
+    mPlanStart.resize(rotations + 1);
+    mPlanIndex.clear();
+    mYearFactor.resize(rotations);
+    for (int r = 0; r < rotations; r++)
+    {
+        Rotation *rot = exploitation->getRotation(r);
+        mRotations[r] = rot;
+        rotIndex.insert(rot, r);
+        mPlanStart[r] = mPlanIndex.count();
+        for (uint i = 0; i < rot->countPlans(); i++)
+        {
+            QString name = rot->getPlan(i)->getName();
+            if ( ! names.contains(name))
+                names.insert(name, names.count());
+            mPlanIndex.append(names.value(name));
+        }
+        ulong plans = rot->countPlans();
+        if (rot->getDuration())
+            mYearFactor[r] = 1.0 / rot->getDuration();
+        else
+            mYearFactor[r] = plans ? (1.0 / plans) : 0;
+        maxRate = qMax(maxRate, plans * mYearFactor.at(r));
+    }
+    mPlanStart[rotations] = mPlanIndex.count();
+    mPlanNames = names.count();
+
+    // Entities : weight and coefficient of each plan name
+    mEntities.clear();
+    mWeights.clear();
+    mValues.clear();
+    for (uint i = 0; i < exploitation->countAtelier(); i++)
+    {
+        Atelier *atelier = exploitation->getAtelier(i);
+        int first = mEntities.count();
+        int count = atelier->countEntity();
+
+        QVector<double> values;
+        if ( ! atelier->evaluateFormula(mWeight, values, mYear))
+        {
+            mError = QString("Atelier %1 : can't evaluate weight \"%2\"")
+                     .arg(atelier->getName()).arg(mWeight);
+            return false;
+        }
+        for (int j = 0; j < count; j++)
+        {
+            mEntities.append(atelier->getEntity(j));
+            mWeights.append(values.at(j));
+        }
+        mValues.resize(mEntities.count() * mPlanNames);
+
+        QHash<QString, int>::const_iterator it;
+        for (it = names.constBegin(); it != names.constEnd(); ++it)
+        {
+            // Plans without coefficient are worth nothing (values are 0)
+            QString formula = mCoefficients.value(it.key());
+            if (formula.isEmpty())
+                continue;
+            if ( ! atelier->evaluateFormula(formula, values, mYear))
+            {
+                mError = QString("Atelier %1 : can't evaluate coefficient of %2 \"%3\"")
+                         .arg(atelier->getName()).arg(it.key()).arg(formula);
+                return false;
+            }
+            for (int j = 0; j < count; j++)
+                mValues[((first + j) * mPlanNames) + it.value()] = values.at(j);
+        }
+    }
+    int entities = mEntities.count();
+    if (entities == 0)
+    {
+        mError = "No entity";
+        return false;
+    }
+
+    // Maximum shares, as a weight for each rotation
+    double total = 0;
+    for (int e = 0; e < entities; e++)
+        total += mWeights.at(e);
+    mCapacity.fill(qInf(), rotations);
+    QHash<Rotation *, double>::const_iterator share;
+    for (share = mMaxShares.constBegin(); share != mMaxShares.constEnd(); ++share)
+    {
+        if (rotIndex.contains(share.key()))
+            mCapacity[rotIndex.value(share.key())] = share.value() * total;
+    }
+
+    // One unit of overflow costs more than the best gain of one unit of weight
+    double maxValue = 0;
+    for (int k = 0; k < mValues.count(); k++)
+        maxValue = qMax(maxValue, qAbs(mValues.at(k)));
+    mPenalty = (2 * maxValue * maxRate) + 1;
+
+    // Start from the current rotations, the best one for entities without
+    mStart.resize(entities);
+    mInitialObjective = 0;
+    for (int e = 0; e < entities; e++)
+    {
+        Rotation *rot = mEntities.at(e)->getRotation();
+        if (rot && rotIndex.contains(rot))
+        {
+            mStart[e] = rotIndex.value(rot);
+            mInitialObjective += score(e, mStart.at(e));
+            continue;
+        }
+        int best = 0;
+        for (int r = 1; r < rotations; r++)
+        {
+            if (score(e, r) > score(e, best))
+                best = r;
+        }
+        mStart[e] = best;
+    }
+    return true;
+}
+
+/**
+ * @brief Get the weight above the maximum share of a rotation
+ *
+ * @param rotation Index of the rotation
+ * @param load     Weight of the entities that use it
+ * @return double Overflow (0 if the maximum is respected)
+ */
+double RotationOptimizer::overflow(int rotation, double load) const
+{
+    return qMax(load - mCapacity.at(rotation), 0.0);
+}
+
+/**
+ * @brief Get the value of one entity with one rotation
+ *
+ * @param entity   Index of the entity
+ * @param rotation Index of the rotation
+ * @return double Weight * mean coefficient of the plans over the cycle
+ */
+double RotationOptimizer::score(int entity, int rotation) const
+{
+    const double *row   = mValues.constData() + (entity * mPlanNames);
+    const int    *plans = mPlanIndex.constData();
+
+    double sum = 0;
+    for (int k = mPlanStart.at(rotation); k < mPlanStart.at(rotation + 1); k++)
+        sum += row[plans[k]];
+    return mWeights.at(entity) * mYearFactor.at(rotation) * sum;
+}
+
+/**
+ * @brief Simulated annealing from the initial assignment (called by a task)
+ *
+ * The value is the objective minus the penalty of the overflows. A move
+ * changes the rotation of one random entity, his cost only depends on the
+ * old and new rotations.
+ *
+ * @param task Index of the task (for the random sequence and the results)
+ */
+void RotationOptimizer::search(int task)
+{
+    INSTRUMENT_CALL("RotationOptimizer::search");
+
+    int entities  = mEntities.count();
+    int rotations = mRotations.count();
+    quint64 state = ((quint64)mSeed << 32) ^ (Q_UINT64_C(0xD1B54A32D192ED03) * (task + 1));
+
+    QVector<int>    assign(mStart);
+    QVector<double> load(rotations, 0);
+    INSTRUMENT_ALLOC(2);
+    double value = 0;
+    for (int e = 0; e < entities; e++)
+    {
+        value += score(e, assign.at(e));
+        load[assign.at(e)] += mWeights.at(e);
+    }
+    for (int r = 0; r < rotations; r++)
+        value -= mPenalty * overflow(r, load.at(r));
+
+    QVector<int> &best = mTaskBest[task];
+    best = assign;
+    double bestValue = value;
+    qint64 iterations = 0;
+
+    if (rotations > 1)
+    {
+        // Initial temperature : mean gain of some random moves
+        double t0 = 0;
+        for (int i = 0; i < TEMPERATURE_SAMPLES; i++)
+        {
+            int e = nextRandom(state) % entities;
+            int r = nextRandom(state) % rotations;
+            t0 += qAbs(score(e, r) - score(e, assign.at(e)));
+        }
+        t0 /= TEMPERATURE_SAMPLES;
+        if (t0 <= 0)
+            t0 = 1;
+        double temperature = t0;
+
+        // The best assignment is saved periodically (it is a full copy)
+        int period = qMax(1024, entities / 4);
+        int untilCheck = period;
+        QElapsedTimer timer;
+        timer.start();
+        while (true)
+        {
+            if (--untilCheck <= 0)
+            {
+                untilCheck = period;
+                if (value > bestValue)
+                {
+                    best = assign;
+                    bestValue = value;
+                }
+                double elapsed = (double)timer.elapsed() / mBudget;
+                if (elapsed >= 1)
+                    break;
+                temperature = t0 * qPow(TEMPERATURE_END, elapsed);
+            }
+            iterations++;
+
+            int e  = nextRandom(state) % entities;
+            int r1 = assign.at(e);
+            int r2 = nextRandom(state) % (rotations - 1);
+            if (r2 >= r1)
+                r2++;
+
+            double w = mWeights.at(e);
+            double delta = score(e, r2) - score(e, r1);
+            delta -= mPenalty * (overflow(r1, load.at(r1) - w) + overflow(r2, load.at(r2) + w)
+                               - overflow(r1, load.at(r1))     - overflow(r2, load.at(r2)));
+
+            if ((delta < 0) &&
+                ((nextRandom(state) >> 11) * (1.0 / 9007199254740992.0) >= qExp(delta / temperature)))
+                continue;
+
+            assign[e] = r2;
+            load[r1] -= w;
+            load[r2] += w;
+            value    += delta;
+        }
+        if (value > bestValue)
+        {
+            best = assign;
+            bestValue = value;
+        }
+    }
+    mTaskValue[task]      = bestValue;
+    mTaskIterations[task] = iterations;
+}
+
+/**
+ * @brief Assign the best rotations found to the entities
+ *
+ * @return integer Number of entities with a new rotation
+ */
+int RotationOptimizer::apply(void)
+{
+    int changed = 0;
+    for (int e = 0; e < mBest.count(); e++)
+    {
+        Rotation *rot = mRotations.at(mBest.at(e));
+        if (mEntities.at(e)->getRotation() == rot)
+            continue;
+        mEntities.at(e)->setRotation(rot);
+        changed++;
+    }
+    return changed;
+}
+
+/**
+ * @brief Forget the result, the maximum shares and the coefficients
+ *
+ */
+void RotationOptimizer::clear(void)
+{
+    mCoefficients.clear();
+    mMaxShares.clear();
+    mEntities.clear();
+    mRotations.clear();
+    mWeights.clear();
+    mValues.clear();
+    mBest.clear();
+    mError.clear();
+}
+
+// -------------------- Settings --------------------
+
+/**
+ * @brief Set the value of one year of a plan, for one unit of weight
+ *
+ * @param plan    Name of the plan (all plans with this name)
+ * @param formula Formula of entity and global parameters (empty to remove)
+ */
+void RotationOptimizer::setCoefficient(const QString &plan, const QString &formula)
+{
+    if (formula.isEmpty())
+        mCoefficients.remove(plan);
+    else
+        mCoefficients.insert(plan, formula);
+}
+
+/**
+ * @brief Limit the use of a rotation to a share of the total weight
+ *
+ * @param rotation Pointer to the Rotation
+ * @param share    Maximum share, from 0 to 1 (1 or more to remove the limit)
+ */
+void RotationOptimizer::setMaxShare(Rotation *rotation, double share)
+{
+    if (share >= 1)
+        mMaxShares.remove(rotation);
+    else
+        mMaxShares.insert(rotation, qMax(share, 0.0));
+}
+
+/**
+ * @brief Set the number of threads (and of independent searches)
+ *
+ * @param count Number of threads
+ */
+void RotationOptimizer::setMaxThreads(int count)
+{
+    if (count > 0)
+        mPool.setMaxThreadCount(count);
+}
+
+/**
+ * @brief Set the seed of the random sequences (same seed, same moves)
+ *
+ * @param seed Seed value
+ */
+void RotationOptimizer::setSeed(quint32 seed)
+{
+    mSeed = seed;
+}
+
+/**
+ * @brief Set the duration of the search
+ *
+ * @param msec Duration in milliseconds
+ */
+void RotationOptimizer::setTimeBudget(int msec)
+{
+    mBudget = qMax(msec, 1);
+}
+
+/**
+ * @brief Set the weight of each entity
+ *
+ * @param formula Formula of entity and global parameters (ex: "Surface")
+ */
+void RotationOptimizer::setWeight(const QString &formula)
+{
+    mWeight = formula.isEmpty() ? QString("1") : formula;
+}
+
+/**
+ * @brief Set the year of the weights and coefficients
+ *
+ * The parameters that have series take their value of this year.
+ *
+ * @param year Year (0 to use the values of the entities)
+ */
+void RotationOptimizer::setYear(int year)
+{
+    mYear = year;
+}
+
+// -------------------- Results --------------------
+
+/**
+ * @brief Get the number of entities of the problem
+ *
+ * @return integer Number of entities (all ateliers)
+ */
+int RotationOptimizer::countEntities(void)
+{
+    return mEntities.count();
+}
+
+/**
+ * @brief Get the number of moves tried by all threads
+ *
+ * @return qint64 Number of moves
+ */
+qint64 RotationOptimizer::countIterations(void)
+{
+    return mIterations;
+}
+
+/**
+ * @brief Get a description of the last error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString RotationOptimizer::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Get one entity of the problem
+ *
+ * @param index Index of the entity (all ateliers, in order)
+ * @return Pointer to the entity
+ */
+Atelier *RotationOptimizer::getEntity(int index)
+{
+    if ((index < 0) || (index >= mEntities.count()))
+        return 0;
+    return mEntities.at(index);
+}
+
+/**
+ * @brief Get the objective of the current assignment (before optimize)
+ *
+ * Entities without rotation are not counted.
+ *
+ * @return double Objective
+ */
+double RotationOptimizer::getInitialObjective(void)
+{
+    return mInitialObjective;
+}
+
+/**
+ * @brief Get the objective of the best assignment found
+ *
+ * @return double Objective
+ */
+double RotationOptimizer::getObjective(void)
+{
+    return mObjective;
+}
+
+/**
+ * @brief Get the weight above the maximum shares, for the best assignment
+ *
+ * @return double Overflow (0 when all maximum shares are respected)
+ */
+double RotationOptimizer::getOverflow(void)
+{
+    return mOverflow;
+}
+
+/**
+ * @brief Get the best rotation found for one entity
+ *
+ * @param index Index of the entity (see getEntity)
+ * @return Pointer to the Rotation (NULL if no result)
+ */
+Rotation *RotationOptimizer::getRotation(int index)
+{
+    if ((index < 0) || (index >= mBest.count()))
+        return 0;
+    return mRotations.at(mBest.at(index));
+}
+
+// -------------------- Task --------------------
+
+/**
+ * @brief Create a task that runs one search of the optimizer
+ *
+ * @param optimizer Pointer to the optimizer that owns the results
+ * @param task      Index of the task (for the random sequence and the results)
+ */
+RotationOptimizerTask::RotationOptimizerTask(RotationOptimizer *optimizer, int task)
+{
+    mOptimizer = optimizer;
+    mTask      = task;
+}
+
+/**
+ * @brief Run the search from the initial assignment (called by a worker)
+ *
+ */
+void RotationOptimizerTask::run()
+{
+    mOptimizer->search(mTask);
+}
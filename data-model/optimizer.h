@@ -0,0 +1,110 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <QHash>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include "exploitation.h"
+
+/*
+ * A RotationOptimizer searches the Rotation of each entity (of all the
+ * ateliers) that maximizes the objective :
+ *
+ *   sum over entities of  weight * mean over the cycle of the plans coefficients
+ *
+ * The weight (ex: "Surface") and the coefficient of each plan name (ex:
+ * "Rendement * PrixBle - Charges") are formulas of the entity parameters
+ * and of the global parameters. A Rotation may be limited to a maximum
+ * share of the total weight. The formulas may use the values of one year
+ * (see setYear) : the parameters that have series take their value of this
+ * year.
+ *
+ * Formulas are evaluated once per entity, then each thread runs a simulated
+ * annealing from the current assignment : a move changes the Rotation of
+ * one entity, and the objective is updated from the two rotations only.
+ * The best assignment of all threads is kept (see apply).
+ */
+class RotationOptimizer
+{
+public:
+    RotationOptimizer();
+    int       apply(void);
+    void      clear(void);
+    int       countEntities  (void);
+    qint64    countIterations(void);
+    QString   errorString(void);
+    Atelier  *getEntity  (int index);
+    double    getInitialObjective(void);
+    double    getObjective(void);
+    double    getOverflow (void);
+    Rotation *getRotation(int index);
+    bool      optimize(Exploitation *exploitation);
+    void      setCoefficient(const QString &plan, const QString &formula);
+    void      setMaxShare   (Rotation *rotation, double share);
+    void      setMaxThreads (int count);
+    void      setSeed       (quint32 seed);
+    void      setTimeBudget (int msec);
+    void      setWeight     (const QString &formula);
+    void      setYear       (int year);
+private:
+    friend class RotationOptimizerTask;
+    bool   buildProblem(Exploitation *exploitation);
+    double overflow(int rotation, double load) const;
+    double score   (int entity, int rotation) const;
+    void   search  (int task);
+private:
+    // Settings
+    QString  mWeight;
+    QHash<QString, QString>   mCoefficients;
+    QHash<Rotation *, double> mMaxShares;
+    int      mBudget;
+    quint32  mSeed;
+    int      mYear;
+    QThreadPool mPool;
+    QString  mError;
+    // Problem : entities, rotations, and the coefficient of each plan name
+    // for each entity (one row per entity)
+    QVector<Atelier *>  mEntities;
+    QVector<Rotation *> mRotations;
+    QVector<double>     mWeights;
+    QVector<double>     mValues;
+    int                 mPlanNames;
+    // Plans of each rotation (index of plan name), and 1 / cycle length
+    QVector<int>        mPlanStart;
+    QVector<int>        mPlanIndex;
+    QVector<double>     mYearFactor;
+    // Maximum weight of each rotation, and cost of one unit of overflow
+    QVector<double>     mCapacity;
+    double              mPenalty;
+    QVector<int>        mStart;
+    // Results of each task, then the best one
+    QVector< QVector<int> > mTaskBest;
+    QVector<double>     mTaskValue;
+    QVector<qint64>     mTaskIterations;
+    QVector<int>        mBest;
+    double   mObjective;
+    double   mInitialObjective;
+    double   mOverflow;
+    qint64   mIterations;
+};
+
+class RotationOptimizerTask : public QRunnable
+{
+public:
+    RotationOptimizerTask(RotationOptimizer *optimizer, int task);
+    void run();
+private:
+    RotationOptimizer *mOptimizer;
+    int mTask;
+};
+
+#endif // OPTIMIZER_H
@@ -5,6 +5,7 @@
  *
  * Copyright (c) 2016 Agilack
  */
+#include "hash.h"
 #include "parameter.h"
 
 /**
@@ -13,8 +14,30 @@
  */
 Parameter::Parameter(const QString &name, double value)
 {
+    mId    = 0;
     mName  = name;
     mValue = value;
+    updateHash();
+}
+
+/**
+ * @brief Get the content hash of this Parameter (name and value)
+ *
+ * @return quint64 Hash, updated at each modification
+ */
+quint64 Parameter::getHash(void)
+{
+    return mHash;
+}
+
+/**
+ * @brief Get the Parameter identifier (unique into his Exploitation)
+ *
+ * @return uint Identifier, 0 if the parameter is not into an Exploitation
+ */
+uint Parameter::getId(void)
+{
+    return mId;
 }
 
 /**
@@ -37,6 +60,50 @@ double Parameter::getValue(void)
     return mValue;
 }
 
+/**
+ * @brief Get the Parameter value for one year
+ *
+ * @param year Year
+ * @return double Value of the year, or the value when there is no series
+ */
+double Parameter::getValue(int year)
+{
+    if (mSeries.isEmpty())
+        return mValue;
+    return mSeries.value(year);
+}
+
+/**
+ * @brief Get the values of each year
+ *
+ * @return TimeSeries Values (empty if the value is the same for all years)
+ */
+const TimeSeries &Parameter::getSeries(void)
+{
+    return mSeries;
+}
+
+/**
+ * @brief Test if this parameter has a value for each year
+ *
+ * @return boolean True if a series is set
+ */
+bool Parameter::hasSeries(void)
+{
+    return ! mSeries.isEmpty();
+}
+
+/**
+ * @brief Add the memory used by this parameter to an estimation
+ *
+ * @param usage Reference to the estimation
+ */
+void Parameter::memoryUsage(MemoryUsage &usage)
+{
+    usage.add(MemoryUsage::CategoryParameters, sizeof(Parameter) + mSeries.memoryUsage());
+    usage.add(MemoryUsage::CategoryStrings, MemoryUsage::stringBytes(mName));
+}
+
 /**
  * @brief Rename this parameter
  *
@@ -45,6 +112,18 @@ double Parameter::getValue(void)
 void Parameter::setName(const QString &name)
 {
     mName = name;
+    updateHash();
+}
+
+/**
+ * @brief Set the values of each year
+ *
+ * @param series Values (an empty series to use the same value for all years)
+ */
+void Parameter::setSeries(const TimeSeries &series)
+{
+    mSeries = series;
+    updateHash();
 }
 
 /**
@@ -55,4 +134,18 @@ void Parameter::setName(const QString &name)
 void Parameter::setValue(double value)
 {
     mValue = value;
+    updateHash();
+}
+
+/**
+ * @brief Compute the content hash after a modification
+ *
+ */
+void Parameter::updateHash(void)
+{
+    mHash = ContentHash::combine(ContentHash::SeedParameter,
+                                 ContentHash::fromString(mName));
+    mHash = ContentHash::combine(mHash, ContentHash::fromDouble(mValue));
+    if ( ! mSeries.isEmpty())
+        mHash = ContentHash::combine(mHash, mSeries.getHash());
 }
@@ -9,18 +9,35 @@
 #define PARAMETER_H
 
 #include <QString>
+#include <QtGlobal>
+#include "memoryusage.h"
+#include "timeseries.h"
 
 class Parameter
 {
 public:
     explicit Parameter(const QString &name, double value = 0);
+    quint64 getHash(void);
+    uint   getId(void);
     const QString & getName(void);
     double getValue(void);
+    double getValue(int year);
+    const TimeSeries &getSeries(void);
+    bool   hasSeries(void);
+    void   memoryUsage(MemoryUsage &usage);
     void   setName (const QString &name);
+    void   setSeries(const TimeSeries &series);
     void   setValue(double value);
 private:
+    void    updateHash(void);
+private:
+    friend class Exploitation;
+    uint    mId;
     QString mName;
     double  mValue;
+    // Values of each year (empty when the value is the same for all years)
+    TimeSeries mSeries;
+    quint64 mHash;
 };
 
 #endif // PARAMETER_H
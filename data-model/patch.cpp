@@ -0,0 +1,1243 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include "instrument.h"
+#include "patch.h"
+
+#define PATCH_MAGIC   0x56454150
+#define PATCH_VERSION 2
+
+// Fields of an Operation that are stored into a patch file, for each type
+enum PatchField { FieldTarget = 0x001, FieldEntity = 0x002, FieldIndex  = 0x004,
+                  FieldName   = 0x008, FieldText   = 0x010, FieldValue  = 0x020,
+                  FieldNumber = 0x040, FieldPath   = 0x080, FieldValues = 0x100 };
+
+static const quint16 patchFields[ExploitationPatch::OpLast] = {
+    0,
+    FieldName   | FieldValue,                               // SetParameter
+    FieldName,                                              // RemoveParameter
+    FieldTarget | FieldNumber,                              // AddRotation
+    FieldTarget,                                            // RemoveRotation
+    FieldTarget | FieldNumber,                              // SetDuration
+    FieldTarget | FieldIndex  | FieldName  | FieldNumber,   // SetPlan
+    FieldTarget | FieldIndex,                               // TruncatePlans
+    FieldTarget,                                            // AddAtelier
+    FieldTarget,                                            // RemoveAtelier
+    FieldTarget | FieldIndex  | FieldName  | FieldValue,    // AddColumn
+    FieldTarget | FieldName,                                // RemoveColumn
+    FieldTarget | FieldPath   | FieldName  | FieldValue,    // SetColumnDefault
+    FieldTarget | FieldPath   | FieldName  | FieldText,     // SetColumnFormula
+    FieldTarget | FieldPath   | FieldName  | FieldIndex,    // SetColumnMandatory
+    FieldTarget | FieldPath   | FieldEntity,                // AddEntity
+    FieldTarget | FieldPath,                                // RemoveEntity
+    FieldTarget | FieldPath   | FieldName  | FieldValue,    // SetEntityValue
+    FieldTarget | FieldPath   | FieldText,                  // SetEntityRotation
+    FieldTarget | FieldPath   | FieldName  | FieldIndex,    // SetColumnKind
+    FieldTarget | FieldPath   | FieldName  | FieldIndex | FieldNumber | FieldValues // SetColumnSeries
+};
+
+/**
+ * @brief Search a parameter column of an Atelier, by name
+ *
+ * @param atelier Pointer to the Atelier
+ * @param name    Name of the parameter
+ * @return integer Index of the parameter (-1 if not found)
+ */
+static int columnIndex(Atelier *atelier, const QString &name)
+{
+    for (int i = 0; i < atelier->countParameter(); ++i)
+    {
+        if (atelier->getParameterName(i) == name)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Get the name of the Rotation used by an entity
+ *
+ * @param entity Pointer to the entity
+ * @return QString Name of the Rotation (empty if none)
+ */
+static QString rotationName(Atelier *entity)
+{
+    Rotation *rotation = entity->getRotation();
+    return rotation ? rotation->getName() : QString();
+}
+
+/**
+ * @brief Test if an Atelier (or entity) defines the parameters of his entities
+ *
+ * An entity defines them only once he holds sub-entities (see
+ * Atelier::getParameter).
+ *
+ * @param atelier Pointer to the Atelier or entity
+ * @return boolean True if the parameters are defined (or there is none)
+ */
+static bool hasDefinitions(Atelier *atelier)
+{
+    return (atelier->countParameter() == 0) || (atelier->getParameter(0) != 0);
+}
+
+/**
+ * @brief Select the sources that can be kept in place
+ *
+ * Each item is the position of a destination object into the source (-1
+ * for a new object). The longest increasing sequence of positions is kept,
+ * the other objects must be moved (removed then inserted).
+ *
+ * @param sources Position of each destination object into the source
+ * @return Flags of the kept objects (one per destination object)
+ */
+static QVector<bool> keptSources(const QVector<int> &sources)
+{
+    // Last item of the best sequence of each length, and the previous items
+    QVector<int> tails;
+    QVector<int> previous(sources.count(), -1);
+    for (int i = 0; i < sources.count(); ++i)
+    {
+        int source = sources.at(i);
+        if (source < 0)
+            continue;
+        int low = 0;
+        int high = tails.count();
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (sources.at(tails.at(middle)) < source)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low > 0)
+            previous[i] = tails.at(low - 1);
+        if (low == tails.count())
+            tails.append(i);
+        else
+            tails[low] = i;
+    }
+
+    QVector<bool> kept(sources.count(), false);
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i))
+        kept[i] = true;
+    return kept;
+}
+
+/**
+ * @brief Get a readable form of an entity path
+ *
+ * @param path Rows of the entity from the top-level Atelier
+ * @return QString Rows separated by '/'
+ */
+static QString pathString(const QList<qint32> &path)
+{
+    QStringList rows;
+    for (int i = 0; i < path.count(); ++i)
+        rows.append(QString::number(path.at(i)));
+    return rows.join('/');
+}
+
+/**
+ * @brief Default constructor, the patch is empty
+ *
+ */
+ExploitationPatch::ExploitationPatch()
+{
+    mOperations.clear();
+}
+
+/**
+ * @brief Apply the patch on an Exploitation
+ *
+ * The Exploitation should be a copy of the source used by diff(). On error
+ * the operations that precede the failed one are kept.
+ *
+ * @param exploitation Pointer to the Exploitation to modify
+ * @return boolean True on success, see errorString() otherwise
+ */
+bool ExploitationPatch::apply(Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("ExploitationPatch::apply");
+
+    mError.clear();
+
+    // Index ateliers and rotations by name
+    mAteliers.clear();
+    mRotations.clear();
+    for (uint i = 0; i < exploitation->countAtelier(); ++i)
+    {
+        Atelier *atelier = exploitation->getAtelier(i);
+        if ( ! mAteliers.contains(atelier->getName()))
+            mAteliers.insert(atelier->getName(), atelier);
+    }
+    for (uint i = 0; i < exploitation->countRotation(); ++i)
+    {
+        Rotation *rotation = exploitation->getRotation(i);
+        if ( ! mRotations.contains(rotation->getName()))
+            mRotations.insert(rotation->getName(), rotation);
+    }
+
+    bool result = true;
+    for (int i = 0; i < mOperations.count(); ++i)
+    {
+        if ( ! applyOperation(exploitation, mOperations.at(i)))
+        {
+            mError = QString("Operation %1 : %2").arg(i).arg(mError);
+            result = false;
+            break;
+        }
+    }
+
+    mAteliers.clear();
+    mRotations.clear();
+
+    return result;
+}
+
+/**
+ * @brief Apply one operation of the patch
+ *
+ * @param exploitation Pointer to the Exploitation to modify
+ * @param op           Operation to apply
+ * @return boolean True on success
+ */
+bool ExploitationPatch::applyOperation(Exploitation *exploitation, const Operation &op)
+{
+    // Global parameters
+    if (op.type == OpSetParameter)
+    {
+        exploitation->setParameter(op.name, op.value);
+        return true;
+    }
+    if (op.type == OpRemoveParameter)
+    {
+        if ( ! exploitation->removeParameter(op.name))
+        {
+            mError = QString("Unknown or used parameter '%1'").arg(op.name);
+            return false;
+        }
+        return true;
+    }
+
+    // Rotations
+    if (op.type == OpAddRotation)
+    {
+        Rotation *rotation = exploitation->createRotation(op.target, op.number);
+        if (rotation == 0)
+        {
+            mError = QString("Failed to create rotation '%1'").arg(op.target);
+            return false;
+        }
+        if ( ! mRotations.contains(op.target))
+            mRotations.insert(op.target, rotation);
+        return true;
+    }
+    if ((op.type >= OpRemoveRotation) && (op.type <= OpTruncatePlans))
+    {
+        Rotation *rotation = mRotations.value(op.target, 0);
+        if (rotation == 0)
+        {
+            mError = QString("Unknown rotation '%1'").arg(op.target);
+            return false;
+        }
+        if (op.type == OpRemoveRotation)
+        {
+            mRotations.remove(op.target);
+            exploitation->removeRotation(rotation);
+        }
+        else if (op.type == OpSetDuration)
+            rotation->setDuration(op.number);
+        else if (op.type == OpSetPlan)
+        {
+            int count = rotation->countPlans();
+            if (op.index < count)
+            {
+                ActivityPlan *plan = rotation->getPlan(op.index);
+                plan->setName(op.name);
+                plan->setPosition(op.number);
+            }
+            else if (op.index == count)
+                rotation->addPlan(op.number, op.name);
+            else
+            {
+                mError = QString("Invalid plan %1 for rotation '%2'").arg(op.index).arg(op.target);
+                return false;
+            }
+        }
+        else
+        {
+            while ((int)rotation->countPlans() > op.index)
+                rotation->removePlan(rotation->countPlans() - 1);
+        }
+        return true;
+    }
+
+    // Ateliers
+    if (op.type == OpAddAtelier)
+    {
+        Atelier *atelier = exploitation->createAtelier(op.target);
+        if (atelier == 0)
+        {
+            mError = QString("Failed to create atelier '%1'").arg(op.target);
+            return false;
+        }
+        if ( ! mAteliers.contains(op.target))
+            mAteliers.insert(op.target, atelier);
+        return true;
+    }
+
+    Atelier *atelier = mAteliers.value(op.target, 0);
+    if (atelier == 0)
+    {
+        mError = QString("Unknown atelier '%1'").arg(op.target);
+        return false;
+    }
+
+    if (op.type == OpRemoveAtelier)
+    {
+        mAteliers.remove(op.target);
+        exploitation->removeAtelier(atelier);
+        return true;
+    }
+    if (op.type == OpAddColumn)
+    {
+        if ((op.index < 0) || (op.index > atelier->countParameter()))
+        {
+            mError = QString("Invalid position %1 for '%2' in atelier '%3'")
+                     .arg(op.index).arg(op.name).arg(op.target);
+            return false;
+        }
+        atelier->insertParameter(op.index, op.name, op.value);
+        return true;
+    }
+    if (op.type == OpRemoveColumn)
+    {
+        int column = columnIndex(atelier, op.name);
+        if (column < 0)
+        {
+            mError = QString("Unknown parameter '%1' in atelier '%2'").arg(op.name).arg(op.target);
+            return false;
+        }
+        // The formulas that use it are modified by the following operations
+        atelier->dropParameter(column);
+        return true;
+    }
+
+    // Entity (or Atelier) designated by the path, parent of a new entity
+    int depth = op.path.count();
+    if (op.type == OpAddEntity)
+        depth--;
+    Atelier *entity = (depth >= 0) ? findEntity(atelier, op.path, depth) : 0;
+    if (entity == 0)
+    {
+        mError = QString("Unknown entity %1 in atelier '%2'")
+                 .arg(pathString(op.path)).arg(op.target);
+        return false;
+    }
+
+    // Operations on one entity
+    if (op.type == OpAddEntity)
+    {
+        Atelier *newEntity = entity->insertEntity(op.path.last());
+        if (newEntity == 0)
+        {
+            mError = QString("Invalid entity %1 in atelier '%2'")
+                     .arg(pathString(op.path)).arg(op.target);
+            return false;
+        }
+        newEntity->setName(op.entity);
+        return true;
+    }
+    if ((op.type == OpRemoveEntity) || (op.type == OpSetEntityValue) ||
+        (op.type == OpSetEntityRotation))
+    {
+        if (entity == atelier)
+        {
+            mError = QString("Missing entity path in atelier '%1'").arg(op.target);
+            return false;
+        }
+        if (op.type == OpRemoveEntity)
+            entity->getParent()->removeEntity(entity->getRow());
+        else if (op.type == OpSetEntityValue)
+        {
+            int column = columnIndex(entity, op.name);
+            if (column < 0)
+            {
+                mError = QString("Unknown parameter '%1' in atelier '%2'").arg(op.name).arg(op.target);
+                return false;
+            }
+            if ( ! entity->setParameterValue(column, op.value))
+            {
+                mError = QString("Value of '%1' refused in atelier '%2'").arg(op.name).arg(op.target);
+                return false;
+            }
+        }
+        else
+        {
+            Rotation *rotation = 0;
+            if ( ! op.text.isEmpty())
+            {
+                rotation = mRotations.value(op.text, 0);
+                if (rotation == 0)
+                {
+                    mError = QString("Unknown rotation '%1'").arg(op.text);
+                    return false;
+                }
+            }
+            entity->setRotation(rotation);
+        }
+        return true;
+    }
+
+    // Operations on one parameter of the entities (or sub-entities)
+    int column = columnIndex(entity, op.name);
+    if (column < 0)
+    {
+        mError = QString("Unknown parameter '%1' in atelier '%2'").arg(op.name).arg(op.target);
+        return false;
+    }
+    // The default value is the first definition of an entity
+    if (op.type == OpSetColumnDefault)
+    {
+        if ( ! entity->setParameterDefault(column, op.value))
+        {
+            mError = QString("Default of '%1' refused in atelier '%2'").arg(op.name).arg(op.target);
+            return false;
+        }
+        return true;
+    }
+    if (entity->getParameter(column) == 0)
+    {
+        mError = QString("No definition of '%1' for entity %2 in atelier '%3'")
+                 .arg(op.name).arg(pathString(op.path)).arg(op.target);
+        return false;
+    }
+    if (op.type == OpSetColumnMandatory)
+        entity->setParameterMandatory(column, op.index != 0);
+    else if (op.type == OpSetColumnFormula)
+    {
+        if ( ! entity->setParameterFormula(column, op.text))
+        {
+            mError = QString("Invalid formula for '%1' : %2").arg(op.name).arg(op.text);
+            return false;
+        }
+    }
+    else if (op.type == OpSetColumnKind)
+    {
+        if ( ! entity->setParameterKind(column, AtelierColumn::Kind(op.index)))
+        {
+            mError = QString("Can not change the type of '%1' in atelier '%2'").arg(op.name).arg(op.target);
+            return false;
+        }
+    }
+    else if (op.type == OpSetColumnSeries)
+    {
+        entity->dropParameterSeries(column);
+        int rows  = entity->countEntity();
+        int years = (int)op.number;
+        if ((years == 0) || (rows == 0))
+            return true;
+        if (op.values.count() != (rows * years))
+        {
+            mError = QString("Invalid series of '%1' in atelier '%2'").arg(op.name).arg(op.target);
+            return false;
+        }
+        // Values are stored year by year, like into a SeriesTable
+        QVector<int> entities(rows);
+        QVector<TimeSeries> series(rows);
+        QVector<double> values(years);
+        for (int r = 0; r < rows; ++r)
+        {
+            for (int y = 0; y < years; ++y)
+                values[y] = op.values.at((y * rows) + r);
+            entities[r] = r;
+            series[r].setValues(op.index, values);
+        }
+        if ( ! entity->setEntitySeries(column, entities, series))
+        {
+            mError = QString("Invalid series of '%1' in atelier '%2'").arg(op.name).arg(op.target);
+            return false;
+        }
+    }
+    else
+    {
+        mError = QString("Invalid operation type %1").arg((int)op.type);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Append a new operation to the patch
+ *
+ * @param type   Type of the operation
+ * @param target Name of the Atelier or Rotation (if any)
+ * @return Reference to the new operation, to fill the other fields
+ */
+ExploitationPatch::Operation &ExploitationPatch::append(OpType type, const QString &target)
+{
+    Operation op;
+    op.type   = type;
+    op.target = target;
+    op.index  = 0;
+    op.value  = 0;
+    op.number = 0;
+    mOperations.append(op);
+    return mOperations.last();
+}
+
+/**
+ * @brief Append a new operation on an entity (or his parameters)
+ *
+ * @param type   Type of the operation
+ * @param target Name of the top-level Atelier
+ * @param path   Rows of the entity (empty for the Atelier itself)
+ * @return Reference to the new operation, to fill the other fields
+ */
+ExploitationPatch::Operation &ExploitationPatch::append(OpType type, const QString &target,
+                                                        const QList<qint32> &path)
+{
+    Operation &op = append(type, target);
+    op.path = path;
+    return op;
+}
+
+/**
+ * @brief Remove all operations
+ *
+ */
+void ExploitationPatch::clear(void)
+{
+    mOperations.clear();
+}
+
+/**
+ * @brief Get the number of operations into the patch
+ *
+ * @return integer Number of operations
+ */
+int ExploitationPatch::count(void)
+{
+    return mOperations.count();
+}
+
+/**
+ * @brief Compute the operations that transform an Exploitation into another
+ *
+ * The previous content of the patch is replaced.
+ *
+ * @param from Pointer to the source Exploitation (ex: last season)
+ * @param to   Pointer to the destination Exploitation (ex: current state)
+ */
+void ExploitationPatch::diff(Exploitation *from, Exploitation *to)
+{
+    INSTRUMENT_CALL("ExploitationPatch::diff");
+
+    mOperations.clear();
+
+    diffParameters(from, to);
+
+    // Rotations : new and modified ones first (used by the entities)
+    QHash<QString, Rotation *> fromRotations;
+    QHash<QString, Rotation *> toRotations;
+    for (uint i = 0; i < from->countRotation(); ++i)
+    {
+        Rotation *rotation = from->getRotation(i);
+        if ( ! fromRotations.contains(rotation->getName()))
+            fromRotations.insert(rotation->getName(), rotation);
+    }
+    for (uint i = 0; i < to->countRotation(); ++i)
+    {
+        Rotation *rotation = to->getRotation(i);
+        if (toRotations.contains(rotation->getName()))
+            continue;
+        toRotations.insert(rotation->getName(), rotation);
+        diffRotation(fromRotations.value(rotation->getName(), 0), rotation);
+    }
+
+    // Ateliers
+    QHash<QString, Atelier *> fromAteliers;
+    QHash<QString, Atelier *> toAteliers;
+    for (uint i = 0; i < to->countAtelier(); ++i)
+    {
+        Atelier *atelier = to->getAtelier(i);
+        if ( ! toAteliers.contains(atelier->getName()))
+            toAteliers.insert(atelier->getName(), atelier);
+    }
+    for (uint i = 0; i < from->countAtelier(); ++i)
+    {
+        Atelier *atelier = from->getAtelier(i);
+        if (fromAteliers.contains(atelier->getName()))
+            continue;
+        fromAteliers.insert(atelier->getName(), atelier);
+        if ( ! toAteliers.contains(atelier->getName()))
+            append(OpRemoveAtelier, atelier->getName());
+    }
+    for (uint i = 0; i < to->countAtelier(); ++i)
+    {
+        Atelier *atelier = to->getAtelier(i);
+        if (toAteliers.value(atelier->getName()) != atelier)
+            continue;
+        Atelier *source = fromAteliers.value(atelier->getName(), 0);
+        // Same content hash, nothing to compare
+        if (source && (source->getHash() == atelier->getHash()))
+            continue;
+        diffAtelier(source, atelier);
+    }
+
+    // Then the removed rotations (no more used)
+    for (uint i = 0; i < from->countRotation(); ++i)
+    {
+        Rotation *rotation = from->getRotation(i);
+        if (fromRotations.value(rotation->getName()) != rotation)
+            continue;
+        if ( ! toRotations.contains(rotation->getName()))
+            append(OpRemoveRotation, rotation->getName());
+    }
+
+    // And the removed global parameters, once no formula uses them
+    for (uint i = 0; i < from->countParameter(); ++i)
+    {
+        Parameter *parameter = from->getParameter(i);
+        if (to->getParameter(parameter->getName()) == 0)
+            append(OpRemoveParameter, QString()).name = parameter->getName();
+    }
+}
+
+/**
+ * @brief Compute the operations that transform an Atelier into another
+ *
+ * @param from Pointer to the source Atelier (NULL for a new Atelier)
+ * @param to   Pointer to the destination Atelier
+ */
+void ExploitationPatch::diffAtelier(Atelier *from, Atelier *to)
+{
+    INSTRUMENT_CALL("ExploitationPatch::diffAtelier");
+
+    const QString &name = to->getName();
+    if (from == 0)
+        append(OpAddAtelier, name);
+
+    // Index of each destination column into the source (-1 for new), only
+    // for the columns that keep their order
+    QVector<int> columns(to->countParameter(), -1);
+    if (from)
+    {
+        for (int i = 0; i < to->countParameter(); ++i)
+            columns[i] = columnIndex(from, to->getParameterName(i));
+        QVector<bool> kept = keptSources(columns);
+        for (int i = 0; i < columns.count(); ++i)
+        {
+            if ( ! kept.at(i))
+                columns[i] = -1;
+        }
+    }
+
+    // Removed (or moved) then new parameter columns
+    bool sameColumns = (from != 0) && (from->countParameter() == to->countParameter());
+    if (from)
+    {
+        for (int i = 0; i < from->countParameter(); ++i)
+        {
+            if ( ! columns.contains(i))
+                append(OpRemoveColumn, name).name = from->getParameterName(i);
+        }
+    }
+    for (int i = 0; i < to->countParameter(); ++i)
+    {
+        if (columns.at(i) == i)
+            continue;
+        sameColumns = false;
+        if (columns.at(i) >= 0)
+            continue;
+        Operation &op = append(OpAddColumn, name);
+        op.index = i;
+        op.name  = to->getParameterName(i);
+        op.value = to->getParameterValue(i);
+    }
+
+    diffColumns (name, QList<qint32>(), from, to, columns);
+    diffEntities(name, QList<qint32>(), from, to, columns, sameColumns);
+}
+
+/**
+ * @brief Compute the operations on the parameters definitions of an Atelier
+ *
+ * For an entity these are the definitions used by his sub-entities, see
+ * Atelier::getParameter. New columns are already added (see diffAtelier).
+ *
+ * @param atelier Name of the top-level Atelier
+ * @param path    Rows of the entity (empty for the Atelier itself)
+ * @param from    Pointer to the source Atelier or entity (NULL if new)
+ * @param to      Pointer to the destination Atelier or entity
+ * @param columns Index of each destination column into the source
+ */
+void ExploitationPatch::diffColumns(const QString &atelier, const QList<qint32> &path,
+                                    Atelier *from, Atelier *to, const QVector<int> &columns)
+{
+    int count = to->countParameter();
+    if ((count == 0) || (to->getParameter(0) == 0))
+        return;
+
+    // An entity without definitions copies the ones of his parent, with
+    // his own values as defaults, when the first default is set
+    bool inherit = ( ! path.isEmpty()) && ((from == 0) || ! hasDefinitions(from));
+    Atelier *parent = to->getParent();
+    if (inherit)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            Operation &op = append(OpSetColumnDefault, atelier, path);
+            op.name  = to->getParameterName(i);
+            op.value = to->getParameter(i)->getValue();
+        }
+    }
+
+    // Definition of each column before this diff
+    QVector<AtelierColumn::Kind> kinds(count, AtelierColumn::KindDouble);
+    QVector<double>  values(count);
+    QVector<bool>    mandatory(count, false);
+    QStringList      formulas;
+    for (int i = 0; i < count; ++i)
+    {
+        AtelierParameter *definition = to->getParameter(i);
+        AtelierParameter *old = 0;
+        if (from && (columns.at(i) >= 0))
+            old = from->getParameter(columns.at(i));
+        if (old)
+        {
+            kinds[i]     = old->getKind();
+            values[i]    = old->getValue();
+            mandatory[i] = old->isMandatory();
+            formulas.append(from->getParameterFormula(columns.at(i)));
+        }
+        else if (inherit)
+        {
+            AtelierParameter *model = parent->getParameter(i);
+            kinds[i]     = model->getKind();
+            mandatory[i] = model->isMandatory();
+            // The value is converted to the kind of the parent, then to the new kind
+            values[i] = AtelierColumn::normalize(kinds.at(i), definition->getValue());
+            values[i] = AtelierColumn::normalize(definition->getKind(), values.at(i));
+            formulas.append(QString());
+        }
+        else
+        {
+            // New column : the default value of the top-level Atelier
+            values[i] = to->getRoot()->getParameterValue(i);
+            formulas.append(QString());
+        }
+    }
+
+    // Formulas removed before new ones
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            QString formula = to->getParameterFormula(i);
+            if ((formula == formulas.at(i)) || (formula.isEmpty() != (pass == 0)))
+                continue;
+            Operation &op = append(OpSetColumnFormula, atelier, path);
+            op.name = to->getParameterName(i);
+            op.text = formula;
+        }
+    }
+    // Kinds before the values (values are converted to the kind)
+    for (int i = 0; i < count; ++i)
+    {
+        AtelierColumn::Kind kind = to->getParameter(i)->getKind();
+        if (kind == kinds.at(i))
+            continue;
+        Operation &op = append(OpSetColumnKind, atelier, path);
+        op.name  = to->getParameterName(i);
+        op.index = kind;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        AtelierParameter *definition = to->getParameter(i);
+        if (definition->getValue() != values.at(i))
+        {
+            Operation &op = append(OpSetColumnDefault, atelier, path);
+            op.name  = to->getParameterName(i);
+            op.value = definition->getValue();
+        }
+        if (definition->isMandatory() != mandatory.at(i))
+        {
+            Operation &op = append(OpSetColumnMandatory, atelier, path);
+            op.name  = to->getParameterName(i);
+            op.index = definition->isMandatory() ? 1 : 0;
+        }
+    }
+}
+
+/**
+ * @brief Compute the operations on the entities of an Atelier (or entity)
+ *
+ * Entities are matched by name, then by occurrence of this name.
+ *
+ * @param atelier     Name of the top-level Atelier
+ * @param path        Rows of the entity (empty for the Atelier itself)
+ * @param from        Pointer to the source Atelier or entity (NULL if new)
+ * @param to          Pointer to the destination Atelier or entity
+ * @param columns     Index of each destination column into the source
+ * @param sameColumns True if the columns did not change
+ */
+void ExploitationPatch::diffEntities(const QString &atelier, const QList<qint32> &path,
+                                     Atelier *from, Atelier *to,
+                                     const QVector<int> &columns, bool sameColumns)
+{
+    int fromCount = from ? from->countEntity() : 0;
+
+    // Row of each destination entity into the source (-1 for new)
+    QHash<QString, QList<int> > fromNames;
+    for (int i = 0; i < fromCount; ++i)
+        fromNames[from->getEntity(i)->getName()].append(i);
+    QHash<QString, int> occurrences;
+    QVector<int> sources(to->countEntity(), -1);
+    for (int i = 0; i < to->countEntity(); ++i)
+    {
+        Atelier *entity = to->getEntity(i);
+        int occurrence = occurrences[entity->getName()]++;
+        const QList<int> &rows = fromNames[entity->getName()];
+        if (occurrence >= rows.count())
+            continue;
+        // Definitions of an entity can not be removed : new entity
+        Atelier *source = from->getEntity(rows.at(occurrence));
+        if (hasDefinitions(entity) || ! hasDefinitions(source))
+            sources[i] = rows.at(occurrence);
+    }
+    QVector<bool> kept = keptSources(sources);
+    QVector<bool> used(fromCount, false);
+    for (int i = 0; i < sources.count(); ++i)
+    {
+        if (kept.at(i))
+            used[sources.at(i)] = true;
+        else
+            sources[i] = -1;
+    }
+
+    // Removed (or moved) entities, last rows first
+    bool sameRows = (fromCount == to->countEntity());
+    for (int i = fromCount - 1; i >= 0; --i)
+    {
+        if (used.at(i))
+            continue;
+        QList<qint32> entityPath(path);
+        entityPath.append(i);
+        append(OpRemoveEntity, atelier, entityPath);
+        sameRows = false;
+    }
+
+    // Modified and new entities, the destination order is kept
+    for (int i = 0; i < to->countEntity(); ++i)
+    {
+        Atelier *entity = to->getEntity(i);
+        QList<qint32> entityPath(path);
+        entityPath.append(i);
+        if (sources.at(i) >= 0)
+        {
+            Atelier *source = from->getEntity(sources.at(i));
+            if ( ! (sameColumns && (source->getHash() == entity->getHash())))
+                diffEntity(atelier, entityPath, to, source, entity, columns, sameColumns);
+        }
+        else
+        {
+            append(OpAddEntity, atelier, entityPath).entity = entity->getName();
+            diffEntity(atelier, entityPath, to, 0, entity, columns, sameColumns);
+            sameRows = false;
+        }
+    }
+
+    diffSeries(atelier, path, from, to, columns, sameRows);
+}
+
+/**
+ * @brief Compute the operations that transform an entity into another
+ *
+ * @param atelier     Name of the top-level Atelier
+ * @param path        Rows of the entity
+ * @param parent      Pointer to the destination parent (Atelier or entity)
+ * @param from        Pointer to the source entity (NULL for a new entity)
+ * @param to          Pointer to the destination entity
+ * @param columns     Index of each destination column into the source
+ * @param sameColumns True if the columns did not change
+ */
+void ExploitationPatch::diffEntity(const QString &atelier, const QList<qint32> &path,
+                                   Atelier *parent, Atelier *from, Atelier *to,
+                                   const QVector<int> &columns, bool sameColumns)
+{
+    for (int i = 0; i < to->countParameter(); ++i)
+    {
+        // Derived values are computed again by the destination
+        if (parent->isParameterDerived(i))
+            continue;
+
+        double value = to->getParameterValue(i);
+        double old;
+        if (from && (columns.at(i) >= 0))
+            old = from->getParameterValue(columns.at(i));
+        else if (from)
+            old = to->getRoot()->getParameterValue(i);
+        else
+            old = parent->getParameter(i)->getValue();
+        if (value == old)
+            continue;
+
+        Operation &op = append(OpSetEntityValue, atelier, path);
+        op.name  = to->getParameterName(i);
+        op.value = value;
+    }
+
+    QString rotation = rotationName(to);
+    if (from ? (rotationName(from) != rotation) : ( ! rotation.isEmpty()))
+        append(OpSetEntityRotation, atelier, path).text = rotation;
+
+    // Sub-entities, with the definitions of their parameters
+    diffColumns (atelier, path, from, to, columns);
+    if ((to->countEntity() > 0) || (from && (from->countEntity() > 0)))
+        diffEntities(atelier, path, from, to, columns, sameColumns);
+}
+
+/**
+ * @brief Compute the operations on the series of the entities of an Atelier
+ *
+ * The whole table of a modified column is written, year by year.
+ *
+ * @param atelier  Name of the top-level Atelier
+ * @param path     Rows of the entity (empty for the Atelier itself)
+ * @param from     Pointer to the source Atelier or entity (NULL if new)
+ * @param to       Pointer to the destination Atelier or entity
+ * @param columns  Index of each destination column into the source
+ * @param sameRows True if the entities did not move
+ */
+void ExploitationPatch::diffSeries(const QString &atelier, const QList<qint32> &path,
+                                   Atelier *from, Atelier *to,
+                                   const QVector<int> &columns, bool sameRows)
+{
+    int rows = to->countEntity();
+    if (rows == 0)
+        return;
+
+    for (int i = 0; i < to->countParameter(); ++i)
+    {
+        int source = columns.at(i);
+        bool known = (from != 0) && (source >= 0) && hasDefinitions(from);
+        bool old   = known && (from->countEntity() > 0) &&
+                     from->getEntity(0)->hasParameterSeries(source);
+        TimeSeries first = to->getEntity(0)->getParameterSeries(i);
+        if (first.isEmpty())
+        {
+            // A table without entity may exist into the source
+            if (old || (known && (from->countEntity() == 0)))
+                append(OpSetColumnSeries, atelier, path).name = to->getParameterName(i);
+            continue;
+        }
+
+        bool same = old && sameRows;
+        for (int r = 0; same && (r < rows); ++r)
+            same = (to->getEntity(r)->getParameterSeries(i).getHash() ==
+                    from->getEntity(r)->getParameterSeries(source).getHash());
+        if (same)
+            continue;
+
+        Operation &op = append(OpSetColumnSeries, atelier, path);
+        op.name   = to->getParameterName(i);
+        op.index  = first.getFirstYear();
+        op.number = first.count();
+        op.values.reserve(rows * first.count());
+        for (int y = first.getFirstYear(); y <= first.getLastYear(); ++y)
+        {
+            const double *values = to->getYearValues(i, y);
+            for (int r = 0; r < rows; ++r)
+                op.values.append(values[r]);
+        }
+    }
+}
+
+/**
+ * @brief Compute the new and modified global parameters
+ *
+ * The removed ones are appended at the end of the patch (see diff).
+ *
+ * @param from Pointer to the source Exploitation
+ * @param to   Pointer to the destination Exploitation
+ */
+void ExploitationPatch::diffParameters(Exploitation *from, Exploitation *to)
+{
+    for (uint i = 0; i < to->countParameter(); ++i)
+    {
+        Parameter *parameter = to->getParameter(i);
+        Parameter *old = from->getParameter(parameter->getName());
+        if (old && (old->getHash() == parameter->getHash()))
+            continue;
+        Operation &op = append(OpSetParameter, QString());
+        op.name  = parameter->getName();
+        op.value = parameter->getValue();
+    }
+}
+
+/**
+ * @brief Compute the operations that transform a Rotation into another
+ *
+ * @param from Pointer to the source Rotation (NULL for a new Rotation)
+ * @param to   Pointer to the destination Rotation
+ */
+void ExploitationPatch::diffRotation(Rotation *from, Rotation *to)
+{
+    if (from && (from->getHash() == to->getHash()))
+        return;
+
+    const QString &name = to->getName();
+    if (from == 0)
+        append(OpAddRotation, name).number = to->getDuration();
+    else if (from->getDuration() != to->getDuration())
+        append(OpSetDuration, name).number = to->getDuration();
+
+    int oldCount = from ? (int)from->countPlans() : 0;
+    for (int i = 0; i < (int)to->countPlans(); ++i)
+    {
+        ActivityPlan *plan = to->getPlan(i);
+        if (i < oldCount)
+        {
+            ActivityPlan *old = from->getPlan(i);
+            if ((old->getName()     == plan->getName()) &&
+                (old->getPosition() == plan->getPosition()))
+                continue;
+        }
+        Operation &op = append(OpSetPlan, name);
+        op.index  = i;
+        op.name   = plan->getName();
+        op.number = plan->getPosition();
+    }
+    if (oldCount > (int)to->countPlans())
+        append(OpTruncatePlans, name).index = to->countPlans();
+}
+
+/**
+ * @brief Get the last error message
+ *
+ * @return QString Error message
+ */
+QString ExploitationPatch::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Search an entity of an Atelier, by the path of his rows
+ *
+ * @param atelier Pointer to the top-level Atelier
+ * @param path    Rows of the entity and his parents
+ * @param depth   Number of rows of the path to use (0 for the Atelier)
+ * @return Pointer to the entity (or NULL)
+ */
+Atelier *ExploitationPatch::findEntity(Atelier *atelier, const QList<qint32> &path, int depth)
+{
+    Atelier *entity = atelier;
+    for (int i = 0; i < depth; ++i)
+    {
+        int row = path.at(i);
+        if ((row < 0) || (row >= entity->countEntity()))
+            return 0;
+        entity = entity->getEntity(row);
+    }
+    return entity;
+}
+
+/**
+ * @brief Get one operation of the patch
+ *
+ * @param index Index of the operation
+ * @return Reference to the operation
+ */
+const ExploitationPatch::Operation &ExploitationPatch::getOperation(int index)
+{
+    return mOperations.at(index);
+}
+
+/**
+ * @brief Test if the patch contains no modification
+ *
+ * @return boolean True if empty
+ */
+bool ExploitationPatch::isEmpty(void)
+{
+    return mOperations.isEmpty();
+}
+
+/**
+ * @brief Load a patch from a device
+ *
+ * @param device Pointer to an opened device
+ * @return boolean True on success, see errorString() otherwise
+ */
+bool ExploitationPatch::load(QIODevice *device)
+{
+    INSTRUMENT_CALL("ExploitationPatch::load");
+
+    mOperations.clear();
+    mError.clear();
+
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if ((in.status() != QDataStream::Ok) || (magic != PATCH_MAGIC))
+    {
+        mError = "Not a patch file";
+        return false;
+    }
+    if (version != PATCH_VERSION)
+    {
+        mError = QString("Unsupported patch version %1").arg(version);
+        return false;
+    }
+
+    for (quint32 i = 0; i < count; ++i)
+    {
+        quint8 type;
+        in >> type;
+        if ((type == 0) || (type >= OpLast))
+        {
+            mError = QString("Invalid operation type %1").arg(type);
+            mOperations.clear();
+            return false;
+        }
+        Operation &op = append((OpType)type, QString());
+        quint16 fields = patchFields[type];
+        if (fields & FieldTarget)
+            in >> op.target;
+        if (fields & FieldPath)
+            in >> op.path;
+        if (fields & FieldEntity)
+            in >> op.entity;
+        if (fields & FieldIndex)
+        {
+            qint32 index;
+            in >> index;
+            op.index = index;
+        }
+        if (fields & FieldName)
+            in >> op.name;
+        if (fields & FieldText)
+            in >> op.text;
+        if (fields & FieldValue)
+            in >> op.value;
+        if (fields & FieldNumber)
+            in >> op.number;
+        if (fields & FieldValues)
+            in >> op.values;
+
+        if (in.status() != QDataStream::Ok)
+        {
+            mError = "Truncated patch file";
+            mOperations.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Load a patch from a file
+ *
+ * @param filename Name of the patch file
+ * @return boolean True on success, see errorString() otherwise
+ */
+bool ExploitationPatch::load(const QString &filename)
+{
+    QFile file(filename);
+    if ( ! file.open(QIODevice::ReadOnly))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    return load(&file);
+}
+
+/**
+ * @brief Write the patch into a device
+ *
+ * @param device Pointer to an opened device
+ * @return boolean True on success, see errorString() otherwise
+ */
+bool ExploitationPatch::save(QIODevice *device)
+{
+    INSTRUMENT_CALL("ExploitationPatch::save");
+
+    mError.clear();
+
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << (quint32)PATCH_MAGIC << (quint32)PATCH_VERSION;
+    out << (quint32)mOperations.count();
+    for (int i = 0; i < mOperations.count(); ++i)
+    {
+        const Operation &op = mOperations.at(i);
+        quint16 fields = patchFields[op.type];
+        out << (quint8)op.type;
+        if (fields & FieldTarget)
+            out << op.target;
+        if (fields & FieldPath)
+            out << op.path;
+        if (fields & FieldEntity)
+            out << op.entity;
+        if (fields & FieldIndex)
+            out << (qint32)op.index;
+        if (fields & FieldName)
+            out << op.name;
+        if (fields & FieldText)
+            out << op.text;
+        if (fields & FieldValue)
+            out << op.value;
+        if (fields & FieldNumber)
+            out << op.number;
+        if (fields & FieldValues)
+            out << op.values;
+    }
+
+    if (out.status() != QDataStream::Ok)
+    {
+        mError = device->errorString();
+        if (mError.isEmpty())
+            mError = "Write error";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the patch into a file (replaced only on success)
+ *
+ * @param filename Name of the patch file
+ * @return boolean True on success, see errorString() otherwise
+ */
+bool ExploitationPatch::save(const QString &filename)
+{
+    QSaveFile file(filename);
+    if ( ! file.open(QIODevice::WriteOnly))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    if ( ! save(&file))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    if ( ! file.commit())
+    {
+        mError = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "exploitation.h"
+
+/*
+ * An ExploitationPatch is the list of modifications that transform one
+ * Exploitation into another. Objects are matched by name : ateliers,
+ * rotations, global parameters and parameter columns by their name, and
+ * entities by their name and occurrence (for entities with the same name).
+ * Ateliers and rotations with the same content hash are skipped, so the
+ * diff cost mostly depends on the modified parts.
+ *
+ * The order of the columns and entities is kept : the longest sequence of
+ * matched objects already in order is kept, the others are removed then
+ * inserted at their new position. An entity is addressed by the path of
+ * his rows from the top-level Atelier (sub-entities included), at the time
+ * the operation is applied.
+ *
+ * A patch can be saved into a compact binary file, then loaded and applied
+ * on another copy of the source Exploitation (ex: on another workstation).
+ */
+class ExploitationPatch
+{
+public:
+    enum OpType {
+        OpSetParameter = 1,  // name, value
+        OpRemoveParameter,   // name
+        OpAddRotation,       // target, number (duration)
+        OpRemoveRotation,    // target
+        OpSetDuration,       // target, number
+        OpSetPlan,           // target, index, name, number (position)
+        OpTruncatePlans,     // target, index (new count of plans)
+        OpAddAtelier,        // target
+        OpRemoveAtelier,     // target
+        OpAddColumn,         // target, index (position), name, value (default)
+        OpRemoveColumn,      // target, name
+        OpSetColumnDefault,  // target, path, name, value
+        OpSetColumnFormula,  // target, path, name, text (empty for none)
+        OpSetColumnMandatory,// target, path, name, index (0 or 1)
+        OpAddEntity,         // target, path (with the new row), entity (name)
+        OpRemoveEntity,      // target, path
+        OpSetEntityValue,    // target, path, name, value
+        OpSetEntityRotation, // target, path, text (empty for none)
+        OpSetColumnKind,     // target, path, name, index (kind)
+        OpSetColumnSeries,   // target, path, name, index (first year),
+                             // number (years, 0 for none), values
+        OpLast
+    };
+    // Column operations use the path of the entity that holds the
+    // parameters of his sub-entities (empty for the Atelier itself)
+    struct Operation
+    {
+        OpType  type;
+        QString target;
+        QList<qint32> path;
+        QString entity;
+        int     index;
+        QString name;
+        QString text;
+        double  value;
+        quint64 number;
+        QVector<double> values;
+    };
+public:
+    ExploitationPatch();
+    bool    apply(Exploitation *exploitation);
+    void    clear(void);
+    int     count(void);
+    void    diff (Exploitation *from, Exploitation *to);
+    QString errorString(void);
+    const Operation &getOperation(int index);
+    bool    isEmpty(void);
+    bool    load(QIODevice *device);
+    bool    load(const QString &filename);
+    bool    save(QIODevice *device);
+    bool    save(const QString &filename);
+private:
+    Operation &append(OpType type, const QString &target);
+    Operation &append(OpType type, const QString &target, const QList<qint32> &path);
+    void    diffAtelier   (Atelier *from, Atelier *to);
+    void    diffColumns   (const QString &atelier, const QList<qint32> &path,
+                           Atelier *from, Atelier *to, const QVector<int> &columns);
+    void    diffEntities  (const QString &atelier, const QList<qint32> &path,
+                           Atelier *from, Atelier *to, const QVector<int> &columns,
+                           bool sameColumns);
+    void    diffEntity    (const QString &atelier, const QList<qint32> &path,
+                           Atelier *parent, Atelier *from, Atelier *to,
+                           const QVector<int> &columns, bool sameColumns);
+    void    diffParameters(Exploitation *from, Exploitation *to);
+    void    diffRotation  (Rotation *from, Rotation *to);
+    void    diffSeries    (const QString &atelier, const QList<qint32> &path,
+                           Atelier *from, Atelier *to, const QVector<int> &columns,
+                           bool sameRows);
+    bool    applyOperation(Exploitation *exploitation, const Operation &op);
+    Atelier *findEntity   (Atelier *atelier, const QList<qint32> &path, int depth);
+private:
+    QList<Operation> mOperations;
+    QString          mError;
+    // Lookup tables, only valid during apply()
+    QHash<QString, Atelier *>  mAteliers;
+    QHash<QString, Rotation *> mRotations;
+};
+
+#endif // PATCH_H
@@ -0,0 +1,347 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QFile>
+#include <QStringList>
+#include "reader.h"
+
+/*
+ * A scenario file describes one Exploitation :
+ *
+ * <exploitation>
+ *   <parameter name="PrixBle" value="180"/>
+ *   <rotation name="Culture Bio" duration="3">
+ *     <plan name="Blé" position="1"/>
+ *   </rotation>
+ *   <atelier name="Grande culture">
+ *     <parameter name="Surface" value="42" mandatory="true"/>
+ *     <parameter name="Nombre" value="0" type="integer"/>
+ *     <parameter name="Rendement" formula="Surface * PrixBle * 0.8"/>
+ *     <entity name="Champ #1" rotation="Culture Bio" values="16"/>
+ *   </atelier>
+ * </exploitation>
+ *
+ * Entity values are listed in the same order than the Atelier parameters.
+ * Formulas are computed once the whole file is read, so they may use global
+ * parameters declared after the Atelier.
+ * The optional type of a parameter selects his storage : "double" (the
+ * default), "float", "integer", "boolean" or "enum".
+ */
+
+/**
+ * @brief Default constructor for an Exploitation reader
+ *
+ * @param exploitation Pointer to the Exploitation to fill
+ */
+ExploitationReader::ExploitationReader(Exploitation *exploitation)
+{
+    mExploitation = exploitation;
+}
+
+/**
+ * @brief Default destructor
+ *
+ */
+ExploitationReader::~ExploitationReader()
+{
+    // Nothing to do
+}
+
+/**
+ * @brief Get a description of the last error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString ExploitationReader::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Load an Exploitation from a scenario file
+ *
+ * @param filename Name of the file to read
+ * @return boolean True on success
+ */
+bool ExploitationReader::read(const QString &filename)
+{
+    QFile file(filename);
+    if ( ! file.open(QIODevice::ReadOnly))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    return read(&file);
+}
+
+/**
+ * @brief Load an Exploitation from an already opened device
+ *
+ * @param device Pointer to the device to read
+ * @return boolean True on success
+ */
+bool ExploitationReader::read(QIODevice *device)
+{
+    mError.clear();
+    mFormulas.clear();
+    mRotations.clear();
+
+    if (mExploitation == 0)
+    {
+        mError = "No Exploitation to fill";
+        return false;
+    }
+
+    // Rotations already into the Exploitation may be used too
+    for (uint i = 0; i < mExploitation->countRotation(); ++i)
+    {
+        Rotation *rot = mExploitation->getRotation(i);
+        if ( ! mRotations.contains(rot->getName()))
+            mRotations.insert(rot->getName(), rot);
+    }
+
+    mXml.setDevice(device);
+
+    if (mXml.readNextStartElement())
+    {
+        if (mXml.name() == "exploitation")
+        {
+            while (mXml.readNextStartElement())
+            {
+                if (mXml.name() == "parameter")
+                    readParameter();
+                else if (mXml.name() == "rotation")
+                    readRotation();
+                else if (mXml.name() == "atelier")
+                {
+                    QString name = mXml.attributes().value("name").toString();
+                    Atelier *atelier = mExploitation->createAtelier(name);
+                    if (atelier == 0)
+                        mXml.raiseError("Atelier without name");
+                    else
+                        readAtelier(atelier);
+                }
+                else
+                    mXml.skipCurrentElement();
+                updateProgress();
+            }
+        }
+        else
+            mXml.raiseError("Not an exploitation file");
+    }
+
+    if ( ! mXml.hasError())
+        applyFormulas();
+
+    if (mXml.hasError())
+    {
+        mError = QString("line %1: %2").arg(mXml.lineNumber())
+                                       .arg(mXml.errorString());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Set the formulas of the derived parameters read from the file
+ *
+ */
+void ExploitationReader::applyFormulas(void)
+{
+    for (int i = 0; i < mFormulas.count(); ++i)
+    {
+        const Formula &formula = mFormulas.at(i);
+        if ( ! formula.atelier->setParameterFormula(formula.index, formula.text))
+        {
+            mXml.raiseError(QString("Invalid formula for parameter \"%1\"")
+                                .arg(formula.atelier->getParameterName(formula.index)));
+            break;
+        }
+    }
+    mFormulas.clear();
+}
+
+/**
+ * @brief Read the content of an "atelier" element
+ *
+ * @param atelier Pointer to the Atelier to fill
+ */
+void ExploitationReader::readAtelier(Atelier *atelier)
+{
+    while (mXml.readNextStartElement())
+    {
+        if (mXml.name() == "parameter")
+        {
+            QXmlStreamAttributes attr = mXml.attributes();
+            atelier->addParameter(attr.value("name").toString(),
+                                  attr.value("value").toDouble());
+            if (attr.hasAttribute("formula"))
+            {
+                // Derived parameter, computed from other parameters (later)
+                Formula formula;
+                formula.atelier = atelier;
+                formula.index   = atelier->countParameter() - 1;
+                formula.text    = attr.value("formula").toString();
+                mFormulas.append(formula);
+            }
+            if (attr.value("mandatory") == "true")
+                atelier->setParameterMandatory(atelier->countParameter() - 1);
+            if (attr.hasAttribute("type"))
+            {
+                AtelierColumn::Kind kind;
+                if ( ! AtelierColumn::kindFromName(attr.value("type").toString(), kind))
+                {
+                    mXml.raiseError(QString("Unknown type \"%1\" for parameter \"%2\"")
+                                        .arg(attr.value("type").toString())
+                                        .arg(attr.value("name").toString()));
+                    return;
+                }
+                atelier->setParameterKind(atelier->countParameter() - 1, kind);
+            }
+            mXml.skipCurrentElement();
+        }
+        else if (mXml.name() == "entity")
+            readEntity(atelier);
+        else
+            mXml.skipCurrentElement();
+    }
+}
+
+/**
+ * @brief Read an "entity" element and insert it into an Atelier
+ *
+ * @param atelier Pointer to the parent Atelier (or entity)
+ */
+void ExploitationReader::readEntity(Atelier *atelier)
+{
+    QXmlStreamAttributes attr = mXml.attributes();
+
+    Atelier *entity = atelier->addEntity();
+    entity->setName( attr.value("name").toString() );
+
+    // Search the Rotation used by this entity (if any)
+    QString rotName = attr.value("rotation").toString();
+    if ( ! rotName.isEmpty())
+    {
+        Rotation *rot = findRotation(rotName);
+        if (rot == 0)
+        {
+            mXml.raiseError(QString("Unknown rotation \"%1\"").arg(rotName));
+            return;
+        }
+        entity->setRotation(rot);
+    }
+
+    // Load parameters values
+    QStringList values = attr.value("values").toString()
+                             .split(' ', QString::SkipEmptyParts);
+    int count = qMin(values.count(), entity->countParameter());
+    for (int i = 0; i < count; ++i)
+    {
+        if ( ! entity->setParameterValue(i, values.at(i).toDouble()))
+        {
+            mXml.raiseError(QString("Too many distinct values for enum parameter \"%1\"")
+                            .arg(entity->getParameterName(i)));
+            return;
+        }
+    }
+
+    // An entity may hold sub-entities
+    while (mXml.readNextStartElement())
+    {
+        if (mXml.name() == "entity")
+            readEntity(entity);
+        else
+            mXml.skipCurrentElement();
+    }
+    updateProgress();
+}
+
+/**
+ * @brief Read a global "parameter" element
+ *
+ */
+void ExploitationReader::readParameter(void)
+{
+    QXmlStreamAttributes attr = mXml.attributes();
+    // Also computes again the derived parameters that use it
+    mExploitation->setParameter(attr.value("name").toString(),
+                                attr.value("value").toDouble());
+    mXml.skipCurrentElement();
+}
+
+/**
+ * @brief Read a "rotation" element and its activity plans
+ *
+ */
+void ExploitationReader::readRotation(void)
+{
+    QXmlStreamAttributes attr = mXml.attributes();
+
+    Rotation *rot = mExploitation->createRotation(attr.value("name").toString(),
+                                                  attr.value("duration").toULong());
+    if (rot == 0)
+    {
+        mXml.raiseError("Rotation without name");
+        return;
+    }
+    // With the same name, the first Rotation is used
+    if ( ! mRotations.contains(rot->getName()))
+        mRotations.insert(rot->getName(), rot);
+
+    while (mXml.readNextStartElement())
+    {
+        if (mXml.name() == "plan")
+        {
+            QXmlStreamAttributes planAttr = mXml.attributes();
+            rot->addPlan(planAttr.value("position").toULong(),
+                         planAttr.value("name").toString());
+        }
+        mXml.skipCurrentElement();
+    }
+}
+
+/**
+ * @brief Called periodically while the file is read
+ *
+ * The default implementation does nothing, a sub-class can override it to
+ * report the progress of a long load.
+ *
+ * @param position Number of bytes already read
+ * @param size     Size of the input device (0 if unknown, sequential device)
+ */
+void ExploitationReader::progress(qint64 position, qint64 size)
+{
+    (void)position;
+    (void)size;
+}
+
+/**
+ * @brief Report the current position into the input device
+ *
+ */
+void ExploitationReader::updateProgress(void)
+{
+    QIODevice *device = mXml.device();
+    if (device == 0)
+        return;
+    if (device->isSequential())
+        progress(device->pos(), 0);
+    else
+        progress(device->pos(), device->size());
+}
+
+/**
+ * @brief Search a Rotation of the Exploitation by his name
+ *
+ * @param name Name of the requested Rotation
+ * @return Pointer to the Rotation (or NULL if not found)
+ */
+Rotation *ExploitationReader::findRotation(const QString &name)
+{
+    return mRotations.value(name, 0);
+}
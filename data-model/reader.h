@@ -0,0 +1,53 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef READER_H
+#define READER_H
+
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QXmlStreamReader>
+#include "exploitation.h"
+
+class ExploitationReader
+{
+public:
+    explicit ExploitationReader(Exploitation *exploitation);
+    virtual ~ExploitationReader();
+    QString errorString(void);
+    bool    read(QIODevice *device);
+    bool    read(const QString &filename);
+protected:
+    virtual void progress(qint64 position, qint64 size);
+private:
+    void updateProgress(void);
+    void applyFormulas(void);
+    void readAtelier  (Atelier *atelier);
+    void readEntity   (Atelier *atelier);
+    void readParameter(void);
+    void readRotation (void);
+    Rotation *findRotation(const QString &name);
+private:
+    // Formula of a derived parameter, set once the whole file is read
+    struct Formula
+    {
+        Atelier *atelier;
+        int      index;
+        QString  text;
+    };
+private:
+    Exploitation    *mExploitation;
+    QXmlStreamReader mXml;
+    QString          mError;
+    QList<Formula>   mFormulas;
+    // Rotations by name, for the entities that use them
+    QHash<QString, Rotation *> mRotations;
+};
+
+#endif // READER_H
@@ -6,6 +6,8 @@
  * Copyright (c) 2016 Agilack
  */
 #include "atelier.h"
+#include "hash.h"
+#include "instrument.h"
 #include "rotation.h"
 
 /**
@@ -14,8 +16,11 @@
  */
 Rotation::Rotation(const QString &name, ulong duration)
 {
+    mId       = 0;
     mDuration = duration;
     mName     = name;
+    mHash     = 0;
+    mHashValid = false;
 }
 
 /**
@@ -24,7 +29,13 @@ Rotation::Rotation(const QString &name, ulong duration)
  */
 Rotation::~Rotation()
 {
-    // Nothing to do
+    // Entities that still use this Rotation must forget it
+    QSet<Atelier *>::iterator it;
+    for (it = mUsers.begin(); it != mUsers.end(); ++it)
+    {
+        (*it)->mRotation = 0;
+        (*it)->invalidateHash();
+    }
 }
 
 /**
@@ -36,12 +47,16 @@ Rotation::~Rotation()
  */
 ActivityPlan *Rotation::addPlan(ulong position, const QString &name)
 {
+    INSTRUMENT_CALL("Rotation::addPlan");
+    INSTRUMENT_ALLOC(1);
+
     // Create a new ActivityPlan
     ActivityPlan *newPlan = new ActivityPlan(this);
     newPlan->setName(name);
     newPlan->setPosition(position);
     // Insert it to the current Rotation
     mPlans.push_back(newPlan);
+    invalidateHash();
     // ... and return it
     return newPlan;
 }
@@ -67,6 +82,16 @@ uint Rotation::countPlans(void)
     return mPlans.count();
 }
 
+/**
+ * @brief Get the number of entities that use this Rotation
+ *
+ * @return Number of entities
+ */
+int Rotation::countUsers(void)
+{
+    return mUsers.count();
+}
+
 /**
  * @brief Get the Rotation duration
  *
@@ -77,6 +102,48 @@ ulong Rotation::getDuration(void)
     return mDuration;
 }
 
+/**
+ * @brief Get the content hash of this Rotation
+ *
+ * The hash covers the name, the duration and the plans (in order). It is
+ * computed again only after a modification.
+ *
+ * @return quint64 Hash of the Rotation content
+ */
+quint64 Rotation::getHash(void)
+{
+    if (mHashValid)
+        return mHash;
+
+    INSTRUMENT_CALL("Rotation::getHash");
+
+    quint64 hash = ContentHash::combine(ContentHash::SeedRotation,
+                                        ContentHash::fromString(mName));
+    hash = ContentHash::combine(hash, mDuration);
+    for (int i = 0; i < mPlans.count(); ++i)
+    {
+        ActivityPlan *plan = mPlans.at(i);
+        quint64 planHash = ContentHash::combine(ContentHash::SeedPlan,
+                                                ContentHash::fromString(plan->mName));
+        planHash = ContentHash::combine(planHash, plan->mPosition);
+        hash = ContentHash::combine(hash, planHash);
+    }
+
+    mHash      = hash;
+    mHashValid = true;
+    return mHash;
+}
+
+/**
+ * @brief Get the Rotation identifier (unique into his Exploitation)
+ *
+ * @return uint Identifier, 0 if the rotation is not into an Exploitation
+ */
+uint Rotation::getId(void)
+{
+    return mId;
+}
+
 /**
  * @brief Get the Rotation name
  *
@@ -95,12 +162,43 @@ const QString &Rotation::getName(void)
  */
 ActivityPlan *Rotation::getPlan(int index)
 {
+    INSTRUMENT_CALL("Rotation::getPlan");
+
     if (index > (mPlans.count() - 1))
         return 0;
 
     return mPlans.at(index);
 }
 
+/**
+ * @brief Get the entities that use this Rotation
+ *
+ * @return List of entities (in no particular order)
+ */
+QList<Atelier *> Rotation::getUsers(void)
+{
+    return mUsers.toList();
+}
+
+/**
+ * @brief Add the memory used by this Rotation and his plans to an estimation
+ *
+ * @param usage Reference to the estimation
+ */
+void Rotation::memoryUsage(MemoryUsage &usage)
+{
+    qint64 bytes = sizeof(Rotation)
+                 + MemoryUsage::listBytes(mPlans.count())
+                 + (mPlans.count() * sizeof(ActivityPlan))
+                 + MemoryUsage::hashBytes(mUsers.count(), sizeof(Atelier *));
+    usage.add(MemoryUsage::CategoryRotations, bytes);
+
+    qint64 strings = MemoryUsage::stringBytes(mName);
+    for (int i = 0; i < mPlans.count(); i++)
+        strings += MemoryUsage::stringBytes(mPlans.at(i)->mName);
+    usage.add(MemoryUsage::CategoryStrings, strings);
+}
+
 /**
  * @brief Remove one activity plan from Rotation
  *
@@ -108,6 +206,8 @@ ActivityPlan *Rotation::getPlan(int index)
  */
 bool Rotation::removePlan(ActivityPlan *plan)
 {
+    INSTRUMENT_CALL("Rotation::removePlan");
+
     bool result = false;
 
     for (int i = 0; i < mPlans.size(); ++i)
@@ -118,6 +218,7 @@ bool Rotation::removePlan(ActivityPlan *plan)
             mPlans.removeAt(i);
             // Delete it
             delete plan;
+            invalidateHash();
 
             result = true;
             break;
@@ -133,6 +234,8 @@ bool Rotation::removePlan(ActivityPlan *plan)
  */
 bool Rotation::removePlan(int index)
 {
+    INSTRUMENT_CALL("Rotation::removePlan");
+
     if (index > (mPlans.count() - 1))
         return false;
 
@@ -140,6 +243,7 @@ bool Rotation::removePlan(int index)
     ActivityPlan *p = mPlans.takeAt(index);
     // Delete it
     delete p;
+    invalidateHash();
 
     return true;
 }
@@ -152,6 +256,22 @@ bool Rotation::removePlan(int index)
 void Rotation::setDuration(ulong duration)
 {
     mDuration = duration;
+    invalidateHash();
+}
+
+/**
+ * @brief Mark the content hash as modified
+ *
+ * The hash of an entity contains the hash of his Rotation, so the entities
+ * that use it are marked too.
+ */
+void Rotation::invalidateHash(void)
+{
+    mHashValid = false;
+
+    QSet<Atelier *>::iterator it;
+    for (it = mUsers.begin(); it != mUsers.end(); ++it)
+        (*it)->invalidateHash();
 }
 
 /**
@@ -162,13 +282,15 @@ void Rotation::setDuration(ulong duration)
 void Rotation::setName(const QString &name)
 {
     mName = name;
+    invalidateHash();
 }
 
 // -------------------- Activity Plans --------------------
 
 ActivityPlan::ActivityPlan(Rotation *parent)
 {
-    mParent = parent;
+    mParent   = parent;
+    mPosition = 0;
 }
 
 QString ActivityPlan::getName(void)
@@ -181,6 +303,25 @@ ulong ActivityPlan::getPosition(void)
     return mPosition;
 }
 
+/**
+ * @brief Test if the plan is performed during a year
+ *
+ * A plan is repeated every "duration" years of his Rotation, at the same
+ * year of the cycle as his position : the years before the position are
+ * active too, the cycle has no start. When the Rotation has no duration,
+ * the plan is only performed the year of his position.
+ *
+ * @param year Year to test (counted from 1)
+ * @return boolean True if the plan is performed this year
+ */
+bool ActivityPlan::isActive(ulong year)
+{
+    ulong duration = mParent ? mParent->getDuration() : 0;
+    if (duration == 0)
+        return (year == mPosition);
+    return ((year % duration) == (mPosition % duration));
+}
+
 Rotation *ActivityPlan::parent(void)
 {
     return mParent;
@@ -189,9 +330,13 @@ Rotation *ActivityPlan::parent(void)
 void ActivityPlan::setName(const QString &name)
 {
     mName = name;
+    if (mParent)
+        mParent->invalidateHash();
 }
 
 void ActivityPlan::setPosition(ulong position)
 {
     mPosition = position;
+    if (mParent)
+        mParent->invalidateHash();
 }
@@ -9,10 +9,13 @@
 #define ROTATION_H
 
 #include <QList>
+#include <QSet>
 #include <QString>
 #include <QtGlobal>
+#include "memoryusage.h"
 
 class ActivityPlan;
+class Atelier;
 
 class Rotation
 {
@@ -22,17 +25,32 @@ public:
     ActivityPlan *addPlan(ulong position, const QString &name);
     ActivityPlan *addPlan(ulong position);
     uint  countPlans(void);
+    int   countUsers(void);
     ulong getDuration(void);
+    quint64 getHash(void);
+    uint  getId(void);
     const QString &getName(void);
     ActivityPlan *getPlan(int index);
+    QList<Atelier *> getUsers(void);
+    void memoryUsage(MemoryUsage &usage);
     bool removePlan(ActivityPlan *plan);
     bool removePlan(int index);
     void setDuration(ulong duration);
     void setName(const QString &name);
 private:
+    void invalidateHash(void);
+private:
+    friend class ActivityPlan;
+    friend class Atelier;
+    friend class Exploitation;
+    uint    mId;
     QString mName;
     ulong   mDuration;
+    quint64 mHash;
+    bool    mHashValid;
     QList<ActivityPlan *> mPlans;
+    // Entities that use this Rotation (maintained by Atelier::setRotation)
+    QSet<Atelier *>       mUsers;
 };
 
 class ActivityPlan
@@ -41,10 +59,12 @@ public:
     explicit  ActivityPlan(Rotation *parent);
     QString   getName(void);
     ulong     getPosition(void);
+    bool      isActive(ulong year);
     Rotation *parent(void);
     void      setName(const QString &name);
     void      setPosition(ulong position);
 private:
+    friend class Rotation;
     Rotation *mParent;
     ulong     mPosition;
     QString   mName;
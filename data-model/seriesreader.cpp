@@ -0,0 +1,223 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QFile>
+#include <QTextStream>
+#include "seriesreader.h"
+
+/*
+ * A series file gives the values of some years of global parameters and
+ * of entity parameters. Fields are separated by tabulations :
+ *
+ * # Comment
+ * mode       linear
+ * parameter  PrixBle      2016=180  2017=175  2020=210
+ * entity     Grande culture  Champ #1  Rendement  2016=7.5  2017=6.9
+ *
+ * The mode (step or linear, see TimeSeries) applies to the following
+ * lines. The series are only stored when the whole file is valid, the
+ * series of one entity parameter are stored at once (see setEntitySeries).
+ */
+
+/**
+ * @brief Default constructor for a series reader
+ *
+ * @param exploitation Pointer to the Exploitation to fill
+ */
+SeriesReader::SeriesReader(Exploitation *exploitation)
+{
+    mExploitation = exploitation;
+    mMode         = TimeSeries::ModeStep;
+}
+
+/**
+ * @brief Get a description of the last error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString SeriesReader::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Load the series of a file
+ *
+ * @param filename Name of the file to read
+ * @return boolean True on success
+ */
+bool SeriesReader::read(const QString &filename)
+{
+    QFile file(filename);
+    if ( ! file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    return read(&file);
+}
+
+/**
+ * @brief Load the series of an already opened device
+ *
+ * @param device Pointer to the device to read
+ * @return boolean True on success
+ */
+bool SeriesReader::read(QIODevice *device)
+{
+    mError.clear();
+    mMode = TimeSeries::ModeStep;
+    mEntities.clear();
+
+    QList< QPair<Parameter *, TimeSeries> > globals;
+    QList<Pending> pending;
+    QHash<Atelier *, QHash<int, int> > pendingIndex;
+
+    QTextStream in(device);
+    int lineNumber = 0;
+    while ( ! in.atEnd())
+    {
+        QString line = in.readLine();
+        lineNumber++;
+        if (line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+            continue;
+
+        QStringList fields = line.split('\t', QString::SkipEmptyParts);
+        for (int i = 0; i < fields.count(); i++)
+            fields[i] = fields.at(i).trimmed();
+        QString keyword = fields.at(0);
+
+        if ((keyword == "mode") && (fields.count() == 2))
+        {
+            if ( ! TimeSeries::modeFromName(fields.at(1), mMode))
+                mError = QString("unknown mode %1").arg(fields.at(1));
+        }
+        else if ((keyword == "parameter") && (fields.count() > 2))
+        {
+            Parameter *param = mExploitation->getParameter(fields.at(1));
+            TimeSeries series;
+            if (param == 0)
+                mError = QString("unknown parameter %1").arg(fields.at(1));
+            else if (parsePoints(fields, 2, series))
+                globals.append(qMakePair(param, series));
+        }
+        else if ((keyword == "entity") && (fields.count() > 4))
+        {
+            Atelier *atelier = findAtelier(fields.at(1));
+            int row   = atelier ? findEntity(atelier, fields.at(2)) : -1;
+            int index = -1;
+            for (int i = 0; atelier && (i < atelier->countParameter()); i++)
+            {
+                if (atelier->getParameterName(i) == fields.at(3))
+                    index = i;
+            }
+            TimeSeries series;
+            if (atelier == 0)
+                mError = QString("unknown atelier %1").arg(fields.at(1));
+            else if (row < 0)
+                mError = QString("unknown entity %1").arg(fields.at(2));
+            else if (index < 0)
+                mError = QString("unknown parameter %1").arg(fields.at(3));
+            else if (parsePoints(fields, 4, series))
+            {
+                QHash<int, int> &indexes = pendingIndex[atelier];
+                if ( ! indexes.contains(index))
+                {
+                    Pending p;
+                    p.atelier = atelier;
+                    p.index   = index;
+                    indexes.insert(index, pending.count());
+                    pending.append(p);
+                }
+                Pending &p = pending[indexes.value(index)];
+                p.rows.append(row);
+                p.series.append(series);
+            }
+        }
+        else
+            mError = "invalid line";
+
+        if ( ! mError.isEmpty())
+        {
+            mError = QString("Line %1 : %2").arg(lineNumber).arg(mError);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < globals.count(); i++)
+        globals.at(i).first->setSeries(globals.at(i).second);
+    for (int i = 0; i < pending.count(); i++)
+    {
+        const Pending &p = pending.at(i);
+        p.atelier->setEntitySeries(p.index, p.rows, p.series);
+    }
+    return true;
+}
+
+/**
+ * @brief Search a top-level Atelier by name
+ *
+ * @param name Name of the Atelier
+ * @return Pointer to the Atelier (NULL if not found)
+ */
+Atelier *SeriesReader::findAtelier(const QString &name)
+{
+    for (uint i = 0; i < mExploitation->countAtelier(); i++)
+    {
+        Atelier *atelier = mExploitation->getAtelier(i);
+        if (atelier->getName() == name)
+            return atelier;
+    }
+    return 0;
+}
+
+/**
+ * @brief Search an entity of an Atelier by name
+ *
+ * @param atelier Pointer to the Atelier
+ * @param name    Name of the entity
+ * @return integer Row of the entity (-1 if not found)
+ */
+int SeriesReader::findEntity(Atelier *atelier, const QString &name)
+{
+    // Names of the entities are indexed at the first search
+    if ( ! mEntities.contains(atelier))
+    {
+        QHash<QString, int> &rows = mEntities[atelier];
+        for (int i = atelier->countEntity() - 1; i >= 0; i--)
+            rows.insert(atelier->getEntity(i)->getName(), i);
+    }
+    return mEntities[atelier].value(name, -1);
+}
+
+/**
+ * @brief Make a series from "year=value" fields
+ *
+ * @param fields List of the fields of the line
+ * @param first  Index of the first point
+ * @param series Reference to the series to fill
+ * @return boolean False if a point is invalid (see mError)
+ */
+bool SeriesReader::parsePoints(const QStringList &fields, int first, TimeSeries &series)
+{
+    QVector<int>    years;
+    QVector<double> values;
+    for (int i = first; i < fields.count(); i++)
+    {
+        bool validYear, validValue;
+        int    year  = fields.at(i).section('=', 0, 0).toInt(&validYear);
+        double value = fields.at(i).section('=', 1).toDouble(&validValue);
+        if ( ! (validYear && validValue))
+        {
+            mError = QString("invalid point \"%1\"").arg(fields.at(i));
+            return false;
+        }
+        years.append(year);
+        values.append(value);
+    }
+    return series.setPoints(years, values, mMode);
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef SERIESREADER_H
+#define SERIESREADER_H
+
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include "exploitation.h"
+#include "timeseries.h"
+
+class SeriesReader
+{
+public:
+    explicit SeriesReader(Exploitation *exploitation);
+    QString errorString(void);
+    bool    read(QIODevice *device);
+    bool    read(const QString &filename);
+private:
+    // Series of one parameter of the entities of one Atelier
+    struct Pending
+    {
+        Atelier *atelier;
+        int      index;
+        QVector<int>        rows;
+        QVector<TimeSeries> series;
+    };
+    Atelier *findAtelier(const QString &name);
+    int      findEntity (Atelier *atelier, const QString &name);
+    bool     parsePoints(const QStringList &fields, int first, TimeSeries &series);
+private:
+    Exploitation    *mExploitation;
+    TimeSeries::Mode mMode;
+    QString          mError;
+    // Row of the entities of each Atelier, by name
+    QHash<Atelier *, QHash<QString, int> > mEntities;
+};
+
+#endif // SERIESREADER_H
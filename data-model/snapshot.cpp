@@ -0,0 +1,400 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QHash>
+#include <QMutexLocker>
+#include "instrument.h"
+#include "snapshot.h"
+
+// -------------------- Atelier --------------------
+
+int SnapshotAtelier::countEntity(void) const
+{
+    return mEntityNames.count();
+}
+
+int SnapshotAtelier::countParameter(void) const
+{
+    return mParameterNames.count();
+}
+
+const QString &SnapshotAtelier::getEntityName(int entity) const
+{
+    return mEntityNames.at(entity);
+}
+
+/**
+ * @brief Get the Rotation used by an entity
+ *
+ * @param entity Index of the entity
+ * @return integer Index of the Rotation into the snapshot (-1 for none)
+ */
+int SnapshotAtelier::getEntityRotation(int entity) const
+{
+    return mRotations.at(entity);
+}
+
+const QString &SnapshotAtelier::getName(void) const
+{
+    return mName;
+}
+
+const QString &SnapshotAtelier::getParameterName(int index) const
+{
+    return mParameterNames.at(index);
+}
+
+double SnapshotAtelier::getValue(int entity, int index) const
+{
+    return mValues.at((entity * mParameterNames.count()) + index);
+}
+
+// -------------------- Rotation --------------------
+
+int SnapshotRotation::countPlans(void) const
+{
+    return mPlanNames.count();
+}
+
+ulong SnapshotRotation::getDuration(void) const
+{
+    return mDuration;
+}
+
+const QString &SnapshotRotation::getName(void) const
+{
+    return mName;
+}
+
+const QString &SnapshotRotation::getPlanName(int index) const
+{
+    return mPlanNames.at(index);
+}
+
+ulong SnapshotRotation::getPlanPosition(int index) const
+{
+    return mPlanPositions.at(index);
+}
+
+// -------------------- Exploitation --------------------
+
+/**
+ * @brief Copy the current content of an Exploitation
+ *
+ * Must be called by the thread that modifies the Exploitation.
+ *
+ * @param exploitation Pointer to the source Exploitation
+ * @param version      Version number of this snapshot
+ */
+ExploitationSnapshot::ExploitationSnapshot(Exploitation *exploitation, quint64 version)
+{
+    INSTRUMENT_CALL("ExploitationSnapshot::ExploitationSnapshot");
+
+    mVersion = version;
+
+    // Copy global parameters
+    for (uint i = 0; i < exploitation->countParameter(); ++i)
+    {
+        Parameter *p = exploitation->getParameter(i);
+        mParameterNames.append(p->getName());
+        mParameterValues.append(p->getValue());
+    }
+
+    // Copy rotations (and keep their index for the entities)
+    QHash<Rotation *, int> rotIndex;
+    mRotations.resize(exploitation->countRotation());
+    for (uint i = 0; i < exploitation->countRotation(); ++i)
+    {
+        Rotation *rot = exploitation->getRotation(i);
+        SnapshotRotation &copy = mRotations[i];
+        copy.mName     = rot->getName();
+        copy.mDuration = rot->getDuration();
+        for (uint j = 0; j < rot->countPlans(); ++j)
+        {
+            ActivityPlan *plan = rot->getPlan(j);
+            copy.mPlanNames.append(plan->getName());
+            copy.mPlanPositions.append(plan->getPosition());
+        }
+        rotIndex.insert(rot, i);
+    }
+
+    // Copy ateliers, entity values are stored row by row
+    mAteliers.resize(exploitation->countAtelier());
+    for (uint i = 0; i < exploitation->countAtelier(); ++i)
+    {
+        Atelier *atelier = exploitation->getAtelier(i);
+        SnapshotAtelier &copy = mAteliers[i];
+        copy.mName = atelier->getName();
+
+        int paramCount  = atelier->countParameter();
+        int entityCount = atelier->countEntity();
+        for (int k = 0; k < paramCount; ++k)
+            copy.mParameterNames.append(atelier->getParameterName(k));
+
+        copy.mRotations.resize(entityCount);
+        copy.mValues.resize(entityCount * paramCount);
+        INSTRUMENT_ALLOC(entityCount);
+        double *values = copy.mValues.data();
+        for (int j = 0; j < entityCount; ++j)
+        {
+            Atelier *entity = atelier->getEntity(j);
+            copy.mEntityNames.append(entity->getName());
+            copy.mRotations[j] = rotIndex.value(entity->getRotation(), -1);
+            for (int k = 0; k < paramCount; ++k)
+                *values++ = entity->getParameterValue(k);
+        }
+    }
+}
+
+int ExploitationSnapshot::countAtelier(void) const
+{
+    return mAteliers.count();
+}
+
+int ExploitationSnapshot::countParameter(void) const
+{
+    return mParameterNames.count();
+}
+
+int ExploitationSnapshot::countRotation(void) const
+{
+    return mRotations.count();
+}
+
+const SnapshotAtelier &ExploitationSnapshot::getAtelier(int index) const
+{
+    return mAteliers.at(index);
+}
+
+const QString &ExploitationSnapshot::getParameterName(int index) const
+{
+    return mParameterNames.at(index);
+}
+
+double ExploitationSnapshot::getParameterValue(int index) const
+{
+    return mParameterValues.at(index);
+}
+
+/**
+ * @brief Get the value of a global parameter
+ *
+ * @param name Name of the parameter
+ * @return double Value of the parameter (0 if not found)
+ */
+double ExploitationSnapshot::getParameterValue(const QString &name) const
+{
+    int index = mParameterNames.indexOf(name);
+    if (index < 0)
+        return 0;
+    return mParameterValues.at(index);
+}
+
+const SnapshotRotation &ExploitationSnapshot::getRotation(int index) const
+{
+    return mRotations.at(index);
+}
+
+/**
+ * @brief Get the version number of this snapshot
+ *
+ * @return quint64 Version (incremented at each publish)
+ */
+quint64 ExploitationSnapshot::getVersion(void) const
+{
+    return mVersion;
+}
+
+// -------------------- Publisher --------------------
+
+/**
+ * @brief Default constructor, nothing is published yet
+ *
+ */
+SnapshotPublisher::SnapshotPublisher()
+{
+    mCurrent.store(0);
+    // Epoch 0 is reserved to mark an idle reader
+    mEpoch.store(1);
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; ++i)
+    {
+        mReaders[i].store(0);
+        mUsed[i].store(0);
+    }
+    mVersion = 0;
+}
+
+/**
+ * @brief Default destructor, all readers must have been released
+ *
+ */
+SnapshotPublisher::~SnapshotPublisher()
+{
+    delete mCurrent.load();
+    for (int i = 0; i < mRetired.count(); ++i)
+        delete mRetired.at(i).second;
+}
+
+/**
+ * @brief Get the current snapshot (called by a reader thread)
+ *
+ * The snapshot stays valid until release() is called for this reader.
+ * This never blocks : the reader only publishes the epoch it has seen.
+ *
+ * @param reader Reader slot (see registerReader)
+ * @return Pointer to the snapshot (NULL if nothing published yet)
+ */
+const ExploitationSnapshot *SnapshotPublisher::acquire(int reader)
+{
+    // Announce the epoch before reading the pointer (full barrier)
+    mReaders[reader].fetchAndStoreOrdered(mEpoch.loadAcquire());
+    return mCurrent.loadAcquire();
+}
+
+/**
+ * @brief Get the number of old snapshots not deleted yet
+ *
+ * @return integer Number of retired snapshots
+ */
+int SnapshotPublisher::countRetired(void)
+{
+    QMutexLocker locker(&mWriteLock);
+    return mRetired.count();
+}
+
+/**
+ * @brief Get the version of the last published snapshot
+ *
+ * @return quint64 Version number (0 if nothing published)
+ */
+quint64 SnapshotPublisher::getVersion(void)
+{
+    const ExploitationSnapshot *current = mCurrent.loadAcquire();
+    return current ? current->getVersion() : 0;
+}
+
+/**
+ * @brief Publish a new snapshot of an Exploitation
+ *
+ * Must be called by the thread that modifies the Exploitation. The
+ * previous snapshot is retired, and deleted once no reader uses it.
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return quint64 Version of the new snapshot
+ */
+quint64 SnapshotPublisher::publish(Exploitation *exploitation)
+{
+    INSTRUMENT_CALL("SnapshotPublisher::publish");
+
+    QMutexLocker locker(&mWriteLock);
+
+    mVersion++;
+    ExploitationSnapshot *snapshot = new ExploitationSnapshot(exploitation, mVersion);
+    INSTRUMENT_ALLOC(1);
+
+    const ExploitationSnapshot *old = mCurrent.fetchAndStoreOrdered(snapshot);
+    // Readers that have seen this epoch may still use the old snapshot
+    quint64 epoch = mEpoch.fetchAndAddOrdered(1);
+    if (old)
+        mRetired.append(qMakePair(epoch, old));
+
+    reclaim();
+
+    return mVersion;
+}
+
+/**
+ * @brief Delete the retired snapshots that no reader can use anymore
+ *
+ */
+void SnapshotPublisher::reclaim(void)
+{
+    // Search the oldest epoch announced by an active reader
+    quint64 oldest = 0;
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; ++i)
+    {
+        quint64 epoch = mReaders[i].loadAcquire();
+        if (epoch && ((oldest == 0) || (epoch < oldest)))
+            oldest = epoch;
+    }
+
+    // Retired before the oldest active epoch : nobody can hold it
+    int i = 0;
+    while (i < mRetired.count())
+    {
+        if ((oldest == 0) || (mRetired.at(i).first < oldest))
+        {
+            delete mRetired.at(i).second;
+            mRetired.removeAt(i);
+        }
+        else
+            i++;
+    }
+}
+
+/**
+ * @brief Allocate a reader slot (one per reader thread)
+ *
+ * @return integer Reader slot (-1 if all slots are used)
+ */
+int SnapshotPublisher::registerReader(void)
+{
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; ++i)
+    {
+        if (mUsed[i].testAndSetOrdered(0, 1))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Release the snapshot acquired by a reader
+ *
+ * @param reader Reader slot
+ */
+void SnapshotPublisher::release(int reader)
+{
+    mReaders[reader].storeRelease(0);
+}
+
+/**
+ * @brief Free a reader slot
+ *
+ * @param reader Reader slot
+ */
+void SnapshotPublisher::unregisterReader(int reader)
+{
+    if ((reader < 0) || (reader >= SNAPSHOT_MAX_READERS))
+        return;
+    release(reader);
+    mUsed[reader].storeRelease(0);
+}
+
+// -------------------- Guard --------------------
+
+/**
+ * @brief Acquire the current snapshot for the lifetime of the guard
+ *
+ * @param publisher Pointer to the snapshot publisher
+ * @param reader    Reader slot of the calling thread
+ */
+SnapshotGuard::SnapshotGuard(SnapshotPublisher *publisher, int reader)
+{
+    mPublisher = publisher;
+    mReader    = reader;
+    mSnapshot  = publisher->acquire(reader);
+}
+
+SnapshotGuard::~SnapshotGuard()
+{
+    mPublisher->release(mReader);
+}
+
+const ExploitationSnapshot *SnapshotGuard::get(void) const
+{
+    return mSnapshot;
+}
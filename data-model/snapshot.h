@@ -0,0 +1,126 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "exploitation.h"
+
+/*
+ * An ExploitationSnapshot is an immutable copy of an Exploitation, that can
+ * be read by any number of threads at the same time. Snapshots are created
+ * by a SnapshotPublisher : the thread that owns the Exploitation (GUI)
+ * publishes new versions while reader threads (simulations) keep using the
+ * version they have acquired. Readers never take a lock, old versions are
+ * deleted only when no reader can use them anymore (epoch based).
+ */
+
+class SnapshotAtelier
+{
+public:
+    int     countEntity   (void) const;
+    int     countParameter(void) const;
+    const QString &getEntityName(int entity) const;
+    int     getEntityRotation(int entity) const;
+    const QString &getName(void) const;
+    const QString &getParameterName(int index) const;
+    double  getValue(int entity, int index) const;
+private:
+    friend class ExploitationSnapshot;
+    QString         mName;
+    QStringList     mParameterNames;
+    QStringList     mEntityNames;
+    QVector<int>    mRotations;
+    QVector<double> mValues;
+};
+
+class SnapshotRotation
+{
+public:
+    int     countPlans(void) const;
+    ulong   getDuration(void) const;
+    const QString &getName(void) const;
+    const QString &getPlanName(int index) const;
+    ulong   getPlanPosition(int index) const;
+private:
+    friend class ExploitationSnapshot;
+    QString        mName;
+    ulong          mDuration;
+    QStringList    mPlanNames;
+    QVector<ulong> mPlanPositions;
+};
+
+class ExploitationSnapshot
+{
+public:
+    ExploitationSnapshot(Exploitation *exploitation, quint64 version);
+    int     countAtelier  (void) const;
+    int     countParameter(void) const;
+    int     countRotation (void) const;
+    const SnapshotAtelier  &getAtelier(int index) const;
+    const QString &getParameterName(int index) const;
+    double  getParameterValue(int index) const;
+    double  getParameterValue(const QString &name) const;
+    const SnapshotRotation &getRotation(int index) const;
+    quint64 getVersion(void) const;
+private:
+    quint64                   mVersion;
+    QStringList               mParameterNames;
+    QVector<double>           mParameterValues;
+    QVector<SnapshotAtelier>  mAteliers;
+    QVector<SnapshotRotation> mRotations;
+};
+
+#define SNAPSHOT_MAX_READERS 64
+
+class SnapshotPublisher
+{
+public:
+    SnapshotPublisher();
+    ~SnapshotPublisher();
+    const ExploitationSnapshot *acquire(int reader);
+    int     countRetired(void);
+    quint64 getVersion(void);
+    quint64 publish(Exploitation *exploitation);
+    int     registerReader(void);
+    void    release(int reader);
+    void    unregisterReader(int reader);
+private:
+    void    reclaim(void);
+private:
+    QAtomicPointer<const ExploitationSnapshot> mCurrent;
+    // Global epoch, and epoch of each reader (0 when idle)
+    QAtomicInteger<quint64> mEpoch;
+    QAtomicInteger<quint64> mReaders[SNAPSHOT_MAX_READERS];
+    QAtomicInt              mUsed[SNAPSHOT_MAX_READERS];
+    // Publish side only (never used by readers)
+    QMutex  mWriteLock;
+    quint64 mVersion;
+    QList< QPair<quint64, const ExploitationSnapshot *> > mRetired;
+};
+
+class SnapshotGuard
+{
+public:
+    SnapshotGuard(SnapshotPublisher *publisher, int reader);
+    ~SnapshotGuard();
+    const ExploitationSnapshot *get(void) const;
+private:
+    SnapshotPublisher          *mPublisher;
+    int                         mReader;
+    const ExploitationSnapshot *mSnapshot;
+};
+
+#endif // SNAPSHOT_H
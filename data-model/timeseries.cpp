@@ -0,0 +1,520 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QMap>
+#include <QtNumeric>
+#include <string.h>
+#include "hash.h"
+#include "memoryusage.h"
+#include "timeseries.h"
+
+// -------------------- Time series --------------------
+
+/**
+ * @brief Default constructor, an empty series
+ *
+ */
+TimeSeries::TimeSeries()
+{
+    mFirst = 0;
+}
+
+/**
+ * @brief Remove all the values
+ *
+ */
+void TimeSeries::clear(void)
+{
+    mFirst = 0;
+    mValues.clear();
+}
+
+/**
+ * @brief Get the number of years of the series
+ *
+ * @return integer Number of years (0 for an empty series)
+ */
+int TimeSeries::count(void) const
+{
+    return mValues.count();
+}
+
+/**
+ * @brief Get the first year with a value
+ *
+ * @return integer First year
+ */
+int TimeSeries::getFirstYear(void) const
+{
+    return mFirst;
+}
+
+/**
+ * @brief Get the last year with a value
+ *
+ * @return integer Last year (lower than the first one if empty)
+ */
+int TimeSeries::getLastYear(void) const
+{
+    return mFirst + mValues.count() - 1;
+}
+
+/**
+ * @brief Get the content hash of the series (years and values)
+ *
+ * @return quint64 Hash
+ */
+quint64 TimeSeries::getHash(void) const
+{
+    quint64 hash = ContentHash::combine(mFirst, mValues.count());
+    for (int i = 0; i < mValues.count(); i++)
+        hash = ContentHash::combine(hash, ContentHash::fromDouble(mValues.at(i)));
+    return hash;
+}
+
+/**
+ * @brief Test if the series has no value
+ *
+ * @return boolean True if empty
+ */
+bool TimeSeries::isEmpty(void) const
+{
+    return mValues.isEmpty();
+}
+
+/**
+ * @brief Get the memory used by the values of the series
+ *
+ * @return qint64 Number of bytes (without the object itself)
+ */
+qint64 TimeSeries::memoryUsage(void) const
+{
+    return MemoryUsage::vectorBytes(mValues);
+}
+
+/**
+ * @brief Make the series from the values of some years
+ *
+ * Years may be given in any order, the last value of a year is kept. The
+ * series then covers the years from the first to the last point.
+ *
+ * @param years  Years of the points
+ * @param values Values of the points (one per year)
+ * @param mode   Rule used for the years between two points
+ * @return boolean False if there is no point, or not one value per year
+ */
+bool TimeSeries::setPoints(const QVector<int> &years, const QVector<double> &values,
+                           Mode mode)
+{
+    if (years.isEmpty() || (years.count() != values.count()))
+        return false;
+
+    QMap<int, double> points;
+    for (int i = 0; i < years.count(); i++)
+        points.insert(years.at(i), values.at(i));
+
+    mFirst = points.firstKey();
+    mValues.resize(points.lastKey() - mFirst + 1);
+
+    QMap<int, double>::const_iterator it   = points.constBegin();
+    QMap<int, double>::const_iterator next = it;
+    ++next;
+    for (; next != points.constEnd(); it = next, ++next)
+    {
+        double *out = mValues.data() + (it.key() - mFirst);
+        int span = next.key() - it.key();
+        for (int y = 0; y < span; y++)
+        {
+            if (mode == ModeLinear)
+                out[y] = it.value() + ((next.value() - it.value()) * y / span);
+            else
+                out[y] = it.value();
+        }
+    }
+    mValues.last() = points.last();
+    return true;
+}
+
+/**
+ * @brief Set the values of all the years
+ *
+ * @param first  Year of the first value
+ * @param values Values, one for each year from the first one
+ */
+void TimeSeries::setValues(int first, const QVector<double> &values)
+{
+    mFirst  = first;
+    mValues = values;
+}
+
+/**
+ * @brief Copy the values of some consecutive years
+ *
+ * @param first  First year to copy
+ * @param count  Number of years
+ * @param output Pointer to the values (count values)
+ */
+void TimeSeries::slice(int first, int count, double *output) const
+{
+    if (mValues.isEmpty())
+    {
+        for (int i = 0; i < count; i++)
+            output[i] = qQNaN();
+        return;
+    }
+
+    // Years before the series, into the series, then after
+    int before = qBound(0, mFirst - first, count);
+    int start  = qMax(first, mFirst) - mFirst;
+    int inside = qBound(0, mValues.count() - start, count - before);
+    for (int i = 0; i < before; i++)
+        output[i] = mValues.first();
+    if (inside)
+        memcpy(output + before, mValues.constData() + start, inside * sizeof(double));
+    for (int i = before + inside; i < count; i++)
+        output[i] = mValues.last();
+}
+
+/**
+ * @brief Get the value of one year
+ *
+ * @param year Year
+ * @return double Value (NaN for an empty series)
+ */
+double TimeSeries::value(int year) const
+{
+    if (mValues.isEmpty())
+        return qQNaN();
+    return mValues.at(qBound(0, year - mFirst, mValues.count() - 1));
+}
+
+/**
+ * @brief Get the buffer of the values, from the first year
+ *
+ * @return Pointer to the values (see count)
+ */
+const double *TimeSeries::values(void) const
+{
+    return mValues.constData();
+}
+
+/**
+ * @brief Get an interpolation mode from his name
+ *
+ * @param name Name of the mode (step or linear)
+ * @param mode Reference to the mode
+ * @return boolean False if the name is unknown
+ */
+bool TimeSeries::modeFromName(const QString &name, Mode &mode)
+{
+    for (int i = 0; i < ModeLast; i++)
+    {
+        if (name.toLower() == modeName((Mode)i))
+        {
+            mode = (Mode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the name of an interpolation mode
+ *
+ * @param mode Interpolation mode
+ * @return QString Name of the mode
+ */
+QString TimeSeries::modeName(Mode mode)
+{
+    switch (mode)
+    {
+        case ModeStep:   return "step";
+        case ModeLinear: return "linear";
+        default:         return QString();
+    }
+}
+
+// -------------------- Table of series --------------------
+
+/**
+ * @brief Default constructor, a table without entity
+ *
+ * Until a series is set, the table has no year : each entity holds one
+ * value, used for all years.
+ */
+SeriesTable::SeriesTable()
+{
+    mFirst = 0;
+    mYears = 0;
+    mRows  = 0;
+}
+
+/**
+ * @brief Add an entity, with the same value for all years
+ *
+ * The buffer grows in place (see insert).
+ *
+ * @param value Value of the new entity
+ */
+void SeriesTable::append(double value)
+{
+    insert(mRows, value);
+}
+
+/**
+ * @brief Get the number of entities
+ *
+ * @return integer Number of entities
+ */
+int SeriesTable::count(void) const
+{
+    return mRows;
+}
+
+/**
+ * @brief Get the number of years of the table
+ *
+ * @return integer Number of years (0 until a series is set)
+ */
+int SeriesTable::countYears(void) const
+{
+    return mYears;
+}
+
+/**
+ * @brief Get the first year of the table
+ *
+ * @return integer First year
+ */
+int SeriesTable::getFirstYear(void) const
+{
+    return mFirst;
+}
+
+/**
+ * @brief Get the content hash of the series of one entity
+ *
+ * @param row Row of the entity
+ * @return quint64 Hash
+ */
+quint64 SeriesTable::getHash(int row) const
+{
+    return getSeries(row).getHash();
+}
+
+/**
+ * @brief Get the series of one entity
+ *
+ * @param row Row of the entity
+ * @return TimeSeries Values of the entity (one year if no series was set)
+ */
+TimeSeries SeriesTable::getSeries(int row) const
+{
+    TimeSeries series;
+    if ((row < 0) || (row >= mRows))
+        return series;
+
+    int years = qMax(mYears, 1);
+    QVector<double> values(years);
+    for (int y = 0; y < years; y++)
+        values[y] = mValues.at((y * mRows) + row);
+    series.setValues(mFirst, values);
+    return series;
+}
+
+/**
+ * @brief Insert an entity before one row, with the same value for all years
+ *
+ * The buffer grows in place : years are moved from the last one, so each
+ * value is copied once.
+ *
+ * @param row   Row of the new entity (count() to append it)
+ * @param value Value of the new entity
+ */
+void SeriesTable::insert(int row, double value)
+{
+    if ((row < 0) || (row > mRows))
+        return;
+
+    int years = qMax(mYears, 1);
+    mValues.resize(years * (mRows + 1));
+    double *data = mValues.data();
+    for (int y = years - 1; y >= 0; y--)
+    {
+        const double *src = data + (y * mRows);
+        double *dst = data + (y * (mRows + 1));
+        memmove(dst + row + 1, src + row, (mRows - row) * sizeof(double));
+        memmove(dst, src, row * sizeof(double));
+        dst[row] = value;
+    }
+    mRows++;
+}
+
+/**
+ * @brief Get the memory used by the table
+ *
+ * @return qint64 Number of bytes (object and values)
+ */
+qint64 SeriesTable::memoryUsage(void) const
+{
+    return sizeof(SeriesTable) + MemoryUsage::vectorBytes(mValues);
+}
+
+/**
+ * @brief Remove one entity
+ *
+ * The buffer shrinks in place : years are moved from the first one, so
+ * each value is copied once.
+ *
+ * @param row Row of the entity
+ */
+void SeriesTable::remove(int row)
+{
+    if ((row < 0) || (row >= mRows))
+        return;
+
+    int years = qMax(mYears, 1);
+    double *data = mValues.data();
+    for (int y = 0; y < years; y++)
+    {
+        const double *src = data + (y * mRows);
+        double *dst = data + (y * (mRows - 1));
+        memmove(dst, src, row * sizeof(double));
+        memmove(dst + row, src + row + 1, (mRows - row - 1) * sizeof(double));
+    }
+    mValues.resize(years * (mRows - 1));
+    mRows--;
+}
+
+/**
+ * @brief Reset the table, each entity with the same value for all years
+ *
+ * @param values Value of each entity
+ */
+void SeriesTable::reset(const QVector<double> &values)
+{
+    mFirst  = 0;
+    mYears  = 0;
+    mRows   = values.count();
+    mValues = values;
+}
+
+/**
+ * @brief Set the series of one entity
+ *
+ * @param row    Row of the entity
+ * @param series Values of the entity
+ * @return boolean False if the row or the series is invalid
+ */
+bool SeriesTable::setSeries(int row, const TimeSeries &series)
+{
+    return setSeries(QVector<int>(1, row), QVector<TimeSeries>(1, series));
+}
+
+/**
+ * @brief Set the series of some entities
+ *
+ * The years of the table grow once for all the series.
+ *
+ * @param rows   Rows of the entities
+ * @param series Values of each entity
+ * @return boolean False if a row or a series is invalid (nothing is set)
+ */
+bool SeriesTable::setSeries(const QVector<int> &rows, const QVector<TimeSeries> &series)
+{
+    if (rows.isEmpty() || (rows.count() != series.count()))
+        return false;
+
+    int first = mFirst;
+    int last  = mFirst + mYears - 1;
+    for (int i = 0; i < rows.count(); i++)
+    {
+        if ((rows.at(i) < 0) || (rows.at(i) >= mRows) || series.at(i).isEmpty())
+            return false;
+        if ((mYears == 0) && (i == 0))
+        {
+            first = series.at(i).getFirstYear();
+            last  = series.at(i).getLastYear();
+        }
+        first = qMin(first, series.at(i).getFirstYear());
+        last  = qMax(last,  series.at(i).getLastYear());
+    }
+    extend(first, last);
+
+    QVector<double> values(mYears);
+    for (int i = 0; i < rows.count(); i++)
+    {
+        series.at(i).slice(mFirst, mYears, values.data());
+        double *out = mValues.data() + rows.at(i);
+        for (int y = 0; y < mYears; y++)
+            out[y * mRows] = values.at(y);
+    }
+    return true;
+}
+
+/**
+ * @brief Get the values of all entities for one year
+ *
+ * @param year Year
+ * @return Pointer to the values (one per entity, see count)
+ */
+const double *SeriesTable::slice(int year) const
+{
+    return mValues.constData() + (yearOffset(year) * mRows);
+}
+
+/**
+ * @brief Get the value of one entity for one year
+ *
+ * @param row  Row of the entity
+ * @param year Year
+ * @return double Value (NaN if the row is invalid)
+ */
+double SeriesTable::value(int row, int year) const
+{
+    if ((row < 0) || (row >= mRows))
+        return qQNaN();
+    return mValues.at((yearOffset(year) * mRows) + row);
+}
+
+/**
+ * @brief Grow the years of the table
+ *
+ * Entities keep their first (last) value on the years added before (after).
+ *
+ * @param first New first year
+ * @param last  New last year
+ */
+void SeriesTable::extend(int first, int last)
+{
+    int years = last - first + 1;
+    if ((mYears != 0) && (first == mFirst) && (years == mYears))
+        return;
+
+    QVector<double> values(years * mRows);
+    for (int y = 0; y < years; y++)
+    {
+        const double *src = mValues.constData() + (yearOffset(first + y) * mRows);
+        memcpy(values.data() + (y * mRows), src, mRows * sizeof(double));
+    }
+    mValues = values;
+    mFirst  = first;
+    mYears  = years;
+}
+
+/**
+ * @brief Get the position of a year into the table
+ *
+ * @param year Year
+ * @return integer Offset of the year (the nearest one outside the table)
+ */
+int SeriesTable::yearOffset(int year) const
+{
+    if (mYears == 0)
+        return 0;
+    return qBound(0, year - mFirst, mYears - 1);
+}
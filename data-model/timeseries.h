@@ -0,0 +1,91 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+/*
+ * A TimeSeries holds one value per year, from a first to a last year, into
+ * a contiguous buffer. Before the first year (after the last one) the value
+ * is the one of the first (last) year.
+ *
+ * A series is usually made from some known years (see setPoints) : years
+ * between two points hold the value of the previous point (ModeStep) or a
+ * linear interpolation of the two points (ModeLinear).
+ */
+class TimeSeries
+{
+public:
+    enum Mode {
+        ModeStep,
+        ModeLinear,
+        ModeLast
+    };
+public:
+    TimeSeries();
+    void    clear(void);
+    int     count(void) const;
+    int     getFirstYear(void) const;
+    int     getLastYear (void) const;
+    quint64 getHash(void) const;
+    bool    isEmpty(void) const;
+    qint64  memoryUsage(void) const;
+    bool    setPoints(const QVector<int> &years, const QVector<double> &values,
+                      Mode mode = ModeStep);
+    void    setValues(int first, const QVector<double> &values);
+    void    slice(int first, int count, double *output) const;
+    double  value(int year) const;
+    const double *values(void) const;
+    static bool    modeFromName(const QString &name, Mode &mode);
+    static QString modeName    (Mode mode);
+private:
+    int             mFirst;
+    QVector<double> mValues;
+};
+
+/*
+ * A SeriesTable holds a time series of one parameter for all the entities
+ * of an Atelier. All series share the same years, and the buffer is stored
+ * year by year : the values of all entities for one year are contiguous, so
+ * a simulation loop reads one year with a single pointer (see slice).
+ *
+ * The years of the table grow when a longer series is set, the other
+ * entities then keep their first (last) value on the new years.
+ */
+class SeriesTable
+{
+public:
+    SeriesTable();
+    void    append(double value);
+    int     count (void) const;
+    int     countYears  (void) const;
+    int     getFirstYear(void) const;
+    quint64 getHash  (int row) const;
+    TimeSeries getSeries(int row) const;
+    void    insert(int row, double value);
+    qint64  memoryUsage(void) const;
+    void    remove(int row);
+    void    reset (const QVector<double> &values);
+    bool    setSeries(int row, const TimeSeries &series);
+    bool    setSeries(const QVector<int> &rows, const QVector<TimeSeries> &series);
+    const double *slice(int year) const;
+    double  value(int row, int year) const;
+private:
+    void    extend(int first, int last);
+    int     yearOffset(int year) const;
+private:
+    int     mFirst;
+    int     mYears;
+    int     mRows;
+    QVector<double> mValues;
+};
+
+#endif // TIMESERIES_H
@@ -0,0 +1,196 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include "trace.h"
+
+// Maximum number of events kept in memory (the oldest events are replaced)
+#define TRACE_MAX_EVENTS (1024 * 1024)
+
+struct TraceEvent
+{
+    const char *name;
+    qint64      start;
+    qint64      duration;
+    int         thread;
+};
+
+static QVector<TraceEvent>      traceEvents;
+static QHash<Qt::HANDLE, int>   traceThreads;
+static QMutex                   traceLock;
+static int                      traceDropped = 0;
+// Once full, the events are a ring : position of the oldest one
+static int                      traceOldest  = 0;
+
+static QElapsedTimer startTimer(void)
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+/**
+ * @brief Start a new span
+ *
+ * @param name Static string used as span name
+ */
+TraceSpan::TraceSpan(const char *name)
+{
+    mName  = name;
+    mStart = Trace::timestamp();
+}
+
+/**
+ * @brief End of span, record it
+ *
+ */
+TraceSpan::~TraceSpan()
+{
+    Trace::record(mName, mStart, Trace::timestamp() - mStart);
+}
+
+// -------------------- Trace --------------------
+
+/**
+ * @brief Remove all recorded events
+ *
+ */
+void Trace::clear(void)
+{
+    QMutexLocker locker(&traceLock);
+    traceEvents.clear();
+    traceDropped = 0;
+    traceOldest  = 0;
+}
+
+/**
+ * @brief Get the number of recorded events
+ *
+ * @return integer Number of events
+ */
+int Trace::count(void)
+{
+    QMutexLocker locker(&traceLock);
+    return traceEvents.count();
+}
+
+/**
+ * @brief Test if the application has been built with trace spans
+ *
+ * @return boolean True if spans are recorded
+ */
+bool Trace::isEnabled(void)
+{
+#ifdef VLE_EA_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Record one complete event
+ *
+ * When TRACE_MAX_EVENTS are recorded, the new event replaces the oldest
+ * one : the last stalls before a save are always kept.
+ *
+ * @param name     Static string used as event name
+ * @param start    Start time of the event (in nanoseconds, see timestamp)
+ * @param duration Duration of the event (in nanoseconds)
+ */
+void Trace::record(const char *name, qint64 start, qint64 duration)
+{
+    Qt::HANDLE threadId = QThread::currentThreadId();
+
+    QMutexLocker locker(&traceLock);
+
+    // Use small thread numbers, easier to read into trace viewers
+    QHash<Qt::HANDLE, int>::const_iterator it = traceThreads.constFind(threadId);
+    int thread;
+    if (it == traceThreads.constEnd())
+    {
+        thread = traceThreads.count() + 1;
+        traceThreads.insert(threadId, thread);
+    }
+    else
+        thread = it.value();
+
+    TraceEvent event;
+    event.name     = name;
+    event.start    = start;
+    event.duration = duration;
+    event.thread   = thread;
+
+    if (traceEvents.count() < TRACE_MAX_EVENTS)
+    {
+        traceEvents.append(event);
+        return;
+    }
+    traceEvents[traceOldest] = event;
+    traceOldest = (traceOldest + 1) % TRACE_MAX_EVENTS;
+    traceDropped++;
+}
+
+/**
+ * @brief Save all recorded events as a Chrome trace-event JSON file
+ *
+ * @param filename Name of the file to write
+ * @return boolean True on success
+ */
+bool Trace::save(const QString &filename)
+{
+    QFile file(filename);
+    if ( ! file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QMutexLocker locker(&traceLock);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < traceEvents.count(); ++i)
+    {
+        // From the oldest event to the newest one
+        const TraceEvent &event = traceEvents.at((traceOldest + i) % traceEvents.count());
+        // Chrome timestamps are expressed in microseconds
+        out << "{\"name\":\"" << event.name << "\",\"cat\":\"vle-ea\","
+            << "\"ph\":\"X\",\"ts\":" << (event.start / 1000.0)
+            << ",\"dur\":" << (event.duration / 1000.0)
+            << ",\"pid\":" << pid << ",\"tid\":" << event.thread << "}";
+        if (i != (traceEvents.count() - 1))
+            out << ",";
+        out << "\n";
+    }
+    out << "],\"otherData\":{\"dropped\":" << traceDropped << "}}\n";
+    out.flush();
+
+    return (file.error() == QFile::NoError);
+}
+
+/**
+ * @brief Get the current time, relative to the first trace call
+ *
+ * @return qint64 Time in nanoseconds
+ */
+qint64 Trace::timestamp(void)
+{
+    // Initialized once, on first call (thread-safe static)
+    static QElapsedTimer origin = startTimer();
+    return origin.nsecsElapsed();
+}
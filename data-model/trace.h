@@ -0,0 +1,50 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QtGlobal>
+
+/*
+ * Trace spans are disabled by default. To record them, build with
+ * VLE_EA_TRACE defined (see "DEFINES" into .pro files). Recorded spans
+ * can be saved as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ */
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name);
+    ~TraceSpan();
+private:
+    const char *mName;
+    qint64      mStart;
+};
+
+class Trace
+{
+public:
+    static void   clear(void);
+    static int    count(void);
+    static bool   isEnabled(void);
+    static void   record(const char *name, qint64 start, qint64 duration);
+    static bool   save(const QString &filename);
+    static qint64 timestamp(void);
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef VLE_EA_TRACE
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name)
+#endif
+
+#endif // TRACE_H
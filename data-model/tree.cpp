@@ -0,0 +1,200 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QPair>
+#include "atelier.h"
+#include "instrument.h"
+#include "memoryusage.h"
+#include "tree.h"
+
+/**
+ * @brief Default constructor, the tree is empty
+ *
+ */
+AtelierTree::AtelierTree()
+{
+}
+
+/**
+ * @brief Compute count, sum, min and max of a parameter over a subtree
+ *
+ * Only the leaves of the subtree are included (entities without
+ * sub-entities) : the value of an entity that holds sub-entities is the
+ * default value of them, counting both would count it twice. The values
+ * are read from the columns of the parents, in preorder (consecutive
+ * leaves usually share the same column).
+ *
+ * @param node      Index of the subtree root
+ * @param parameter Index of the parameter
+ * @return Aggregate Result (count is the number of leaves, 0 for an empty
+ *                   subtree)
+ */
+AtelierTree::Aggregate AtelierTree::aggregate(int node, int parameter) const
+{
+    INSTRUMENT_CALL("AtelierTree::aggregate");
+
+    Aggregate result;
+    result.count = 0;
+    result.sum   = 0;
+    result.min   = 0;
+    result.max   = 0;
+
+    if ((node < 0) || (node >= mNodes.count()))
+        return result;
+
+    int last = node + mSizes.at(node);
+    int parent = -1;
+    const AtelierColumn *column = 0;
+    for (int i = node + 1; i < last; ++i)
+    {
+        if (mSizes.at(i) != 1)
+            continue;
+        // Column of the parent (kept while the leaves are siblings)
+        if (mParents.at(i) != parent)
+        {
+            parent = mParents.at(i);
+            const QList<AtelierParameter *> &parameters = mNodes.at(parent)->mParameters;
+            column = (parameter < parameters.count()) ? parameters.at(parameter)->mColumn : 0;
+        }
+        if (column == 0)
+            continue;
+        double value = column->value(mRows.at(i));
+        if (result.count == 0)
+        {
+            result.min = value;
+            result.max = value;
+        }
+        else
+        {
+            result.min = qMin(result.min, value);
+            result.max = qMax(result.max, value);
+        }
+        result.sum += value;
+        result.count++;
+    }
+    return result;
+}
+
+/**
+ * @brief Build the tree of an Atelier
+ *
+ * @param root Pointer to the Atelier (node 0)
+ */
+void AtelierTree::build(Atelier *root)
+{
+    INSTRUMENT_CALL("AtelierTree::build");
+
+    mNodes.clear();
+    mParents.clear();
+    mRows.clear();
+    mDepths.clear();
+    mIndex.clear();
+
+    // Preorder walk with an explicit stack of (node, parent index)
+    QVector< QPair<Atelier *, int> > stack;
+    stack.append(qMakePair(root, -1));
+    while ( ! stack.isEmpty())
+    {
+        QPair<Atelier *, int> item = stack.last();
+        stack.removeLast();
+
+        Atelier *atelier = item.first;
+        int index = mNodes.count();
+        mNodes.append(atelier);
+        mParents.append(item.second);
+        mRows.append(atelier->getRow());
+        mDepths.append((item.second < 0) ? 0 : (mDepths.at(item.second) + 1));
+        mIndex.insert(atelier, index);
+
+        // Children in reverse order, so the first one is walked first
+        for (int i = atelier->countEntity() - 1; i >= 0; --i)
+            stack.append(qMakePair(atelier->getEntity(i), index));
+    }
+    INSTRUMENT_ALLOC(mNodes.count());
+
+    // A subtree is stored after his root : sizes are summed backward
+    mSizes.fill(1, mNodes.count());
+    for (int i = mNodes.count() - 1; i > 0; --i)
+        mSizes[mParents.at(i)] += mSizes.at(i);
+}
+
+/**
+ * @brief Get the number of nodes (the Atelier and all his entities)
+ *
+ * @return integer Number of nodes
+ */
+int AtelierTree::count(void) const
+{
+    return mNodes.count();
+}
+
+/**
+ * @brief Get the depth of a node (0 for the Atelier, 1 for his entities)
+ *
+ * @param node Index of the node
+ * @return integer Depth
+ */
+int AtelierTree::getDepth(int node) const
+{
+    return mDepths.at(node);
+}
+
+Atelier *AtelierTree::getNode(int node) const
+{
+    return mNodes.at(node);
+}
+
+/**
+ * @brief Get the parent of a node
+ *
+ * @param node Index of the node
+ * @return integer Index of the parent (-1 for the Atelier)
+ */
+int AtelierTree::getParent(int node) const
+{
+    return mParents.at(node);
+}
+
+/**
+ * @brief Get the size of the subtree of a node (with the node itself)
+ *
+ * The next sibling of a node is at index node + size.
+ *
+ * @param node Index of the node
+ * @return integer Number of nodes of the subtree
+ */
+int AtelierTree::getSize(int node) const
+{
+    return mSizes.at(node);
+}
+
+/**
+ * @brief Search the node of an Atelier (or entity)
+ *
+ * @param atelier Pointer to the Atelier
+ * @return integer Index of the node (-1 if not into this tree)
+ */
+int AtelierTree::indexOf(Atelier *atelier) const
+{
+    return mIndex.value(atelier, -1);
+}
+
+/**
+ * @brief Get the memory used by the tree
+ *
+ * @return qint64 Number of bytes (object, arrays and node index)
+ */
+qint64 AtelierTree::memoryUsage(void) const
+{
+    return sizeof(AtelierTree)
+         + MemoryUsage::vectorBytes(mNodes)
+         + MemoryUsage::vectorBytes(mParents)
+         + MemoryUsage::vectorBytes(mRows)
+         + MemoryUsage::vectorBytes(mSizes)
+         + MemoryUsage::vectorBytes(mDepths)
+         + MemoryUsage::hashBytes(mIndex.count(), sizeof(Atelier *) + sizeof(int));
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef TREE_H
+#define TREE_H
+
+#include <QHash>
+#include <QVector>
+
+class Atelier;
+
+/*
+ * An AtelierTree is a flat copy of the structure of an Atelier and of all
+ * his entities (and sub-entities), in preorder : each node is followed by
+ * his whole subtree. The subtree of node i is the range [i, i + size[i]),
+ * so subtrees are walked and aggregated by simple loops, without recursion
+ * and without following pointers between the nodes.
+ *
+ * Only the structure is copied (with the row of each node into his
+ * parent), the values are read from the columns of the Atelier. The tree
+ * is built by Atelier::getTree and is valid until an entity is added or
+ * removed.
+ */
+class AtelierTree
+{
+public:
+    struct Aggregate
+    {
+        int    count;
+        double sum;
+        double min;
+        double max;
+    };
+public:
+    AtelierTree();
+    Aggregate aggregate(int node, int parameter) const;
+    void      build    (Atelier *root);
+    int       count    (void) const;
+    int       getDepth (int node) const;
+    Atelier  *getNode  (int node) const;
+    int       getParent(int node) const;
+    int       getSize  (int node) const;
+    int       indexOf  (Atelier *atelier) const;
+    qint64    memoryUsage(void) const;
+private:
+    QVector<Atelier *> mNodes;
+    QVector<int>       mParents;
+    QVector<int>       mRows;
+    QVector<int>       mSizes;
+    QVector<int>       mDepths;
+    QHash<Atelier *, int> mIndex;
+};
+
+#endif // TREE_H
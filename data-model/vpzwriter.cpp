@@ -0,0 +1,281 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QDateTime>
+#include <QSaveFile>
+#include "vpzwriter.h"
+
+/*
+ * The Exploitation is exported as VLE experimental conditions :
+ *
+ * - "exploitation" : one port per global parameter (double)
+ * - "rotations"    : one port per Rotation, a map with the duration and
+ *                    the set of activity plans (name, position)
+ * - "atelier_N"    : one condition per Atelier, holding his name and one
+ *                    port per column : "entities" (names), "rotation"
+ *                    (rotation name of each entity) and one tuple per
+ *                    parameter. The value of the i-th entity is at the
+ *                    i-th position of each port.
+ *
+ * Entities are written column by column directly to the device, nothing is
+ * buffered, so the memory used does not depend on the number of entities.
+ */
+
+/**
+ * @brief Default constructor for a VPZ writer
+ *
+ * @param exploitation Pointer to the Exploitation to export
+ */
+VpzWriter::VpzWriter(Exploitation *exploitation)
+{
+    mExploitation = exploitation;
+    mExperiment   = "exploitation";
+}
+
+/**
+ * @brief Get a description of the last error
+ *
+ * @return QString Error message (empty if no error)
+ */
+QString VpzWriter::errorString(void)
+{
+    return mError;
+}
+
+/**
+ * @brief Set the name of the VLE experiment
+ *
+ * @param name Name of the experiment
+ */
+void VpzWriter::setExperimentName(const QString &name)
+{
+    mExperiment = name;
+}
+
+/**
+ * @brief Export the Exploitation into a .vpz file
+ *
+ * The file is replaced only when the export is complete.
+ *
+ * @param filename Name of the file to write
+ * @return boolean True on success
+ */
+bool VpzWriter::write(const QString &filename)
+{
+    QSaveFile file(filename);
+    if ( ! file.open(QIODevice::WriteOnly))
+    {
+        mError = file.errorString();
+        return false;
+    }
+    if ( ! write(&file))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    if ( ! file.commit())
+    {
+        mError = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Export the Exploitation to an already opened device
+ *
+ * @param device Pointer to the device to write
+ * @return boolean True on success
+ */
+bool VpzWriter::write(QIODevice *device)
+{
+    mError.clear();
+
+    if (mExploitation == 0)
+    {
+        mError = "No Exploitation to export";
+        return false;
+    }
+
+    mXml.setDevice(device);
+    mXml.setAutoFormatting(true);
+    mXml.setAutoFormattingIndent(1);
+
+    mXml.writeStartDocument();
+    mXml.writeDTD("<!DOCTYPE vle_project PUBLIC \"-//VLE TEAM//DTD Strict//EN\" "
+                  "\"https://www.vle-project.org/vle-2.0.0.dtd\">");
+    mXml.writeStartElement("vle_project");
+    mXml.writeAttribute("version", "1.0");
+    mXml.writeAttribute("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    mXml.writeAttribute("author", "vle-ea");
+
+    // Empty top model, the conditions are used by the real models
+    mXml.writeStartElement("structures");
+    mXml.writeEmptyElement("model");
+    mXml.writeAttribute("name", "Top model");
+    mXml.writeAttribute("type", "coupled");
+    mXml.writeEndElement(); // structures
+
+    mXml.writeStartElement("experiment");
+    mXml.writeAttribute("name", mExperiment);
+    mXml.writeStartElement("conditions");
+
+    writeParameters();
+    writeRotations();
+    for (uint i = 0; i < mExploitation->countAtelier(); ++i)
+        writeAtelier(mExploitation->getAtelier(i), i);
+
+    mXml.writeEndElement(); // conditions
+    mXml.writeEndElement(); // experiment
+    mXml.writeEndElement(); // vle_project
+    mXml.writeEndDocument();
+
+    if (mXml.hasError())
+    {
+        mError = device->errorString();
+        if (mError.isEmpty())
+            mError = "Write error";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the condition of one Atelier
+ *
+ * @param atelier Pointer to the Atelier
+ * @param index   Index of the Atelier (used for condition name)
+ */
+void VpzWriter::writeAtelier(Atelier *atelier, int index)
+{
+    mXml.writeStartElement("condition");
+    mXml.writeAttribute("name", QString("atelier_%1").arg(index));
+
+    mXml.writeStartElement("port");
+    mXml.writeAttribute("name", "name");
+    writeValue("string", atelier->getName());
+    mXml.writeEndElement(); // port
+
+    // Names of the entities
+    mXml.writeStartElement("port");
+    mXml.writeAttribute("name", "entities");
+    mXml.writeStartElement("set");
+    for (int i = 0; i < atelier->countEntity(); ++i)
+        writeValue("string", atelier->getEntity(i)->getName());
+    mXml.writeEndElement(); // set
+    mXml.writeEndElement(); // port
+
+    // Rotation of the entities (empty string for no rotation)
+    mXml.writeStartElement("port");
+    mXml.writeAttribute("name", "rotation");
+    mXml.writeStartElement("set");
+    for (int i = 0; i < atelier->countEntity(); ++i)
+    {
+        Rotation *rot = atelier->getEntity(i)->getRotation();
+        writeValue("string", rot ? rot->getName() : QString());
+    }
+    mXml.writeEndElement(); // set
+    mXml.writeEndElement(); // port
+
+    // One tuple (list of doubles) per parameter
+    for (int k = 0; k < atelier->countParameter(); ++k)
+    {
+        mXml.writeStartElement("port");
+        mXml.writeAttribute("name", atelier->getParameterName(k));
+        mXml.writeStartElement("tuple");
+        for (int i = 0; i < atelier->countEntity(); ++i)
+        {
+            if (i)
+                mXml.writeCharacters(" ");
+            mXml.writeCharacters(QString::number(atelier->getEntity(i)->getParameterValue(k), 'g', 17));
+        }
+        mXml.writeEndElement(); // tuple
+        mXml.writeEndElement(); // port
+    }
+
+    mXml.writeEndElement(); // condition
+}
+
+/**
+ * @brief Write the condition of the global parameters
+ *
+ */
+void VpzWriter::writeParameters(void)
+{
+    mXml.writeStartElement("condition");
+    mXml.writeAttribute("name", "exploitation");
+
+    for (uint i = 0; i < mExploitation->countParameter(); ++i)
+    {
+        Parameter *p = mExploitation->getParameter(i);
+        mXml.writeStartElement("port");
+        mXml.writeAttribute("name", p->getName());
+        writeValue("double", QString::number(p->getValue(), 'g', 17));
+        mXml.writeEndElement(); // port
+    }
+
+    mXml.writeEndElement(); // condition
+}
+
+/**
+ * @brief Write the condition of the Rotations and activity plans
+ *
+ */
+void VpzWriter::writeRotations(void)
+{
+    mXml.writeStartElement("condition");
+    mXml.writeAttribute("name", "rotations");
+
+    for (uint i = 0; i < mExploitation->countRotation(); ++i)
+    {
+        Rotation *rot = mExploitation->getRotation(i);
+        mXml.writeStartElement("port");
+        mXml.writeAttribute("name", rot->getName());
+        mXml.writeStartElement("map");
+
+        mXml.writeStartElement("key");
+        mXml.writeAttribute("name", "duration");
+        writeValue("integer", QString::number((qulonglong)rot->getDuration()));
+        mXml.writeEndElement(); // key
+
+        mXml.writeStartElement("key");
+        mXml.writeAttribute("name", "plans");
+        mXml.writeStartElement("set");
+        for (uint j = 0; j < rot->countPlans(); ++j)
+        {
+            ActivityPlan *plan = rot->getPlan(j);
+            mXml.writeStartElement("map");
+            mXml.writeStartElement("key");
+            mXml.writeAttribute("name", "name");
+            writeValue("string", plan->getName());
+            mXml.writeEndElement(); // key
+            mXml.writeStartElement("key");
+            mXml.writeAttribute("name", "position");
+            writeValue("integer", QString::number((qulonglong)plan->getPosition()));
+            mXml.writeEndElement(); // key
+            mXml.writeEndElement(); // map
+        }
+        mXml.writeEndElement(); // set
+        mXml.writeEndElement(); // key
+
+        mXml.writeEndElement(); // map
+        mXml.writeEndElement(); // port
+    }
+
+    mXml.writeEndElement(); // condition
+}
+
+/**
+ * @brief Write a simple VLE value (ex: <double>4.2</double>)
+ *
+ * @param type  Name of the VLE type (double, integer, string ...)
+ * @param value Text of the value
+ */
+void VpzWriter::writeValue(const QString &type, const QString &value)
+{
+    mXml.writeTextElement(type, value);
+}
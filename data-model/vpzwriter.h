@@ -0,0 +1,36 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef VPZWRITER_H
+#define VPZWRITER_H
+
+#include <QIODevice>
+#include <QString>
+#include <QXmlStreamWriter>
+#include "exploitation.h"
+
+class VpzWriter
+{
+public:
+    explicit VpzWriter(Exploitation *exploitation);
+    QString errorString(void);
+    void    setExperimentName(const QString &name);
+    bool    write(QIODevice *device);
+    bool    write(const QString &filename);
+private:
+    void writeAtelier   (Atelier *atelier, int index);
+    void writeParameters(void);
+    void writeRotations (void);
+    void writeValue     (const QString &type, const QString &value);
+private:
+    Exploitation    *mExploitation;
+    QXmlStreamWriter mXml;
+    QString          mError;
+    QString          mExperiment;
+};
+
+#endif // VPZWRITER_H
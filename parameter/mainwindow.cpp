@@ -6,9 +6,13 @@
  * Copyright (c) 2016 Agilack
  */
 #include <QDebug>
+#include <QStringList>
+#include "data-model/trace.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#define AUTOSAVE_FILE "parameter-autosave.log"
+
 /**
  * @brief Default constructor for the main window of the test-app
  *
@@ -20,7 +24,28 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
     setWindowTitle("VLE EA Unit-test for Parameters");
 
-    loadTestData();
+    // Recover the autosave left by a crash, else load some tests datas
+    bool recovered = false;
+    if (ChangeLog::exists(AUTOSAVE_FILE))
+    {
+        recovered = mLog.recover(AUTOSAVE_FILE, &mExploitation);
+        if ( ! recovered)
+        {
+            // The autosave has been moved aside, forget the partial content
+            qWarning() << "Autosave recovery failed after" << mLog.countReplayed()
+                       << "change(s) :" << mLog.errorString();
+            mExploitation.clear();
+        }
+    }
+    if ( ! recovered)
+    {
+        loadTestData();
+        // Never overwrite an autosave that could not be recovered nor moved aside
+        if (ChangeLog::exists(AUTOSAVE_FILE))
+            qWarning() << "Autosave disabled : an old autosave is still present";
+        else if ( ! mLog.open(AUTOSAVE_FILE, &mExploitation))
+            qWarning() << "Autosave disabled :" << mLog.errorString();
+    }
 
     ui->ParameterWidget->setup( &mExploitation );
 
@@ -36,6 +61,8 @@ MainWindow::MainWindow(QWidget *parent) :
     // Catch signal emited when the value of a parameter is modified
     QObject::connect(ui->ParameterWidget, SIGNAL(valueChanged(Parameter*,double,double)),
                      this,                SLOT(slotValueChanged(Parameter*,double,double)) );
+
+    showMemoryUsage();
 }
 
 /**
@@ -50,9 +77,34 @@ MainWindow::~MainWindow()
         Parameter *p = mExploitation.getParameter(i);
         qWarning() << " -" << p->getName() << "=" << p->getValue();
     }
+    // Clean exit, the autosave is not needed anymore
+    mLog.discard();
+
+    // Save widget trace spans (only when built with tracing)
+    if (Trace::isEnabled())
+    {
+        if (Trace::save("parameter-trace.json"))
+            qWarning() << "Trace saved into parameter-trace.json";
+    }
+
     delete ui;
 }
 
+/**
+ * @brief Log an estimation of the memory used by the Exploitation and the widget
+ *
+ */
+void MainWindow::showMemoryUsage(void)
+{
+    MemoryUsage usage = mExploitation.memoryUsage();
+    ui->ParameterWidget->memoryUsage(usage);
+
+    qWarning() << "--=={ Memory usage }==--";
+    QStringList lines = usage.report();
+    for (int i = 0; i < lines.count(); i++)
+        qWarning() << lines.at(i).toStdString().c_str();
+}
+
 /**
  * @brief Load some dummy datas into local Exploitation
  *
@@ -69,6 +121,7 @@ void MainWindow::loadTestData(void)
  */
 void MainWindow::slotAdded(Parameter *param)
 {
+    mLog.recordGlobalValue(param->getName(), param->getValue());
     qWarning() << "A new global parameter has been created " << param->getName();
 }
 
@@ -81,6 +134,7 @@ void MainWindow::slotAdded(Parameter *param)
 void MainWindow::slotRemoved(const QString &name, double value)
 {
     (void)value;
+    mLog.recordGlobalRemoved(name);
     qWarning() << "A parameter has been removed " << name;
 }
 
@@ -94,6 +148,7 @@ void MainWindow::slotRemoved(const QString &name, double value)
 void MainWindow::slotRenamed(Parameter *param, const QString &oldName, const QString &newName)
 {
     (void)param;
+    mLog.recordGlobalRenamed(oldName, newName);
     qWarning() << "A parameter has been renamed " << oldName << "--->" << newName;
 }
 
@@ -106,5 +161,6 @@ void MainWindow::slotRenamed(Parameter *param, const QString &oldName, const QSt
  */
 void MainWindow::slotValueChanged(Parameter *param, double oldValue, double newValue)
 {
+    mLog.recordGlobalValue(param->getName(), newValue);
     qWarning() << "The value has been modified " << param->getName() << " : " << oldValue << "--->" << newValue;
 }
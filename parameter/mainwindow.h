@@ -9,6 +9,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include "data-model/changelog.h"
 #include "data-model/exploitation.h"
 
 namespace Ui {
@@ -31,10 +32,12 @@ public slots:
 
 protected:
     void loadTestData(void);
+    void showMemoryUsage(void);
 
 private:
     Ui::MainWindow *ui;
     Exploitation mExploitation;
+    ChangeLog    mLog;
 };
 
 #endif // MAINWINDOW_H
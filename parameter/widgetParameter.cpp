@@ -8,9 +8,29 @@
 #include <QHeaderView>
 #include <QLineEdit>
 #include <QMenu>
+#include <QMessageBox>
 #include <QTableWidgetItem>
+#include "data-model/trace.h"
 #include "widgetParameter.h"
 
+
+// Estimated memory of the data of one item (roles and values), besides text
+#define ITEM_DATA_BYTES 72
+
+/**
+ * @brief Estimate the memory used by one item of a table
+ *
+ * @param item Pointer to the item (may be NULL)
+ * @return qint64 Number of bytes (object, data of the roles and text)
+ */
+static qint64 itemBytes(QTableWidgetItem *item)
+{
+    if (item == 0)
+        return 0;
+    return sizeof(QTableWidgetItem) + ITEM_DATA_BYTES
+         + MemoryUsage::stringBytes(item->text());
+}
+
 /**
  * @brief Default constructor for Parameter widget
  *
@@ -45,6 +65,30 @@ widgetParameter::widgetParameter(QWidget *parent) : QTableWidget(parent)
                      this, SLOT(slotContextMenu(QPoint))            );
 }
 
+/**
+ * @brief Add the memory used by the items of the table to an estimation
+ *
+ * The rows are not walked : the items of the middle row give the size of
+ * all the rows.
+ *
+ * @param usage Reference to the estimation
+ */
+void widgetParameter::memoryUsage(MemoryUsage &usage)
+{
+    qint64 bytes = 0;
+    int rows = rowCount();
+    if (rows > 0)
+    {
+        qint64 rowBytes = itemBytes(verticalHeaderItem(rows / 2));
+        for (int c = 0; c < columnCount(); ++c)
+            rowBytes += itemBytes(item(rows / 2, c));
+        bytes += rows * rowBytes;
+    }
+    for (int c = 0; c < columnCount(); ++c)
+        bytes += itemBytes(horizontalHeaderItem(c));
+    usage.add(MemoryUsage::CategoryWidgets, bytes);
+}
+
 /**
  * @brief Initialize widget for a specific Exploitation
  *
@@ -66,13 +110,11 @@ bool widgetParameter::setup(Exploitation *exploitation)
 
         // Create an item for the parameter name
         QTableWidgetItem *item = new QTableWidgetItem();
-        item->setData(Qt::UserRole, QVariant::fromValue((void *)param));
         item->setText( param->getName() );
         setItem(i, 0, item);
 
         // Create an item for the parameter value
         item = new QTableWidgetItem();
-        item->setData(Qt::UserRole, QVariant::fromValue((void *)param));
         item->setText( QString::number(param->getValue()));
         setItem(i, 1, item);
     }
@@ -93,25 +135,34 @@ bool widgetParameter::setup(Exploitation *exploitation)
  */
 void widgetParameter::slotCellChanged(int row, int col)
 {
+    TRACE_SPAN("widgetParameter::slotCellChanged");
+
     // Get the modified item (based on row-col)
     QTableWidgetItem *selectedItem = item(row, col);
     if (selectedItem == 0)
         return;
 
-    // Get the associated parameter
-    QVariant vParameter = selectedItem->data(Qt::UserRole);
-    if ( ! vParameter.isValid())
+    // Get the associated parameter (rows follow the Exploitation order)
+    Parameter *p = mExploitation->getParameter(row);
+    if (p == 0)
         return;
-    Parameter *p = (Parameter *)vParameter.value<void *>();
 
     // The column "0" contains parameter names
     if (col == 0)
     {
         QString oldName( p->getName() );
         QString newName( selectedItem->text() );
-        // Update the parameter name
-        p->setName( newName );
+        // Update the parameter name (refused while a formula uses it)
+        if ( ! mExploitation->renameParameter(p, newName))
+        {
+            bool blocked = blockSignals(true);
+            selectedItem->setText(oldName);
+            blockSignals(blocked);
+            QMessageBox::warning(this, oldName, tr("A formula uses this parameter"));
+            return;
+        }
         // Send a message to inform the world that a parameter has been renamed
+        TRACE_SPAN("widgetParameter::renamed");
         emit renamed(p, oldName, newName);
     }
 
@@ -120,9 +171,10 @@ void widgetParameter::slotCellChanged(int row, int col)
     {
         double oldValue = p->getValue();
         double newValue = selectedItem->text().toDouble();
-        // Update the parameter value
-        p->setValue( newValue );
+        // Update the parameter value (and the formulas that use it)
+        mExploitation->setParameter(p->getName(), newValue);
         // Send a message to inform the world that a value has been modified
+        TRACE_SPAN("widgetParameter::valueChanged");
         emit valueChanged(p, oldValue, newValue);
     }
 }
@@ -145,6 +197,9 @@ void widgetParameter::slotContextMenu(const QPoint &pos)
     // Show context-menu
     QAction *selectedAction = ctxMenu.exec(QCursor::pos());
 
+    // Trace only the processing of the selected action, not the menu itself
+    TRACE_SPAN("widgetParameter::slotContextMenu");
+
     // Process selected action
     if (selectedAction == actionAdd)
     {
@@ -152,7 +207,10 @@ void widgetParameter::slotContextMenu(const QPoint &pos)
         param->setValue(mDefaultValue);
 
         // Send a message to inform the world that a new parameter has been added
-        emit added(param);
+        {
+            TRACE_SPAN("widgetParameter::added");
+            emit added(param);
+        }
 
         // Insert a new row at the bottom of the table
         int rowPos = rowCount();
@@ -160,14 +218,12 @@ void widgetParameter::slotContextMenu(const QPoint &pos)
 
         // Create an item for the parameter value
         QTableWidgetItem *item = new QTableWidgetItem();
-        item->setData(Qt::UserRole, QVariant::fromValue((void *)param));
         item->setText( QString::number(param->getValue()));
         setItem(rowPos, 1, item);
 
         // Create an item for the parameter name
         item = new QTableWidgetItem();
         item->setFlags( item->flags() | Qt::ItemIsEditable);
-        item->setData(Qt::UserRole, QVariant::fromValue((void *)param));
         item->setText( param->getName() );
         setItem(rowPos, 0, item);
 
@@ -176,16 +232,23 @@ void widgetParameter::slotContextMenu(const QPoint &pos)
     else if (selectedAction == actionRemove)
     {
         // Get the associated parameter
-        QVariant vParameter = clickedItem->data(Qt::UserRole);
-        if (vParameter.isValid())
+        Parameter *p = mExploitation->getParameter(clickedItem->row());
+        if (p)
         {
-            Parameter *p = (Parameter *)vParameter.value<void *>();
+            QString name( p->getName() );
+            double  value = p->getValue();
 
-            // Send a message to inform the world that a parameter is removed
-            emit removed(p->getName(), p->getValue());
+            // A parameter used by a formula is not removed
+            if ( ! mExploitation->removeParameter(p))
+            {
+                QMessageBox::warning(this, name, tr("A formula uses this parameter"));
+                return;
+            }
+            removeRow( clickedItem->row() );
 
-            if (mExploitation->removeParameter(p))
-                removeRow( clickedItem->row() );
+            // Send a message to inform the world that a parameter is removed
+            TRACE_SPAN("widgetParameter::removed");
+            emit removed(name, value);
         }
     }
 }
@@ -17,6 +17,7 @@ class widgetParameter : public QTableWidget
     Q_OBJECT
 public:
     explicit widgetParameter(QWidget *parent = 0);
+    void     memoryUsage(MemoryUsage &usage);
     bool     setup(Exploitation *exploitation);
 
 signals:
@@ -5,10 +5,15 @@
  *
  * Copyright (c) 2016 Agilack
  */
+#include <QCoreApplication>
 #include <QDebug>
+#include <QStatusBar>
+#include "data-model/trace.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#define AUTOSAVE_FILE "rotation-autosave.log"
+
 /**
  * @brief Default constructor for the main window of the test-app
  *
@@ -18,10 +23,46 @@ MainWindow::MainWindow(QWidget *parent) :
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
+    mLoader   = 0;
+    mProgress = 0;
     setWindowTitle("VLE EA Unit-test for Rotation");
 
-    loadTest();
-    ui->RotationWidget->setup(&mExploitation);
+    // Recover the autosave left by a crash, else load a scenario file
+    // (first argument) or some tests datas
+    QStringList args = QCoreApplication::arguments();
+    bool recovered = false;
+    if (ChangeLog::exists(AUTOSAVE_FILE))
+    {
+        recovered = mLog.recover(AUTOSAVE_FILE, &mExploitation);
+        if (recovered)
+            statusBar()->showMessage(tr("Recovered %1 change(s) from autosave")
+                                     .arg(mLog.countReplayed()), 5000);
+        else
+        {
+            // The autosave has been moved aside, forget the partial content
+            qWarning() << "Autosave recovery failed after" << mLog.countReplayed()
+                       << "change(s) :" << mLog.errorString();
+            statusBar()->showMessage(tr("Autosave recovery failed, kept into %1.bak")
+                                     .arg(AUTOSAVE_FILE), 5000);
+            mExploitation.clear();
+        }
+    }
+    if (recovered)
+    {
+        ui->RotationWidget->setup(&mExploitation);
+        ui->TimelineWidget->setup(&mExploitation);
+        checkRotations();
+    }
+    else if (args.count() < 2)
+    {
+        loadTest();
+        ui->RotationWidget->setup(&mExploitation);
+        ui->TimelineWidget->setup(&mExploitation);
+        checkRotations();
+        startAutosave();
+    }
+    else
+        loadFile(args.at(1));
 
     // Catch signal emited when the duration of a Rotation is modified
     QObject::connect(ui->RotationWidget, SIGNAL(durationChanged(Rotation*,ulong,ulong)),
@@ -47,6 +88,24 @@ MainWindow::MainWindow(QWidget *parent) :
     // Catch signal emited when the name of a Rotation is modified
     QObject::connect(ui->RotationWidget, SIGNAL(rotationRenamed(Rotation*,QString,QString)),
                      this,               SLOT(slotRotationRenamed(Rotation*,QString,QString)) );
+
+    // The timeline follows the modifications made into the tree
+    QObject::connect(ui->RotationWidget, SIGNAL(durationChanged(Rotation*,ulong,ulong)),
+                     ui->TimelineWidget, SLOT(slotDurationChanged(Rotation*,ulong,ulong)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(planAdded(ActivityPlan*)),
+                     ui->TimelineWidget, SLOT(slotPlanAdded(ActivityPlan*)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(planDeleted(Rotation*,QString,ulong)),
+                     ui->TimelineWidget, SLOT(slotPlanDeleted(Rotation*,QString,ulong)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(planRenamed(ActivityPlan*,QString,QString)),
+                     ui->TimelineWidget, SLOT(slotPlanRenamed(ActivityPlan*,QString,QString)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(positionChanged(ActivityPlan*,ulong,ulong)),
+                     ui->TimelineWidget, SLOT(slotPositionChanged(ActivityPlan*,ulong,ulong)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(rotationAdded(Rotation*)),
+                     ui->TimelineWidget, SLOT(slotRotationAdded(Rotation*)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(rotationDeleted(QString,ulong)),
+                     ui->TimelineWidget, SLOT(slotRotationDeleted(QString,ulong)) );
+    QObject::connect(ui->RotationWidget, SIGNAL(rotationRenamed(Rotation*,QString,QString)),
+                     ui->TimelineWidget, SLOT(slotRotationRenamed(Rotation*,QString,QString)) );
 }
 
 /**
@@ -55,9 +114,160 @@ MainWindow::MainWindow(QWidget *parent) :
  */
 MainWindow::~MainWindow()
 {
+    // The Exploitation may still be filled by the loader thread
+    if (mLoader)
+        mLoader->wait();
+
+    // Clean exit, the autosave is not needed anymore
+    mLog.discard();
+
+    // Save widget trace spans (only when built with tracing)
+    if (Trace::isEnabled())
+    {
+        if (Trace::save("rotation-trace.json"))
+            qWarning() << "Trace saved into rotation-trace.json";
+    }
+
     delete ui;
 }
 
+/**
+ * @brief Start to load a scenario file into local Exploitation
+ *
+ * The file is parsed by a worker thread, the widget is initialized when
+ * the Exploitation is complete (see slotLoaded).
+ *
+ * @param filename Name of the scenario file
+ */
+void MainWindow::loadFile(const QString &filename)
+{
+    mProgress = new QProgressBar(this);
+    mProgress->setRange(0, 100);
+    statusBar()->addPermanentWidget(mProgress);
+    statusBar()->showMessage(tr("Loading %1 ...").arg(filename));
+
+    mLoader = new ExploitationLoader(&mExploitation, this);
+    QObject::connect(mLoader,   SIGNAL(progress(int)),
+                     mProgress, SLOT  (setValue(int)));
+    QObject::connect(mLoader,   SIGNAL(loaded(bool)),
+                     this,      SLOT  (slotLoaded(bool)));
+    mLoader->load(filename);
+}
+
+/**
+ * @brief Slot called when the loader thread has finished to read the file
+ *
+ * @param success True if the file has been successfully loaded
+ */
+void MainWindow::slotLoaded(bool success)
+{
+    if ( ! success)
+    {
+        statusBar()->showMessage(tr("Load failed: %1").arg(mLoader->errorString()));
+        mProgress->hide();
+        return;
+    }
+
+    // Then, fill the widget by batches from the event loop
+    statusBar()->showMessage(tr("Filling rotations ..."));
+    QObject::connect(ui->RotationWidget, SIGNAL(setupProgress(int,int)),
+                     this,           SLOT  (slotSetupProgress(int,int)));
+    QObject::connect(ui->RotationWidget, SIGNAL(setupFinished()),
+                     this,           SLOT  (slotSetupFinished()));
+    ui->RotationWidget->setFillBatch(50);
+    ui->RotationWidget->setup(&mExploitation);
+    // The timeline reads the Exploitation directly, it is ready at once
+    ui->TimelineWidget->setup(&mExploitation);
+    checkRotations();
+
+    startAutosave();
+}
+
+/**
+ * @brief Slot called after each batch inserted into the widget
+ *
+ * @param done  Number of rotations already inserted
+ * @param total Total number of rotations
+ */
+void MainWindow::slotSetupProgress(int done, int total)
+{
+    mProgress->setRange(0, total);
+    mProgress->setValue(done);
+}
+
+/**
+ * @brief Slot called when the widget is completely filled
+ *
+ */
+void MainWindow::slotSetupFinished(void)
+{
+    mProgress->hide();
+    showMemoryUsage();
+}
+
+/**
+ * @brief Estimate the memory used by the Exploitation and the widgets
+ *
+ * The total is shown into the status bar, the details are logged.
+ */
+void MainWindow::showMemoryUsage(void)
+{
+    MemoryUsage usage = mExploitation.memoryUsage();
+    ui->RotationWidget->memoryUsage(usage);
+    ui->TimelineWidget->memoryUsage(usage);
+
+    statusBar()->showMessage(tr("Ready (memory %1)")
+                             .arg(MemoryUsage::formatBytes(usage.total())), 2000);
+    qWarning() << "--=={ Memory usage }==--";
+    QStringList lines = usage.report();
+    for (int i = 0; i < lines.count(); i++)
+        qWarning() << lines.at(i).toStdString().c_str();
+}
+
+/**
+ * @brief Start to record the modifications into the autosave log
+ *
+ */
+void MainWindow::startAutosave(void)
+{
+    // Never overwrite an autosave that could not be recovered nor moved aside
+    if (( ! mLog.isOpen()) && ChangeLog::exists(AUTOSAVE_FILE))
+    {
+        qWarning() << "Autosave disabled : an old autosave is still present";
+        return;
+    }
+    if ( ! mLog.open(AUTOSAVE_FILE, &mExploitation))
+        qWarning() << "Autosave disabled :" << mLog.errorString();
+}
+
+/**
+ * @brief Check the consistency of the rotations, show the result
+ *
+ * Only the rotations modified since the previous check are analyzed again,
+ * so this is called after each edit.
+ */
+void MainWindow::checkRotations(void)
+{
+    TRACE_SPAN("MainWindow::checkRotations");
+
+    mAnalyzer.analyze(&mExploitation);
+
+    int errors   = mAnalyzer.countErrors();
+    int warnings = mAnalyzer.count() - errors;
+    if (mAnalyzer.count() == 0)
+        statusBar()->showMessage(tr("Rotations are consistent"), 2000);
+    else
+        statusBar()->showMessage(tr("Rotations : %1 error(s), %2 warning(s)")
+                                 .arg(errors).arg(warnings));
+
+    for (int i = 0; i < mAnalyzer.count(); i++)
+    {
+        const RotationAnalyzer::Issue &issue = mAnalyzer.getIssue(i);
+        if (RotationAnalyzer::isError(issue.type))
+            qWarning() << "Error :" << RotationAnalyzer::describe(issue);
+    }
+}
+
 /**
  * @brief Load some dummy datas into local Exploitation
  *
@@ -89,9 +299,13 @@ void MainWindow::loadTest()
  */
 void MainWindow::slotDurationChanged(Rotation *rot, ulong oldDuration, ulong newDuration)
 {
+    mLog.recordRotation(rot);
+
     qWarning() << "The duration of the rotation" << rot->getName()
                << "has been modified :" << oldDuration
                << "--->" << newDuration;
+
+    checkRotations();
 }
 
 /**
@@ -102,9 +316,12 @@ void MainWindow::slotDurationChanged(Rotation *rot, ulong oldDuration, ulong new
 void MainWindow::slotPlanAdded(ActivityPlan *plan)
 {
     Rotation *rot = plan->parent();
+    mLog.recordRotation(rot);
 
     qWarning() << "A new plan has been added to rotation" << rot->getName()
                << ":" << plan->getName();
+
+    checkRotations();
 }
 
 /**
@@ -117,8 +334,12 @@ void MainWindow::slotPlanAdded(ActivityPlan *plan)
 void MainWindow::slotPlanDeleted(Rotation *rot, const QString &name, ulong position)
 {
     (void)position;
+    mLog.recordRotation(rot);
+
     qWarning() << "A plan has been deleted from rotation" << rot->getName()
                << ":" << name;
+
+    checkRotations();
 }
 
 /**
@@ -131,6 +352,8 @@ void MainWindow::slotPlanDeleted(Rotation *rot, const QString &name, ulong posit
 void MainWindow::slotPlanRenamed(ActivityPlan *plan, const QString &oldName, const QString &newName)
 {
     Rotation *rot = plan->parent();
+    mLog.recordRotation(rot);
+
     qWarning() << "A Plan of the rotation" << rot->getName()
                << "has been renamed :"
                << oldName << "--->" << newName;
@@ -145,8 +368,12 @@ void MainWindow::slotPlanRenamed(ActivityPlan *plan, const QString &oldName, con
  */
 void MainWindow::slotPositionChanged(ActivityPlan *plan, ulong oldPosition, ulong newPosition)
 {
+    mLog.recordRotation(plan->parent());
+
     qWarning() << "The position of the plan" << plan->getName()
                << "has been modified :" << oldPosition << "--->" << newPosition;
+
+    checkRotations();
 }
 
 /**
@@ -156,7 +383,11 @@ void MainWindow::slotPositionChanged(ActivityPlan *plan, ulong oldPosition, ulon
  */
 void MainWindow::slotRotationAdded(Rotation *rot)
 {
+    mLog.recordRotationAdded(rot);
+
     qWarning() << "A new rotation has been created" << rot->getName();
+
+    checkRotations();
 }
 
 /**
@@ -168,7 +399,11 @@ void MainWindow::slotRotationAdded(Rotation *rot)
 void MainWindow::slotRotationDeleted(const QString &name, ulong duration)
 {
     (void)duration;
+    mLog.recordRotationDeleted(name);
+
     qWarning() << "A rotation has been deleted :" << name;
+
+    checkRotations();
 }
 
 /**
@@ -181,6 +416,8 @@ void MainWindow::slotRotationDeleted(const QString &name, ulong duration)
 void MainWindow::slotRotationRenamed(Rotation *rot, const QString &oldName, const QString &newName)
 {
     (void)rot;
+    mLog.recordRotationRenamed(oldName, newName);
+
     qWarning() << "A rotation has been renamed :"
                << oldName << "--->" << newName;
 }
@@ -9,7 +9,11 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QProgressBar>
+#include "data-model/analyzer.h"
+#include "data-model/changelog.h"
 #include "data-model/exploitation.h"
+#include "data-model/loader.h"
 
 namespace Ui {
 class MainWindow;
@@ -24,6 +28,9 @@ public:
     ~MainWindow();
 
 public slots:
+    void slotLoaded         (bool success);
+    void slotSetupProgress  (int done, int total);
+    void slotSetupFinished  (void);
     void slotDurationChanged(Rotation *rot, ulong oldDuration, ulong newDuration);
     void slotPlanAdded      (ActivityPlan *plan);
     void slotPlanDeleted    (Rotation *rot, const QString &name, ulong position);
@@ -34,11 +41,19 @@ public slots:
     void slotRotationRenamed(Rotation *rot, const QString &oldName, const QString &newName);
 
 protected:
+    void checkRotations(void);
     void loadTest(void);
+    void loadFile(const QString &filename);
+    void showMemoryUsage(void);
+    void startAutosave(void);
 
 private:
     Ui::MainWindow *ui;
+    ExploitationLoader *mLoader;
+    QProgressBar       *mProgress;
     Exploitation mExploitation;
+    ChangeLog    mLog;
+    RotationAnalyzer mAnalyzer;
 };
 
 #endif // MAINWINDOW_H
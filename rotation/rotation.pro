@@ -14,19 +14,54 @@ TEMPLATE = app
 
 INCLUDEPATH += ../
 
+# Uncomment to enable data-model instrumentation counters
+#DEFINES += VLE_EA_INSTRUMENT
+# Uncomment to record trace spans of widget handlers
+#DEFINES += VLE_EA_TRACE
+
 SOURCES += main.cpp\
         mainwindow.cpp \
         widgetRotation.cpp \
+        widgetTimeline.cpp \
         ../data-model/exploitation.cpp \
         ../data-model/atelier.cpp \
+        ../data-model/analyzer.cpp \
+        ../data-model/changelog.cpp \
+        ../data-model/column.cpp \
+        ../data-model/expression.cpp \
+        ../data-model/hash.cpp \
     ../data-model/rotation.cpp \
-    ../data-model/parameter.cpp
+    ../data-model/parameter.cpp \
+    ../data-model/patch.cpp \
+    ../data-model/instrument.cpp \
+    ../data-model/loader.cpp \
+    ../data-model/reader.cpp \
+    ../data-model/seriesreader.cpp \
+    ../data-model/memoryusage.cpp \
+    ../data-model/trace.cpp \
+    ../data-model/timeseries.cpp \
+    ../data-model/tree.cpp
 
 HEADERS  += mainwindow.h \
             widgetRotation.h \
+            widgetTimeline.h \
             ../data-model/exploitation.h \
             ../data-model/atelier.h \
+            ../data-model/analyzer.h \
+            ../data-model/changelog.h \
+            ../data-model/column.h \
+            ../data-model/expression.h \
+            ../data-model/hash.h \
     ../data-model/rotation.h \
-    ../data-model/parameter.h
+    ../data-model/parameter.h \
+    ../data-model/patch.h \
+    ../data-model/instrument.h \
+    ../data-model/loader.h \
+    ../data-model/reader.h \
+    ../data-model/seriesreader.h \
+    ../data-model/memoryusage.h \
+    ../data-model/trace.h \
+    ../data-model/timeseries.h \
+    ../data-model/tree.h
 
 FORMS    += mainwindow.ui
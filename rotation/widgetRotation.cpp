@@ -7,8 +7,33 @@
  */
 #include <QLineEdit>
 #include <QMenu>
+#include "data-model/trace.h"
 #include "widgetRotation.h"
 
+// Estimated memory of the data of one item (roles and values), besides text
+#define ITEM_DATA_BYTES 72
+
+/**
+ * @brief Estimate the memory used by an item of the tree and his children
+ *
+ * The children are not walked : the child of the middle gives the size of
+ * all of them (with his own children, estimated the same way).
+ *
+ * @param item Pointer to the item
+ * @return qint64 Number of bytes (objects, data of the roles and texts)
+ */
+static qint64 itemBytes(QTreeWidgetItem *item)
+{
+    qint64 bytes = sizeof(QTreeWidgetItem) + ITEM_DATA_BYTES;
+    for (int c = 0; c < item->columnCount(); ++c)
+        bytes += MemoryUsage::stringBytes(item->text(c));
+    int children = item->childCount();
+    bytes += MemoryUsage::listBytes(children);
+    if (children > 0)
+        bytes += children * itemBytes(item->child(children / 2));
+    return bytes;
+}
+
 /**
  * @brief Default constructor for Rotation widget
  *
@@ -18,6 +43,14 @@ widgetRotation::widgetRotation(QWidget *parent) : QTreeWidget(parent)
 {
     mExploitation = 0;
 
+    // By default, the tree is filled synchronously by setup()
+    mFillBatch = 0;
+    mFillNext  = 0;
+    mFillTimer = new QTimer(this);
+    mFillTimer->setInterval(0);
+    QObject::connect(mFillTimer, SIGNAL(timeout()),
+                     this,       SLOT(slotFillBatch()));
+
     // Create two columns by setting her names
     headerItem()->setText(0, "Name");
     headerItem()->setText(1, " ");
@@ -39,6 +72,19 @@ widgetRotation::widgetRotation(QWidget *parent) : QTreeWidget(parent)
                      this, SLOT  (slotItemChanged(QTreeWidgetItem*,int)) );
 }
 
+/**
+ * @brief Add the memory used by the items of the tree to an estimation
+ *
+ * @param usage Reference to the estimation
+ */
+void widgetRotation::memoryUsage(MemoryUsage &usage)
+{
+    qint64 bytes = itemBytes(headerItem());
+    for (int i = 0; i < topLevelItemCount(); ++i)
+        bytes += itemBytes(topLevelItem(i));
+    usage.add(MemoryUsage::CategoryWidgets, bytes);
+}
+
 /**
  * @brief Initialize widget for a specific Exploitation
  *
@@ -52,35 +98,20 @@ bool widgetRotation::setup(Exploitation *exploitation)
     mExploitation = exploitation;
 
     QTreeWidgetItem *root = topLevelItem(0);
+    mFillNext = 0;
 
-    // Insert all Rotation(s) of the Exploitation
-    for (uint i = 0; i < mExploitation->countRotation(); ++i)
+    if ((mFillBatch > 0) && (mExploitation->countRotation() > 0))
     {
-        Rotation *rot = mExploitation->getRotation(i);
-        // Create a tree-item for this Rotation
-        QTreeWidgetItem *newItem = new QTreeWidgetItem();
-        newItem->setFlags( newItem->flags() |  Qt::ItemIsEditable);
-        newItem->setText(0, rot->getName());
-        newItem->setText(1, QString("%1 an(s)").arg(rot->getDuration()));
-        newItem->setData(0, Qt::UserRole, qVariantFromValue((void*)rot));
-        newItem->setData(1, Qt::UserRole, qVariantFromValue((void*)rot));
-
-        // Insert the activity plans of this Rotation
-        for (uint j = 0; j < rot->countPlans(); ++j)
-        {
-            ActivityPlan *plan = rot->getPlan(j);
-            QTreeWidgetItem *planItem = new QTreeWidgetItem();
-            planItem->setText(0, plan->getName());
-            planItem->setText(1, QString("année %1").arg(plan->getPosition()));
-            planItem->setFlags( planItem->flags() |  Qt::ItemIsEditable);
-            planItem->setData(0, Qt::UserRole + 1, qVariantFromValue((void *)plan));
-            planItem->setData(1, Qt::UserRole + 1, qVariantFromValue((void *)plan));
-
-            // Insert it as sub-tree of current Rotation item
-            newItem->addChild(planItem);
-        }
-        // Insert this Rotation as child of the root item
-        root->addChild(newItem);
+        // Rotations are inserted later by batches (see slotFillBatch)
+        emit setupProgress(0, mExploitation->countRotation());
+        mFillTimer->start();
+    }
+    else
+    {
+        // Insert all Rotation(s) of the Exploitation
+        fillItems(mExploitation->countRotation());
+        if (mFillBatch > 0)
+            emit setupFinished();
     }
     root->setExpanded(true);
     resizeColumnToContents(0);
@@ -88,6 +119,158 @@ bool widgetRotation::setup(Exploitation *exploitation)
     return true;
 }
 
+/**
+ * @brief Configure the progressive fill of the tree
+ *
+ * When a batch size is set, setup() returns immediately and the Rotations
+ * are inserted by batches from the event loop. The setupProgress and
+ * setupFinished signals follow this fill.
+ *
+ * @param rotations Number of Rotations inserted per batch (0 for synchronous)
+ */
+void widgetRotation::setFillBatch(int rotations)
+{
+    if (rotations < 0)
+        rotations = 0;
+    mFillBatch = rotations;
+}
+
+/**
+ * @brief Insert the next Rotations of the Exploitation into the tree
+ *
+ * @param count Maximum number of Rotations to insert
+ * @return integer Number of Rotations inserted
+ */
+int widgetRotation::fillItems(int count)
+{
+    QList<QTreeWidgetItem *> items;
+    while ((mFillNext < mExploitation->countRotation()) && (items.count() < count))
+    {
+        items.append( rotationItem(mExploitation->getRotation(mFillNext)) );
+        mFillNext++;
+    }
+    // Insert all new items at once (only one update of the view)
+    topLevelItem(0)->addChildren(items);
+
+    return items.count();
+}
+
+/**
+ * @brief Create a tree-item (with sub-items for plans) for a Rotation
+ *
+ * @param rot Pointer to the Rotation
+ * @return Pointer to the new tree-item
+ */
+QTreeWidgetItem *widgetRotation::rotationItem(Rotation *rot)
+{
+    // Create a tree-item for this Rotation
+    QTreeWidgetItem *newItem = new QTreeWidgetItem();
+    newItem->setFlags( newItem->flags() |  Qt::ItemIsEditable);
+    newItem->setText(0, rot->getName());
+    newItem->setText(1, QString("%1 an(s)").arg(rot->getDuration()));
+    // Save the Rotation identifier (plans are found by position)
+    newItem->setData(0, Qt::UserRole, rot->getId());
+
+    // Insert the activity plans of this Rotation
+    for (uint j = 0; j < rot->countPlans(); ++j)
+    {
+        ActivityPlan *plan = rot->getPlan(j);
+        QTreeWidgetItem *planItem = new QTreeWidgetItem();
+        planItem->setText(0, plan->getName());
+        planItem->setText(1, QString("année %1").arg(plan->getPosition()));
+        planItem->setFlags( planItem->flags() |  Qt::ItemIsEditable);
+
+        // Insert it as sub-tree of current Rotation item
+        newItem->addChild(planItem);
+    }
+    return newItem;
+}
+
+/**
+ * @brief Slot called from the event loop to insert a batch of Rotations
+ *
+ */
+void widgetRotation::slotFillBatch(void)
+{
+    TRACE_SPAN("widgetRotation::slotFillBatch");
+
+    fillItems(mFillBatch);
+
+    {
+        TRACE_SPAN("widgetRotation::setupProgress");
+        emit setupProgress(mFillNext, mExploitation->countRotation());
+    }
+
+    if (mFillNext >= mExploitation->countRotation())
+    {
+        mFillTimer->stop();
+        resizeColumnToContents(0);
+        TRACE_SPAN("widgetRotation::setupFinished");
+        emit setupFinished();
+    }
+}
+
+/**
+ * @brief Get the ActivityPlan shown at a model index
+ *
+ * @param index Model index of an item of the tree
+ * @return Pointer to the ActivityPlan (or NULL if the item is not a plan)
+ */
+ActivityPlan *widgetRotation::getPlan(const QModelIndex &index)
+{
+    return itemPlan( itemFromIndex(index) );
+}
+
+/**
+ * @brief Get the Rotation shown at a model index
+ *
+ * @param index Model index of an item of the tree
+ * @return Pointer to the Rotation (or NULL if the item is not a rotation)
+ */
+Rotation *widgetRotation::getRotation(const QModelIndex &index)
+{
+    return itemRotation( itemFromIndex(index) );
+}
+
+/**
+ * @brief Get the ActivityPlan associated with a tree item
+ *
+ * Plan items are children of Rotation items, in the same order than the
+ * plans into the Rotation.
+ *
+ * @param item Pointer to a tree item
+ * @return Pointer to the ActivityPlan (or NULL if the item is not a plan)
+ */
+ActivityPlan *widgetRotation::itemPlan(QTreeWidgetItem *item)
+{
+    if ((item == 0) || (item->parent() == 0))
+        return 0;
+
+    Rotation *rot = itemRotation(item->parent());
+    if (rot == 0)
+        return 0;
+
+    return rot->getPlan( item->parent()->indexOfChild(item) );
+}
+
+/**
+ * @brief Get the Rotation associated with a tree item
+ *
+ * @param item Pointer to a tree item
+ * @return Pointer to the Rotation (or NULL if the item is not a rotation)
+ */
+Rotation *widgetRotation::itemRotation(QTreeWidgetItem *item)
+{
+    if ((item == 0) || (mExploitation == 0))
+        return 0;
+
+    QVariant vRotation = item->data(0, Qt::UserRole);
+    if ( ! vRotation.isValid())
+        return 0;
+
+    return mExploitation->getRotationById( vRotation.toUInt() );
+}
+
 /**
  * @brief Slot called when an item has been modified
  *
@@ -96,14 +279,15 @@ bool widgetRotation::setup(Exploitation *exploitation)
  */
 void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
 {
-    QVariant vRotation = item->data(0, Qt::UserRole);
-    QVariant vPlan     = item->data(0, Qt::UserRole + 1);
-    if ( ( ! vRotation.isValid()) && ( ! vPlan.isValid()) )
+    TRACE_SPAN("widgetRotation::slotItemChanged");
+
+    Rotation     *rot  = itemRotation(item);
+    ActivityPlan *plan = itemPlan(item);
+    if ( (rot == 0) && (plan == 0) )
         return;
 
-    if (vRotation.isValid())
+    if (rot)
     {
-        Rotation *rot = (Rotation *)vRotation.value<void *>();
         // If the modifed column is the first, update Rotation name
         if (column == 0)
         {
@@ -112,6 +296,7 @@ void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
             // Update the rotation name
             rot->setName( item->text(0) );
             // Send a message to inform the world that the rotation has been renamed
+            TRACE_SPAN("widgetRotation::rotationRenamed");
             emit rotationRenamed(rot, oldName, newName);
         }
         // Is the modified column is the second, update Rotation duration
@@ -124,13 +309,13 @@ void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
             {
                 rot->setDuration(duration);
                 // Send a message to inform the world that the rotation have a new duration
+                TRACE_SPAN("widgetRotation::durationChanged");
                 emit durationChanged(rot, oldDuration, duration);
             }
         }
     }
-    else if (vPlan.isValid())
+    else if (plan)
     {
-        ActivityPlan *plan = (ActivityPlan *)vPlan.value<void *>();
         // If the modifed column is the first, update Plan name
         if (column == 0)
         {
@@ -139,6 +324,7 @@ void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
             // Update the ActivityPlan name
             plan->setName( item->text(0) );
             // Send a message to inform the world that the plan has been renamed
+            TRACE_SPAN("widgetRotation::planRenamed");
             emit planRenamed(plan, oldName, newName);
         }
         // Is the modified column is the second, update Rotation duration
@@ -152,6 +338,7 @@ void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
                 // Update the position of the plan
                 plan->setPosition(position);
                 // Send a message to inform the world that the plan has a new position
+                TRACE_SPAN("widgetRotation::positionChanged");
                 emit positionChanged(plan, old, position);
             }
         }
@@ -166,9 +353,7 @@ void widgetRotation::slotItemChanged(QTreeWidgetItem *item, int column)
  */
 void widgetRotation::slotItemEdit(QTreeWidgetItem *item, int column)
 {
-    QVariant vRotation = item->data(0, Qt::UserRole);
-    QVariant vPlan     = item->data(0, Qt::UserRole + 1);
-    if ( ( ! vRotation.isValid()) && ( ! vPlan.isValid()) )
+    if ( (itemRotation(item) == 0) && (itemPlan(item) == 0) )
         return;
 
     editItem(item, column);
@@ -190,13 +375,9 @@ void widgetRotation::slotMenu(const QPoint &pos)
     QTreeWidgetItem *item = itemAt(pos);
     if (item)
     {
-        QVariant vRotation = item->data(0, Qt::UserRole);
-        QVariant vPlan     = item->data(0, Qt::UserRole + 1);
-        if (vRotation.isValid())
-            rot = (Rotation *)vRotation.value<void *>();
-        else if (vPlan.isValid())
-            plan = (ActivityPlan *)vPlan.value<void *>();
-        else
+        rot  = itemRotation(item);
+        plan = itemPlan(item);
+        if ( (rot == 0) && (plan == 0) )
             item = 0;
     }
 
@@ -219,19 +400,28 @@ void widgetRotation::slotMenu(const QPoint &pos)
 
     QAction *selectedAction = ctxMenu.exec(QCursor::pos());
 
+    // Trace only the processing of the selected action, not the menu itself
+    TRACE_SPAN("widgetRotation::slotMenu");
+
     // If the menu "Add Rotation" is selected
     if (selectedAction == actAddRotation)
     {
+        // Insert pending Rotations first, the new one goes at the end
+        if (mFillTimer->isActive())
+            fillItems(mExploitation->countRotation());
+
         Rotation *newRot = mExploitation->createRotation(tr("NewRotation"), 0);
         // Send a message to inform the world that a new rotation has been added
-        emit rotationAdded(newRot);
+        {
+            TRACE_SPAN("widgetRotation::rotationAdded");
+            emit rotationAdded(newRot);
+        }
         // Create a tree-item for this Rotation
         QTreeWidgetItem *newItem = new QTreeWidgetItem();
         newItem->setFlags( newItem->flags() |  Qt::ItemIsEditable);
         newItem->setText(0, newRot->getName());
         newItem->setText(1, QString("%1 an(s)").arg(newRot->getDuration()));
-        newItem->setData(0, Qt::UserRole, qVariantFromValue((void*)newRot));
-        newItem->setData(1, Qt::UserRole, qVariantFromValue((void*)newRot));
+        newItem->setData(0, Qt::UserRole, newRot->getId());
         // Insert this Rotation as child of the root item
         topLevelItem(0)->addChild(newItem);
     }
@@ -246,10 +436,14 @@ void widgetRotation::slotMenu(const QPoint &pos)
         {
             // Remove the selected item from the tree
             topLevelItem(0)->removeChild(item);
+            // Items already inserted are one less (progressive fill)
+            if (mFillNext > 0)
+                mFillNext--;
             // Delete it (not freed when removed from tree)
             delete item;
             item = 0; // Set to NULL to avoid using this pointer after (debug)
             // Send a message to inform the world that a rotation has been deleted
+            TRACE_SPAN("widgetRotation::rotationDeleted");
             emit rotationDeleted(rotName, rotDuration);
         }
     }
@@ -269,15 +463,16 @@ void widgetRotation::slotMenu(const QPoint &pos)
         ActivityPlan *newPlan = rot->addPlan(0, tr("NewActivityPlan"));
 
         // Send a message to inform the world that a new plan has been added
-        emit planAdded(newPlan);
+        {
+            TRACE_SPAN("widgetRotation::planAdded");
+            emit planAdded(newPlan);
+        }
 
         // Create a new tree item
         QTreeWidgetItem *newItem = new QTreeWidgetItem();
         newItem->setText(0, newPlan->getName());
         newItem->setText(1, QString("année %1").arg(newPlan->getPosition()));
         newItem->setFlags( newItem->flags() |  Qt::ItemIsEditable);
-        newItem->setData(0, Qt::UserRole + 1, qVariantFromValue((void *)newPlan));
-        newItem->setData(1, Qt::UserRole + 1, qVariantFromValue((void *)newPlan));
         // Insert it as child of the selected Rotation
         rotationItem->addChild(newItem);
     }
@@ -298,6 +493,7 @@ void widgetRotation::slotMenu(const QPoint &pos)
             delete item;
             item = 0; // Set to NULL to avoid using this pointer after (debug)
             // Send a message to inform the world that a plan has been deleted
+            TRACE_SPAN("widgetRotation::planDeleted");
             emit planDeleted(rot, planName, planPosition);
         }
     }
@@ -305,9 +501,9 @@ void widgetRotation::slotMenu(const QPoint &pos)
 
 // -------------------- Delegate --------------------
 
-widgetRotationDelegate::widgetRotationDelegate(QObject *parent) : QStyledItemDelegate(parent)
+widgetRotationDelegate::widgetRotationDelegate(widgetRotation *parent) : QStyledItemDelegate(parent)
 {
-    // Nothing to do
+    mView = parent;
 }
 
 QWidget *widgetRotationDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
@@ -316,11 +512,9 @@ QWidget *widgetRotationDelegate::createEditor(QWidget *parent, const QStyleOptio
     (void)index;
     QLineEdit* editor = new QLineEdit(parent);
 
-    QVariant vRotation = index.model()->data(index, Qt::UserRole);
-    QVariant vPlan     = index.model()->data(index, Qt::UserRole + 1);
-    if (vRotation.isValid())
+    if (mView->getRotation(index))
         editor->setProperty("mode", QVariant((int)1) );
-    else if (vPlan.isValid())
+    else if (mView->getPlan(index))
         editor->setProperty("mode", QVariant((int)2) );
     else
         editor->setProperty("mode", QVariant((int)0) );
@@ -344,10 +538,9 @@ void widgetRotationDelegate::setEditorData(QWidget *editor, const QModelIndex &i
 
     if (mode == 1)
     {
-        QVariant vRotation = index.model()->data(index, Qt::UserRole);
-        if ( ! vRotation.isValid())
+        Rotation *rot = mView->getRotation(index);
+        if (rot == 0)
             return; // ToDo : notify this very bad error ?
-        Rotation *rot = (Rotation *)vRotation.value<void *>();
 
         if (index.column() == 0)
             line->setText( rot->getName() );
@@ -356,10 +549,9 @@ void widgetRotationDelegate::setEditorData(QWidget *editor, const QModelIndex &i
     }
     else if (mode == 2)
     {
-        QVariant vPlan = index.model()->data(index, Qt::UserRole + 1);
-        if ( ! vPlan.isValid())
+        ActivityPlan *plan = mView->getPlan(index);
+        if (plan == 0)
             return; // ToDo : notify this very bad error ?
-        ActivityPlan *plan = (ActivityPlan *)vPlan.value<void *>();
 
         if (index.column() == 0)
             line->setText( plan->getName() );
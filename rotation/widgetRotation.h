@@ -9,6 +9,7 @@
 #define WIDGETROTATION_H
 
 #include <QPoint>
+#include <QTimer>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
 #include "data-model/exploitation.h"
@@ -18,7 +19,11 @@ class widgetRotation : public QTreeWidget
     Q_OBJECT
 public:
     explicit widgetRotation(QWidget *parent = 0);
+    void     memoryUsage(MemoryUsage &usage);
     bool     setup(Exploitation *exploitation);
+    void     setFillBatch(int rotations);
+    ActivityPlan *getPlan    (const QModelIndex &index);
+    Rotation     *getRotation(const QModelIndex &index);
 
 signals:
     void durationChanged(Rotation *rot, ulong oldDuration, ulong newDuration);
@@ -29,14 +34,26 @@ signals:
     void rotationAdded  (Rotation *rot);
     void rotationDeleted(const QString &name, ulong duration);
     void rotationRenamed(Rotation *rot, const QString &oldName, const QString &newName);
+    void setupProgress  (int done, int total);
+    void setupFinished  (void);
 
 private slots:
+    void slotFillBatch(void);
     void slotItemChanged(QTreeWidgetItem *item, int column);
     void slotItemEdit(QTreeWidgetItem *item, int column);
     void slotMenu(const QPoint &pos);
 
+private:
+    int              fillItems   (int count);
+    ActivityPlan    *itemPlan    (QTreeWidgetItem *item);
+    Rotation        *itemRotation(QTreeWidgetItem *item);
+    QTreeWidgetItem *rotationItem(Rotation *rot);
 private:
     Exploitation *mExploitation;
+    // Progressive fill of the tree (see setFillBatch)
+    QTimer       *mFillTimer;
+    int           mFillBatch;
+    uint          mFillNext;
 };
 
 #include <QStyledItemDelegate>
@@ -46,10 +63,12 @@ class widgetRotationDelegate : public QStyledItemDelegate
 Q_OBJECT
 
 public:
-    widgetRotationDelegate(QObject* parent = 0);
+    widgetRotationDelegate(widgetRotation* parent);
     QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const;
     void setEditorData(QWidget *editor, const QModelIndex &index) const;
     void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
+private:
+    widgetRotation *mView;
 };
 
 #endif // WIDGETROTATION_H
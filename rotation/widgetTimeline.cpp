@@ -0,0 +1,558 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#include <QHelpEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QToolTip>
+#include "data-model/trace.h"
+#include "widgetTimeline.h"
+
+// Size of one year (horizontally) and one Rotation (vertically), in pixels
+#define YEAR_WIDTH    24
+#define ROW_HEIGHT    20
+// Size of the fixed areas : years header at top, rotation names at left
+#define HEADER_HEIGHT 20
+#define NAME_WIDTH   140
+// Size of a cached tile, in years and rotations
+#define TILE_YEARS    16
+#define TILE_ROWS     32
+// Memory allowed to the tiles cache, in KB (each tile is about 1 MB)
+#define TILES_CACHE_KB (48 * 1024)
+
+/**
+ * @brief Default constructor for the Timeline widget
+ *
+ * @param parent
+ */
+widgetTimeline::widgetTimeline(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    mExploitation = 0;
+    mHorizon      = 50;
+    mRowsValid    = false;
+    mTiles.setMaxCost(TILES_CACHE_KB);
+
+    horizontalScrollBar()->setSingleStep(YEAR_WIDTH);
+    verticalScrollBar()  ->setSingleStep(ROW_HEIGHT);
+}
+
+/**
+ * @brief Add the memory used by the rows and the tiles to an estimation
+ *
+ * @param usage Reference to the estimation
+ */
+void widgetTimeline::memoryUsage(MemoryUsage &usage)
+{
+    // Cost of the tiles is in KB
+    qint64 bytes = qint64(mTiles.totalCost()) * 1024;
+    bytes += MemoryUsage::hashBytes(mRows.count(), sizeof(Rotation *) + sizeof(int));
+    usage.add(MemoryUsage::CategoryWidgets, bytes);
+}
+
+/**
+ * @brief Initialize widget for a specific Exploitation
+ *
+ * @param exploitation Pointer to the Exploitation
+ * @return boolean True if init success
+ */
+bool widgetTimeline::setup(Exploitation *exploitation)
+{
+    if (exploitation == 0)
+        return false;
+    mExploitation = exploitation;
+
+    invalidateAll();
+    updateScrollBars();
+    viewport()->update();
+
+    return true;
+}
+
+/**
+ * @brief Get the number of years shown by the timeline
+ *
+ * @return integer Number of years
+ */
+int widgetTimeline::getHorizon(void)
+{
+    return mHorizon;
+}
+
+/**
+ * @brief Set the number of years shown by the timeline
+ *
+ * @param years Number of years (at least one)
+ */
+void widgetTimeline::setHorizon(int years)
+{
+    if (years < 1)
+        years = 1;
+    if (years == mHorizon)
+        return;
+    mHorizon = years;
+
+    // Tiles of the last year block may be truncated, render all again
+    mTiles.clear();
+    updateScrollBars();
+    viewport()->update();
+}
+
+/**
+ * @brief Get the color used to draw an ActivityPlan
+ *
+ * The color only depends on the name of the plan, so the same crop has the
+ * same color into all the Rotations.
+ *
+ * @param name Name of the plan
+ * @return Color of the plan bars
+ */
+QColor widgetTimeline::planColor(const QString &name)
+{
+    uint h = qHash(name);
+    return QColor::fromHsv(h % 360, 90 + (h >> 9) % 80, 210 + (h >> 16) % 40);
+}
+
+// -------------------- Tiles --------------------
+
+/**
+ * @brief Forget all the rendered tiles and the rows of the Rotations
+ *
+ */
+void widgetTimeline::invalidateAll(void)
+{
+    mTiles.clear();
+    mRows.clear();
+    mRowsValid = false;
+}
+
+/**
+ * @brief Forget the rendered tiles that contain a Rotation, and repaint it
+ *
+ * @param rot Pointer to the modified Rotation
+ */
+void widgetTimeline::invalidateRotation(Rotation *rot)
+{
+    int row = rotationRow(rot);
+    if (row < 0)
+        return;
+
+    quint64 rowBlock = (row / TILE_ROWS);
+    int yearBlocks = (mHorizon + TILE_YEARS - 1) / TILE_YEARS;
+    for (int i = 0; i < yearBlocks; i++)
+        mTiles.remove((rowBlock << 32) | i);
+
+    // Repaint only the row of this Rotation (if visible)
+    int y = HEADER_HEIGHT + (row * ROW_HEIGHT) - verticalScrollBar()->value();
+    viewport()->update(0, y, viewport()->width(), ROW_HEIGHT);
+}
+
+/**
+ * @brief Get the row of a Rotation into the timeline
+ *
+ * @param rot Pointer to the Rotation
+ * @return integer Row of the Rotation (or -1 if not found)
+ */
+int widgetTimeline::rotationRow(Rotation *rot)
+{
+    if (mExploitation == 0)
+        return -1;
+
+    if ( ! mRowsValid)
+    {
+        mRows.clear();
+        mRows.reserve(mExploitation->countRotation());
+        for (uint i = 0; i < mExploitation->countRotation(); i++)
+            mRows.insert(mExploitation->getRotation(i), i);
+        mRowsValid = true;
+    }
+    return mRows.value(rot, -1);
+}
+
+/**
+ * @brief Get a tile of the chart, render it if not already cached
+ *
+ * @param rowBlock  Index of the block of rotations
+ * @param yearBlock Index of the block of years
+ * @return Pointer to the tile pixmap (owned by the cache)
+ */
+QPixmap *widgetTimeline::tile(int rowBlock, int yearBlock)
+{
+    quint64 key = ((quint64)rowBlock << 32) | (quint32)yearBlock;
+
+    QPixmap *pixmap = mTiles.object(key);
+    if (pixmap)
+        return pixmap;
+
+    pixmap = new QPixmap(TILE_YEARS * YEAR_WIDTH, TILE_ROWS * ROW_HEIGHT);
+    renderTile(pixmap, rowBlock, yearBlock);
+    mTiles.insert(key, pixmap, (pixmap->width() * pixmap->height() * 4) / 1024);
+
+    return pixmap;
+}
+
+/**
+ * @brief Draw the plans of a block of rotations over a block of years
+ *
+ * @param pixmap    Pointer to the tile to draw
+ * @param rowBlock  Index of the block of rotations
+ * @param yearBlock Index of the block of years
+ */
+void widgetTimeline::renderTile(QPixmap *pixmap, int rowBlock, int yearBlock)
+{
+    TRACE_SPAN("widgetTimeline::renderTile");
+
+    pixmap->fill(Qt::white);
+    QPainter painter(pixmap);
+
+    // Years are numbered from 1, the first column shows the first year
+    ulong firstYear = (yearBlock * TILE_YEARS) + 1;
+    ulong lastYear  = qMin(firstYear + TILE_YEARS - 1, (ulong)mHorizon);
+    int   firstRow  = rowBlock * TILE_ROWS;
+    int   lastRow   = qMin(firstRow + TILE_ROWS, (int)mExploitation->countRotation()) - 1;
+
+    QHash<ulong, int> lanes;
+    QVector<ulong>    cycle;
+    QVector<int>      lane;
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+        int top = (row - firstRow) * ROW_HEIGHT;
+        if (row & 1)
+            painter.fillRect(0, top, pixmap->width(), ROW_HEIGHT, QColor(246, 246, 246));
+        // Grid : a light line every 5 years
+        painter.setPen(QColor(220, 220, 220));
+        for (ulong year = firstYear; year <= lastYear; year++)
+        {
+            if ((year % 5) == 0)
+            {
+                int x = ((year - firstYear + 1) * YEAR_WIDTH) - 1;
+                painter.drawLine(x, top, x, top + ROW_HEIGHT - 1);
+            }
+        }
+
+        Rotation *rot = mExploitation->getRotation(row);
+        ulong duration = rot->getDuration();
+        uint  count    = rot->countPlans();
+
+        // Plans at the same year of the cycle share the height of the row
+        lanes.clear();
+        cycle.resize(count);
+        lane.resize(count);
+        for (uint i = 0; i < count; i++)
+        {
+            ulong position = rot->getPlan(i)->getPosition();
+            cycle[i] = duration ? (position % duration) : position;
+            lane[i]  = lanes[cycle[i]]++;
+        }
+
+        for (uint i = 0; i < count; i++)
+        {
+            ActivityPlan *plan = rot->getPlan(i);
+            ulong position = plan->getPosition();
+            ulong year, step;
+            if (duration == 0)
+            {
+                // Without duration, the plan is not repeated
+                if ((position < firstYear) || (position > lastYear))
+                    continue;
+                year = position;
+                step = TILE_YEARS;
+            }
+            else
+            {
+                // First year of the tile at the same point of the cycle
+                year = firstYear + (cycle[i] + duration - (firstYear % duration)) % duration;
+                step = duration;
+            }
+
+            int   height = qMax((ROW_HEIGHT - 4) / lanes.value(cycle[i]), 1);
+            int   y      = top + 2 + (lane[i] * height);
+            QColor color = planColor(plan->getName());
+            for ( ; year <= lastYear; year += step)
+                painter.fillRect((year - firstYear) * YEAR_WIDTH + 1, y, YEAR_WIDTH - 2, height, color);
+        }
+    }
+}
+
+// -------------------- Events --------------------
+
+/**
+ * @brief Draw the visible part of the timeline
+ *
+ * @param event Paint event, with the area to repaint
+ */
+void widgetTimeline::paintEvent(QPaintEvent *event)
+{
+    TRACE_SPAN("widgetTimeline::paintEvent");
+
+    QPainter painter(viewport());
+    QRect area = event->rect();
+    painter.fillRect(area, Qt::white);
+    if (mExploitation == 0)
+        return;
+
+    int x0    = horizontalScrollBar()->value();
+    int y0    = verticalScrollBar()->value();
+    int rows  = mExploitation->countRotation();
+    int width = viewport()->width();
+
+    // Visible years and rows (only them are drawn)
+    int firstYear = qMax(area.left() - NAME_WIDTH, 0) + x0;
+    int lastYear  = area.right() - NAME_WIDTH + x0;
+    int firstRow  = qMax(area.top() - HEADER_HEIGHT, 0) + y0;
+    int lastRow   = area.bottom() - HEADER_HEIGHT + y0;
+    firstYear /= YEAR_WIDTH;
+    lastYear   = qMin(lastYear / YEAR_WIDTH, mHorizon - 1);
+    firstRow  /= ROW_HEIGHT;
+    lastRow    = qMin(lastRow / ROW_HEIGHT, rows - 1);
+
+    // Chart : copy the visible tiles
+    if ((firstYear <= lastYear) && (firstRow <= lastRow))
+    {
+        painter.save();
+        painter.setClipRect(QRect(NAME_WIDTH, HEADER_HEIGHT,
+                                  width - NAME_WIDTH, viewport()->height() - HEADER_HEIGHT));
+        for (int rb = firstRow / TILE_ROWS; rb <= lastRow / TILE_ROWS; rb++)
+        {
+            for (int yb = firstYear / TILE_YEARS; yb <= lastYear / TILE_YEARS; yb++)
+            {
+                int x = NAME_WIDTH    + (yb * TILE_YEARS * YEAR_WIDTH) - x0;
+                int y = HEADER_HEIGHT + (rb * TILE_ROWS  * ROW_HEIGHT) - y0;
+                painter.drawPixmap(x, y, *tile(rb, yb));
+            }
+        }
+        painter.restore();
+    }
+
+    // Header : number of the visible years
+    painter.fillRect(0, 0, width, HEADER_HEIGHT, QColor(232, 232, 232));
+    painter.setPen(Qt::black);
+    for (int i = qMax(firstYear, 0); i <= lastYear; i++)
+    {
+        int x = NAME_WIDTH + (i * YEAR_WIDTH) - x0;
+        if (x < NAME_WIDTH)
+            continue;
+        painter.drawText(QRect(x, 0, YEAR_WIDTH, HEADER_HEIGHT), Qt::AlignCenter, QString::number(i + 1));
+    }
+
+    // Names of the visible rotations
+    painter.fillRect(0, HEADER_HEIGHT, NAME_WIDTH, viewport()->height(), QColor(240, 240, 240));
+    painter.setClipRect(QRect(0, HEADER_HEIGHT, NAME_WIDTH, viewport()->height() - HEADER_HEIGHT));
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+        int y = HEADER_HEIGHT + (row * ROW_HEIGHT) - y0;
+        painter.drawText(QRect(4, y, NAME_WIDTH - 8, ROW_HEIGHT), Qt::AlignLeft | Qt::AlignVCenter,
+                         mExploitation->getRotation(row)->getName());
+    }
+}
+
+/**
+ * @brief Called when the widget is resized, update the scroll ranges
+ *
+ * @param event Resize event
+ */
+void widgetTimeline::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+/**
+ * @brief Called when the view is scrolled
+ *
+ * Tiles are already rendered, so the visible area is simply painted again.
+ *
+ * @param dx Horizontal move (unused)
+ * @param dy Vertical move (unused)
+ */
+void widgetTimeline::scrollContentsBy(int dx, int dy)
+{
+    (void)dx;
+    (void)dy;
+    viewport()->update();
+}
+
+/**
+ * @brief Handle the tooltip events of the viewport (plans under the mouse)
+ *
+ * @param event Event received by the viewport
+ * @return boolean True if the event has been handled
+ */
+bool widgetTimeline::viewportEvent(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip)
+    {
+        QHelpEvent *help = static_cast<QHelpEvent *>(event);
+        QString text = toolTipText(help->pos());
+        if (text.isEmpty())
+            QToolTip::hideText();
+        else
+            QToolTip::showText(help->globalPos(), text, viewport());
+        return true;
+    }
+    return QAbstractScrollArea::viewportEvent(event);
+}
+
+/**
+ * @brief Get the description of the plans at a position of the viewport
+ *
+ * @param pos Position into the viewport
+ * @return Text for the tooltip (empty if no Rotation here)
+ */
+QString widgetTimeline::toolTipText(const QPoint &pos)
+{
+    if ((mExploitation == 0) || (pos.x() < NAME_WIDTH) || (pos.y() < HEADER_HEIGHT))
+        return QString();
+
+    int row = (pos.y() - HEADER_HEIGHT + verticalScrollBar()->value()) / ROW_HEIGHT;
+    int col = (pos.x() - NAME_WIDTH  + horizontalScrollBar()->value()) / YEAR_WIDTH;
+    if ((row >= (int)mExploitation->countRotation()) || (col >= mHorizon))
+        return QString();
+
+    Rotation *rot = mExploitation->getRotation(row);
+    ulong year    = col + 1;
+
+    QString text = tr("%1 - année %2").arg(rot->getName()).arg(year);
+    for (uint i = 0; i < rot->countPlans(); i++)
+    {
+        ActivityPlan *plan = rot->getPlan(i);
+        if (plan->isActive(year))
+            text += "\n" + plan->getName();
+    }
+    return text;
+}
+
+/**
+ * @brief Update the range of the scroll bars for the current content
+ *
+ */
+void widgetTimeline::updateScrollBars(void)
+{
+    int rows = mExploitation ? (int)mExploitation->countRotation() : 0;
+    int w = viewport()->width()  - NAME_WIDTH;
+    int h = viewport()->height() - HEADER_HEIGHT;
+
+    horizontalScrollBar()->setPageStep(w);
+    horizontalScrollBar()->setRange(0, qMax((mHorizon * YEAR_WIDTH) - w, 0));
+    verticalScrollBar()->setPageStep(h);
+    verticalScrollBar()->setRange(0, qMax((rows * ROW_HEIGHT) - h, 0));
+}
+
+// -------------------- Slots --------------------
+
+/**
+ * @brief Slot called when the duration of a Rotation is modified
+ *
+ * @param rot Pointer to the modified rotation
+ * @param oldDuration Previous duration of the rotation
+ * @param newDuration New duration of the rotation
+ */
+void widgetTimeline::slotDurationChanged(Rotation *rot, ulong oldDuration, ulong newDuration)
+{
+    (void)oldDuration;
+    (void)newDuration;
+    invalidateRotation(rot);
+}
+
+/**
+ * @brief Slot called when a new plan has been added to a rotation
+ *
+ * @param plan Pointer to the newly created ActivityPlan
+ */
+void widgetTimeline::slotPlanAdded(ActivityPlan *plan)
+{
+    invalidateRotation(plan->parent());
+}
+
+/**
+ * @brief Slot called when a plan has been deleted
+ *
+ * @param rot  Pointer to the rotation that owned the plan
+ * @param name Name of the removed plan
+ * @param position Last known position of the deleted plan
+ */
+void widgetTimeline::slotPlanDeleted(Rotation *rot, const QString &name, ulong position)
+{
+    (void)name;
+    (void)position;
+    invalidateRotation(rot);
+}
+
+/**
+ * @brief Slot called when a plan has been renamed (its color changes)
+ *
+ * @param plan    Pointer to the modified plan
+ * @param oldName Old name of the plan
+ * @param newName New name of the plan
+ */
+void widgetTimeline::slotPlanRenamed(ActivityPlan *plan, const QString &oldName, const QString &newName)
+{
+    (void)oldName;
+    (void)newName;
+    invalidateRotation(plan->parent());
+}
+
+/**
+ * @brief Slot called when the position of a plan is modified
+ *
+ * @param plan Pointer to the modified plan
+ * @param oldPosition Old position of the plan
+ * @param newPosition New position of the plan
+ */
+void widgetTimeline::slotPositionChanged(ActivityPlan *plan, ulong oldPosition, ulong newPosition)
+{
+    (void)oldPosition;
+    (void)newPosition;
+    invalidateRotation(plan->parent());
+}
+
+/**
+ * @brief Slot called when a new rotation is created into Exploitation
+ *
+ * New rotations are appended, only the tiles of the last row block change.
+ *
+ * @param rot Pointer to the newly created rotation
+ */
+void widgetTimeline::slotRotationAdded(Rotation *rot)
+{
+    if (mRowsValid)
+        mRows.insert(rot, mExploitation->countRotation() - 1);
+    invalidateRotation(rot);
+    updateScrollBars();
+}
+
+/**
+ * @brief Slot called when a rotation has been deleted
+ *
+ * The following rotations move up by one row, so all tiles are rendered again.
+ *
+ * @param name     Name of the deleted rotation
+ * @param duration Last known duration of the deleted rotation
+ */
+void widgetTimeline::slotRotationDeleted(const QString &name, ulong duration)
+{
+    (void)name;
+    (void)duration;
+    invalidateAll();
+    updateScrollBars();
+    viewport()->update();
+}
+
+/**
+ * @brief Slot called when a rotation is renamed (names are not cached)
+ *
+ * @param rot     Pointer to the modified rotation
+ * @param oldName Old name of the rotation
+ * @param newName New name of the rotation
+ */
+void widgetTimeline::slotRotationRenamed(Rotation *rot, const QString &oldName, const QString &newName)
+{
+    (void)rot;
+    (void)oldName;
+    (void)newName;
+    viewport()->update(0, HEADER_HEIGHT, NAME_WIDTH, viewport()->height());
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of VLE, a framework for multi-modeling,
+ * simulation and analysis of complex dynamical systems.
+ * http://www.vle-project.org
+ *
+ * Copyright (c) 2016 Agilack
+ */
+#ifndef WIDGETTIMELINE_H
+#define WIDGETTIMELINE_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QColor>
+#include <QHash>
+#include <QPixmap>
+#include "data-model/exploitation.h"
+
+/*
+ * The timeline shows the Rotations of an Exploitation over a horizon of
+ * years, one Rotation per row. Each ActivityPlan is drawn as a bar at its
+ * position, repeated every "duration" years of its Rotation.
+ *
+ * The chart is rendered by tiles (a block of rows over a block of years)
+ * kept into a cache, so a repaint only copies the visible tiles. When a
+ * Rotation is modified, only the tiles of its row block are rendered again.
+ */
+class widgetTimeline : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    explicit widgetTimeline(QWidget *parent = 0);
+    int      getHorizon(void);
+    void     setHorizon(int years);
+    void     memoryUsage(MemoryUsage &usage);
+    bool     setup(Exploitation *exploitation);
+    static QColor planColor(const QString &name);
+
+public slots:
+    void slotDurationChanged(Rotation *rot, ulong oldDuration, ulong newDuration);
+    void slotPlanAdded      (ActivityPlan *plan);
+    void slotPlanDeleted    (Rotation *rot, const QString &name, ulong position);
+    void slotPlanRenamed    (ActivityPlan *plan, const QString &oldName, const QString &newName);
+    void slotPositionChanged(ActivityPlan *plan, ulong oldPosition, ulong newPosition);
+    void slotRotationAdded  (Rotation *rot);
+    void slotRotationDeleted(const QString &name, ulong duration);
+    void slotRotationRenamed(Rotation *rot, const QString &oldName, const QString &newName);
+
+protected:
+    void paintEvent (QPaintEvent  *event);
+    void resizeEvent(QResizeEvent *event);
+    void scrollContentsBy(int dx, int dy);
+    bool viewportEvent(QEvent *event);
+
+private:
+    void     invalidateAll     (void);
+    void     invalidateRotation(Rotation *rot);
+    void     renderTile (QPixmap *pixmap, int rowBlock, int yearBlock);
+    int      rotationRow(Rotation *rot);
+    QPixmap *tile       (int rowBlock, int yearBlock);
+    QString  toolTipText(const QPoint &pos);
+    void     updateScrollBars(void);
+private:
+    Exploitation *mExploitation;
+    int           mHorizon;
+    // Rendered tiles, by row block (high 32 bits) and year block (low bits)
+    QCache<quint64, QPixmap> mTiles;
+    // Row of each Rotation (rebuilt when a Rotation is removed)
+    QHash<Rotation *, int>   mRows;
+    bool          mRowsValid;
+};
+
+#endif // WIDGETTIMELINE_H